@@ -9,7 +9,10 @@
 #include <ossim/base/ossimApplicationUsage.h>
 #include <ossim/base/ossimArgumentParser.h>
 #include <ossim/init/ossimInit.h>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace std;
 using namespace ossimMsp;
@@ -27,16 +30,41 @@ int main(int argc, char** argv)
       // Initialize ossim stuff, factories, plugin, etc.
       ossimInit::instance()->initialize(ap);
 
+      // Image filenames may come from a list file (one per line) and/or the command line:
+      vector<string> filenames;
+      string listFile;
+      ossimArgumentParser::ossimParameter listParam (listFile);
+      if (ap.read("-l", listParam))
+      {
+         ifstream s (listFile.c_str());
+         if (s.fail())
+         {
+            cerr<<"Could not open list file <"<<listFile<<">."<<endl;
+            return 1;
+         }
+         string line;
+         while (getline(s, line))
+         {
+            if (!line.empty() && (line[0] != '#'))
+               filenames.push_back(line);
+         }
+      }
+      for (int i=1; i<ap.argc(); ++i)
+         filenames.push_back(ap.argv()[i]);
+
       // Must have a filename:
-      if (ap.argc() < 2)
+      if (filenames.empty())
       {
-         cout<<"\nUsage: "<<argv[0]<<" <image_filename>\n"<<endl;
+         cout<<"\nUsage: "<<argv[0]<<" [-l <list_file>] <image_filename> [<image_filename>...]\n"
+             <<"\nThe list file contains one image filename per line.\n"<<endl;
          return 0;
       }
 
-      string filename = argv[1];
       SensorModelService sms;
-      sms.execute(filename);
+      if (filenames.size() == 1)
+         sms.execute(filenames[0]);
+      else
+         sms.execute(filenames);
    }
    catch(ossimException &e)
    {
@@ -0,0 +1,203 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "AvailableModelsCache.h"
+#include "SensorModelServicePool.h"
+#include "ModelStateCache.h"
+#include <ossim/base/ossimPreferences.h>
+#include <ossim/base/ossimNotify.h>
+#include <SensorModel/SensorModelService.h>
+#include <MSPVersionUtils/MSPVersionInformation.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+// Fields are tab-delimited, one entry per line:
+static const char FIELD_SEP = '\t';
+
+static bool isStorable(const std::string& field)
+{
+   return field.find_first_of("\t\r\n") == string::npos;
+}
+
+AvailableModelsCache* AvailableModelsCache::instance()
+{
+   static AvailableModelsCache s_instance;
+   return &s_instance;
+}
+
+AvailableModelsCache::AvailableModelsCache()
+:  m_loaded (false),
+   m_staleLines (0)
+{
+   const char* value = ossimPreferences::instance()->findPreference(
+         "msp.available_models_cache.dir");
+   if (value && *value)
+   {
+      ossimFilename dir = ossimFilename(value).expand();
+      if (dir.isDir() || dir.createDirectory(true))
+         m_indexFile = dir.dirCat("available-models.idx");
+      else
+      {
+         ossimNotify(ossimNotifyLevel_WARN)<<"AvailableModelsCache -- Cannot create cache "
+               "directory <"<<dir<<">. Available models will not be persisted."<<endl;
+      }
+   }
+}
+
+std::string AvailableModelsCache::pluginSignature()
+{
+   // The plugin names and their versions both affect which models an image supports:
+   ostringstream s;
+   shared_ptr<MSP::SMS::SensorModelService> sms = SensorModelServicePool::instance()->checkout();
+   MSP::SMS::NameList plugins;
+   sms->getAllRegisteredPlugins(plugins);
+   for (MSP::SMS::NameList::iterator i=plugins.begin(); i!=plugins.end(); ++i)
+      s<<*i<<';';
+   s<<MSP::MSPVersionInformation::getMSPPluginsVersionsString();
+
+   // The signature is written to disk, so the hash must be stable across builds:
+   ostringstream signature;
+   signature<<hex<<ModelStateCache::hashState(s.str());
+   return signature.str();
+}
+
+std::string AvailableModelsCache::makeKey(const FileIdentity& fileId,
+                                          unsigned int entryIndex) const
+{
+   ostringstream key;
+   key<<fileId.path<<'\n'<<entryIndex;
+   return key.str();
+}
+
+std::string AvailableModelsCache::formatLine(const Entry& entry, unsigned int entryIndex) const
+{
+   ostringstream line;
+   line<<m_signature<<FIELD_SEP<<entry.fileId.path<<FIELD_SEP<<entry.fileId.size<<FIELD_SEP
+       <<entry.fileId.mtime<<FIELD_SEP<<entryIndex;
+   for (size_t i=0; i<entry.models.size(); ++i)
+      line<<FIELD_SEP<<entry.models[i].first<<FIELD_SEP<<entry.models[i].second;
+   line<<'\n';
+   return line.str();
+}
+
+void AvailableModelsCache::load()
+{
+   if (m_loaded)
+      return;
+   m_loaded = true;
+   m_signature = pluginSignature();
+   if (m_indexFile.empty())
+      return;
+
+   ifstream s (m_indexFile.c_str());
+   string line;
+   while (getline(s, line))
+   {
+      vector<string> fields;
+      istringstream ls (line);
+      string field;
+      while (getline(ls, field, FIELD_SEP))
+         fields.push_back(field);
+
+      // Expect header fields followed by plugin/model pairs:
+      if ((fields.size() < 5) || (fields.size() % 2 == 0) || (fields[0] != m_signature))
+      {
+         ++m_staleLines;
+         continue;
+      }
+
+      Entry entry;
+      entry.fileId.path = fields[1];
+      entry.fileId.size = ossimString(fields[2]).toInt64();
+      entry.fileId.mtime = ossimString(fields[3]).toInt64();
+      unsigned int entryIndex = ossimString(fields[4]).toUInt32();
+      for (size_t i=5; i<fields.size(); i+=2)
+         entry.models.push_back(pair<string, string>(fields[i], fields[i+1]));
+
+      // Later lines supersede earlier ones:
+      string key = makeKey(entry.fileId, entryIndex);
+      if (m_entries.count(key))
+         ++m_staleLines;
+      m_entries[key] = entry;
+   }
+
+   if ((m_staleLines > 100) && (m_staleLines > m_entries.size()))
+      compact();
+}
+
+void AvailableModelsCache::compact()
+{
+   string tmpName = m_indexFile.string() + ".tmp";
+   ofstream s (tmpName.c_str(), ios::trunc);
+   if (s.fail())
+      return;
+
+   for (auto i=m_entries.begin(); i!=m_entries.end(); ++i)
+   {
+      unsigned int entryIndex = ossimString(i->first.substr(i->first.rfind('\n')+1)).toUInt32();
+      s<<formatLine(i->second, entryIndex);
+   }
+   s.close();
+   if (!s.fail() && (std::rename(tmpName.c_str(), m_indexFile.c_str()) == 0))
+      m_staleLines = 0;
+   else
+      std::remove(tmpName.c_str());
+}
+
+bool AvailableModelsCache::find(const FileIdentity& fileId,
+                                unsigned int entryIndex,
+                                ModelList& models)
+{
+   std::lock_guard<std::mutex> lock (m_mutex);
+   load();
+
+   auto i = m_entries.find(makeKey(fileId, entryIndex));
+   if ((i == m_entries.end()) || (i->second.fileId != fileId))
+      return false;
+
+   models = i->second.models;
+   return true;
+}
+
+void AvailableModelsCache::add(const FileIdentity& fileId,
+                               unsigned int entryIndex,
+                               const ModelList& models)
+{
+   std::lock_guard<std::mutex> lock (m_mutex);
+   load();
+
+   Entry entry;
+   entry.fileId = fileId;
+   entry.models = models;
+   string key = makeKey(fileId, entryIndex);
+   if (m_entries.count(key))
+      ++m_staleLines;
+   m_entries[key] = entry;
+
+   if (m_indexFile.empty())
+      return;
+
+   // Only persist what the line format can represent:
+   bool storable = isStorable(fileId.path);
+   for (size_t i=0; storable && (i<models.size()); ++i)
+      storable = isStorable(models[i].first) && isStorable(models[i].second);
+   if (!storable)
+      return;
+
+   // Append as a single write so concurrent processes sharing the directory don't interleave:
+   string line = formatLine(entry, entryIndex);
+   ofstream s (m_indexFile.c_str(), ios::app);
+   s.write(line.data(), line.size());
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,76 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef AvailableModelsCache_HEADER
+#define AvailableModelsCache_HEADER 1
+
+#include <common/FileIdentity.h>
+#include <ossim/base/ossimFilename.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Persistent cache of the <plugin-name, model-name> pairs supported by an image entry, as
+ * returned by MSP's getAllSupportedModels(). The probe opens the image once per registered
+ * plugin, so results are kept in memory and in an index file under the directory given by the
+ * "msp.available_models_cache.dir" preference. If no directory is configured, the cache is
+ * memory-only.
+ *
+ * Entries are keyed by the file's path, size and modification time plus the entry index. They are
+ * also stamped with a signature of the registered plugin set, so an entry is ignored if either
+ * the file or the installed plugins change.
+ */
+class AvailableModelsCache
+{
+public:
+   typedef std::vector< std::pair<std::string, std::string> > ModelList;
+
+   static AvailableModelsCache* instance();
+
+   /** Returns true and assigns models if a valid entry exists for the image entry. */
+   bool find(const FileIdentity& fileId, unsigned int entryIndex, ModelList& models);
+
+   /** Records the models supported by the image entry, persisting them if a directory is set. */
+   void add(const FileIdentity& fileId, unsigned int entryIndex, const ModelList& models);
+
+private:
+   AvailableModelsCache();
+
+   struct Entry
+   {
+      FileIdentity fileId;
+      ModelList models;
+   };
+
+   /** Loads the index file the first time the cache is used. Caller must hold the mutex. */
+   void load();
+
+   /** Rewrites the index file with only the valid entries. Caller must hold the mutex. */
+   void compact();
+
+   std::string makeKey(const FileIdentity& fileId, unsigned int entryIndex) const;
+   std::string formatLine(const Entry& entry, unsigned int entryIndex) const;
+
+   /** Signature of the registered MSP plugins and their versions. */
+   static std::string pluginSignature();
+
+   std::mutex m_mutex;
+   bool m_loaded;
+   ossimFilename m_indexFile;
+   std::string m_signature;
+   std::unordered_map<std::string, Entry> m_entries;
+   size_t m_staleLines;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,1177 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "BundleAdjuster.h"
+#include "LinearAlgebra.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+// Heights (m) of the two ground points defining each image ray for intersection:
+static const double RAY_HEIGHTS[2] = { 0.0, 1000.0 };
+
+// Levenberg-Marquardt damping schedule:
+static const double INITIAL_LAMBDA = 1.0e-3;
+static const double MIN_LAMBDA = 1.0e-12;
+static const double MAX_LAMBDA = 1.0e8;
+
+// Usual robust loss constants (95% efficiency for Gaussian errors), in sigmas:
+static const double HUBER_SCALE = 1.345;
+static const double CAUCHY_SCALE = 2.3849;
+
+// Median of the normalized residual (2-D) for Gaussian errors, sqrt(2*ln(2)):
+static const double MEDIAN_NORMALIZED_RESIDUAL = 1.17741;
+
+/** Inverts the symmetric 3x3 (row-major) in place, returning false if not positive-definite. */
+static bool invert3(double* m)
+{
+   vector<double> a (m, m + 9);
+   if (!LinearAlgebra::invert(a, 3))
+      return false;
+   copy(a.begin(), a.end(), m);
+   return true;
+}
+
+BundleAdjuster::Options::Options()
+:  maxIterations (20),
+   convergence (1.0e-6),
+   maxDenseParameters (2000),
+   maxCgIterations (500),
+   cgTolerance (1.0e-10),
+   computeCovariance (true),
+   numThreads (0),
+   robustLoss (NO_ROBUST_LOSS),
+   robustScale (0.0),
+   prepassThreshold (0.0),
+   rejectionThreshold (0.0),
+   minResidualScale (1.0),
+   maxRejectionRounds (5),
+   control (0),
+   stage ("adjustment")
+{
+}
+
+BundleAdjuster::Result::Result()
+:  iterations (0),
+   converged (false),
+   initialRms (0.0),
+   finalRms (0.0),
+   sigma0 (0.0),
+   numObservations (0),
+   numParameters (0),
+   numPoints (0),
+   cgIterations (0),
+   approximateCovariance (false),
+   elapsedSeconds (0.0),
+   numRejected (0),
+   numDownweighted (0),
+   interruption (ExecutionControl::NOT_INTERRUPTED)
+{
+}
+
+BundleAdjuster::ObservationStatus::ObservationStatus()
+:  rejection (NOT_REJECTED),
+   iteration (0),
+   normalizedResidual (0.0),
+   robustWeight (1.0)
+{
+}
+
+BundleAdjuster::BundleAdjuster()
+:  m_numParameters (0),
+   m_numThreads (0),
+   m_robustLoss (NO_ROBUST_LOSS),
+   m_robustScale (0.0),
+   m_minResidualScale (1.0)
+{
+}
+
+unsigned int BundleAdjuster::addImage(csm::RasterGM* model, bool adjustable)
+{
+   ImageData image;
+   image.model = model;
+   image.offset = 0;
+   image.rms = 0.0;
+
+   // Adjust the parameters that are meant to be adjusted and have an a priori uncertainty:
+   int numModelParams = adjustable ? model->getNumParameters() : 0;
+   for (int i=0; i<numModelParams; ++i)
+   {
+      csm::param::Type type = model->getParameterType(i);
+      if (((type == csm::param::REAL) || (type == csm::param::FICTITIOUS)) &&
+          (model->getParameterCovariance(i, i) > 0.0))
+      {
+         image.parameters.push_back(i);
+         image.initial.push_back(model->getParameterValue(i));
+      }
+   }
+
+   size_t p = image.parameters.size();
+   image.priorWeight.resize(p*p);
+   for (size_t r=0; r<p; ++r)
+   {
+      for (size_t c=0; c<p; ++c)
+      {
+         image.priorWeight[r*p + c] =
+               model->getParameterCovariance(image.parameters[r], image.parameters[c]);
+      }
+   }
+   if (!LinearAlgebra::invert(image.priorWeight, p))
+   {
+      // Inconsistent correlations, so fall back to the variances alone:
+      image.priorWeight.assign(p*p, 0.0);
+      for (size_t r=0; r<p; ++r)
+      {
+         image.priorWeight[r*p + r] =
+               1.0/model->getParameterCovariance(image.parameters[r], image.parameters[r]);
+      }
+   }
+
+   m_images.push_back(image);
+   return (unsigned int) (m_images.size() - 1);
+}
+
+void BundleAdjuster::setImageParameters(unsigned int image, const double* values)
+{
+   const ImageData& data = m_images[image];
+   for (size_t k=0; k<data.parameters.size(); ++k)
+      data.model->setParameterValue(data.parameters[k], values[data.parameters[k]]);
+}
+
+unsigned int BundleAdjuster::addPoint(const std::string& pointId)
+{
+   PointData point;
+   point.id = pointId;
+   point.control = false;
+   point.initialized = false;
+   point.estimated = false;
+   fill(point.position, point.position + 3, 0.0);
+   fill(point.prior, point.prior + 3, 0.0);
+   fill(point.priorWeight, point.priorWeight + 9, 0.0);
+   fill(point.covariance, point.covariance + 9, 0.0);
+   m_points.push_back(point);
+   return (unsigned int) (m_points.size() - 1);
+}
+
+unsigned int BundleAdjuster::addControlPoint(const std::string& pointId, const double* ecf,
+                                             const double* covariance)
+{
+   unsigned int index = addPoint(pointId);
+   PointData& point = m_points[index];
+   copy(ecf, ecf + 3, point.position);
+   copy(ecf, ecf + 3, point.prior);
+   copy(covariance, covariance + 9, point.priorWeight);
+   if (invert3(point.priorWeight))
+      point.control = true;
+   else
+      fill(point.priorWeight, point.priorWeight + 9, 0.0); // no usable prior: a tie point
+   return index;
+}
+
+void BundleAdjuster::setPointPosition(unsigned int point, const double* ecf)
+{
+   copy(ecf, ecf + 3, m_points[point].position);
+   m_points[point].initialized = true;
+}
+
+void BundleAdjuster::addObservation(unsigned int point, unsigned int image, double line,
+                                    double sample, const double* covariance)
+{
+   Observation obs;
+   obs.point = point;
+   obs.image = image;
+   obs.line = line;
+   obs.sample = sample;
+   obs.jacobianOffset = 0;
+   obs.valid = false;
+
+   // Unit weight if the covariance is unusable:
+   double det = covariance[0]*covariance[2] - covariance[1]*covariance[1];
+   if ((covariance[0] > 0.0) && (det > 0.0))
+   {
+      obs.weight[0] = covariance[2]/det;
+      obs.weight[1] = -covariance[1]/det;
+      obs.weight[2] = covariance[0]/det;
+   }
+   else
+   {
+      obs.weight[0] = 1.0;
+      obs.weight[1] = 0.0;
+      obs.weight[2] = 1.0;
+   }
+   copy(obs.weight, obs.weight + 3, obs.effectiveWeight);
+
+   m_points[point].observations.push_back(m_observations.size());
+   m_images[image].observations.push_back(m_observations.size());
+   m_observations.push_back(obs);
+}
+
+BundleAdjuster::Result BundleAdjuster::solve(const Options& options)
+{
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   Result result;
+   m_numThreads = options.numThreads;
+   m_robustLoss = options.robustLoss;
+   m_robustScale = options.robustScale;
+   if (m_robustScale <= 0.0)
+      m_robustScale = (m_robustLoss == CAUCHY_LOSS) ? CAUCHY_SCALE : HUBER_SCALE;
+   m_minResidualScale = options.minResidualScale;
+
+   // Lay out the parameters in the reduced system, and each observation's partials:
+   m_numParameters = 0;
+   size_t numPartials = 0;
+   for (size_t j=0; j<m_images.size(); ++j)
+   {
+      m_images[j].offset = m_numParameters;
+      m_numParameters += m_images[j].parameters.size();
+      for (size_t a : m_images[j].observations)
+      {
+         m_observations[a].jacobianOffset = numPartials;
+         numPartials += m_images[j].parameters.size();
+      }
+   }
+   m_jacobians.assign(2*numPartials, 0.0);
+   m_crossBlocks.assign(3*numPartials, 0.0);
+
+   initializePoints();
+   buildStructure();
+
+   double sumSquares = 0.0;
+   double cost = linearize(sumSquares);
+
+   // Blunders at the initial estimates would distort the tie points' intersections, so those are
+   // redone without them:
+   if (options.prepassThreshold > 0.0)
+   {
+      result.numRejected = rejectOutliers(options.prepassThreshold, PREPASS_REJECTED, 0);
+      if (result.numRejected > 0)
+      {
+         initializePoints();
+         buildStructure();
+         cost = linearize(sumSquares);
+      }
+   }
+
+   size_t numValid = 0;
+   for (const Observation& obs : m_observations)
+      numValid += obs.valid ? 1 : 0;
+   result.numObservations = numValid;
+   result.numParameters = m_numParameters;
+   result.initialRms = numValid ? sqrt(sumSquares/(2*numValid)) : 0.0;
+   if (options.control)
+      options.control->reportProgress(options.stage, 0, result.initialRms);
+
+   // RMS pixel residual over the observations in use, for progress reports:
+   auto rms = [&](double squares)
+   {
+      size_t count = 0;
+      for (const Observation& obs : m_observations)
+         count += obs.valid ? 1 : 0;
+      return count ? sqrt(squares/(2*count)) : 0.0;
+   };
+
+   vector<double> deltaParams;
+   vector<double> deltaPoints;
+   vector<double> savedParams (m_numParameters);
+   vector<double> savedPoints (3*m_points.size());
+   double lambda = INITIAL_LAMBDA;
+   unsigned int numRejectionRounds = 0;
+   result.message = "Maximum iterations reached.";
+   while (result.iterations < options.maxIterations)
+   {
+      // The current estimates are the best reached, since rejected steps are undone:
+      if (options.control)
+      {
+         result.interruption = options.control->checkInterruption();
+         if (result.interruption == ExecutionControl::CANCELLED)
+            result.message = "Cancelled.";
+         else if (result.interruption == ExecutionControl::TIME_BUDGET_EXHAUSTED)
+            result.message = "Time budget exhausted.";
+         if (result.interruption != ExecutionControl::NOT_INTERRUPTED)
+            break;
+      }
+
+      assemble(lambda);
+      if (!solveReduced(options, deltaParams, result))
+      {
+         lambda *= 10.0;
+         if (lambda > MAX_LAMBDA)
+         {
+            result.message = "Normal equations are singular.";
+            break;
+         }
+         continue;
+      }
+      backSubstitute(deltaParams, deltaPoints);
+
+      // Apply the corrections, keeping the current estimates in case the step is rejected:
+      ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+      {
+         ImageData& image = m_images[j];
+         for (size_t k=0; k<image.parameters.size(); ++k)
+         {
+            double value = image.model->getParameterValue(image.parameters[k]);
+            savedParams[image.offset + k] = value;
+            image.model->setParameterValue(image.parameters[k],
+                                           value + deltaParams[image.offset + k]);
+         }
+      }, m_numThreads);
+      for (size_t i=0; i<m_points.size(); ++i)
+      {
+         for (int c=0; c<3; ++c)
+         {
+            savedPoints[3*i + c] = m_points[i].position[c];
+            m_points[i].position[c] += deltaPoints[3*i + c];
+         }
+      }
+
+      ++result.iterations;
+      double newSumSquares = 0.0;
+      double newCost = linearize(newSumSquares);
+      if (newCost <= cost)
+      {
+         double reduction = (cost - newCost)/max(cost, 1.0e-300);
+         cost = newCost;
+         sumSquares = newSumSquares;
+         lambda = max(0.1*lambda, MIN_LAMBDA);
+         if (options.control)
+            options.control->reportProgress(options.stage, result.iterations, rms(sumSquares));
+
+         // Rejections change the cost function, so convergence is judged on the next iteration.
+         // The rounds are limited, so that a poorly fitting block is not eroded indefinitely:
+         if ((options.rejectionThreshold > 0.0) &&
+             (numRejectionRounds < options.maxRejectionRounds))
+         {
+            size_t numRejected = rejectOutliers(options.rejectionThreshold, ITERATION_REJECTED,
+                                                result.iterations);
+            if (numRejected > 0)
+            {
+               ++numRejectionRounds;
+               result.numRejected += numRejected;
+               cost = linearize(sumSquares);
+               continue;
+            }
+         }
+         if (reduction < options.convergence)
+         {
+            result.converged = true;
+            result.message = "Converged.";
+            break;
+         }
+         continue;
+      }
+
+      // The step increased the cost, so restore and retry with more damping, unless the increase
+      // is negligible, as at a solution (e.g. when warm-started from one):
+      ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+      {
+         ImageData& image = m_images[j];
+         for (size_t k=0; k<image.parameters.size(); ++k)
+            image.model->setParameterValue(image.parameters[k], savedParams[image.offset + k]);
+      }, m_numThreads);
+      for (size_t i=0; i<m_points.size(); ++i)
+         copy(&savedPoints[3*i], &savedPoints[3*i] + 3, m_points[i].position);
+      double increase = (newCost - cost)/max(cost, 1.0e-300);
+      cost = linearize(sumSquares);
+      if (increase < options.convergence)
+      {
+         result.converged = true;
+         result.message = "Converged.";
+         break;
+      }
+      lambda *= 10.0;
+      if (lambda > MAX_LAMBDA)
+      {
+         result.converged = true;
+         result.message = "No further reduction possible.";
+         break;
+      }
+   }
+
+   // Redundancy: two equations per observation and three per control point prior, less three
+   // unknowns per point (the parameter priors balance the parameters):
+   numValid = 0;
+   for (const Observation& obs : m_observations)
+   {
+      numValid += obs.valid ? 1 : 0;
+      if (obs.valid && (obs.status.robustWeight < 1.0))
+         ++result.numDownweighted;
+   }
+   long dof = 2*(long) numValid;
+   for (PointData& point : m_points)
+   {
+      // Tie points left with fewer than two rays (after rejections) are undetermined:
+      size_t numRays = 0;
+      for (size_t a : point.observations)
+         numRays += m_observations[a].valid ? 1 : 0;
+      if (!point.control && (numRays < 2))
+         point.estimated = false;
+      if (point.estimated)
+      {
+         ++result.numPoints;
+         dof += point.control ? 0 : -3;
+      }
+   }
+   result.numObservations = numValid;
+   result.finalRms = numValid ? sqrt(sumSquares/(2*numValid)) : 0.0;
+   result.sigma0 = sqrt(cost/max(dof, 1L));
+
+   if (options.computeCovariance && (result.interruption == ExecutionControl::NOT_INTERRUPTED))
+      computeCovariances(options, result);
+
+   result.elapsedSeconds =
+         chrono::duration<double>(chrono::steady_clock::now() - start).count();
+   return result;
+}
+
+void BundleAdjuster::initializePoints()
+{
+   // Rays through each observation, per image since models are not thread-safe. Only needed for
+   // tie points without a position:
+   vector<double> rays (6*m_observations.size(), 0.0);
+   vector<char> haveRay (m_observations.size(), 0);
+   ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+   {
+      const ImageData& image = m_images[j];
+      for (size_t a : image.observations)
+      {
+         const Observation& obs = m_observations[a];
+         if (obs.status.rejection != NOT_REJECTED)
+            continue;
+         try
+         {
+            csm::ImageCoord ip (obs.line, obs.sample);
+            csm::EcefCoord p0 = image.model->imageToGround(ip, RAY_HEIGHTS[0]);
+            csm::EcefCoord p1 = image.model->imageToGround(ip, RAY_HEIGHTS[1]);
+            double d[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+            double norm = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+            if (norm == 0.0)
+               continue;
+            double* ray = &rays[6*a];
+            ray[0] = p0.x;
+            ray[1] = p0.y;
+            ray[2] = p0.z;
+            for (int c=0; c<3; ++c)
+               ray[3 + c] = d[c]/norm;
+            haveRay[a] = 1;
+         }
+         catch (exception&)
+         {
+         }
+      }
+   }, m_numThreads);
+
+   // Least-squares intersection: minimize the sum of squared distances to the rays, i.e. solve
+   // sum(I - d*d^T)*X = sum(I - d*d^T)*p:
+   ThreadPool::instance()->parallelFor(m_points.size(), [&](size_t i)
+   {
+      PointData& point = m_points[i];
+      point.estimated = point.control || point.initialized;
+      if (point.estimated)
+         return;
+
+      vector<double> normal (9, 0.0);
+      vector<double> rhs (3, 0.0);
+      size_t numRays = 0;
+      for (size_t a : point.observations)
+      {
+         if (!haveRay[a])
+            continue;
+         const double* p = &rays[6*a];
+         const double* d = p + 3;
+         for (int r=0; r<3; ++r)
+         {
+            for (int c=0; c<3; ++c)
+            {
+               double m = ((r == c) ? 1.0 : 0.0) - d[r]*d[c];
+               normal[3*r + c] += m;
+               rhs[r] += m*p[c];
+            }
+         }
+         ++numRays;
+      }
+      if ((numRays >= 2) && LinearAlgebra::solve(normal, 3, rhs))
+      {
+         copy(rhs.begin(), rhs.end(), point.position);
+         point.estimated = true;
+      }
+   }, m_numThreads);
+}
+
+size_t BundleAdjuster::rejectOutliers(double threshold, Rejection reason, unsigned int iteration)
+{
+   vector<double> residuals;
+   residuals.reserve(m_observations.size());
+   for (const Observation& obs : m_observations)
+   {
+      if (obs.valid)
+         residuals.push_back(obs.status.normalizedResidual);
+   }
+   if (residuals.empty())
+      return 0;
+   vector<double>::iterator median = residuals.begin() + residuals.size()/2;
+   nth_element(residuals.begin(), median, residuals.end());
+   double limit = threshold*max((*median)/MEDIAN_NORMALIZED_RESIDUAL, m_minResidualScale);
+
+   // A blunder spreads into the residuals of its point's other observations, so only the worst of
+   // each point's is rejected at a time:
+   vector<char> rejected (m_points.size(), 0);
+   ThreadPool::instance()->parallelFor(m_points.size(), [&](size_t i)
+   {
+      Observation* worst = 0;
+      for (size_t a : m_points[i].observations)
+      {
+         Observation& obs = m_observations[a];
+         if (obs.valid && (obs.status.normalizedResidual > limit) &&
+             (!worst || (obs.status.normalizedResidual > worst->status.normalizedResidual)))
+         {
+            worst = &obs;
+         }
+      }
+      if (!worst)
+         return;
+      worst->valid = false;
+      worst->status.rejection = reason;
+      worst->status.iteration = iteration;
+      rejected[i] = 1;
+   }, m_numThreads);
+   return (size_t) count(rejected.begin(), rejected.end(), 1);
+}
+
+void BundleAdjuster::buildStructure()
+{
+   // Images j and k >= j are coupled if they observe a common point:
+   size_t numImages = m_images.size();
+   m_rowImages.assign(numImages, vector<size_t>());
+   m_rowOffsets.assign(numImages, vector<size_t>());
+   m_columnBlocks.assign(numImages, vector< pair<size_t, size_t> >());
+   ThreadPool::instance()->parallelFor(numImages, [&](size_t j)
+   {
+      vector<size_t>& row = m_rowImages[j];
+      row.push_back(j);
+      for (size_t a : m_images[j].observations)
+      {
+         const PointData& point = m_points[m_observations[a].point];
+         if (!point.estimated)
+            continue;
+         for (size_t b : point.observations)
+         {
+            if (m_observations[b].image > j)
+               row.push_back(m_observations[b].image);
+         }
+      }
+      sort(row.begin(), row.end());
+      row.erase(unique(row.begin(), row.end()), row.end());
+   }, m_numThreads);
+
+   size_t size = 0;
+   for (size_t j=0; j<numImages; ++j)
+   {
+      size_t pj = m_images[j].parameters.size();
+      for (size_t k : m_rowImages[j])
+      {
+         m_rowOffsets[j].push_back(size);
+         if (k != j)
+            m_columnBlocks[k].push_back(make_pair(j, size));
+         size += pj*m_images[k].parameters.size();
+      }
+   }
+   m_blockData.assign(size, 0.0);
+   m_rhs.assign(m_numParameters, 0.0);
+   m_pointInverse.assign(9*m_points.size(), 0.0);
+   m_pointGradient.assign(3*m_points.size(), 0.0);
+   m_pointSolvable.assign(m_points.size(), false);
+}
+
+double* BundleAdjuster::findBlock(size_t j, size_t k)
+{
+   const vector<size_t>& row = m_rowImages[j];
+   vector<size_t>::const_iterator entry = lower_bound(row.begin(), row.end(), k);
+   if ((entry == row.end()) || (*entry != k))
+      return 0;
+   return &m_blockData[m_rowOffsets[j][entry - row.begin()]];
+}
+
+double BundleAdjuster::linearize(double& sumSquares)
+{
+   vector<double> imageCosts (m_images.size(), 0.0);
+   vector<double> imageSums (m_images.size(), 0.0);
+   ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+   {
+      ImageData& image = m_images[j];
+      size_t p = image.parameters.size();
+      double cost = 0.0;
+      double sum = 0.0;
+      size_t count = 0;
+      for (size_t a : image.observations)
+      {
+         Observation& obs = m_observations[a];
+         const PointData& point = m_points[obs.point];
+         obs.valid = false;
+         if (!point.estimated || (obs.status.rejection != NOT_REJECTED))
+            continue;
+
+         double* partials = &m_jacobians[2*obs.jacobianOffset];
+         try
+         {
+            csm::EcefCoord ground (point.position[0], point.position[1], point.position[2]);
+            csm::ImageCoord ip = image.model->groundToImage(ground);
+            obs.residual[0] = obs.line - ip.line;
+            obs.residual[1] = obs.sample - ip.samp;
+            vector<double> groundPartials = image.model->computeGroundPartials(ground);
+            copy(groundPartials.begin(), groundPartials.begin() + 6, obs.groundPartials);
+            for (size_t k=0; k<p; ++k)
+            {
+               csm::RasterGM::SensorPartials sp =
+                     image.model->computeSensorPartials(image.parameters[k], ground);
+               partials[k] = sp.first;
+               partials[p + k] = sp.second;
+            }
+         }
+         catch (exception&)
+         {
+            continue;
+         }
+         obs.valid = true;
+
+         // Squared normalized residual, and its robust cost and weight (the derivative of the
+         // cost over twice the normalized residual):
+         const double* r = obs.residual;
+         double z2 = r[0]*(obs.weight[0]*r[0] + obs.weight[1]*r[1]) +
+                     r[1]*(obs.weight[1]*r[0] + obs.weight[2]*r[1]);
+         double z = sqrt(z2);
+         double k = m_robustScale;
+         double factor = 1.0;
+         if ((m_robustLoss == HUBER_LOSS) && (z > k))
+         {
+            cost += 2.0*k*z - k*k;
+            factor = k/z;
+         }
+         else if (m_robustLoss == CAUCHY_LOSS)
+         {
+            cost += k*k*log(1.0 + z2/(k*k));
+            factor = 1.0/(1.0 + z2/(k*k));
+         }
+         else
+            cost += z2;
+         obs.status.normalizedResidual = z;
+         obs.status.robustWeight = factor;
+         for (int c=0; c<3; ++c)
+            obs.effectiveWeight[c] = factor*obs.weight[c];
+         sum += r[0]*r[0] + r[1]*r[1];
+         ++count;
+
+         const double* w = obs.effectiveWeight;
+
+         // A^T*W*B, the coupling of the image's parameters with the point:
+         const double* g = obs.groundPartials;
+         double wb[6];
+         for (int c=0; c<3; ++c)
+         {
+            wb[c] = w[0]*g[c] + w[1]*g[3 + c];
+            wb[3 + c] = w[1]*g[c] + w[2]*g[3 + c];
+         }
+         double* cross = &m_crossBlocks[3*obs.jacobianOffset];
+         for (size_t k=0; k<p; ++k)
+         {
+            for (int c=0; c<3; ++c)
+               cross[3*k + c] = partials[k]*wb[c] + partials[p + k]*wb[3 + c];
+         }
+      }
+
+      // Departure from the a priori parameters:
+      vector<double> d (p);
+      for (size_t k=0; k<p; ++k)
+         d[k] = image.model->getParameterValue(image.parameters[k]) - image.initial[k];
+      for (size_t r=0; r<p; ++r)
+      {
+         for (size_t c=0; c<p; ++c)
+            cost += d[r]*image.priorWeight[r*p + c]*d[c];
+      }
+
+      image.rms = count ? sqrt(sum/(2*count)) : 0.0;
+      imageCosts[j] = cost;
+      imageSums[j] = sum;
+   }, m_numThreads);
+
+   double cost = 0.0;
+   sumSquares = 0.0;
+   for (size_t j=0; j<m_images.size(); ++j)
+   {
+      cost += imageCosts[j];
+      sumSquares += imageSums[j];
+   }
+   for (const PointData& point : m_points)
+   {
+      if (!point.control)
+         continue;
+      double d[3];
+      for (int c=0; c<3; ++c)
+         d[c] = point.position[c] - point.prior[c];
+      for (int r=0; r<3; ++r)
+      {
+         for (int c=0; c<3; ++c)
+            cost += d[r]*point.priorWeight[3*r + c]*d[c];
+      }
+   }
+   return cost;
+}
+
+void BundleAdjuster::assemble(double lambda)
+{
+   // Point blocks V = B^T*W*B + P, their inverses, and gradients B^T*W*r - P*(X - X0):
+   ThreadPool::instance()->parallelFor(m_points.size(), [&](size_t i)
+   {
+      const PointData& point = m_points[i];
+      m_pointSolvable[i] = false;
+      if (!point.estimated)
+         return;
+
+      double v[9];
+      double* g = &m_pointGradient[3*i];
+      copy(point.priorWeight, point.priorWeight + 9, v);
+      for (int r=0; r<3; ++r)
+      {
+         g[r] = 0.0;
+         for (int c=0; c<3; ++c)
+            g[r] -= point.priorWeight[3*r + c]*(point.position[c] - point.prior[c]);
+      }
+
+      size_t numValid = 0;
+      for (size_t a : point.observations)
+      {
+         const Observation& obs = m_observations[a];
+         if (!obs.valid)
+            continue;
+         const double* b = obs.groundPartials;
+         const double* w = obs.effectiveWeight;
+         for (int r=0; r<3; ++r)
+         {
+            double wb0 = w[0]*b[r] + w[1]*b[3 + r];
+            double wb1 = w[1]*b[r] + w[2]*b[3 + r];
+            g[r] += wb0*obs.residual[0] + wb1*obs.residual[1];
+            for (int c=0; c<3; ++c)
+               v[3*r + c] += wb0*b[c] + wb1*b[3 + c];
+         }
+         ++numValid;
+      }
+
+      // A tie point needs two rays to be determined:
+      if (!point.control && (numValid < 2))
+         return;
+      for (int d=0; d<3; ++d)
+         v[4*d] *= 1.0 + lambda;
+      if (invert3(v))
+      {
+         copy(v, v + 9, &m_pointInverse[9*i]);
+         m_pointSolvable[i] = true;
+      }
+   }, m_numThreads);
+
+   // Rows of the reduced system, S = U - sum(W*V^-1*W^T) and rhs = gc - sum(W*V^-1*gp), each
+   // image writing only its own row:
+   ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+   {
+      const ImageData& image = m_images[j];
+      size_t p = image.parameters.size();
+      for (size_t n=0; n<m_rowImages[j].size(); ++n)
+      {
+         size_t size = p*m_images[m_rowImages[j][n]].parameters.size();
+         fill(&m_blockData[m_rowOffsets[j][n]], &m_blockData[m_rowOffsets[j][n]] + size, 0.0);
+      }
+      if (p == 0)
+         return;
+
+      double* u = findBlock(j, j);
+      double* rhs = &m_rhs[image.offset];
+      vector<double> d (p);
+      for (size_t k=0; k<p; ++k)
+         d[k] = image.model->getParameterValue(image.parameters[k]) - image.initial[k];
+      for (size_t r=0; r<p; ++r)
+      {
+         rhs[r] = 0.0;
+         for (size_t c=0; c<p; ++c)
+         {
+            u[r*p + c] = image.priorWeight[r*p + c];
+            rhs[r] -= image.priorWeight[r*p + c]*d[c];
+         }
+      }
+
+      for (size_t a : image.observations)
+      {
+         const Observation& obs = m_observations[a];
+         if (!obs.valid || !m_pointSolvable[obs.point])
+            continue;
+         const double* partials = &m_jacobians[2*obs.jacobianOffset];
+         const double* w = obs.effectiveWeight;
+         for (size_t r=0; r<p; ++r)
+         {
+            double wa0 = w[0]*partials[r] + w[1]*partials[p + r];
+            double wa1 = w[1]*partials[r] + w[2]*partials[p + r];
+            rhs[r] += wa0*obs.residual[0] + wa1*obs.residual[1];
+            for (size_t c=0; c<p; ++c)
+               u[r*p + c] += wa0*partials[c] + wa1*partials[p + c];
+         }
+      }
+      for (size_t k=0; k<p; ++k)
+         u[k*p + k] *= 1.0 + lambda;
+
+      // Eliminate the points:
+      vector<double> t (3*p);
+      for (size_t a : image.observations)
+      {
+         const Observation& obs = m_observations[a];
+         if (!obs.valid || !m_pointSolvable[obs.point])
+            continue;
+         const double* cross = &m_crossBlocks[3*obs.jacobianOffset];
+         const double* vinv = &m_pointInverse[9*obs.point];
+         const double* gp = &m_pointGradient[3*obs.point];
+         for (size_t r=0; r<p; ++r)
+         {
+            for (int c=0; c<3; ++c)
+            {
+               t[3*r + c] = cross[3*r]*vinv[c] + cross[3*r + 1]*vinv[3 + c] +
+                            cross[3*r + 2]*vinv[6 + c];
+            }
+            rhs[r] -= t[3*r]*gp[0] + t[3*r + 1]*gp[1] + t[3*r + 2]*gp[2];
+         }
+
+         for (size_t b : m_points[obs.point].observations)
+         {
+            const Observation& other = m_observations[b];
+            if (!other.valid || (other.image < j))
+               continue;
+            size_t q = m_images[other.image].parameters.size();
+            double* block = findBlock(j, other.image);
+            const double* otherCross = &m_crossBlocks[3*other.jacobianOffset];
+            for (size_t r=0; r<p; ++r)
+            {
+               for (size_t c=0; c<q; ++c)
+               {
+                  block[r*q + c] -= t[3*r]*otherCross[3*c] + t[3*r + 1]*otherCross[3*c + 1] +
+                                    t[3*r + 2]*otherCross[3*c + 2];
+               }
+            }
+         }
+      }
+   }, m_numThreads);
+}
+
+void BundleAdjuster::multiply(const std::vector<double>& x, std::vector<double>& y) const
+{
+   y.assign(m_numParameters, 0.0);
+   ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+   {
+      size_t p = m_images[j].parameters.size();
+      double* yj = &y[m_images[j].offset];
+
+      // Blocks (j, k), k >= j:
+      for (size_t n=0; n<m_rowImages[j].size(); ++n)
+      {
+         const ImageData& other = m_images[m_rowImages[j][n]];
+         size_t q = other.parameters.size();
+         const double* block = &m_blockData[m_rowOffsets[j][n]];
+         const double* xk = &x[other.offset];
+         for (size_t r=0; r<p; ++r)
+         {
+            for (size_t c=0; c<q; ++c)
+               yj[r] += block[r*q + c]*xk[c];
+         }
+      }
+
+      // Blocks (i, j), i < j, transposed:
+      for (const pair<size_t, size_t>& column : m_columnBlocks[j])
+      {
+         const ImageData& other = m_images[column.first];
+         size_t q = other.parameters.size();
+         const double* block = &m_blockData[column.second];
+         const double* xi = &x[other.offset];
+         for (size_t r=0; r<q; ++r)
+         {
+            for (size_t c=0; c<p; ++c)
+               yj[c] += block[r*p + c]*xi[r];
+         }
+      }
+   }, m_numThreads);
+}
+
+bool BundleAdjuster::solveReduced(const Options& options, std::vector<double>& delta,
+                                  Result& result)
+{
+   size_t n = m_numParameters;
+   delta.assign(n, 0.0);
+   if (n == 0)
+      return true;
+
+   if (n <= options.maxDenseParameters)
+   {
+      result.solver = "cholesky";
+      vector<double> dense (n*n, 0.0);
+      for (size_t j=0; j<m_images.size(); ++j)
+      {
+         const ImageData& image = m_images[j];
+         size_t p = image.parameters.size();
+         for (size_t k=0; k<m_rowImages[j].size(); ++k)
+         {
+            const ImageData& other = m_images[m_rowImages[j][k]];
+            size_t q = other.parameters.size();
+            const double* block = &m_blockData[m_rowOffsets[j][k]];
+            for (size_t r=0; r<p; ++r)
+            {
+               for (size_t c=0; c<q; ++c)
+               {
+                  dense[(image.offset + r)*n + other.offset + c] = block[r*q + c];
+                  dense[(other.offset + c)*n + image.offset + r] = block[r*q + c];
+               }
+            }
+         }
+      }
+      delta = m_rhs;
+      return LinearAlgebra::solve(dense, n, delta);
+   }
+
+   // Block-Jacobi preconditioner: the inverse of each image's diagonal block:
+   result.solver = "pcg";
+   vector< vector<double> > preconditioner (m_images.size());
+   ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+   {
+      size_t p = m_images[j].parameters.size();
+      const double* block = findBlock(j, j);
+      vector<double>& m = preconditioner[j];
+      m.assign(block, block + p*p);
+      if (!LinearAlgebra::invert(m, p))
+      {
+         m.assign(p*p, 0.0);
+         for (size_t k=0; k<p; ++k)
+            m[k*p + k] = (block[k*p + k] > 0.0) ? 1.0/block[k*p + k] : 1.0;
+      }
+   }, m_numThreads);
+   auto precondition = [&](const vector<double>& r, vector<double>& z)
+   {
+      z.assign(n, 0.0);
+      ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+      {
+         size_t p = m_images[j].parameters.size();
+         size_t offset = m_images[j].offset;
+         const vector<double>& m = preconditioner[j];
+         for (size_t row=0; row<p; ++row)
+         {
+            for (size_t c=0; c<p; ++c)
+               z[offset + row] += m[row*p + c]*r[offset + c];
+         }
+      }, m_numThreads);
+   };
+   auto dot = [n](const vector<double>& a, const vector<double>& b)
+   {
+      double sum = 0.0;
+      for (size_t i=0; i<n; ++i)
+         sum += a[i]*b[i];
+      return sum;
+   };
+
+   vector<double> r = m_rhs;
+   vector<double> z, p, q;
+   precondition(r, z);
+   p = z;
+   double rz = dot(r, z);
+   double threshold = options.cgTolerance*sqrt(dot(r, r));
+   for (unsigned int iteration=0; iteration<options.maxCgIterations; ++iteration)
+   {
+      if (sqrt(dot(r, r)) <= threshold)
+         break;
+      multiply(p, q);
+      double pq = dot(p, q);
+      if (!(pq > 0.0))
+         return false;
+      double alpha = rz/pq;
+      for (size_t i=0; i<n; ++i)
+      {
+         delta[i] += alpha*p[i];
+         r[i] -= alpha*q[i];
+      }
+      precondition(r, z);
+      double rzNext = dot(r, z);
+      double beta = rzNext/rz;
+      rz = rzNext;
+      for (size_t i=0; i<n; ++i)
+         p[i] = z[i] + beta*p[i];
+      ++result.cgIterations;
+   }
+   return true;
+}
+
+void BundleAdjuster::backSubstitute(const std::vector<double>& deltaParams,
+                                    std::vector<double>& deltaPoints)
+{
+   // dX = V^-1*(gp - sum(W^T*dc)):
+   deltaPoints.assign(3*m_points.size(), 0.0);
+   ThreadPool::instance()->parallelFor(m_points.size(), [&](size_t i)
+   {
+      if (!m_pointSolvable[i])
+         return;
+      double t[3];
+      copy(&m_pointGradient[3*i], &m_pointGradient[3*i] + 3, t);
+      for (size_t a : m_points[i].observations)
+      {
+         const Observation& obs = m_observations[a];
+         if (!obs.valid)
+            continue;
+         const ImageData& image = m_images[obs.image];
+         const double* cross = &m_crossBlocks[3*obs.jacobianOffset];
+         const double* dc = &deltaParams[image.offset];
+         for (size_t k=0; k<image.parameters.size(); ++k)
+         {
+            for (int c=0; c<3; ++c)
+               t[c] -= cross[3*k + c]*dc[k];
+         }
+      }
+      const double* vinv = &m_pointInverse[9*i];
+      for (int r=0; r<3; ++r)
+         deltaPoints[3*i + r] = vinv[3*r]*t[0] + vinv[3*r + 1]*t[1] + vinv[3*r + 2]*t[2];
+   }, m_numThreads);
+}
+
+void BundleAdjuster::computeCovariances(const Options& options, Result& result)
+{
+   // The undamped system at the solution:
+   assemble(0.0);
+   size_t n = m_numParameters;
+
+   // Parameter covariance: the full inverse of the reduced system if small enough, else the
+   // inverses of its diagonal blocks:
+   vector< vector<double> > diagonal (m_images.size());
+   m_parameterCovariance.clear();
+   result.approximateCovariance = (n > options.maxDenseParameters);
+   if (!result.approximateCovariance && (n > 0))
+   {
+      m_parameterCovariance.assign(n*n, 0.0);
+      for (size_t j=0; j<m_images.size(); ++j)
+      {
+         const ImageData& image = m_images[j];
+         size_t p = image.parameters.size();
+         for (size_t k=0; k<m_rowImages[j].size(); ++k)
+         {
+            const ImageData& other = m_images[m_rowImages[j][k]];
+            size_t q = other.parameters.size();
+            const double* block = &m_blockData[m_rowOffsets[j][k]];
+            for (size_t r=0; r<p; ++r)
+            {
+               for (size_t c=0; c<q; ++c)
+               {
+                  m_parameterCovariance[(image.offset + r)*n + other.offset + c] = block[r*q + c];
+                  m_parameterCovariance[(other.offset + c)*n + image.offset + r] = block[r*q + c];
+               }
+            }
+         }
+      }
+      if (!LinearAlgebra::invert(m_parameterCovariance, n))
+      {
+         m_parameterCovariance.clear();
+         result.approximateCovariance = true;
+      }
+   }
+   if (result.approximateCovariance)
+   {
+      ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+      {
+         size_t p = m_images[j].parameters.size();
+         const double* block = findBlock(j, j);
+         diagonal[j].assign(block, block + p*p);
+         if (!LinearAlgebra::invert(diagonal[j], p))
+            diagonal[j].assign(p*p, 0.0);
+      }, m_numThreads);
+   }
+
+   // Element (r, c) of the covariance block of images j and k, or 0 if not available:
+   auto parameterCovariance = [&](size_t j, size_t k, size_t r, size_t c)
+   {
+      if (!m_parameterCovariance.empty())
+         return m_parameterCovariance[(m_images[j].offset + r)*n + m_images[k].offset + c];
+      if (j != k)
+         return 0.0;
+      return diagonal[j][r*m_images[j].parameters.size() + c];
+   };
+
+   // Write the images' covariance blocks back to their models:
+   ThreadPool::instance()->parallelFor(m_images.size(), [&](size_t j)
+   {
+      const ImageData& image = m_images[j];
+      for (size_t r=0; r<image.parameters.size(); ++r)
+      {
+         for (size_t c=0; c<image.parameters.size(); ++c)
+         {
+            image.model->setParameterCovariance(image.parameters[r], image.parameters[c],
+                                                parameterCovariance(j, j, r, c));
+         }
+      }
+   }, m_numThreads);
+
+   // Points: V^-1 + V^-1*(sum over observation pairs of W_a^T*C_jk*W_b)*V^-1:
+   ThreadPool::instance()->parallelFor(m_points.size(), [&](size_t i)
+   {
+      PointData& point = m_points[i];
+      fill(point.covariance, point.covariance + 9, 0.0);
+      if (!m_pointSolvable[i])
+         return;
+
+      double m[9] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+      for (size_t a : point.observations)
+      {
+         const Observation& obsA = m_observations[a];
+         if (!obsA.valid)
+            continue;
+         size_t p = m_images[obsA.image].parameters.size();
+         const double* crossA = &m_crossBlocks[3*obsA.jacobianOffset];
+         for (size_t b : point.observations)
+         {
+            const Observation& obsB = m_observations[b];
+            if (!obsB.valid)
+               continue;
+            size_t q = m_images[obsB.image].parameters.size();
+            const double* crossB = &m_crossBlocks[3*obsB.jacobianOffset];
+            for (size_t r=0; r<p; ++r)
+            {
+               for (size_t c=0; c<q; ++c)
+               {
+                  double cov = parameterCovariance(obsA.image, obsB.image, r, c);
+                  if (cov == 0.0)
+                     continue;
+                  for (int x=0; x<3; ++x)
+                  {
+                     for (int y=0; y<3; ++y)
+                        m[3*x + y] += crossA[3*r + x]*cov*crossB[3*c + y];
+                  }
+               }
+            }
+         }
+      }
+
+      const double* vinv = &m_pointInverse[9*i];
+      double t[9];
+      for (int r=0; r<3; ++r)
+      {
+         for (int c=0; c<3; ++c)
+            t[3*r + c] = vinv[3*r]*m[c] + vinv[3*r + 1]*m[3 + c] + vinv[3*r + 2]*m[6 + c];
+      }
+      for (int r=0; r<3; ++r)
+      {
+         for (int c=0; c<3; ++c)
+         {
+            point.covariance[3*r + c] = vinv[3*r + c] + t[3*r]*vinv[c] + t[3*r + 1]*vinv[3 + c] +
+                                        t[3*r + 2]*vinv[6 + c];
+         }
+      }
+   }, m_numThreads);
+}
+
+} // end namespace ossimMsp
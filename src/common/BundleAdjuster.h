@@ -0,0 +1,353 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef BundleAdjuster_HEADER
+#define BundleAdjuster_HEADER 1
+
+#include "ExecutionControl.h"
+#include <csm/RasterGM.h>
+#include <string>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Sparse bundle adjustment of CSM sensor models and ground points from image measurements, as an
+ * alternative to MSP's triangulation. Levenberg-Marquardt iterations linearize with the models'
+ * sensor and ground partials, eliminate the ground points from the block-sparse normal equations
+ * (the Schur complement, since each point's block is only 3x3), solve the reduced system over the
+ * sensor parameters, then back-substitute for the points.
+ *
+ * The reduced system is solved by dense Cholesky factorization when it has at most
+ * Options::maxDenseParameters unknowns, otherwise by conjugate gradients preconditioned with the
+ * inverses of its diagonal (per-image) blocks.
+ *
+ * Adjustable parameters are those of type REAL or FICTITIOUS with positive a priori variance; the
+ * a priori covariance weights their departure from the initial values. Control points are
+ * weighted by their covariance likewise. Tie points are initialized by intersecting their rays.
+ *
+ * Blunders can be handled by a robust loss (Huber or Cauchy), which down-weights observations by
+ * their normalized residuals, reweighted at each linearization, and by rejecting observations
+ * with outlying residuals: in a pre-pass at the initial estimates, and after each iteration (for
+ * a limited number of rounds). Outliers are judged against a robust (median-based) estimate of
+ * the residual scale (by default no less than the a priori sigma), one per point at a time since
+ * a blunder also inflates the residuals of its point's other observations.
+ *
+ * With an ExecutionControl, each iteration's progress is reported, and the iterations stop early
+ * when cancelled or out of time, leaving the best estimates reached (covariances are then not
+ * computed).
+ *
+ * Models are adjusted in place and are called concurrently (one thread per model at a time), so
+ * each must be a private instance not used elsewhere during solve().
+ */
+class BundleAdjuster
+{
+public:
+   enum RobustLoss
+   {
+      NO_ROBUST_LOSS,
+      HUBER_LOSS,
+      CAUCHY_LOSS
+   };
+
+   enum Rejection
+   {
+      NOT_REJECTED,
+      PREPASS_REJECTED,    // at the initial estimates
+      ITERATION_REJECTED   // after an iteration
+   };
+
+   struct Options
+   {
+      Options();
+
+      unsigned int maxIterations;
+
+      /** Converged when an iteration reduces the cost by less than this fraction. */
+      double convergence;
+
+      /** Largest reduced system solved by dense Cholesky rather than by PCG. */
+      size_t maxDenseParameters;
+
+      unsigned int maxCgIterations;
+
+      /** PCG stops when the residual norm falls by this factor. */
+      double cgTolerance;
+
+      /** Computes point and parameter covariances after the solution. */
+      bool computeCovariance;
+
+      /** Limit on threads used (0 = all in the pool). */
+      unsigned int numThreads;
+
+      RobustLoss robustLoss;
+
+      /**
+       * Normalized residual (in a priori sigmas) beyond which the robust loss down-weights
+       * (0 = the loss's usual constant: 1.345 for Huber, 2.3849 for Cauchy).
+       */
+      double robustScale;
+
+      /**
+       * Rejects observations whose normalized residual at the initial estimates exceeds this many
+       * times the robust residual scale (0 = no pre-pass).
+       */
+      double prepassThreshold;
+
+      /** As prepassThreshold, after each iteration (0 = no rejection). */
+      double rejectionThreshold;
+
+      /**
+       * Floor on the robust residual scale (in a priori sigmas) used for rejection, so that a
+       * block fitting better than its a priori sigmas does not have its good observations judged
+       * against a shrunken scale.
+       */
+      double minResidualScale;
+
+      /** Iterations after which observations may be rejected. */
+      unsigned int maxRejectionRounds;
+
+      /** Progress reporting and interruption (0 = none). Not owned. */
+      const ExecutionControl* control;
+
+      /** Stage name in progress reports. */
+      std::string stage;
+   };
+
+   struct Result
+   {
+      Result();
+
+      unsigned int iterations;
+      bool converged;
+
+      /** RMS image residual in pixels before and after adjustment. */
+      double initialRms;
+      double finalRms;
+
+      /** Square root of the weighted cost per degree of freedom. */
+      double sigma0;
+
+      size_t numObservations;
+      size_t numParameters;
+      size_t numPoints;
+
+      /** "cholesky" or "pcg". */
+      std::string solver;
+      unsigned int cgIterations;
+
+      /**
+       * True if the covariances are from the diagonal blocks of the reduced system only, ignoring
+       * correlations between images (the PCG case).
+       */
+      bool approximateCovariance;
+
+      double elapsedSeconds;
+      std::string message;
+
+      size_t numRejected;
+
+      /** Observations given less than full weight by the robust loss at the solution. */
+      size_t numDownweighted;
+
+      /** Why the iterations stopped early, if they did. */
+      ExecutionControl::Interruption interruption;
+   };
+
+   struct ObservationStatus
+   {
+      ObservationStatus();
+
+      Rejection rejection;
+      unsigned int iteration;         // of rejection
+      double normalizedResidual;      // at rejection, else at the last linearization
+      double robustWeight;            // factor on the a priori weight
+   };
+
+   BundleAdjuster();
+
+   /**
+    * Adds an image, returning its index. The model is adjusted in place, or if not adjustable,
+    * only used to constrain the points.
+    */
+   unsigned int addImage(csm::RasterGM* model, bool adjustable=true);
+
+   /**
+    * Starts the image's adjustment from the parameter values given (one per model parameter) rather
+    * than from its model's. The model's values when added remain the a priori values.
+    */
+   void setImageParameters(unsigned int image, const double* values);
+
+   /** Adds a tie point, returning its index. Its position is found by intersection. */
+   unsigned int addPoint(const std::string& pointId);
+
+   /**
+    * Adds a ground control point with its a priori ECF position and 3x3 covariance (row-major),
+    * returning its index.
+    */
+   unsigned int addControlPoint(const std::string& pointId, const double* ecf,
+                                const double* covariance);
+
+   /** Sets the point's initial position, which is otherwise found by intersection. */
+   void setPointPosition(unsigned int point, const double* ecf);
+
+   /**
+    * Adds a measurement of the point on the image, with covariance packed as
+    * { var(line), cov(line, sample), var(sample) }.
+    */
+   void addObservation(unsigned int point, unsigned int image, double line, double sample,
+                       const double* covariance);
+
+   /**
+    * Adjusts the models and points. The models are left with the adjusted parameter values and,
+    * if computed, their covariances.
+    */
+   Result solve(const Options& options);
+
+   size_t getNumImages() const { return m_images.size(); }
+   size_t getNumPoints() const { return m_points.size(); }
+
+   const std::string& getPointId(unsigned int point) const { return m_points[point].id; }
+
+   /** True if the point had enough observations to be estimated. */
+   bool isPointEstimated(unsigned int point) const { return m_points[point].estimated; }
+
+   const double* getPointPosition(unsigned int point) const { return m_points[point].position; }
+
+   /** 3x3 row-major. Zero unless covariances were computed. */
+   const double* getPointCovariance(unsigned int point) const
+   { return m_points[point].covariance; }
+
+   /** RMS residual (pixels) of the image's observations after solve(). */
+   double getImageRms(unsigned int image) const { return m_images[image].rms; }
+
+   size_t getNumImageObservations(unsigned int image) const
+   { return m_images[image].observations.size(); }
+
+   size_t getNumObservations() const { return m_observations.size(); }
+
+   /** Rejection and weighting of the observation (in order added) after solve(). */
+   const ObservationStatus& getObservationStatus(size_t observation) const
+   { return m_observations[observation].status; }
+
+   /** Number of the image's parameters adjusted. */
+   size_t getNumImageParameters(unsigned int image) const
+   { return m_images[image].parameters.size(); }
+
+private:
+   struct ImageData
+   {
+      csm::RasterGM* model;
+      std::vector<int> parameters;      // indices of the adjusted parameters
+      std::vector<double> initial;      // their a priori values
+      std::vector<double> priorWeight;  // inverse a priori covariance, p x p
+      std::vector<size_t> observations;
+      size_t offset;                    // of the parameters in the reduced system
+      double rms;
+   };
+
+   struct PointData
+   {
+      std::string id;
+      bool control;
+      bool initialized;
+      bool estimated;
+      double position[3];
+      double prior[3];
+      double priorWeight[9];
+      double covariance[9];
+      std::vector<size_t> observations;
+   };
+
+   struct Observation
+   {
+      unsigned int point;
+      unsigned int image;
+      double line;
+      double sample;
+      double weight[3];     // inverse covariance, packed as the covariance
+      double effectiveWeight[3]; // including the robust weight
+      double residual[2];   // observed - computed
+      double groundPartials[6];
+      size_t jacobianOffset; // of the 2 x p sensor partials in m_jacobians, and the p x 3 block
+                             // A^T*W*B in m_crossBlocks
+      bool valid;
+      ObservationStatus status;
+   };
+
+   /** Intersects the rays of each tie point to initialize its position. */
+   void initializePoints();
+
+   /**
+    * Rejects, for each point, the worst of its observations with normalized residuals beyond
+    * threshold times the robust residual scale (at least m_minResidualScale), returning the number
+    * rejected.
+    */
+   size_t rejectOutliers(double threshold, Rejection reason, unsigned int iteration);
+
+   /** Finds the block structure of the reduced system and sizes the work arrays. */
+   void buildStructure();
+
+   /**
+    * Computes residuals and partials at the current estimates, returning the total weighted cost
+    * (including priors) and setting the sum of squared pixel residuals.
+    */
+   double linearize(double& sumSquares);
+
+   /**
+    * Forms the reduced camera system with damping lambda, including the per-point inverse
+    * blocks and gradients needed for back-substitution.
+    */
+   void assemble(double lambda);
+
+   /** Solves the reduced system for the parameter corrections. Returns false on failure. */
+   bool solveReduced(const Options& options, std::vector<double>& delta, Result& result);
+
+   /** Computes the point corrections given the parameter corrections. */
+   void backSubstitute(const std::vector<double>& deltaParams, std::vector<double>& deltaPoints);
+
+   /** Computes covariances from the undamped system. */
+   void computeCovariances(const Options& options, Result& result);
+
+   /** y = S*x over the block structure. */
+   void multiply(const std::vector<double>& x, std::vector<double>& y) const;
+
+   /** Returns the block (j, k), k >= j, of the reduced system, or 0 if structurally zero. */
+   double* findBlock(size_t j, size_t k);
+
+   std::vector<ImageData> m_images;
+   std::vector<PointData> m_points;
+   std::vector<Observation> m_observations;
+   std::vector<double> m_jacobians;
+   std::vector<double> m_crossBlocks;
+   size_t m_numParameters;
+   unsigned int m_numThreads;
+   RobustLoss m_robustLoss;
+   double m_robustScale;
+   double m_minResidualScale;
+
+   // Upper block structure of the reduced system: for each image, the images k >= j sharing a
+   // point with it, and the offsets of the blocks in m_blockData. The lower part is reached
+   // through m_columnBlocks (image k < j, block offset) for parallel multiplication:
+   std::vector< std::vector<size_t> > m_rowImages;
+   std::vector< std::vector<size_t> > m_rowOffsets;
+   std::vector< std::vector< std::pair<size_t, size_t> > > m_columnBlocks;
+   std::vector<double> m_blockData;
+   std::vector<double> m_rhs;
+
+   // Per point, for back-substitution:
+   std::vector<double> m_pointInverse;  // 3x3 each
+   std::vector<double> m_pointGradient; // 3 each
+   std::vector<bool> m_pointSolvable;
+
+   // Full inverse of the reduced system from computeCovariances() when dense:
+   std::vector<double> m_parameterCovariance;
+};
+
+} // End namespace ossimMsp
+
+#endif
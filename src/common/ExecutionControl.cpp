@@ -0,0 +1,77 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "ExecutionControl.h"
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+ExecutionControl::Progress::Progress()
+:  iteration (0),
+   rms (0.0),
+   elapsedSeconds (0.0)
+{
+}
+
+ExecutionControl::ExecutionControl()
+:  m_timeBudget (0.0),
+   m_start (chrono::steady_clock::now())
+{
+}
+
+void ExecutionControl::start()
+{
+   m_start = chrono::steady_clock::now();
+}
+
+double ExecutionControl::getElapsedSeconds() const
+{
+   return chrono::duration<double>(chrono::steady_clock::now() - m_start).count();
+}
+
+ExecutionControl::Interruption ExecutionControl::checkInterruption() const
+{
+   if (m_token && m_token->isCancelled())
+      return CANCELLED;
+   if ((m_timeBudget > 0.0) && (getElapsedSeconds() >= m_timeBudget))
+      return TIME_BUDGET_EXHAUSTED;
+   return NOT_INTERRUPTED;
+}
+
+void ExecutionControl::reportProgress(const std::string& stage, unsigned int iteration,
+                                      double rms) const
+{
+   if (!m_callback)
+      return;
+
+   Progress progress;
+   progress.stage = stage;
+   progress.iteration = iteration;
+   progress.rms = rms;
+   progress.elapsedSeconds = getElapsedSeconds();
+
+   // Sub-blocks of a partitioned adjustment report concurrently:
+   lock_guard<mutex> lock (m_callbackMutex);
+   m_callback(progress);
+}
+
+std::string ExecutionControl::toString(Interruption interruption)
+{
+   switch (interruption)
+   {
+   case CANCELLED:
+      return "cancelled";
+   case TIME_BUDGET_EXHAUSTED:
+      return "timeBudgetExhausted";
+   default:
+      return "";
+   }
+}
+
+} // end namespace ossimMsp
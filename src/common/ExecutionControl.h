@@ -0,0 +1,107 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef ExecutionControl_HEADER
+#define ExecutionControl_HEADER 1
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace ossimMsp
+{
+
+/**
+ * Flag through which a caller (e.g. a scheduler preempting low-priority work) asks a running
+ * service to stop. Cancellation is cooperative: the service stops at its next check, with the
+ * best result it has reached.
+ */
+class CancellationToken
+{
+public:
+   CancellationToken() : m_cancelled (false) { }
+
+   /** May be called from any thread. */
+   void cancel() { m_cancelled = true; }
+
+   bool isCancelled() const { return m_cancelled; }
+
+private:
+   std::atomic<bool> m_cancelled;
+};
+
+/**
+ * Progress reporting and early termination of a service's execution: an optional progress
+ * callback, cancellation token, and wall-clock time budget. Long-running work checks for
+ * interruption between iterations and reports each iteration's progress.
+ */
+class ExecutionControl
+{
+public:
+   enum Interruption
+   {
+      NOT_INTERRUPTED,
+      CANCELLED,
+      TIME_BUDGET_EXHAUSTED
+   };
+
+   struct Progress
+   {
+      Progress();
+
+      /** The work in progress, e.g. "adjustment", "partition 3", "merge". */
+      std::string stage;
+
+      unsigned int iteration;
+
+      /** RMS image residual in pixels. */
+      double rms;
+
+      /** Since start(). */
+      double elapsedSeconds;
+   };
+
+   /** Called from worker threads, one call at a time. Should return quickly. */
+   typedef std::function<void(const Progress& progress)> ProgressCallback;
+
+   ExecutionControl();
+
+   void setProgressCallback(const ProgressCallback& callback) { m_callback = callback; }
+
+   void setCancellationToken(const std::shared_ptr<CancellationToken>& token) { m_token = token; }
+
+   /** Wall-clock seconds allowed from start() (0 = no limit). */
+   void setTimeBudget(double seconds) { m_timeBudget = seconds; }
+   double getTimeBudget() const { return m_timeBudget; }
+
+   /** Starts the clock for the time budget and the elapsed time reported. */
+   void start();
+
+   double getElapsedSeconds() const;
+
+   /** Returns why the work should stop, if it should. Thread-safe. */
+   Interruption checkInterruption() const;
+
+   /** Passes the progress to the callback, if any. Thread-safe. */
+   void reportProgress(const std::string& stage, unsigned int iteration, double rms) const;
+
+   /** "cancelled" or "timeBudgetExhausted" ("" if not interrupted), as used in responses. */
+   static std::string toString(Interruption interruption);
+
+private:
+   ProgressCallback m_callback;
+   std::shared_ptr<CancellationToken> m_token;
+   double m_timeBudget;
+   std::chrono::steady_clock::time_point m_start;
+   mutable std::mutex m_callbackMutex;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,42 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "FileIdentity.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+bool FileIdentity::read(const std::string& filename)
+{
+   struct stat info;
+   if (filename.empty() || (stat(filename.c_str(), &info) != 0))
+   {
+      path.clear();
+      size = 0;
+      mtime = 0;
+      return false;
+   }
+
+   path = filename;
+   size = (ossim_int64) info.st_size;
+   mtime = (ossim_int64) info.st_mtime;
+   return true;
+}
+
+size_t FileIdentity::hash() const
+{
+   size_t h = std::hash<string>()(path);
+   h ^= std::hash<ossim_int64>()(size) + 0x9e3779b9 + (h << 6) + (h >> 2);
+   h ^= std::hash<ossim_int64>()(mtime) + 0x9e3779b9 + (h << 6) + (h >> 2);
+   return h;
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,49 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef FileIdentity_HEADER
+#define FileIdentity_HEADER 1
+
+#include <ossim/base/ossimConstants.h>
+#include <string>
+#include <functional>
+
+namespace ossimMsp
+{
+
+/**
+ * Identifies a specific version of a file on disk by path, size and modification time. Used for
+ * keying caches of data derived from image files so that entries become stale when the file is
+ * replaced or modified.
+ */
+struct FileIdentity
+{
+   FileIdentity() : size (0), mtime (0) {}
+
+   /**
+    * Initializes the identity from the file system. Returns false if the file could not be
+    * stat'd, in which case the identity is left blank.
+    */
+   bool read(const std::string& filename);
+
+   bool operator==(const FileIdentity& other) const
+   {
+      return (size == other.size) && (mtime == other.mtime) && (path == other.path);
+   }
+
+   bool operator!=(const FileIdentity& other) const { return !(*this == other); }
+
+   /** Combines all fields into a single hash value. */
+   size_t hash() const;
+
+   std::string path;
+   ossim_int64 size;
+   ossim_int64 mtime;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,156 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "Footprint.h"
+#include <ossim/base/ossimEcefPoint.h>
+#include <ossim/base/ossimException.h>
+#include <ossim/base/ossimGpt.h>
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+// Points traced along each image edge, so that curved edges (e.g., pushbroom) are followed:
+static const int POINTS_PER_EDGE = 8;
+
+Footprint::Footprint()
+:  m_minLat (0.0),
+   m_minLon (0.0),
+   m_maxLat (0.0),
+   m_maxLon (0.0),
+   m_height (0.0)
+{
+}
+
+std::shared_ptr<const Footprint> Footprint::create(const csm::RasterGM& model, double height)
+{
+   shared_ptr<Footprint> footprint (new Footprint);
+   footprint->m_height = height;
+
+   // Trace the border clockwise from the first pixel, each edge excluding its last corner:
+   csm::ImageCoord start = model.getImageStart();
+   csm::ImageVector size = model.getImageSize();
+   double lines[4] = { start.line, start.line, start.line + size.line, start.line + size.line };
+   double samps[4] = { start.samp, start.samp + size.samp, start.samp + size.samp, start.samp };
+   for (int edge=0; edge<4; ++edge)
+   {
+      int next = (edge + 1) % 4;
+      for (int i=0; i<POINTS_PER_EDGE; ++i)
+      {
+         double t = (double) i / POINTS_PER_EDGE;
+         csm::ImageCoord ip (lines[edge] + t*(lines[next] - lines[edge]),
+                             samps[edge] + t*(samps[next] - samps[edge]));
+         try
+         {
+            csm::EcefCoord ecf = model.imageToGround(ip, height);
+            ossimGpt gpt (ossimEcefPoint(ecf.x, ecf.y, ecf.z));
+            double lon = gpt.lon;
+
+            // Keep longitudes continuous with the previous vertex:
+            if (!footprint->m_lons.empty())
+            {
+               double previous = footprint->m_lons.back();
+               while (lon - previous > 180.0)
+                  lon -= 360.0;
+               while (lon - previous < -180.0)
+                  lon += 360.0;
+            }
+            footprint->m_lats.push_back(gpt.lat);
+            footprint->m_lons.push_back(lon);
+         }
+         catch (...)
+         {
+            // Border points not intersecting the ground (e.g., above the horizon) are skipped
+         }
+      }
+   }
+
+   if (footprint->m_lats.size() < 3)
+   {
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": create() -- Image border of model <"<<model.getModelName()
+          <<"> could not be projected to the ground.";
+      throw ossimException(xmsg.str());
+   }
+
+   footprint->m_minLat = *min_element(footprint->m_lats.begin(), footprint->m_lats.end());
+   footprint->m_maxLat = *max_element(footprint->m_lats.begin(), footprint->m_lats.end());
+   footprint->m_minLon = *min_element(footprint->m_lons.begin(), footprint->m_lons.end());
+   footprint->m_maxLon = *max_element(footprint->m_lons.begin(), footprint->m_lons.end());
+   return footprint;
+}
+
+double Footprint::normalizeLongitude(double lon) const
+{
+   double center = 0.5*(m_minLon + m_maxLon);
+   while (lon - center > 180.0)
+      lon -= 360.0;
+   while (lon - center < -180.0)
+      lon += 360.0;
+   return lon;
+}
+
+bool Footprint::contains(double lat, double lon) const
+{
+   lon = normalizeLongitude(lon);
+   if ((lat < m_minLat) || (lat > m_maxLat) || (lon < m_minLon) || (lon > m_maxLon))
+      return false;
+
+   // Even-odd rule, treating lat/lon as planar over the extent of an image:
+   bool inside = false;
+   size_t n = m_lats.size();
+   for (size_t i=0, j=n-1; i<n; j=i++)
+   {
+      if (((m_lats[i] > lat) != (m_lats[j] > lat)) &&
+          (lon < m_lons[i] + (lat - m_lats[i])*(m_lons[j] - m_lons[i])/(m_lats[j] - m_lats[i])))
+      {
+         inside = !inside;
+      }
+   }
+   return inside;
+}
+
+void Footprint::getBounds(double& minLat, double& minLon, double& maxLat, double& maxLon) const
+{
+   minLat = m_minLat;
+   minLon = m_minLon;
+   maxLat = m_maxLat;
+   maxLon = m_maxLon;
+}
+
+void Footprint::saveJSON(Json::Value& json) const
+{
+   json["height"] = m_height;
+
+   Json::Value vertices (Json::arrayValue);
+   for (size_t i=0; i<m_lats.size(); ++i)
+   {
+      double lon = m_lons[i];
+      if (lon > 180.0)
+         lon -= 360.0;
+      else if (lon < -180.0)
+         lon += 360.0;
+      Json::Value vertex (Json::arrayValue);
+      vertex.append(m_lats[i]);
+      vertex.append(lon);
+      vertices.append(vertex);
+   }
+   json["vertices"] = vertices;
+
+   // Bounds keep continuous longitudes, so minLon > maxLon indicates a date line crossing:
+   Json::Value bounds;
+   bounds["minLat"] = m_minLat;
+   bounds["maxLat"] = m_maxLat;
+   bounds["minLon"] = (m_minLon < -180.0) ? m_minLon + 360.0 : m_minLon;
+   bounds["maxLon"] = (m_maxLon > 180.0) ? m_maxLon - 360.0 : m_maxLon;
+   json["bounds"] = bounds;
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,65 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef Footprint_HEADER
+#define Footprint_HEADER 1
+
+#include <ossim/base/JsonInterface.h>
+#include <csm/RasterGM.h>
+#include <memory>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Ground footprint of an image: the polygon traced by projecting the image border to the ground
+ * at a constant height. Longitudes are kept continuous around the polygon (i.e., they may exceed
+ * +/-180 for images crossing the date line), and queries are normalized to match.
+ */
+class Footprint
+{
+public:
+   Footprint();
+
+   /**
+    * Traces the border of the model's image at the height given (meters above the ellipsoid).
+    * Throws ossimException if too few border points can be projected.
+    */
+   static std::shared_ptr<const Footprint> create(const csm::RasterGM& model, double height=0.0);
+
+   /** Returns true if the point lies inside the footprint polygon. */
+   bool contains(double lat, double lon) const;
+
+   /** Returns longitude shifted by a multiple of 360 to be closest to the footprint. */
+   double normalizeLongitude(double lon) const;
+
+   void getBounds(double& minLat, double& minLon, double& maxLat, double& maxLon) const;
+
+   double getHeight() const { return m_height; }
+
+   const std::vector<double>& getLatitudes() const { return m_lats; }
+   const std::vector<double>& getLongitudes() const { return m_lons; }
+
+   /**
+    * Writes {"height": h, "vertices": [[lat, lon], ...], "bounds": {"minLat", "minLon", "maxLat",
+    * "maxLon"}} with longitudes in [-180, 180].
+    */
+   void saveJSON(Json::Value& json) const;
+
+private:
+   std::vector<double> m_lats;
+   std::vector<double> m_lons;
+   double m_minLat;
+   double m_minLon;
+   double m_maxLat;
+   double m_maxLon;
+   double m_height;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,166 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "GcpCrossCovariance.h"
+#include <ossim/base/ossimException.h>
+#include <sstream>
+#include <unordered_set>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+GcpCrossCovariance::GcpCrossCovariance()
+:  m_table (make_shared<Table>())
+{
+}
+
+void GcpCrossCovariance::clear()
+{
+   m_table = make_shared<Table>();
+}
+
+std::string GcpCrossCovariance::pairKey(const std::string& gcpId1, const std::string& gcpId2,
+                                        bool& swapped)
+{
+   // IDs cannot contain a null, so it separates them unambiguously:
+   swapped = (gcpId2 < gcpId1);
+   const string& first = swapped ? gcpId2 : gcpId1;
+   const string& second = swapped ? gcpId1 : gcpId2;
+   string key;
+   key.reserve(first.size() + second.size() + 1);
+   key.append(first).append(1, '\0').append(second);
+   return key;
+}
+
+GcpCrossCovariance::Table& GcpCrossCovariance::writableTable()
+{
+   if (m_table.use_count() > 1)
+      m_table = make_shared<Table>(*m_table);
+   return *m_table;
+}
+
+void GcpCrossCovariance::set(const std::string& gcpId1, const std::string& gcpId2,
+                             const double* block)
+{
+   if (gcpId1 == gcpId2)
+   {
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": set() -- Cross-covariance given between GCP <"<<gcpId1<<"> and itself.";
+      throw ossimException(xmsg.str());
+   }
+
+   // Held in the pair's canonical order, transposing if given the other way around:
+   bool swapped;
+   string key = pairKey(gcpId1, gcpId2, swapped);
+   Block entry;
+   entry.gcpId1 = swapped ? gcpId2 : gcpId1;
+   entry.gcpId2 = swapped ? gcpId1 : gcpId2;
+   for (int r=0; r<3; ++r)
+   {
+      for (int c=0; c<3; ++c)
+         entry.block[3*r + c] = swapped ? block[3*c + r] : block[3*r + c];
+   }
+
+   Table& table = writableTable();
+   auto existing = table.index.emplace(key, table.blocks.size());
+   if (existing.second)
+      table.blocks.push_back(entry);
+   else
+      table.blocks[existing.first->second] = entry;
+}
+
+bool GcpCrossCovariance::find(const std::string& gcpId1, const std::string& gcpId2,
+                              double* block) const
+{
+   bool swapped;
+   auto entry = m_table->index.find(pairKey(gcpId1, gcpId2, swapped));
+   if (entry == m_table->index.end())
+      return false;
+
+   const double* stored = m_table->blocks[entry->second].block;
+   for (int r=0; r<3; ++r)
+   {
+      for (int c=0; c<3; ++c)
+         block[3*r + c] = swapped ? stored[3*c + r] : stored[3*r + c];
+   }
+   return true;
+}
+
+size_t GcpCrossCovariance::removePoints(const std::vector<std::string>& gcpIds)
+{
+   unordered_set<string> ids (gcpIds.begin(), gcpIds.end());
+   const vector<Block>& blocks = m_table->blocks;
+   size_t numRemoved = 0;
+   for (size_t i=0; i<blocks.size(); ++i)
+   {
+      if (ids.count(blocks[i].gcpId1) || ids.count(blocks[i].gcpId2))
+         ++numRemoved;
+   }
+   if (numRemoved == 0)
+      return 0;
+
+   // Compact and re-index:
+   shared_ptr<Table> table = make_shared<Table>();
+   table->blocks.reserve(blocks.size() - numRemoved);
+   for (size_t i=0; i<blocks.size(); ++i)
+   {
+      if (ids.count(blocks[i].gcpId1) || ids.count(blocks[i].gcpId2))
+         continue;
+      bool swapped;
+      table->index.emplace(pairKey(blocks[i].gcpId1, blocks[i].gcpId2, swapped),
+                           table->blocks.size());
+      table->blocks.push_back(blocks[i]);
+   }
+   m_table = table;
+   return numRemoved;
+}
+
+void GcpCrossCovariance::addFromJSON(const Json::Value& entry)
+{
+   const Json::Value& values = entry["crossCovariance"];
+   if (!entry.isMember("pointId1") || !entry.isMember("pointId2") || !values.isArray() ||
+       (values.size() != 9))
+   {
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": addFromJSON() -- Expected \"pointId1\", \"pointId2\" and a 9-element "
+            "\"crossCovariance\" array in gpCrossCovList entry.";
+      throw ossimException(xmsg.str());
+   }
+
+   double block[9];
+   for (unsigned int i=0; i<9; ++i)
+      block[i] = values[i].asDouble();
+   set(entry["pointId1"].asString(), entry["pointId2"].asString(), block);
+}
+
+void GcpCrossCovariance::loadJSON(const Json::Value& list)
+{
+   Table& table = writableTable();
+   table.blocks.reserve(table.blocks.size() + list.size());
+   table.index.reserve(table.blocks.size() + list.size());
+   for (unsigned int i=0; i<list.size(); ++i)
+      addFromJSON(list[i]);
+}
+
+void GcpCrossCovariance::saveJSON(Json::Value& list) const
+{
+   list = Json::Value(Json::arrayValue);
+   const vector<Block>& blocks = m_table->blocks;
+   for (size_t i=0; i<blocks.size(); ++i)
+   {
+      Json::Value& entry = list.append(Json::Value());
+      entry["pointId1"] = blocks[i].gcpId1;
+      entry["pointId2"] = blocks[i].gcpId2;
+      Json::Value& values = entry["crossCovariance"];
+      for (int k=0; k<9; ++k)
+         values.append(blocks[i].block[k]);
+   }
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,95 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef GcpCrossCovariance_HEADER
+#define GcpCrossCovariance_HEADER 1
+
+#include <ossim/base/JsonInterface.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Sparse store of the 3x3 cross-covariance blocks between pairs of ground control points, keyed
+ * by GCP ID pair. Only the non-zero blocks are held, so memory and loading time are proportional
+ * to the number given rather than to the square of the number of GCPs. The blocks of (a, b) and
+ * (b, a) are the same entry, the one transposed.
+ *
+ * Copies share the blocks until one of them is modified.
+ *
+ * The JSON form (the photoblock's "gpCrossCovList") is an array of
+ *
+ *    { "pointId1": gcpId, "pointId2": gcpId, "crossCovariance": [c11, c12, ..., c33] }
+ *
+ * with the block in row-major order, rows for pointId1 and columns for pointId2.
+ */
+class GcpCrossCovariance
+{
+public:
+   GcpCrossCovariance();
+
+   void clear();
+
+   size_t size() const { return m_table->blocks.size(); }
+   bool empty() const { return m_table->blocks.empty(); }
+
+   /**
+    * Sets the cross-covariance of the GCPs (row-major, rows for gcpId1), replacing any prior
+    * block for the pair. Throws ossimException if the IDs are the same.
+    */
+   void set(const std::string& gcpId1, const std::string& gcpId2, const double* block);
+
+   /** Copies the block for the pair into block (rows for gcpId1), returning false if none. */
+   bool find(const std::string& gcpId1, const std::string& gcpId2, double* block) const;
+
+   /** Drops the blocks involving any of the GCPs, returning the number dropped. */
+   size_t removePoints(const std::vector<std::string>& gcpIds);
+
+   /** Accessors for iterating over the blocks, i < size(). */
+   const std::string& getGcpId1(size_t i) const { return m_table->blocks[i].gcpId1; }
+   const std::string& getGcpId2(size_t i) const { return m_table->blocks[i].gcpId2; }
+   const double* getBlock(size_t i) const { return m_table->blocks[i].block; }
+
+   /** Adds one entry of a gpCrossCovList. Throws ossimException if malformed. */
+   void addFromJSON(const Json::Value& entry);
+
+   /** Adds the entries of a gpCrossCovList array. */
+   void loadJSON(const Json::Value& list);
+
+   /** Writes the blocks as a gpCrossCovList array. */
+   void saveJSON(Json::Value& list) const;
+
+private:
+   struct Block
+   {
+      std::string gcpId1;
+      std::string gcpId2;
+      double block[9];
+   };
+
+   struct Table
+   {
+      std::vector<Block> blocks;
+      std::unordered_map<std::string, size_t> index; // by pairKey()
+   };
+
+   /** Key for the unordered pair. Sets swapped if gcpId2 is the first of the pair. */
+   static std::string pairKey(const std::string& gcpId1, const std::string& gcpId2,
+                              bool& swapped);
+
+   /** Returns the table, first taking a private copy if shared. */
+   Table& writableTable();
+
+   std::shared_ptr<Table> m_table;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,474 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "JsonTokenReader.h"
+#include <ossim/base/ossimException.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+static const size_t BUFFER_SIZE = 65536;
+
+JsonTokenReader::JsonTokenReader(std::istream& in)
+:  m_in (in),
+   m_buffer (BUFFER_SIZE),
+   m_pos (0),
+   m_end (0),
+   m_line (1),
+   m_afterValue (false),
+   m_afterComma (false),
+   m_token (END_OF_INPUT),
+   m_peeked (false)
+{
+}
+
+const char* JsonTokenReader::tokenName(Token token)
+{
+   switch (token)
+   {
+   case BEGIN_OBJECT: return "'{'";
+   case END_OBJECT:   return "'}'";
+   case BEGIN_ARRAY:  return "'['";
+   case END_ARRAY:    return "']'";
+   case KEY:          return "member name";
+   case STRING:       return "string";
+   case NUMBER:       return "number";
+   case BOOLEAN:      return "boolean";
+   case NULL_VALUE:   return "null";
+   default:           return "end of input";
+   }
+}
+
+void JsonTokenReader::fail(const std::string& message) const
+{
+   ostringstream xmsg;
+   xmsg<<__FILE__<<": JSON syntax error at line "<<m_line<<": "<<message;
+   throw ossimException(xmsg.str());
+}
+
+int JsonTokenReader::peekChar()
+{
+   if (m_pos == m_end)
+   {
+      m_in.read(&m_buffer[0], m_buffer.size());
+      m_end = (size_t) m_in.gcount();
+      m_pos = 0;
+      if (m_end == 0)
+         return -1;
+   }
+   return (unsigned char) m_buffer[m_pos];
+}
+
+int JsonTokenReader::getChar()
+{
+   int c = peekChar();
+   if (c >= 0)
+   {
+      ++m_pos;
+      if (c == '\n')
+         ++m_line;
+   }
+   return c;
+}
+
+void JsonTokenReader::skipWhitespace()
+{
+   int c = peekChar();
+   while ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'))
+   {
+      getChar();
+      c = peekChar();
+   }
+}
+
+JsonTokenReader::Token JsonTokenReader::next()
+{
+   if (m_peeked)
+      m_peeked = false;
+   else
+      m_token = scan();
+   return m_token;
+}
+
+JsonTokenReader::Token JsonTokenReader::peek()
+{
+   if (!m_peeked)
+   {
+      m_token = scan();
+      m_peeked = true;
+   }
+   return m_token;
+}
+
+void JsonTokenReader::expect(Token token)
+{
+   Token actual = next();
+   if (actual != token)
+      fail(string("Expected ") + tokenName(token) + " but found " + tokenName(actual) + ".");
+}
+
+JsonTokenReader::Token JsonTokenReader::scan()
+{
+   skipWhitespace();
+   int c = peekChar();
+
+   if (m_stack.empty())
+   {
+      if (c < 0)
+         return END_OF_INPUT;
+      if (m_afterValue)
+         fail("Unexpected content after the top-level value.");
+      return scanValue(c);
+   }
+
+   if (c < 0)
+      fail("Unexpected end of input.");
+
+   // Close the current container:
+   Frame& frame = m_stack.back();
+   if ((c == frame.close) && !frame.afterKey && !m_afterComma)
+   {
+      getChar();
+      m_stack.pop_back();
+      m_afterValue = true;
+      return (c == '}') ? END_OBJECT : END_ARRAY;
+   }
+
+   // Member value following its key:
+   if (frame.afterKey)
+   {
+      if (c != ':')
+         fail("Expected ':' after member name.");
+      getChar();
+      skipWhitespace();
+      frame.afterKey = false;
+      return scanValue(peekChar());
+   }
+
+   // Separator between elements or members:
+   if (m_afterValue)
+   {
+      if (c != ',')
+         fail(string("Expected ',' or '") + frame.close + "'.");
+      getChar();
+      skipWhitespace();
+      c = peekChar();
+      m_afterValue = false;
+      m_afterComma = true;
+   }
+
+   if (frame.close == ']')
+      return scanValue(c);
+
+   if (c != '"')
+      fail("Expected member name.");
+   scanString();
+   frame.afterKey = true;
+   m_afterComma = false;
+   return KEY;
+}
+
+JsonTokenReader::Token JsonTokenReader::scanValue(int c)
+{
+   m_afterComma = false;
+   m_afterValue = true;
+   switch (c)
+   {
+   case '{':
+   case '[':
+   {
+      getChar();
+      Frame frame = { (c == '{') ? '}' : ']', false };
+      m_stack.push_back(frame);
+      m_afterValue = false;
+      return (c == '{') ? BEGIN_OBJECT : BEGIN_ARRAY;
+   }
+   case '"':
+      scanString();
+      return STRING;
+   case 't':
+      scanLiteral("true");
+      return BOOLEAN;
+   case 'f':
+      scanLiteral("false");
+      return BOOLEAN;
+   case 'n':
+      scanLiteral("null");
+      return NULL_VALUE;
+   default:
+      if ((c == '-') || ((c >= '0') && (c <= '9')))
+      {
+         scanNumber();
+         return NUMBER;
+      }
+   }
+   if (c < 0)
+      fail("Unexpected end of input.");
+   fail(string("Unexpected character '") + (char) c + "'.");
+   return END_OF_INPUT;
+}
+
+void JsonTokenReader::scanLiteral(const char* literal)
+{
+   for (const char* p=literal; *p; ++p)
+   {
+      if (getChar() != *p)
+         fail(string("Invalid literal, expected \"") + literal + "\".");
+   }
+   m_text = literal;
+}
+
+void JsonTokenReader::scanNumber()
+{
+   m_text.clear();
+   int c = peekChar();
+   while (((c >= '0') && (c <= '9')) || (c == '-') || (c == '+') || (c == '.') ||
+          (c == 'e') || (c == 'E'))
+   {
+      m_text.push_back((char) getChar());
+      c = peekChar();
+   }
+
+   char* end = 0;
+   strtod(m_text.c_str(), &end);
+   if (*end != '\0')
+      fail("Invalid number \"" + m_text + "\".");
+}
+
+double JsonTokenReader::getNumber() const
+{
+   return strtod(m_text.c_str(), 0);
+}
+
+void JsonTokenReader::appendUtf8(unsigned long codePoint)
+{
+   if (codePoint < 0x80)
+   {
+      m_text.push_back((char) codePoint);
+   }
+   else if (codePoint < 0x800)
+   {
+      m_text.push_back((char) (0xC0 | (codePoint >> 6)));
+      m_text.push_back((char) (0x80 | (codePoint & 0x3F)));
+   }
+   else if (codePoint < 0x10000)
+   {
+      m_text.push_back((char) (0xE0 | (codePoint >> 12)));
+      m_text.push_back((char) (0x80 | ((codePoint >> 6) & 0x3F)));
+      m_text.push_back((char) (0x80 | (codePoint & 0x3F)));
+   }
+   else
+   {
+      m_text.push_back((char) (0xF0 | (codePoint >> 18)));
+      m_text.push_back((char) (0x80 | ((codePoint >> 12) & 0x3F)));
+      m_text.push_back((char) (0x80 | ((codePoint >> 6) & 0x3F)));
+      m_text.push_back((char) (0x80 | (codePoint & 0x3F)));
+   }
+}
+
+void JsonTokenReader::scanString()
+{
+   getChar(); // opening quote
+   m_text.clear();
+   while (true)
+   {
+      // Copy runs of plain characters straight from the buffer:
+      size_t start = m_pos;
+      while ((m_pos < m_end) && (m_buffer[m_pos] != '"') && (m_buffer[m_pos] != '\\') &&
+             (m_buffer[m_pos] != '\n'))
+      {
+         ++m_pos;
+      }
+      m_text.append(&m_buffer[0] + start, m_pos - start);
+
+      int c = getChar();
+      if (c < 0)
+         fail("Unterminated string.");
+      if (c == '"')
+         return;
+      if (c != '\\')
+      {
+         m_text.push_back((char) c);
+         continue;
+      }
+
+      c = getChar();
+      switch (c)
+      {
+      case '"':  m_text.push_back('"'); break;
+      case '\\': m_text.push_back('\\'); break;
+      case '/':  m_text.push_back('/'); break;
+      case 'b':  m_text.push_back('\b'); break;
+      case 'f':  m_text.push_back('\f'); break;
+      case 'n':  m_text.push_back('\n'); break;
+      case 'r':  m_text.push_back('\r'); break;
+      case 't':  m_text.push_back('\t'); break;
+      case 'u':
+      {
+         unsigned long codePoint = 0;
+         for (int pair=0; pair<2; ++pair)
+         {
+            unsigned long unit = 0;
+            for (int i=0; i<4; ++i)
+            {
+               c = getChar();
+               unit <<= 4;
+               if ((c >= '0') && (c <= '9'))
+                  unit |= c - '0';
+               else if ((c >= 'a') && (c <= 'f'))
+                  unit |= c - 'a' + 10;
+               else if ((c >= 'A') && (c <= 'F'))
+                  unit |= c - 'A' + 10;
+               else
+                  fail("Invalid \\u escape.");
+            }
+            if (pair == 0)
+            {
+               codePoint = unit;
+               if ((unit < 0xD800) || (unit > 0xDBFF))
+                  break;
+
+               // High surrogate, must be followed by the low one:
+               if ((getChar() != '\\') || (getChar() != 'u'))
+                  fail("Unpaired UTF-16 surrogate.");
+            }
+            else
+            {
+               if ((unit < 0xDC00) || (unit > 0xDFFF))
+                  fail("Invalid UTF-16 surrogate pair.");
+               codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (unit - 0xDC00);
+            }
+         }
+         appendUtf8(codePoint);
+         break;
+      }
+      default:
+         fail("Invalid escape sequence.");
+      }
+   }
+}
+
+std::string JsonTokenReader::readScalarAsString()
+{
+   Token token = next();
+   switch (token)
+   {
+   case STRING:
+   case NUMBER:
+   case BOOLEAN:
+      return m_text;
+   case NULL_VALUE:
+      return string();
+   default:
+      fail(string("Expected a value but found ") + tokenName(token) + ".");
+   }
+   return string();
+}
+
+double JsonTokenReader::readNumber()
+{
+   expect(NUMBER);
+   return getNumber();
+}
+
+void JsonTokenReader::skipValue()
+{
+   size_t depth = 0;
+   do
+   {
+      switch (next())
+      {
+      case BEGIN_OBJECT:
+      case BEGIN_ARRAY:
+         ++depth;
+         break;
+      case END_OBJECT:
+      case END_ARRAY:
+         --depth;
+         break;
+      case KEY:
+         break;
+      case END_OF_INPUT:
+         fail("Unexpected end of input.");
+         break;
+      default:
+         break;
+      }
+   } while (depth > 0);
+}
+
+void JsonTokenReader::readValue(Json::Value& value)
+{
+   Token token = next();
+   if ((token == END_OBJECT) || (token == END_ARRAY) || (token == KEY) ||
+       (token == END_OF_INPUT))
+   {
+      fail(string("Expected a value but found ") + tokenName(token) + ".");
+   }
+   readCurrentValue(value);
+}
+
+void JsonTokenReader::readCurrentValue(Json::Value& value)
+{
+   switch (m_token)
+   {
+   case BEGIN_OBJECT:
+      value = Json::Value(Json::objectValue);
+      while (next() == KEY)
+      {
+         string key = m_text;
+         readValue(value[key]);
+      }
+      break;
+   case BEGIN_ARRAY:
+      value = Json::Value(Json::arrayValue);
+      while (peek() != END_ARRAY)
+         readValue(value.append(Json::Value()));
+      next();
+      break;
+   case STRING:
+      value = m_text;
+      break;
+   case NUMBER:
+      // Keep integers integral so that asInt() etc. behave as with the JsonCpp reader:
+      if (m_text.find_first_of(".eE") == string::npos)
+      {
+         errno = 0;
+         if (m_text[0] == '-')
+         {
+            long long i = strtoll(m_text.c_str(), 0, 10);
+            value = Json::Value((Json::Int64) i);
+         }
+         else
+         {
+            unsigned long long u = strtoull(m_text.c_str(), 0, 10);
+            value = (u <= (unsigned long long) Json::Value::maxInt64) ?
+                  Json::Value((Json::Int64) u) : Json::Value((Json::UInt64) u);
+         }
+         if (errno != ERANGE)
+            break;
+      }
+      value = getNumber();
+      break;
+   case BOOLEAN:
+      value = getBoolean();
+      break;
+   case NULL_VALUE:
+      value = Json::Value();
+      break;
+   default:
+      fail(string("Expected a value but found ") + tokenName(m_token) + ".");
+   }
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,133 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef JsonTokenReader_HEADER
+#define JsonTokenReader_HEADER 1
+
+#include <ossim/base/JsonInterface.h>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Pull parser reading JSON from a stream one token at a time through a fixed-size buffer, so that
+ * arbitrarily large documents can be consumed without building a DOM. Commas and colons are
+ * checked but not reported. Small subtrees can still be materialized with readValue().
+ *
+ * Typical use walking an object:
+ *
+ *    reader.expect(JsonTokenReader::BEGIN_OBJECT);
+ *    while (reader.next() == JsonTokenReader::KEY)
+ *    {
+ *       if (reader.getString() == "wanted")
+ *          ... read the value's tokens ...
+ *       else
+ *          reader.skipValue();
+ *    }
+ *
+ * Syntax errors throw ossimException giving the line number.
+ */
+class JsonTokenReader
+{
+public:
+   enum Token
+   {
+      BEGIN_OBJECT,
+      END_OBJECT,
+      BEGIN_ARRAY,
+      END_ARRAY,
+      KEY,
+      STRING,
+      NUMBER,
+      BOOLEAN,
+      NULL_VALUE,
+      END_OF_INPUT
+   };
+
+   JsonTokenReader(std::istream& in);
+
+   /** Advances to and returns the next token. */
+   Token next();
+
+   /** Returns the next token without consuming it. */
+   Token peek();
+
+   /** Advances to the next token, throwing if it is not the type expected. */
+   void expect(Token token);
+
+   /** Text of the current KEY or STRING token, or the literal text of a NUMBER. */
+   const std::string& getString() const { return m_text; }
+
+   /** Value of the current NUMBER token. */
+   double getNumber() const;
+
+   /** Value of the current BOOLEAN token. */
+   bool getBoolean() const { return m_text == "true"; }
+
+   /**
+    * Reads a string, number or boolean as text (null as empty), throwing for a container.
+    * For use with fields whose producers are loose about types (e.g., numeric IDs).
+    */
+   std::string readScalarAsString();
+
+   /** Reads a number, throwing if the next token is not a NUMBER. */
+   double readNumber();
+
+   /** Consumes the next value, including any nested content. */
+   void skipValue();
+
+   /** Reads the next value, including any nested content, into a DOM. */
+   void readValue(Json::Value& value);
+
+   /** Builds a DOM for the value that begins with the token just returned by next(). */
+   void readCurrentValue(Json::Value& value);
+
+   static const char* tokenName(Token token);
+
+private:
+   struct Frame
+   {
+      char close;     // '}' or ']'
+      bool afterKey;  // object member key read, value not yet
+   };
+
+   /** Returns the next character without consuming it, or -1 at the end of input. */
+   int peekChar();
+
+   int getChar();
+
+   void skipWhitespace();
+
+   Token scan();
+   Token scanValue(int c);
+   void scanString();
+   void scanNumber();
+   void scanLiteral(const char* literal);
+   void appendUtf8(unsigned long codePoint);
+
+   void fail(const std::string& message) const;
+
+   std::istream& m_in;
+   std::vector<char> m_buffer;
+   size_t m_pos;
+   size_t m_end;
+   size_t m_line;
+
+   std::vector<Frame> m_stack;
+   bool m_afterValue;
+   bool m_afterComma;
+
+   Token m_token;
+   bool m_peeked;
+   std::string m_text;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,98 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "LinearAlgebra.h"
+#include <cmath>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+bool LinearAlgebra::choleskyFactor(std::vector<double>& a, size_t n)
+{
+   for (size_t j=0; j<n; ++j)
+   {
+      double* rowJ = &a[j*n];
+      double d = rowJ[j];
+      for (size_t k=0; k<j; ++k)
+         d -= rowJ[k]*rowJ[k];
+      if (!(d > 0.0))
+         return false;
+      d = sqrt(d);
+      rowJ[j] = d;
+
+      for (size_t i=j+1; i<n; ++i)
+      {
+         double* rowI = &a[i*n];
+         double s = rowI[j];
+         for (size_t k=0; k<j; ++k)
+            s -= rowI[k]*rowJ[k];
+         rowI[j] = s / d;
+      }
+   }
+
+   // Clear the upper triangle so the factor can be used as a full matrix:
+   for (size_t i=0; i<n; ++i)
+   {
+      for (size_t j=i+1; j<n; ++j)
+         a[i*n+j] = 0.0;
+   }
+   return true;
+}
+
+void LinearAlgebra::choleskySolve(const std::vector<double>& l, size_t n, double* b)
+{
+   // Forward substitution, L*y = b:
+   for (size_t i=0; i<n; ++i)
+   {
+      const double* row = &l[i*n];
+      double s = b[i];
+      for (size_t k=0; k<i; ++k)
+         s -= row[k]*b[k];
+      b[i] = s / row[i];
+   }
+
+   // Back substitution, L^T*x = y:
+   for (size_t i=n; i-- > 0; )
+   {
+      double s = b[i];
+      for (size_t k=i+1; k<n; ++k)
+         s -= l[k*n+i]*b[k];
+      b[i] = s / l[i*n+i];
+   }
+}
+
+bool LinearAlgebra::solve(std::vector<double>& a, size_t n, std::vector<double>& b)
+{
+   if (!choleskyFactor(a, n))
+      return false;
+   choleskySolve(a, n, &b[0]);
+   return true;
+}
+
+bool LinearAlgebra::invert(std::vector<double>& a, size_t n)
+{
+   if (!choleskyFactor(a, n))
+      return false;
+
+   // Solve for each column of the identity:
+   vector<double> inverse (n*n, 0.0);
+   vector<double> column (n);
+   for (size_t j=0; j<n; ++j)
+   {
+      column.assign(n, 0.0);
+      column[j] = 1.0;
+      choleskySolve(a, n, &column[0]);
+      for (size_t i=0; i<n; ++i)
+         inverse[i*n+j] = column[i];
+   }
+   a.swap(inverse);
+   return true;
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,44 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef LinearAlgebra_HEADER
+#define LinearAlgebra_HEADER 1
+
+#include <cstddef>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Small dense symmetric positive-definite solvers used by the fitting and adjustment code. Matrices
+ * are n x n, stored row-major in contiguous vectors. Only the lower triangle of the input is read.
+ */
+class LinearAlgebra
+{
+public:
+   /**
+    * Replaces a with its Cholesky factor L (lower triangle, a = L*L^T). Returns false if a is not
+    * numerically positive-definite, leaving a partially factored.
+    */
+   static bool choleskyFactor(std::vector<double>& a, size_t n);
+
+   /** Solves L*L^T*x = b in place given the factor from choleskyFactor(). */
+   static void choleskySolve(const std::vector<double>& l, size_t n, double* b);
+
+   /** Factors a and solves a*x = b in place. Returns false if a is not positive-definite. */
+   static bool solve(std::vector<double>& a, size_t n, std::vector<double>& b);
+
+   /**
+    * Replaces a with its (full, symmetric) inverse. Returns false if a is not positive-definite,
+    * leaving a undefined.
+    */
+   static bool invert(std::vector<double>& a, size_t n);
+};
+
+} // End namespace ossimMsp
+
+#endif
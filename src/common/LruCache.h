@@ -0,0 +1,187 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef LruCache_HEADER
+#define LruCache_HEADER 1
+
+#include <ossim/base/ossimConstants.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <functional>
+
+namespace ossimMsp
+{
+
+/**
+ * Thread-safe, cost-bounded least-recently-used cache. Each entry carries a cost (an entry count
+ * of 1 by default, or a byte size) and the least recently used entries are evicted whenever the
+ * total cost exceeds the maximum. Values are copied in and out, so the value type is normally a
+ * shared_ptr to the cached object.
+ */
+template <class Key, class Value, class Hash = std::hash<Key> >
+class LruCache
+{
+public:
+   struct Statistics
+   {
+      Statistics() : hits (0), misses (0), evictions (0), entries (0), cost (0), maxCost (0) {}
+
+      ossim_uint64 hits;
+      ossim_uint64 misses;
+      ossim_uint64 evictions;
+      size_t entries;
+      size_t cost;
+      size_t maxCost;
+   };
+
+   LruCache(size_t maxCost) : m_maxCost (maxCost), m_totalCost (0) {}
+
+   /**
+    * Looks up the key, returning true and assigning value if found. A hit makes the entry the most
+    * recently used.
+    */
+   bool find(const Key& key, Value& value)
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      typename IndexType::iterator i = m_index.find(key);
+      if (i == m_index.end())
+      {
+         ++m_stats.misses;
+         return false;
+      }
+      ++m_stats.hits;
+      m_entries.splice(m_entries.begin(), m_entries, i->second);
+      value = i->second->value;
+      return true;
+   }
+
+   /**
+    * Adds (or replaces) the entry for key, then evicts least recently used entries until the total
+    * cost is within the maximum. An entry costing more than the maximum is not cached.
+    */
+   void insert(const Key& key, const Value& value, size_t cost=1)
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      typename IndexType::iterator i = m_index.find(key);
+      if (i != m_index.end())
+      {
+         m_totalCost -= i->second->cost;
+         m_entries.erase(i->second);
+         m_index.erase(i);
+      }
+      if (cost > m_maxCost)
+         return;
+
+      Entry entry;
+      entry.key = key;
+      entry.value = value;
+      entry.cost = cost;
+      m_entries.push_front(entry);
+      m_index[key] = m_entries.begin();
+      m_totalCost += cost;
+      evict();
+   }
+
+   /** Removes the entry for key if present. Returns true if an entry was removed. */
+   bool erase(const Key& key)
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      typename IndexType::iterator i = m_index.find(key);
+      if (i == m_index.end())
+         return false;
+      m_totalCost -= i->second->cost;
+      m_entries.erase(i->second);
+      m_index.erase(i);
+      return true;
+   }
+
+   /**
+    * Evicts least recently used entries referenced only by this cache, until stop() returns true
+    * or no such entries remain. Requires a shared_ptr value type.
+    */
+   void releaseUnreferenced(const std::function<bool()>& stop)
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      typename EntryList::iterator i = m_entries.end();
+      while ((i != m_entries.begin()) && !stop())
+      {
+         --i;
+         if (i->value.use_count() == 1)
+         {
+            m_totalCost -= i->cost;
+            m_index.erase(i->key);
+            i = m_entries.erase(i);
+            ++m_stats.evictions;
+         }
+      }
+   }
+
+   void clear()
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      m_entries.clear();
+      m_index.clear();
+      m_totalCost = 0;
+   }
+
+   void setMaxCost(size_t maxCost)
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      m_maxCost = maxCost;
+      evict();
+   }
+
+   size_t getMaxCost() const
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      return m_maxCost;
+   }
+
+   Statistics getStatistics() const
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      Statistics stats (m_stats);
+      stats.entries = m_entries.size();
+      stats.cost = m_totalCost;
+      stats.maxCost = m_maxCost;
+      return stats;
+   }
+
+private:
+   struct Entry
+   {
+      Key key;
+      Value value;
+      size_t cost;
+   };
+   typedef std::list<Entry> EntryList;
+   typedef std::unordered_map<Key, typename EntryList::iterator, Hash> IndexType;
+
+   /** Caller must hold the mutex. */
+   void evict()
+   {
+      while ((m_totalCost > m_maxCost) && !m_entries.empty())
+      {
+         Entry& lru = m_entries.back();
+         m_totalCost -= lru.cost;
+         m_index.erase(lru.key);
+         m_entries.pop_back();
+         ++m_stats.evictions;
+      }
+   }
+
+   EntryList m_entries; // most recently used at front
+   IndexType m_index;
+   size_t m_maxCost;
+   size_t m_totalCost;
+   Statistics m_stats;
+   mutable std::mutex m_mutex;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,92 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ossimMsp
+{
+
+MappedFile::MappedFile()
+:  m_data (0),
+   m_size (0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+   close();
+
+#if defined(_WIN32)
+   HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+   if (file == INVALID_HANDLE_VALUE)
+      return false;
+   LARGE_INTEGER fileSize;
+   if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0))
+   {
+      CloseHandle(file);
+      return false;
+   }
+   HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+   CloseHandle(file);
+   if (!mapping)
+      return false;
+   void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   CloseHandle(mapping); // The view keeps the mapping alive
+   if (!view)
+      return false;
+   m_size = (size_t) fileSize.QuadPart;
+#else
+   int fd = ::open(filename.c_str(), O_RDONLY);
+   if (fd < 0)
+      return false;
+   struct stat info;
+   if ((fstat(fd, &info) != 0) || (info.st_size == 0))
+   {
+      ::close(fd);
+      return false;
+   }
+   void* view = mmap(0, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   ::close(fd); // The mapping stays valid
+   if (view == MAP_FAILED)
+      return false;
+   m_size = (size_t) info.st_size;
+#endif
+
+   m_data = (const char*) view;
+   return true;
+}
+
+void MappedFile::close()
+{
+   if (m_data)
+   {
+#if defined(_WIN32)
+      UnmapViewOfFile((void*) m_data);
+#else
+      munmap((void*) m_data, m_size);
+#endif
+   }
+   m_data = 0;
+   m_size = 0;
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,41 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef MappedFile_HEADER
+#define MappedFile_HEADER 1
+
+#include <cstddef>
+#include <string>
+
+namespace ossimMsp
+{
+
+/** Read-only memory mapping of a whole file. The mapping is released by close() or destruction. */
+class MappedFile
+{
+public:
+   MappedFile();
+   ~MappedFile();
+
+   /** Maps the file, replacing any current mapping. Returns false if missing or empty. */
+   bool open(const std::string& filename);
+
+   void close();
+
+   const char* data() const { return m_data; }
+   size_t size() const { return m_size; }
+
+private:
+   MappedFile(const MappedFile&);
+   MappedFile& operator=(const MappedFile&);
+
+   const char* m_data;
+   size_t m_size;
+};
+
+} // End namespace ossimMsp
+
+#endif
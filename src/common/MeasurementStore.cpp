@@ -0,0 +1,202 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "MeasurementStore.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+MeasurementStore::MeasurementStore()
+:  m_size (0)
+{
+   clear();
+}
+
+void MeasurementStore::clear()
+{
+   m_chunks.clear();
+   m_size = 0;
+   m_points = make_shared<PointTable>();
+
+   // An empty store is trivially indexed:
+   shared_ptr<PointIndex> index = make_shared<PointIndex>();
+   index->start.assign(1, 0);
+   m_pointIndex = index;
+}
+
+unsigned int MeasurementStore::addPoint(const std::string& pointId)
+{
+   auto existing = m_points->index.find(pointId);
+   if (existing != m_points->index.end())
+      return existing->second;
+
+   // New point. Take a private copy of the table if it is shared with another store:
+   if (m_points.use_count() > 1)
+      m_points = make_shared<PointTable>(*m_points);
+   unsigned int point = (unsigned int) m_points->ids.size();
+   m_points->index.emplace(pointId, point);
+   m_points->ids.push_back(pointId);
+   m_pointIndex.reset();
+   return point;
+}
+
+int MeasurementStore::findPoint(const std::string& pointId) const
+{
+   auto entry = m_points->index.find(pointId);
+   return (entry == m_points->index.end()) ? -1 : (int) entry->second;
+}
+
+void MeasurementStore::reserve(size_t numMeasurements)
+{
+   m_chunks.reserve((numMeasurements + CHUNK_MASK) >> CHUNK_BITS);
+}
+
+MeasurementStore::Chunk& MeasurementStore::appendChunk()
+{
+   if (m_size == (m_chunks.size() << CHUNK_BITS))
+      m_chunks.push_back(make_shared<Chunk>());
+   else if (m_chunks.back().use_count() > 1)
+      m_chunks.back() = make_shared<Chunk>(*m_chunks.back());
+   return *m_chunks.back();
+}
+
+void MeasurementStore::add(unsigned int point, unsigned int image, double line, double sample,
+                           double varLine, double covLineSample, double varSample)
+{
+   Chunk& chunk = appendChunk();
+   chunk.point.push_back(point);
+   chunk.image.push_back(image);
+   chunk.line.push_back(line);
+   chunk.sample.push_back(sample);
+   chunk.covariance.push_back(varLine);
+   chunk.covariance.push_back(covLineSample);
+   chunk.covariance.push_back(varSample);
+   ++m_size;
+   m_pointIndex.reset();
+}
+
+void MeasurementStore::removeImage(unsigned int image)
+{
+   // Measurements on lower-numbered images are unchanged, so chunks holding only those are kept:
+   size_t firstChunk = 0;
+   while ((firstChunk < m_chunks.size()) &&
+          (*max_element(m_chunks[firstChunk]->image.begin(),
+                        m_chunks[firstChunk]->image.end()) < image))
+   {
+      ++firstChunk;
+   }
+
+   rewrite(firstChunk, [image](unsigned int& /* point */, unsigned int& measImage)
+   {
+      if (measImage == image)
+         return false;
+      if (measImage > image)
+         --measImage;
+      return true;
+   });
+}
+
+void MeasurementStore::removePoints(const std::vector<bool>& remove)
+{
+   // Renumber the surviving points:
+   const vector<string>& ids = m_points->ids;
+   shared_ptr<PointTable> points = make_shared<PointTable>();
+   vector<unsigned int> renumbered (ids.size());
+   unsigned int firstRemoved = (unsigned int) ids.size();
+   for (size_t p=0; p<ids.size(); ++p)
+   {
+      if (remove[p])
+      {
+         firstRemoved = min(firstRemoved, (unsigned int) p);
+         continue;
+      }
+      renumbered[p] = (unsigned int) points->ids.size();
+      points->index.emplace(ids[p], renumbered[p]);
+      points->ids.push_back(ids[p]);
+   }
+   if (firstRemoved == ids.size())
+      return;
+
+   size_t firstChunk = 0;
+   while ((firstChunk < m_chunks.size()) &&
+          (*max_element(m_chunks[firstChunk]->point.begin(),
+                        m_chunks[firstChunk]->point.end()) < firstRemoved))
+   {
+      ++firstChunk;
+   }
+
+   rewrite(firstChunk, [&remove, &renumbered](unsigned int& point, unsigned int& /* image */)
+   {
+      if (remove[point])
+         return false;
+      point = renumbered[point];
+      return true;
+   });
+   m_points = points;
+}
+
+void MeasurementStore::rewrite(
+   size_t firstChunk, const std::function<bool(unsigned int& point, unsigned int& image)>& keep)
+{
+   if (firstChunk >= m_chunks.size())
+      return;
+
+   vector< shared_ptr<Chunk> > oldChunks (m_chunks.begin() + firstChunk, m_chunks.end());
+   m_chunks.resize(firstChunk);
+   m_size = firstChunk << CHUNK_BITS;
+   for (const shared_ptr<Chunk>& source : oldChunks)
+   {
+      for (size_t i=0; i<source->point.size(); ++i)
+      {
+         unsigned int point = source->point[i];
+         unsigned int image = source->image[i];
+         if (!keep(point, image))
+            continue;
+         Chunk& chunk = appendChunk();
+         chunk.point.push_back(point);
+         chunk.image.push_back(image);
+         chunk.line.push_back(source->line[i]);
+         chunk.sample.push_back(source->sample[i]);
+         chunk.covariance.insert(chunk.covariance.end(), &source->covariance[3*i],
+                                 &source->covariance[3*i] + 3);
+         ++m_size;
+      }
+   }
+   m_pointIndex.reset();
+}
+
+void MeasurementStore::buildPointIndex()
+{
+   if (m_pointIndex)
+      return;
+
+   // Counting sort by point, stable so that measurement order within a point is kept:
+   shared_ptr<PointIndex> index = make_shared<PointIndex>();
+   size_t numPoints = m_points->ids.size();
+   index->start.assign(numPoints + 1, 0);
+   for (size_t m=0; m<m_size; ++m)
+      ++index->start[getPoint(m) + 1];
+   for (size_t p=0; p<numPoints; ++p)
+      index->start[p+1] += index->start[p];
+
+   vector<size_t> fill (index->start.begin(), index->start.end() - 1);
+   index->byPoint.resize(m_size);
+   for (size_t m=0; m<m_size; ++m)
+      index->byPoint[fill[getPoint(m)]++] = m;
+   m_pointIndex = index;
+}
+
+const size_t* MeasurementStore::getPointMeasurements(unsigned int point, size_t& count) const
+{
+   count = m_pointIndex->start[point+1] - m_pointIndex->start[point];
+   return m_pointIndex->byPoint.data() + m_pointIndex->start[point];
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,141 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef MeasurementStore_HEADER
+#define MeasurementStore_HEADER 1
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Contiguous store of the image point measurements of a photoblock, kept as parallel arrays
+ * (point index, image index, line, sample, packed covariance) so that marshalling the whole set
+ * is a linear scan. Points are numbered by the order their IDs were first added, images by their
+ * position in the photoblock's image list. An index of the measurements of each point is built
+ * on demand with buildPointIndex().
+ *
+ * Covariances are packed as { var(line), cov(line, sample), var(sample) }.
+ *
+ * The arrays are held in fixed-size chunks shared between copies of the store. Copying is cheap
+ * (a reference per chunk), and a chunk is only duplicated when one of the copies modifies it, so
+ * branched photoblocks share all but the measurements they change. Appends touch only the last
+ * chunk; removals rewrite the chunks from the first one affected.
+ */
+class MeasurementStore
+{
+public:
+   MeasurementStore();
+
+   void clear();
+
+   /** Returns the index of the point ID, adding it if new. */
+   unsigned int addPoint(const std::string& pointId);
+
+   /** Returns the index of the point ID, or -1 if not present. */
+   int findPoint(const std::string& pointId) const;
+
+   /** Appends a measurement of the point on the image. Invalidates the point index. */
+   void add(unsigned int point, unsigned int image, double line, double sample,
+            double varLine, double covLineSample, double varSample);
+
+   void reserve(size_t numMeasurements);
+
+   /**
+    * Drops the measurements on the image and renumbers higher image indices down by one, as for
+    * removal from the image list.
+    */
+   void removeImage(unsigned int image);
+
+   /**
+    * Drops the flagged points (remove has one flag per point) with their measurements. Remaining
+    * points are renumbered in order.
+    */
+   void removePoints(const std::vector<bool>& remove);
+
+   size_t size() const { return m_size; }
+   size_t getNumPoints() const { return m_points->ids.size(); }
+
+   const std::string& getPointId(unsigned int point) const { return m_points->ids[point]; }
+
+   unsigned int getPoint(size_t m) const { return chunk(m).point[m & CHUNK_MASK]; }
+   unsigned int getImage(size_t m) const { return chunk(m).image[m & CHUNK_MASK]; }
+   double getLine(size_t m) const { return chunk(m).line[m & CHUNK_MASK]; }
+   double getSample(size_t m) const { return chunk(m).sample[m & CHUNK_MASK]; }
+   const double* getCovariance(size_t m) const
+   { return &chunk(m).covariance[3*(m & CHUNK_MASK)]; }
+
+   /**
+    * Groups the measurements by point, keeping their order within each point. Needed before
+    * getPointMeasurements(), and not safe to call concurrently with it.
+    */
+   void buildPointIndex();
+
+   bool isPointIndexed() const { return (bool) m_pointIndex; }
+
+   /**
+    * Returns the measurement numbers of the point (count of them in count). Requires
+    * buildPointIndex() since the last add().
+    */
+   const size_t* getPointMeasurements(unsigned int point, size_t& count) const;
+
+private:
+   static const unsigned int CHUNK_BITS = 14;
+   static const size_t CHUNK_SIZE = (size_t) 1 << CHUNK_BITS;
+   static const size_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+   /** Up to CHUNK_SIZE consecutive measurements. All chunks but the last are full. */
+   struct Chunk
+   {
+      std::vector<unsigned int> point;
+      std::vector<unsigned int> image;
+      std::vector<double> line;
+      std::vector<double> sample;
+      std::vector<double> covariance;
+   };
+
+   struct PointTable
+   {
+      std::vector<std::string> ids;
+      std::unordered_map<std::string, unsigned int> index;
+   };
+
+   /** Measurement numbers ordered by point, with each point's range starting at start[point]. */
+   struct PointIndex
+   {
+      std::vector<size_t> byPoint;
+      std::vector<size_t> start;
+   };
+
+   const Chunk& chunk(size_t m) const { return *m_chunks[m >> CHUNK_BITS]; }
+
+   /** Returns the last chunk with room for another measurement, unshared. */
+   Chunk& appendChunk();
+
+   /**
+    * Rewrites the measurements from chunk firstChunk on, dropping those for which keep() returns
+    * false. keep() may renumber the point and image indices passed to it. Earlier chunks remain
+    * shared.
+    */
+   void rewrite(size_t firstChunk,
+                const std::function<bool(unsigned int& point, unsigned int& image)>& keep);
+
+   std::vector< std::shared_ptr<Chunk> > m_chunks;
+   size_t m_size;
+   std::shared_ptr<PointTable> m_points;
+
+   // Null when stale:
+   std::shared_ptr<const PointIndex> m_pointIndex;
+};
+
+} // End namespace ossimMsp
+
+#endif
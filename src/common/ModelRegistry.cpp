@@ -0,0 +1,115 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "ModelRegistry.h"
+#include <ossim/base/ossimPreferences.h>
+#include <ossim/base/ossimString.h>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+ModelRegistry* ModelRegistry::instance()
+{
+   // Never destroyed, since handles may still be released during static destruction:
+   static ModelRegistry* s_instance = new ModelRegistry;
+   return s_instance;
+}
+
+ModelRegistry::ModelRegistry()
+:  m_totalBytes (0),
+   m_maxBytes ((size_t) 2048*1024*1024)
+{
+   const char* value = ossimPreferences::instance()->findPreference("msp.model_memory.max_bytes");
+   if (value)
+      m_maxBytes = (size_t) ossimString(value).toInt64();
+}
+
+shared_ptr<csm::RasterGM> ModelRegistry::adopt(csm::Model* base, size_t bytes)
+{
+   csm::RasterGM* model = dynamic_cast<csm::RasterGM*>(base);
+   if (!model)
+   {
+      delete base;
+      return shared_ptr<csm::RasterGM>();
+   }
+
+   if (bytes == 0)
+      bytes = model->getModelState().size();
+
+   shared_ptr<csm::RasterGM> handle (model, [this](csm::RasterGM* p) { release(p); });
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      Record& record = m_models[model];
+      record.handle = handle;
+      record.bytes = bytes;
+   }
+   m_totalBytes += bytes;
+
+   if (isOverLimit())
+      enforceLimit();
+
+   return handle;
+}
+
+shared_ptr<const csm::RasterGM> ModelRegistry::find(const csm::RasterGM* model)
+{
+   std::lock_guard<std::mutex> lock (m_mutex);
+   auto i = m_models.find(model);
+   if (i == m_models.end())
+      return shared_ptr<const csm::RasterGM>();
+   return i->second.handle.lock();
+}
+
+void ModelRegistry::addReleaser(const Releaser& releaser)
+{
+   std::lock_guard<std::mutex> lock (m_mutex);
+   m_releasers.push_back(releaser);
+}
+
+size_t ModelRegistry::getNumModels() const
+{
+   std::lock_guard<std::mutex> lock (m_mutex);
+   return m_models.size();
+}
+
+void ModelRegistry::setMaxBytes(size_t maxBytes)
+{
+   m_maxBytes = maxBytes;
+   if (isOverLimit())
+      enforceLimit();
+}
+
+void ModelRegistry::release(csm::RasterGM* model)
+{
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      auto i = m_models.find(model);
+      if (i != m_models.end())
+      {
+         m_totalBytes -= i->second.bytes;
+         m_models.erase(i);
+      }
+   }
+   delete model;
+}
+
+void ModelRegistry::enforceLimit()
+{
+   // Releasers lock their caches, whose evictions call back into release(), so they must be
+   // invoked without holding the registry mutex:
+   vector<Releaser> releasers;
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      releasers = m_releasers;
+   }
+   for (size_t i=0; (i<releasers.size()) && isOverLimit(); ++i)
+      releasers[i]();
+}
+
+} // end namespace ossimMsp
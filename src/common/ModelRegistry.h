@@ -0,0 +1,86 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef ModelRegistry_HEADER
+#define ModelRegistry_HEADER 1
+
+#include <csm/RasterGM.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Central owner of all CSM sensor models instantiated by the plugin. Models are handed out as
+ * reference-counted handles and deleted when the last handle is released. The registry tracks the
+ * approximate memory held by each live model (estimated by its model state size) and enforces a
+ * ceiling, set by the "msp.model_memory.max_bytes" preference (default 2 GB), by asking the model
+ * caches to release models that nobody else references.
+ */
+class ModelRegistry
+{
+public:
+   /** Releases unreferenced models until the registry is within its ceiling. */
+   typedef std::function<void()> Releaser;
+
+   static ModelRegistry* instance();
+
+   /**
+    * Takes ownership of a model returned by MSP and returns its handle. Returns null (and deletes
+    * the model) if it is not a raster model. The model's size in bytes is estimated from its state
+    * if not provided.
+    */
+   std::shared_ptr<csm::RasterGM> adopt(csm::Model* model, size_t bytes=0);
+
+   /**
+    * Returns the handle of a live model owned by the registry, or null if the model is not
+    * managed here. The handle is read-only, as the model may be shared (e.g. by a cache).
+    */
+   std::shared_ptr<const csm::RasterGM> find(const csm::RasterGM* model);
+
+   /**
+    * Registers a function called when the ceiling is exceeded. Caches register one that drops
+    * their unreferenced entries.
+    */
+   void addReleaser(const Releaser& releaser);
+
+   size_t getTotalBytes() const { return m_totalBytes; }
+
+   size_t getNumModels() const;
+
+   size_t getMaxBytes() const { return m_maxBytes; }
+
+   void setMaxBytes(size_t maxBytes);
+
+   bool isOverLimit() const { return m_totalBytes > m_maxBytes; }
+
+private:
+   ModelRegistry();
+
+   struct Record
+   {
+      std::weak_ptr<csm::RasterGM> handle;
+      size_t bytes;
+   };
+
+   void release(csm::RasterGM* model);
+   void enforceLimit();
+
+   mutable std::mutex m_mutex;
+   std::unordered_map<const csm::RasterGM*, Record> m_models;
+   std::vector<Releaser> m_releasers;
+   std::atomic<size_t> m_totalBytes;
+   std::atomic<size_t> m_maxBytes;
+};
+
+} // End namespace ossimMsp
+
+#endif
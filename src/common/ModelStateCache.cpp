@@ -0,0 +1,80 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "ModelStateCache.h"
+#include "ModelRegistry.h"
+#include "SensorModelServicePool.h"
+#include <ossim/base/ossimPreferences.h>
+#include <ossim/base/ossimString.h>
+#include <SensorModel/SensorModelService.h>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+ModelStateCache* ModelStateCache::instance()
+{
+   // Never destroyed, since it is registered with the model registry:
+   static ModelStateCache* s_instance = new ModelStateCache;
+   return s_instance;
+}
+
+ModelStateCache::ModelStateCache()
+:  m_cache (256*1024*1024)
+{
+   const char* value = ossimPreferences::instance()->findPreference("msp.state_cache.max_bytes");
+   if (value)
+      m_cache.setMaxCost((size_t) ossimString(value).toInt64());
+
+   // Give up cached models nobody is using when the plugin's model memory ceiling is exceeded:
+   ModelRegistry::instance()->addReleaser([this]()
+   {
+      m_cache.releaseUnreferenced([]() { return !ModelRegistry::instance()->isOverLimit(); });
+   });
+}
+
+ossim_uint64 ModelStateCache::hashState(const std::string& modelState)
+{
+   ossim_uint64 h = 14695981039346656037ULL;
+   const char* p = modelState.data();
+   const char* end = p + modelState.size();
+   for (; p != end; ++p)
+   {
+      h ^= (unsigned char) *p;
+      h *= 1099511628211ULL;
+   }
+   return h;
+}
+
+shared_ptr<const csm::RasterGM> ModelStateCache::getModel(const std::string& modelState,
+                                                          const std::string& modelName)
+{
+   // Keyed by the whole state rather than a digest of it, since a collision would silently hand
+   // out another image's model:
+   string key;
+   key.reserve(modelName.size() + 1 + modelState.size());
+   key.append(modelName).append(1, '\n').append(modelState);
+
+   shared_ptr<const csm::RasterGM> model;
+   if (m_cache.find(key, model))
+      return model;
+
+   model = createModel(modelState);
+   if (model)
+      m_cache.insert(key, model, modelState.size());
+   return model;
+}
+
+shared_ptr<csm::RasterGM> ModelStateCache::createModel(const std::string& modelState)
+{
+   shared_ptr<MSP::SMS::SensorModelService> sms = SensorModelServicePool::instance()->checkout();
+   return ModelRegistry::instance()->adopt(sms->createModelFromState(modelState.c_str()),
+                                           modelState.size());
+}
+
+} // end namespace ossimMsp
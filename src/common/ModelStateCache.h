@@ -0,0 +1,68 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef ModelStateCache_HEADER
+#define ModelStateCache_HEADER 1
+
+#include <common/LruCache.h>
+#include <csm/RasterGM.h>
+#include <memory>
+#include <string>
+
+namespace ossimMsp
+{
+
+/**
+ * Process-wide, content-addressed cache of CSM sensor models deserialized from model state
+ * strings. Entries are keyed by the state itself (and the model name), so repeated requests
+ * carrying the same state share one instance instead of re-parsing it. The cache is bounded by the
+ * total size of the cached states, taken as a proxy for the memory held by the models, and set by
+ * the "msp.state_cache.max_bytes" preference (default 256 MB).
+ *
+ * Cached models are shared, so are handed out read-only: a model modified in place would no
+ * longer match the state it is keyed by. Callers needing to modify a model use createModel().
+ * Models are owned through the ModelRegistry.
+ */
+class ModelStateCache
+{
+public:
+   typedef LruCache<std::string, std::shared_ptr<const csm::RasterGM> >::Statistics Statistics;
+
+   static ModelStateCache* instance();
+
+   /**
+    * Returns the model corresponding to the state, instantiating it via MSP and caching it if not
+    * already present. Returns null if the state does not represent a raster model. MSP exceptions
+    * are passed through.
+    */
+   std::shared_ptr<const csm::RasterGM> getModel(const std::string& modelState,
+                                                 const std::string& modelName="");
+
+   /**
+    * Returns a new, private (uncached) model instantiated from the state, for callers that need to
+    * modify it or use it concurrently with other instances. Returns null if the state does not
+    * represent a raster model. MSP exceptions are passed through.
+    */
+   std::shared_ptr<csm::RasterGM> createModel(const std::string& modelState);
+
+   void setMaxBytes(size_t maxBytes) { m_cache.setMaxCost(maxBytes); }
+
+   void clear() { m_cache.clear(); }
+
+   Statistics getStatistics() const { return m_cache.getStatistics(); }
+
+   /** 64-bit FNV-1a hash of the string, stable across builds and platforms. */
+   static ossim_uint64 hashState(const std::string& modelState);
+
+private:
+   ModelStateCache();
+
+   LruCache<std::string, std::shared_ptr<const csm::RasterGM> > m_cache;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -6,9 +6,20 @@
 //**************************************************************************************************
 
 #include "MspImage.h"
+#include "AvailableModelsCache.h"
+#include "FileIdentity.h"
+#include "LruCache.h"
+#include "ModelRegistry.h"
+#include "NitfIsdReader.h"
+#include "SensorModelCache.h"
+#include "ModelStateCache.h"
+#include "ThreadPool.h"
+#include "SensorModelServicePool.h"
 
 #include <ossim/base/ossimException.h>
+#include <ossim/base/ossimPreferences.h>
 #include <ossim/base/ossimString.h>
+#include <mutex>
 
 #include <SensorModel/SensorModelService.h>
 #include <SupportData/SupportDataService.h>
@@ -26,14 +37,18 @@ MspImage::MspImage(const std::string& imageId,
              unsigned int entryIndex,
              unsigned int band)
 :  Image(imageId, filename, modelName, entryIndex, band),
-   m_csmModel (0)
+   m_csmModel (),
+   m_stateEncoding (PayloadCodec::PLAIN),
+   m_modelFromFile (false)
 {
 
 }
 
 MspImage::MspImage(const Json::Value& json_node)
 :  Image(json_node),
-   m_csmModel (0)
+   m_csmModel (),
+   m_stateEncoding (PayloadCodec::PLAIN),
+   m_modelFromFile (false)
 {
    loadJSON(json_node);
 }
@@ -45,11 +60,20 @@ MspImage::~MspImage()
 
 void MspImage::getAvailableModels(std::vector< pair<string, string> >& availableModels) const
 {
+   // The probe opens the file once per plugin, so check for a prior result first:
+   FileIdentity fileId;
+   bool cacheable = fileId.read(m_filename.string());
+   AvailableModelsCache* cache = AvailableModelsCache::instance();
+   if (cacheable && cache->find(fileId, m_entryIndex, availableModels))
+      return;
+
    // Fetch models from MSP:
    csm::Isd isd (m_filename); // TODO: Note entry index ignored here
-   MSP::SMS::SensorModelService sms;
-   sms.setPluginPreferencesRigorousBeforeRpc();
-   availableModels = sms.getAllSupportedModels(isd);
+   shared_ptr<MSP::SMS::SensorModelService> sms = SensorModelServicePool::instance()->checkout();
+   availableModels = sms->getAllSupportedModels(isd);
+
+   if (cacheable)
+      cache->add(fileId, m_entryIndex, availableModels);
 }
 
 void MspImage::loadJSON(const Json::Value& json_node)
@@ -82,43 +106,24 @@ void MspImage::loadJSON(const Json::Value& json_node)
       }
    }
 
-   // Establish the sensor model. This also sets the official image ID, which will be overwritten
-   // if JSON field provided
-   string modelState = json_node["modelState"].asString();
-   if (modelState.empty())
-      modelState = json_node["stateData"].asString();
-   string isdData = json_node["imageSupportData"].asString();
-   if (modelState.size())
-   {
-      MSP::SMS::SensorModelService sms;
-      csm::Model* base = sms.createModelFromState(modelState.c_str());
-      m_csmModel = dynamic_cast<csm::RasterGM*>(base);
-      string id = m_csmModel->getImageIdentifier();
-      if (id.compare("UNKNOWN"))
-         m_imageId = id;
-      else
-         m_csmModel->setImageIdentifier(m_imageId);
-   }
-   else if (isdData.size())
-   {
-      csm::BytestreamIsd isd (isdData);
-      MSP::SMS::SensorModelService sms;
-      csm::Model* base = sms.createModelFromISD(isd, m_modelName.c_str());
-      m_csmModel = dynamic_cast<csm::RasterGM*>(base);
-      string id = m_csmModel->getImageIdentifier();
-      if (id.compare("UNKNOWN"))
-         m_imageId = id;
-      else
-         m_csmModel->setImageIdentifier(m_imageId);
-   }
-   else
-   {
-      // Rely on image file for geometry info:
+   // Keep the model payload for instantiating the sensor model on first access. Models are only
+   // built now if the image ID is not provided and must come from the model:
+   m_csmModel.reset();
+   // Either payload may be a plain string or an encoded object (see PayloadCodec):
+   PayloadCodec::decode(json_node["modelState"], m_modelState);
+   if (m_modelState.empty())
+      PayloadCodec::decode(json_node["stateData"], m_modelState);
+   PayloadCodec::decode(json_node["imageSupportData"], m_isdData);
+   if (m_imageId.empty())
       getCsmSensorModel();
-   }
 }
 
 void MspImage::saveJSON(Json::Value& json_node) const
+{
+   saveJSON(json_node, m_stateEncoding);
+}
+
+void MspImage::saveJSON(Json::Value& json_node, PayloadCodec::Encoding encoding) const
 {
    json_node.clear();
    json_node["imageId"] = m_imageId;
@@ -131,29 +136,86 @@ void MspImage::saveJSON(Json::Value& json_node) const
    if (m_csmModel)
    {
       string state = m_csmModel->getModelState();
-      json_node["modelState"] = state;
+      PayloadCodec::encode(state, encoding, json_node["modelState"]);
+   }
+   else if (m_modelState.size())
+   {
+      // Model never needed, so pass the state through as received:
+      PayloadCodec::encode(m_modelState, encoding, json_node["modelState"]);
+   }
+   else if (m_isdData.size())
+   {
+      // ISDs are binary NITF headers and not safe as plain JSON strings:
+      PayloadCodec::Encoding isdEncoding = encoding;
+      if (isdEncoding == PayloadCodec::PLAIN)
+         isdEncoding = PayloadCodec::BASE64;
+      PayloadCodec::encode(m_isdData, isdEncoding, json_node["imageSupportData"]);
    }
 }
 
+std::string MspImage::getModelState() const
+{
+   if (m_csmModel)
+      return m_csmModel->getModelState();
+   return m_modelState;
+}
+
+void MspImage::setModelState(const std::string& state)
+{
+   m_csmModel.reset();
+   m_approximation.reset();
+   m_footprint.reset();
+   m_modelFromFile = false;
+   m_modelState = state;
+   m_isdData.clear();
+}
+
+void MspImage::setImageSupportData(const std::string& isd)
+{
+   m_csmModel.reset();
+   m_approximation.reset();
+   m_footprint.reset();
+   m_modelFromFile = false;
+   m_modelState.clear();
+   m_isdData = isd;
+}
+
+void MspImage::getISD(std::string& isd, const std::string& filename, unsigned int entryIndex)
+{
+   NitfIsdReader::getIsd(filename, entryIndex, isd);
+}
+
 void MspImage::setCsmSensorModel(const csm::RasterGM* model)
 {
    ostringstream xmsg;
-   xmsg<<__FILE__<<": getCsmSensorModel() -- ";
+   xmsg<<__FILE__<<": setCsmSensorModel() -- ";
+
+   if (!model)
+   {
+      xmsg<<"Null model provided.";
+      throw ossimException(xmsg.str());
+   }
+
+   // Nothing to do if it is the model already assigned:
+   if (model == m_csmModel.get())
+   {
+      m_modelName = model->getModelName();
+      return;
+   }
 
    try
    {
-      MSP::SMS::SensorModelService sms;
-      csm::Model* base = sms.createModelFromState(model->getModelState().c_str());
-      m_csmModel = dynamic_cast<csm::RasterGM*>(base);
-      if (m_csmModel)
+      // No state round trip needed if the model is already owned by the plugin. Otherwise the
+      // caller retains ownership and a copy is needed:
+      shared_ptr<const csm::RasterGM> shared = ModelRegistry::instance()->find(model);
+      if (!shared)
       {
-         // Fetch the ID according to CSM, checking for "UNKNOWN":
-         string id = m_csmModel->getImageIdentifier();
-         if (id.compare("UNKNOWN"))
-            m_imageId = id;
-         else
-            m_csmModel->setImageIdentifier(m_imageId);
+         shared = ModelStateCache::instance()->getModel(model->getModelState(),
+                                                        model->getModelName());
       }
+      adoptModel(shared, true);
+      m_modelState.clear();
+      m_isdData.clear();
    }
    catch (exception& e)
    {
@@ -171,27 +233,52 @@ const csm::RasterGM*  MspImage::getCsmSensorModel()
 
    // May already be instantiated:
    if (m_csmModel)
-      return m_csmModel;
+      return m_csmModel.get();
 
    try
    {
-      MSP::SMS::SensorModelService sms;
-      const char* modelName = 0;
-      if (m_modelName.size())
-         modelName = m_modelName.c_str();
-      MSP::ImageIdentifier entry ("IMAGE_INDEX", ossimString::toString(m_entryIndex).string());
-      sms.setPluginPreferencesRigorousBeforeRpc();
-      csm::Model* base = sms.createModelFromFile(m_filename.c_str(), modelName, &entry);
-      m_csmModel = dynamic_cast<csm::RasterGM*>(base);
+      if (m_modelState.size())
+      {
+         // Identical states are frequently resent, so share previously deserialized instances:
+         adoptModel(ModelStateCache::instance()->getModel(m_modelState, m_modelName), true);
+         if (m_csmModel)
+            m_modelState.clear();
+         return m_csmModel.get();
+      }
+
+      if (m_isdData.size())
+      {
+         csm::BytestreamIsd isd (m_isdData);
+         shared_ptr<MSP::SMS::SensorModelService> sms =
+               SensorModelServicePool::instance()->checkout();
+         csm::Model* base = sms->createModelFromISD(isd, m_modelName.c_str());
+         adoptModel(ModelRegistry::instance()->adopt(base), false);
+         if (m_csmModel)
+            m_isdData.clear();
+         return m_csmModel.get();
+      }
 
-      if (m_csmModel)
+      // Rely on image file for geometry info. Parsing the image file is expensive, so check for a
+      // model previously instantiated from the same file:
+      SensorModelCache* cache = SensorModelCache::instance();
+      shared_ptr<const csm::RasterGM> model = cache->findModel(m_filename.string(), m_entryIndex,
+                                                               m_modelName);
+      if (!model)
+      {
+         shared_ptr<MSP::SMS::SensorModelService> sms =
+               SensorModelServicePool::instance()->checkout();
+         const char* modelName = 0;
+         if (m_modelName.size())
+            modelName = m_modelName.c_str();
+         MSP::ImageIdentifier entry ("IMAGE_INDEX", ossimString::toString(m_entryIndex).string());
+         csm::Model* base = sms->createModelFromFile(m_filename.c_str(), modelName, &entry);
+         model = ModelRegistry::instance()->adopt(base);
+         cache->addModel(m_filename.string(), m_entryIndex, m_modelName, model);
+      }
+      if (model)
       {
-         // Fetch the ID according to CSM, checking for "UNKNOWN":
-         string id = m_csmModel->getImageIdentifier();
-         if (id.compare("UNKNOWN"))
-            m_imageId = id;
-         else
-            m_csmModel->setImageIdentifier(m_imageId);
+         adoptModel(model, true);
+         m_modelFromFile = true;
       }
    }
    catch (exception& e)
@@ -199,7 +286,243 @@ const csm::RasterGM*  MspImage::getCsmSensorModel()
       xmsg<<"Caught exception: "<<e.what();
       throw ossimException(xmsg.str());
    }
-   return m_csmModel;
+   return m_csmModel.get();
+}
+
+bool MspImage::hasCsmSensorModel() const
+{
+   return (bool) m_csmModel;
+}
+
+std::shared_ptr<csm::RasterGM> MspImage::cloneCsmSensorModel()
+{
+   shared_ptr<csm::RasterGM> clone;
+   if (!getCsmSensorModel())
+      return clone;
+
+   try
+   {
+      clone = ModelStateCache::instance()->createModel(m_csmModel->getModelState());
+   }
+   catch (exception& e)
+   {
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": cloneCsmSensorModel() -- Caught exception: "<<e.what();
+      throw ossimException(xmsg.str());
+   }
+   return clone;
+}
+
+std::shared_ptr<const ProjectionApproximation> MspImage::getProjectionApproximation(
+      double tolerance, double minHeight, double maxHeight)
+{
+   shared_ptr<const ProjectionApproximation> approximation;
+   if (!getCsmSensorModel())
+      return approximation;
+
+   if (!m_approximation || (m_approximation->getMinHeight() != minHeight) ||
+       (m_approximation->getMaxHeight() != maxHeight))
+   {
+      // The model instance may be shared through the model cache, and CSM models need not be
+      // thread-safe, so the fit evaluates a private copy:
+      shared_ptr<csm::RasterGM> model = cloneCsmSensorModel();
+      m_approximation = ProjectionApproximation::create(*model, minHeight, maxHeight);
+   }
+   if (m_approximation && (m_approximation->getMaxError() <= tolerance))
+      approximation = m_approximation;
+   return approximation;
+}
+
+typedef LruCache< string, shared_ptr<const Footprint> > FootprintCache;
+
+// Approximate memory of a cached footprint apart from its key:
+static const size_t FOOTPRINT_COST = 1024;
+
+static FootprintCache* footprintCache()
+{
+   static FootprintCache* s_cache = 0;
+   static std::once_flag s_once;
+   std::call_once(s_once, []()
+   {
+      size_t maxBytes = 64*1024*1024;
+      const char* value = ossimPreferences::instance()->findPreference(
+            "msp.footprint_cache.max_bytes");
+      if (value)
+         maxBytes = (size_t) ossimString(value).toInt64();
+      s_cache = new FootprintCache(maxBytes);
+   });
+   return s_cache;
+}
+
+std::string MspImage::footprintKey(double height) const
+{
+   // The geometry comes from the first of these the image has. Payloads are part of the key
+   // whole, so that a match is exact:
+   ostringstream key;
+   key<<m_modelName<<'\n'<<height<<'\n';
+   if (m_modelState.size())
+      key<<"state\n"<<m_modelState;
+   else if (m_isdData.size())
+      key<<"isd\n"<<m_isdData;
+   else if (m_csmModel && !m_modelFromFile)
+      key<<"state\n"<<m_csmModel->getModelState();
+   else
+   {
+      FileIdentity fileId;
+      if (!fileId.read(m_filename.string()))
+         return string();
+      key<<"file\n"<<fileId.path<<'\n'<<fileId.size<<'\n'<<fileId.mtime<<'\n'<<m_entryIndex;
+   }
+   return key.str();
+}
+
+std::shared_ptr<const Footprint> MspImage::findFootprint(double height)
+{
+   if (m_footprint && (m_footprint->getHeight() == height))
+      return m_footprint;
+
+   string key = footprintKey(height);
+   shared_ptr<const Footprint> footprint;
+   if (!key.empty() && footprintCache()->find(key, footprint))
+      m_footprint = footprint;
+   return footprint;
+}
+
+std::shared_ptr<const Footprint> MspImage::getFootprint(double height)
+{
+   shared_ptr<const Footprint> footprint = findFootprint(height);
+   if (footprint)
+      return footprint;
+
+   // Key taken before instantiating the model, which consumes the payloads:
+   string key = footprintKey(height);
+   if (!getCsmSensorModel())
+   {
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": getFootprint() -- No sensor model for image <"<<m_imageId<<">.";
+      throw ossimException(xmsg.str());
+   }
+   // As for the approximation, project with a private copy of the possibly shared model:
+   shared_ptr<csm::RasterGM> model = cloneCsmSensorModel();
+   footprint = Footprint::create(*model, height);
+   if (!key.empty())
+      footprintCache()->insert(key, footprint, key.size() + FOOTPRINT_COST);
+   m_footprint = footprint;
+   return footprint;
+}
+
+void MspImage::getFootprints(const std::vector< std::shared_ptr<MspImage> >& images,
+                             double height,
+                             std::vector< std::shared_ptr<const Footprint> >& footprints,
+                             std::vector<std::string>& errors,
+                             unsigned int numThreads)
+{
+   footprints.clear();
+   footprints.resize(images.size());
+   errors.clear();
+   errors.resize(images.size());
+
+   // Models are only needed for footprints not cached:
+   vector< shared_ptr<MspImage> > uncached;
+   vector<size_t> positions;
+   for (size_t i=0; i<images.size(); ++i)
+   {
+      if (!images[i])
+         errors[i] = "Null image.";
+      else if (!(footprints[i] = images[i]->findFootprint(height)))
+      {
+         uncached.push_back(images[i]);
+         positions.push_back(i);
+      }
+   }
+   if (uncached.empty())
+      return;
+
+   vector<string> modelErrors;
+   createCsmSensorModels(uncached, modelErrors, numThreads);
+
+   // Each projection uses a private model copy, but an image may be listed more than once and
+   // getFootprint() updates it, so the projections themselves are done serially:
+   for (size_t u=0; u<uncached.size(); ++u)
+   {
+      size_t i = positions[u];
+      if (!modelErrors[u].empty())
+      {
+         errors[i] = modelErrors[u];
+         continue;
+      }
+      try
+      {
+         footprints[i] = uncached[u]->getFootprint(height);
+      }
+      catch (exception& e)
+      {
+         errors[i] = e.what();
+      }
+   }
+}
+
+unsigned int MspImage::createCsmSensorModels(const std::vector< std::shared_ptr<MspImage> >& images,
+                                             std::vector<std::string>& errors,
+                                             unsigned int numThreads)
+{
+   errors.clear();
+   errors.resize(images.size());
+
+   ThreadPool::instance()->parallelFor(images.size(), [&images, &errors](size_t i)
+   {
+      try
+      {
+         if (!images[i])
+            errors[i] = "Null image.";
+         else if (!images[i]->getCsmSensorModel())
+            errors[i] = "No sensor model could be instantiated.";
+      }
+      catch (exception& e)
+      {
+         errors[i] = e.what();
+      }
+   }, numThreads);
+
+   unsigned int numErrors = 0;
+   for (size_t i=0; i<errors.size(); ++i)
+   {
+      if (!errors[i].empty())
+         ++numErrors;
+   }
+   return numErrors;
+}
+
+void MspImage::adoptModel(shared_ptr<const csm::RasterGM> model, bool shared)
+{
+   m_approximation.reset();
+   m_footprint.reset();
+   m_modelFromFile = false;
+   if (!model)
+   {
+      m_csmModel.reset();
+      return;
+   }
+
+   // Fetch the ID according to CSM, checking for "UNKNOWN":
+   string id = model->getImageIdentifier();
+   if (id.compare("UNKNOWN"))
+   {
+      m_imageId = id;
+   }
+   else
+   {
+      // Need to assign this image's ID to the model, but must not touch a shared instance:
+      shared_ptr<csm::RasterGM> writable;
+      if (shared)
+         writable = ModelStateCache::instance()->createModel(model->getModelState());
+      else
+         writable = const_pointer_cast<csm::RasterGM>(model);
+      if (writable)
+         writable->setImageIdentifier(m_imageId);
+      model = writable;
+   }
+   m_csmModel = model;
 }
 
 } // end namespace ossimMsp
@@ -11,6 +11,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 #include <ossim/base/ossimGpt.h>
 #include <ossim/base/ossimConstants.h>
 #include <ossim/base/ossimFilename.h>
@@ -18,6 +19,9 @@
 #include <ossim/base/JsonInterface.h>
 #include <ossim/reg/Image.h>
 #include <csm/RasterGM.h>
+#include "PayloadCodec.h"
+#include "Footprint.h"
+#include "ProjectionApproximation.h"
 namespace ossimMsp
 {
 
@@ -57,6 +61,12 @@ public:
     */
     virtual void saveJSON(Json::Value& json) const;
 
+    /**
+     * As saveJSON(), with the model state in the encoding given rather than the image's own, for
+     * owners of shared images (see setStateEncoding()).
+     */
+    void saveJSON(Json::Value& json, PayloadCodec::Encoding encoding) const;
+
     /**
      * Replaces the MSP CSM sensor model with updated model.
      */
@@ -64,20 +74,126 @@ public:
 
     /**
      * Returns the MSP CSM sensor model associated with the image. If the sensor model name is not
-     * defined, the first (most accurate) model will be selected.
+     * defined, the first (most accurate) model will be selected. The model is instantiated on first
+     * access, from the model state or image support data given in the JSON if any, otherwise from
+     * the image file. Note that the image ID may then be updated to the model's image identifier.
      */
     const csm::RasterGM* getCsmSensorModel();
 
     /**
-     * Returns the ISD portion
+     * Returns true if the sensor model has been instantiated, after which the image ID is final.
+     */
+    bool hasCsmSensorModel() const;
+
+    /**
+     * Returns a private copy of the sensor model (instantiating the model first if needed), or
+     * null if there is none. CSM models are not required to be thread-safe, so concurrent
+     * evaluation needs one copy per thread. Throws ossimException on failure.
+     */
+    std::shared_ptr<csm::RasterGM> cloneCsmSensorModel();
+
+    /**
+     * Returns a fast approximation of the sensor model over the height range (meters above the
+     * ellipsoid), or null if there is no model or the approximation's measured error exceeds the
+     * tolerance (pixels), in which case the rigorous model must be used. The approximation is
+     * fitted on first use and retained with the image.
+     */
+    std::shared_ptr<const ProjectionApproximation> getProjectionApproximation(double tolerance,
+                                                                              double minHeight,
+                                                                              double maxHeight);
+
+    /**
+     * Returns the image's ground footprint at the height given (meters above the ellipsoid),
+     * computed from the sensor model unless already cached for the same image. Footprints are
+     * cached process-wide by the source of the geometry (file identity, model state or support
+     * data) and model name, with the cache size in bytes (mostly the states and support data
+     * keying it) set by the "msp.footprint_cache.max_bytes" preference (default 64 MB). Throws
+     * ossimException if it cannot be computed.
+     */
+    std::shared_ptr<const Footprint> getFootprint(double height=0.0);
+
+    /**
+     * Returns the footprint if it is cached, otherwise null. Never instantiates the sensor model,
+     * so it is a cheap test for whether getFootprint() will need the model.
      */
-    static void getISD(std::string isd, const std::string& filename, unsigned int entryIndex=0)
-    {
-       // TODO
-    }
+    std::shared_ptr<const Footprint> findFootprint(double height=0.0);
+
+    /**
+     * Fetches the footprints of all images, instantiating the sensor models of those not cached
+     * concurrently (as createCsmSensorModels()). On return, footprints and errors have one entry
+     * per image, with a null footprint and an error message for images that failed.
+     */
+    static void getFootprints(const std::vector< std::shared_ptr<MspImage> >& images,
+                              double height,
+                              std::vector< std::shared_ptr<const Footprint> >& footprints,
+                              std::vector<std::string>& errors,
+                              unsigned int numThreads=0);
+
+    /**
+     * Sets the encoding used by saveJSON() for the model state (default PLAIN). Image support data
+     * is binary and always encoded, with BASE64 standing in for PLAIN.
+     */
+    void setStateEncoding(PayloadCodec::Encoding encoding) { m_stateEncoding = encoding; }
+    PayloadCodec::Encoding getStateEncoding() const { return m_stateEncoding; }
+
+    /**
+     * Returns the state of the sensor model if instantiated, otherwise the model state retained
+     * from the JSON, if any (else empty). Never instantiates the model.
+     */
+    std::string getModelState() const;
+
+    /**
+     * Replaces the sensor model with one to be instantiated from the state on first access.
+     */
+    void setModelState(const std::string& state);
+
+    /** Image support data retained for deferred model instantiation, if any. */
+    const std::string& getImageSupportData() const { return m_isdData; }
+
+    /**
+     * Replaces the sensor model with one to be instantiated from the ISD on first access.
+     */
+    void setImageSupportData(const std::string& isd);
+
+    /**
+     * Instantiates the sensor models of all images concurrently on the shared thread pool, using
+     * at most numThreads threads (0 = all). On return, errors has one entry per image, empty for
+     * images whose model was established. Returns the number of images that failed.
+     */
+    static unsigned int createCsmSensorModels(
+          const std::vector< std::shared_ptr<MspImage> >& images,
+          std::vector<std::string>& errors,
+          unsigned int numThreads=0);
+
+    /**
+     * Returns the image support data of the NITF image entry (a header-only NITF without pixel
+     * data) suitable for the "imageSupportData" field. ISDs are cached by file identity. Throws
+     * ossimException if the file is not a NITF or has no such entry.
+     */
+    static void getISD(std::string& isd, const std::string& filename, unsigned int entryIndex=0);
 
 private:
-   csm::RasterGM* m_csmModel;
+   /**
+    * Makes the model the image's sensor model and reconciles the image ID with the model's image
+    * identifier. A shared model (i.e., one owned by a model cache) is copied before its identifier
+    * is modified. Otherwise the model must be private to the image.
+    */
+   void adoptModel(std::shared_ptr<const csm::RasterGM> model, bool shared);
+
+   /** Key identifying the geometry source of the image for the footprint cache. */
+   std::string footprintKey(double height) const;
+
+   // Possibly shared with the model caches and other images, so never modified:
+   std::shared_ptr<const csm::RasterGM> m_csmModel;
+
+   // Payloads from JSON retained for deferred model instantiation:
+   std::string m_modelState;
+   std::string m_isdData;
+
+   PayloadCodec::Encoding m_stateEncoding;
+   std::shared_ptr<const ProjectionApproximation> m_approximation;
+   std::shared_ptr<const Footprint> m_footprint;
+   bool m_modelFromFile;
 };
 
 } // End namespace ossimMsp
@@ -6,26 +6,75 @@
 //**************************************************************************************************
 
 #include "MspPhotoBlock.h"
+#include "JsonTokenReader.h"
 #include "MspImage.h"
+#include "PhotoBlockSnapshot.h"
+#include "ThreadPool.h"
 #include <ossim/base/ossimException.h>
+#include <algorithm>
+#include <deque>
+#include <fstream>
 
 using namespace ossim;
 
 namespace ossimMsp
 {
+// A tie point needs measurements on at least two distinct images:
+static bool onTwoImages(const MeasurementStore& store, unsigned int point)
+{
+   size_t count = 0;
+   const size_t* m = store.getPointMeasurements(point, count);
+   for (size_t k=1; k<count; ++k)
+   {
+      if (store.getImage(m[k]) != store.getImage(m[0]))
+         return true;
+   }
+   return false;
+}
+
 MspPhotoBlock::MspPhotoBlock()
+:  m_numThreads (0),
+   m_stateEncoding (PayloadCodec::PLAIN),
+   m_indexedCount (0),
+   m_measuredCount (0),
+   m_ownershipToken (make_shared<int>(0))
 {
 }
 
 MspPhotoBlock::MspPhotoBlock(const Json::Value& pb_json_node)
+:  m_numThreads (0),
+   m_stateEncoding (PayloadCodec::PLAIN),
+   m_indexedCount (0),
+   m_measuredCount (0),
+   m_ownershipToken (make_shared<int>(0))
 {
    loadJSON(pb_json_node);
 }
 
 MspPhotoBlock::MspPhotoBlock(const MspPhotoBlock& copyThis)
-: PhotoBlock (copyThis)
+:  PhotoBlock (copyThis),
+   m_name (copyThis.m_name),
+   m_type (copyThis.m_type),
+   m_date (copyThis.m_date),
+   m_description (copyThis.m_description),
+   m_ownerProducer (copyThis.m_ownerProducer),
+   m_classification (copyThis.m_classification),
+   m_derivedFrom (copyThis.m_derivedFrom),
+   m_disseminationCtrls (copyThis.m_disseminationCtrls),
+   m_gcpCrossCov (copyThis.m_gcpCrossCov),
+   m_mspJCM (copyThis.m_mspJCM),
+   m_numThreads (copyThis.m_numThreads),
+   m_stateEncoding (copyThis.m_stateEncoding),
+   m_imageIndex (copyThis.m_imageIndex),
+   m_indexedCount (copyThis.m_indexedCount),
+   m_measurements (copyThis.m_measurements),
+   m_measuredCount (copyThis.m_measuredCount),
+   m_ownershipToken (make_shared<int>(0)),
+   m_sharedTokens (copyThis.m_sharedTokens)
 {
-   *this = copyThis;
+   // All images are now shared with the original, which sees its token referenced here (and so
+   // do the photoblocks it shares images with):
+   m_sharedTokens.push_back(copyThis.m_ownershipToken);
 }
 
 MspPhotoBlock::~MspPhotoBlock()
@@ -34,9 +83,6 @@ MspPhotoBlock::~MspPhotoBlock()
 
 void MspPhotoBlock::loadJSON(const Json::Value& pb_json_node)
 {
-   ostringstream xmsg;
-   xmsg<<__FILE__<<": loadJSON() -- ";
-
    // Attempt to read the MSP-formatted JSON photoblock header first. If not successful, assume it
    // is in ossim format:
    if (!pb_json_node.isMember("photoBlockHeader"))
@@ -45,143 +91,956 @@ void MspPhotoBlock::loadJSON(const Json::Value& pb_json_node)
       return;
    }
 
-   const Json::Value& pbheaderJson = pb_json_node["photoBlockHeader"];
-   m_name = pbheaderJson["name"].asString();
-   m_type = pbheaderJson["type"].asString();
-   m_date = pbheaderJson["date"].asString();
-   m_description = pbheaderJson["description"].asString();
-   m_ownerProducer = pbheaderJson["ownerProducer"].asString();
-   m_classification = pbheaderJson["classification"].asString();
-   m_derivedFrom = pbheaderJson["derivedFrom"].asString();
-   m_disseminationCtrls = pbheaderJson["disseminationControls"].asString();
+   loadHeader(pb_json_node["photoBlockHeader"]);
+   addFromJSON(pb_json_node);
+}
 
+void MspPhotoBlock::addFromJSON(const Json::Value& json)
+{
    // Always do images first, as tiepoints will be using the image list to:
-   if (pb_json_node.isMember("imageList"))
+   if (json.isMember("imageList"))
    {
-      Json::Value imageListJson = pb_json_node["imageList"];
-      const Json::Value& stateListJson = pb_json_node["sensorModelStateList"];
+      const Json::Value& imageListJson = json["imageList"];
+      const Json::Value& stateListJson = json["sensorModelStateList"];
 
       // IMPORTANT NOTE: Assuming that the array entry order for images and sensor model states
       // correspond:
       unsigned int count = imageListJson.size();
       if (count != stateListJson.size())
       {
+         ostringstream xmsg;
+         xmsg<<__FILE__<<": addFromJSON() -- ";
          xmsg<<"The number of images and sensor model states provided do not correspond!. Cannot"
                " load MSP PhotoBlock.";
          throw ossimException(xmsg.str());
       }
+      vector<Json::Value> imageNodes (count);
       for (unsigned int i=0; i<count; ++i)
       {
-         Json::Value& imageJson = imageListJson[i];
-         imageJson.append(stateListJson[i]);
-
-         shared_ptr<ossim::Image> item (new MspImage(imageJson));
-         m_imageList.push_back(item);
+         imageNodes[i] = imageListJson[i];
+         imageNodes[i].append(stateListJson[i]);
       }
+      addImages(imageNodes, 0);
    }
 
-   // TODO: Implement GCP cross covariance capability
+   if (json.isMember("groundPointList"))
+   {
+      const Json::Value& listJson = json["groundPointList"];
+      vector<Json::Value> gcpNodes (listJson.begin(), listJson.end());
+      addGroundPoints(gcpNodes);
+   }
 
-   if (pb_json_node.isMember("groundPointList"))
+   // GCP cross-covariances are parsed once into sparse blocks by GCP pair:
+   if (json.isMember("gpCrossCovList"))
+      m_gcpCrossCov.loadJSON(json["gpCrossCovList"]);
+
+   if (json.isMember("imagePointList"))
    {
-      const Json::Value& listJson = pb_json_node["groundPointList"];
-      unsigned int count = listJson.size();
+      // This is a sequential list of image points, correlated only by point ID to other points:
+      ImagePointTable table;
+      ImagePointTable::Record record;
+      const Json::Value& ipListJson = json["imagePointList"];
+      unsigned int count = ipListJson.size();
+      table.records.reserve(count);
       for (unsigned int i=0; i<count; ++i)
       {
-         Json::Value jsonItem = listJson[i];
-         jsonItem.append(pb_json_node["gpCrossCovList"]);
-         shared_ptr<ossim::GroundControlPoint> item (new ossim::GroundControlPoint(jsonItem));
-         m_gcpList.push_back(item);
+         const Json::Value& ipJson = ipListJson[i];
+         record.column = ipJson["column"].asDouble();
+         record.row = ipJson["row"].asDouble();
+         record.sigmaColumn = ipJson["sigmaColumn"].asDouble();
+         record.sigmaRow = ipJson["sigmaRow"].asDouble();
+         record.rho = ipJson["rho"].asDouble();
+         table.add(ipJson["pointId"].asString(), ipJson["imageId"].asString(), record);
       }
+      addTiePoints(table);
    }
+}
 
+void MspPhotoBlock::loadFile(const std::string& filename)
+{
+   if (PhotoBlockSnapshot::isSnapshot(filename))
+   {
+      loadSnapshot(filename);
+      return;
+   }
 
-   if (pb_json_node.isMember("imagePointList"))
+   ifstream in (filename.c_str(), ios::binary);
+   if (!in)
    {
-      // This is a sequential list of image points, correlated only by point ID to other points.
-      // So need a multi map to store using pointID as key:
-      std::multimap<string, Json::Value> ipMap;
-      vector<string> pointIds;
-      const Json::Value& ipListJson = pb_json_node["imagePointList"];
-      unsigned int count = ipListJson.size();
-      for (unsigned int i=0; i<count; ++i)
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": loadFile() -- Could not open photoblock file <"<<filename<<">.";
+      throw ossimException(xmsg.str());
+   }
+   loadStream(in);
+}
+
+void MspPhotoBlock::loadStream(std::istream& in)
+{
+   ostringstream xmsg;
+   xmsg<<__FILE__<<": loadStream() -- ";
+
+   // Images are instantiated in batches of a few per thread as soon as both their entries and
+   // model states have arrived, so that at most a batch of states is held as JSON at a time
+   // (unless the document lists all images before any states):
+   unsigned int numThreads = m_numThreads ? m_numThreads : ThreadPool::instance()->getNumThreads();
+   size_t batchSize = 4*max(numThreads, 1u);
+   deque<Json::Value> imageNodes;
+   deque<Json::Value> stateNodes;
+   size_t numImages = 0;
+   size_t numStates = 0;
+   size_t numBuilt = 0;
+   auto buildImages = [&](bool all)
+   {
+      size_t ready = min(numImages, numStates) - numBuilt;
+      if ((ready == 0) || (!all && (ready < batchSize)))
+         return;
+      vector<Json::Value> batch (ready);
+      for (size_t i=0; i<ready; ++i)
       {
-         const Json::Value& ipJson = ipListJson[i];
-         string pointId = ipJson["pointId"].asString();
-         pointIds.push_back(pointId);
-         ipMap.emplace(pointId, ipJson);
-      }
-
-      string imageId;
-      ossimDpt xy;
-      double sigmaX, sigmaY, rho;
-      NEWMAT::SymmetricMatrix cov;
-      typedef std::multimap<string, Json::Value>::iterator ipIterType;
-      std::pair < ipIterType, ipIterType > tpSet;
-      for (auto &pointId : pointIds)
-      {
-         shared_ptr<TiePoint> tp (new TiePoint);
-         tp->setTiePointId(pointId);
-         tpSet = ipMap.equal_range(pointId);
-         for (ipIterType ipIter=tpSet.first; ipIter!=tpSet.second; ++ipIter)
+         batch[i].swap(imageNodes[i]);
+         batch[i].append(Json::Value());
+         batch[i][batch[i].size() - 1].swap(stateNodes[i]);
+      }
+      imageNodes.erase(imageNodes.begin(), imageNodes.begin() + ready);
+      stateNodes.erase(stateNodes.begin(), stateNodes.begin() + ready);
+      addImages(batch, numBuilt);
+      numBuilt += ready;
+   };
+
+   vector<Json::Value> gcpNodes;
+   ImagePointTable table;
+   bool haveHeader = false;
+
+   JsonTokenReader reader (in);
+   reader.expect(JsonTokenReader::BEGIN_OBJECT);
+   while (reader.next() == JsonTokenReader::KEY)
+   {
+      string key = reader.getString();
+      if (key == "photoBlockHeader")
+      {
+         Json::Value pbheaderJson;
+         reader.readValue(pbheaderJson);
+         loadHeader(pbheaderJson);
+         haveHeader = true;
+      }
+      else if ((key == "imageList") || (key == "sensorModelStateList"))
+      {
+         bool isImage = (key == "imageList");
+         reader.expect(JsonTokenReader::BEGIN_ARRAY);
+         while (reader.peek() != JsonTokenReader::END_ARRAY)
          {
-            Json::Value& ipJson = ipIter->second;
-            shared_ptr<Image> image = findImage(ipJson["imageId"].asString());
-            if (!image)
+            if (isImage)
             {
-               tp.reset();
-               continue;
+               imageNodes.push_back(Json::Value());
+               reader.readValue(imageNodes.back());
+               ++numImages;
             }
-            xy.x = ipJson["column"].asDouble();
-            xy.y = ipJson["row"].asDouble();
-            sigmaX = ipJson["sigmaColumn"].asDouble();
-            sigmaY = ipJson["sigmaRow"].asDouble();
-            rho = ipJson["rho"].asDouble();
-            cov(0,0) = sigmaX*sigmaX;
-            cov(1,1) = sigmaY*sigmaY;
-            cov(0,1) = rho*sigmaX*sigmaY;
-            tp->setImagePoint(image, xy, cov);
+            else
+            {
+               stateNodes.push_back(Json::Value());
+               reader.readValue(stateNodes.back());
+               ++numStates;
+            }
+            buildImages(false);
+         }
+         reader.next();
+      }
+      else if (key == "groundPointList")
+      {
+         reader.expect(JsonTokenReader::BEGIN_ARRAY);
+         while (reader.peek() != JsonTokenReader::END_ARRAY)
+         {
+            gcpNodes.push_back(Json::Value());
+            reader.readValue(gcpNodes.back());
+         }
+         reader.next();
+      }
+      else if (key == "gpCrossCovList")
+      {
+         Json::Value entry;
+         reader.expect(JsonTokenReader::BEGIN_ARRAY);
+         while (reader.peek() != JsonTokenReader::END_ARRAY)
+         {
+            reader.readValue(entry);
+            m_gcpCrossCov.addFromJSON(entry);
          }
-         if (tp->getImageCount() >= 2)
-            m_tiePointList.push_back(tp);
+         reader.next();
+      }
+      else if (key == "imagePointList")
+      {
+         // Read each measurement's fields straight into a record:
+         ImagePointTable::Record record;
+         string pointId, imageId;
+         reader.expect(JsonTokenReader::BEGIN_ARRAY);
+         while (reader.next() == JsonTokenReader::BEGIN_OBJECT)
+         {
+            record.column = record.row = record.sigmaColumn = record.sigmaRow = record.rho = 0.0;
+            pointId.clear();
+            imageId.clear();
+            while (reader.next() == JsonTokenReader::KEY)
+            {
+               const string& field = reader.getString();
+               if (field == "pointId")
+                  pointId = reader.readScalarAsString();
+               else if (field == "imageId")
+                  imageId = reader.readScalarAsString();
+               else if (field == "column")
+                  record.column = reader.readNumber();
+               else if (field == "row")
+                  record.row = reader.readNumber();
+               else if (field == "sigmaColumn")
+                  record.sigmaColumn = reader.readNumber();
+               else if (field == "sigmaRow")
+                  record.sigmaRow = reader.readNumber();
+               else if (field == "rho")
+                  record.rho = reader.readNumber();
+               else
+                  reader.skipValue();
+            }
+            table.add(pointId, imageId, record);
+         }
+      }
+      else
+      {
+         reader.skipValue();
+      }
+   }
+   reader.expect(JsonTokenReader::END_OF_INPUT);
+
+   if (!haveHeader)
+   {
+      xmsg<<"No photoBlockHeader found. Only MSP-format photoblocks can be streamed.";
+      throw ossimException(xmsg.str());
+   }
+   if (numImages != numStates)
+   {
+      xmsg<<"The number of images and sensor model states provided do not correspond!. Cannot"
+            " load MSP PhotoBlock.";
+      throw ossimException(xmsg.str());
+   }
+   buildImages(true);
+   addGroundPoints(gcpNodes);
+   addTiePoints(table);
+}
+
+void MspPhotoBlock::loadHeader(const Json::Value& pbheaderJson)
+{
+   m_name = pbheaderJson["name"].asString();
+   m_type = pbheaderJson["type"].asString();
+   m_date = pbheaderJson["date"].asString();
+   m_description = pbheaderJson["description"].asString();
+   m_ownerProducer = pbheaderJson["ownerProducer"].asString();
+   m_classification = pbheaderJson["classification"].asString();
+   m_derivedFrom = pbheaderJson["derivedFrom"].asString();
+   m_disseminationCtrls = pbheaderJson["disseminationControls"].asString();
+}
+
+void MspPhotoBlock::addImages(std::vector<Json::Value>& imageNodes, size_t firstIndex)
+{
+   // Image construction may involve instantiating sensor models, so do it concurrently while
+   // preserving list order:
+   size_t count = imageNodes.size();
+   vector< shared_ptr<ossim::Image> > images (count);
+   vector<string> errors (count);
+   ThreadPool::instance()->parallelFor(count, [&](size_t i)
+   {
+      try
+      {
+         images[i].reset(new MspImage(imageNodes[i]));
+      }
+      catch (exception& e)
+      {
+         errors[i] = e.what();
+      }
+   }, m_numThreads);
+
+   ostringstream xmsg;
+   xmsg<<__FILE__<<": addImages() -- ";
+   bool failed = false;
+   for (size_t i=0; i<count; ++i)
+   {
+      if (errors[i].empty())
+         continue;
+      xmsg<<"\n  imageList["<<firstIndex + i<<"]: "<<errors[i];
+      failed = true;
+   }
+   if (failed)
+      throw ossimException(xmsg.str());
+
+   for (size_t i=0; i<count; ++i)
+      addImage(images[i]);
+}
+
+void MspPhotoBlock::addGroundPoints(const std::vector<Json::Value>& gcpNodes)
+{
+   for (size_t i=0; i<gcpNodes.size(); ++i)
+   {
+      shared_ptr<ossim::GroundControlPoint> item (new ossim::GroundControlPoint(gcpNodes[i]));
+      m_gcpList.push_back(item);
+   }
+}
+
+void MspPhotoBlock::ImagePointTable::add(const std::string& pointId,
+                                         const std::string& imageId,
+                                         Record& record)
+{
+   auto p = pointIndex.emplace(pointId, (unsigned int) pointIds.size());
+   if (p.second)
+      pointIds.push_back(pointId);
+   record.point = p.first->second;
+
+   auto i = imageIndex.emplace(imageId, (unsigned int) imageIds.size());
+   if (i.second)
+      imageIds.push_back(imageId);
+   record.image = i.first->second;
+
+   records.push_back(record);
+}
+
+void MspPhotoBlock::addTiePoints(const ImagePointTable& table)
+{
+   syncMeasurements();
+
+   // Resolve each distinct image ID once:
+   vector<int> positions (table.imageIds.size());
+   for (size_t i=0; i<positions.size(); ++i)
+      positions[i] = findImagePosition(table.imageIds[i]);
+
+   // Order the records by point, keeping measurement order within each point (counting sort):
+   size_t numPoints = table.pointIds.size();
+   vector<size_t> first (numPoints + 1, 0);
+   for (size_t r=0; r<table.records.size(); ++r)
+      ++first[table.records[r].point + 1];
+   for (size_t p=0; p<numPoints; ++p)
+      first[p+1] += first[p];
+   vector<size_t> order (table.records.size());
+   vector<size_t> fill (first.begin(), first.end() - 1);
+   for (size_t r=0; r<table.records.size(); ++r)
+      order[fill[table.records[r].point]++] = r;
+
+   m_measurements.reserve(m_measurements.size() + table.records.size());
+   unsigned int firstPoint = (unsigned int) m_measurements.getNumPoints();
+   vector<unsigned int> extended;
+   for (size_t p=0; p<numPoints; ++p)
+   {
+      // Skip points with a measurement on an unknown image. New points need measurements on two
+      // distinct images, while points already present are extended:
+      size_t k = first[p];
+      bool multiImage = false;
+      for (; k<first[p+1]; ++k)
+      {
+         int position = positions[table.records[order[k]].image];
+         if (position < 0)
+            break;
+         if (position != positions[table.records[order[first[p]]].image])
+            multiImage = true;
+      }
+      int existing = m_measurements.findPoint(table.pointIds[p]);
+      if ((k < first[p+1]) || ((existing < 0) && !multiImage))
+         continue;
+
+      unsigned int point = m_measurements.addPoint(table.pointIds[p]);
+      if (existing >= 0)
+         extended.push_back(point);
+      for (k=first[p]; k<first[p+1]; ++k)
+      {
+         const ImagePointTable::Record& record = table.records[order[k]];
+         m_measurements.add(point, (unsigned int) positions[record.image],
+                            record.row, record.column,
+                            record.sigmaRow*record.sigmaRow,
+                            record.rho*record.sigmaColumn*record.sigmaRow,
+                            record.sigmaColumn*record.sigmaColumn);
+      }
+   }
+   createTiePoints(firstPoint);
+   refreshTiePoints(extended);
+}
+
+std::shared_ptr<ossim::TiePoint> MspPhotoBlock::buildTiePoint(unsigned int point) const
+{
+   // Requires the store's point index:
+   ossimDpt xy;
+   NEWMAT::SymmetricMatrix cov (2);
+   size_t count = 0;
+   shared_ptr<TiePoint> tp (new TiePoint);
+   tp->setTiePointId(m_measurements.getPointId(point));
+   const size_t* m = m_measurements.getPointMeasurements(point, count);
+   for (size_t k=0; k<count; ++k)
+   {
+      const double* packed = m_measurements.getCovariance(m[k]);
+      xy.x = m_measurements.getSample(m[k]);
+      xy.y = m_measurements.getLine(m[k]);
+      cov(1,1) = packed[2];
+      cov(2,2) = packed[0];
+      cov(1,2) = packed[1];
+      tp->setImagePoint(m_imageList[m_measurements.getImage(m[k])], xy, cov);
+   }
+   return tp;
+}
+
+void MspPhotoBlock::createTiePoints(unsigned int firstPoint)
+{
+   // The TiePoint view of the store's points from firstPoint on:
+   m_measurements.buildPointIndex();
+   for (unsigned int p=firstPoint; p<m_measurements.getNumPoints(); ++p)
+      m_tiePointList.push_back(buildTiePoint(p));
+   m_measuredCount = m_tiePointList.size();
+}
+
+void MspPhotoBlock::refreshTiePoints(const std::vector<unsigned int>& points)
+{
+   if (points.empty())
+      return;
+
+   // Points left measured on fewer than two images are dropped from both views:
+   m_measurements.buildPointIndex();
+   unordered_map<string, shared_ptr<TiePoint> > replacements;
+   vector<bool> dropped (m_measurements.getNumPoints(), false);
+   bool anyDropped = false;
+   for (size_t i=0; i<points.size(); ++i)
+   {
+      const string& pointId = m_measurements.getPointId(points[i]);
+      if (!onTwoImages(m_measurements, points[i]))
+      {
+         replacements[pointId].reset();
+         dropped[points[i]] = anyDropped = true;
+      }
+      else
+      {
+         replacements[pointId] = buildTiePoint(points[i]);
+      }
+   }
+
+   size_t kept = 0;
+   for (size_t t=0; t<m_tiePointList.size(); ++t)
+   {
+      auto entry = replacements.find(pointIdOf(*m_tiePointList[t]));
+      if (entry == replacements.end())
+         m_tiePointList[kept++] = m_tiePointList[t];
+      else if (entry->second)
+         m_tiePointList[kept++] = entry->second;
+   }
+   m_tiePointList.resize(kept);
+
+   if (anyDropped)
+      m_measurements.removePoints(dropped);
+   m_measuredCount = m_tiePointList.size();
+}
+
+std::string MspPhotoBlock::pointIdOf(const ossim::TiePoint& tp)
+{
+   // Tie points on GCPs are identified to MSP by the GCP ID:
+   string pointId = tp.getGcpId();
+   if (pointId.empty())
+      pointId = tp.getTiePointId();
+   return pointId;
+}
+
+size_t MspPhotoBlock::removeTiePoints(const std::vector<std::string>& pointIds)
+{
+   syncMeasurements();
+
+   vector<bool> remove (m_measurements.getNumPoints(), false);
+   unordered_map<string, bool> ids;
+   for (size_t i=0; i<pointIds.size(); ++i)
+   {
+      ids.emplace(pointIds[i], true);
+      int point = m_measurements.findPoint(pointIds[i]);
+      if (point >= 0)
+         remove[point] = true;
+   }
+
+   size_t kept = 0;
+   for (size_t t=0; t<m_tiePointList.size(); ++t)
+   {
+      if (!ids.count(pointIdOf(*m_tiePointList[t])))
+         m_tiePointList[kept++] = m_tiePointList[t];
+   }
+   size_t removed = m_tiePointList.size() - kept;
+   m_tiePointList.resize(kept);
+
+   m_measurements.removePoints(remove);
+   m_measuredCount = m_tiePointList.size();
+   return removed;
+}
+
+size_t MspPhotoBlock::removeGroundPoints(const std::vector<std::string>& gcpIds)
+{
+   unordered_map<string, bool> ids;
+   for (size_t i=0; i<gcpIds.size(); ++i)
+      ids.emplace(gcpIds[i], true);
+
+   size_t kept = 0;
+   for (size_t g=0; g<m_gcpList.size(); ++g)
+   {
+      if (!ids.count(m_gcpList[g]->getId()))
+         m_gcpList[kept++] = m_gcpList[g];
+   }
+   size_t removed = m_gcpList.size() - kept;
+   m_gcpList.resize(kept);
+   m_gcpCrossCov.removePoints(gcpIds);
+   return removed;
+}
+
+void MspPhotoBlock::applyDelta(const Json::Value& delta)
+{
+   vector<string> ids;
+   const Json::Value& removeImages = delta["removeImages"];
+   for (unsigned int i=0; i<removeImages.size(); ++i)
+      removeImage(removeImages[i].asString());
+
+   const Json::Value& removeTiePointIds = delta["removeTiePoints"];
+   for (unsigned int i=0; i<removeTiePointIds.size(); ++i)
+      ids.push_back(removeTiePointIds[i].asString());
+   if (!ids.empty())
+      removeTiePoints(ids);
+
+   ids.clear();
+   const Json::Value& removeGcpIds = delta["removeGroundPoints"];
+   for (unsigned int i=0; i<removeGcpIds.size(); ++i)
+      ids.push_back(removeGcpIds[i].asString());
+   if (!ids.empty())
+      removeGroundPoints(ids);
+
+   addFromJSON(delta);
+}
+
+void MspPhotoBlock::saveSnapshot(const std::string& filename)
+{
+   PhotoBlockSnapshot::Writer writer;
+   const string* header[PhotoBlockSnapshot::NUM_HEADER_FIELDS] =
+   {
+      &m_name, &m_type, &m_date, &m_description, &m_ownerProducer, &m_classification,
+      &m_derivedFrom, &m_disseminationCtrls
+   };
+   for (unsigned int i=0; i<PhotoBlockSnapshot::NUM_HEADER_FIELDS; ++i)
+      writer.setHeaderField(i, *header[i]);
+
+   // Model states are the bulk of the data, so fetch and compress them concurrently:
+   size_t numImages = m_imageList.size();
+   vector<PhotoBlockSnapshot::PayloadKind> kinds (numImages, PhotoBlockSnapshot::NO_PAYLOAD);
+   vector<string> payloads (numImages);
+   vector<size_t> sizes (numImages, 0);
+   ThreadPool::instance()->parallelFor(numImages, [&](size_t i)
+   {
+      shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(m_imageList[i]);
+      if (!image)
+         return;
+      string payload = image->getModelState();
+      kinds[i] = PhotoBlockSnapshot::MODEL_STATE;
+      if (payload.empty())
+      {
+         payload = image->getImageSupportData();
+         kinds[i] = PhotoBlockSnapshot::IMAGE_SUPPORT_DATA;
+      }
+      if (payload.empty())
+      {
+         kinds[i] = PhotoBlockSnapshot::NO_PAYLOAD;
+         return;
+      }
+      sizes[i] = payload.size();
+      PayloadCodec::compress(payload, payloads[i]);
+   }, m_numThreads);
+
+   for (size_t i=0; i<numImages; ++i)
+   {
+      const Image& image = *m_imageList[i];
+      writer.addImage(image.getImageId(), image.getFilename().string(), image.getModelName(),
+                      image.getEntryIndex(), kinds[i], payloads[i], sizes[i]);
+      string().swap(payloads[i]);
+   }
+
+   const MeasurementStore& measurements = getMeasurements();
+   for (unsigned int p=0; p<measurements.getNumPoints(); ++p)
+      writer.addPointId(measurements.getPointId(p));
+   for (size_t m=0; m<measurements.size(); ++m)
+   {
+      writer.addMeasurement(measurements.getPoint(m), measurements.getImage(m),
+                            measurements.getLine(m), measurements.getSample(m),
+                            measurements.getCovariance(m));
+   }
+
+   double packed[6];
+   for (size_t g=0; g<m_gcpList.size(); ++g)
+   {
+      const ossimEcefPoint& ecf = m_gcpList[g]->getECF();
+      const NEWMAT::SymmetricMatrix& cov = m_gcpList[g]->getCovariance();
+      packed[0] = cov(1,1);
+      packed[1] = cov(1,2);
+      packed[2] = cov(1,3);
+      packed[3] = cov(2,2);
+      packed[4] = cov(2,3);
+      packed[5] = cov(3,3);
+      writer.addGcp(m_gcpList[g]->getId(), ecf.x(), ecf.y(), ecf.z(), packed);
+   }
+   for (size_t i=0; i<m_gcpCrossCov.size(); ++i)
+   {
+      writer.addGcpCrossCovariance(m_gcpCrossCov.getGcpId1(i), m_gcpCrossCov.getGcpId2(i),
+                                   m_gcpCrossCov.getBlock(i));
+   }
+
+   writer.write(filename);
+}
+
+void MspPhotoBlock::loadSnapshot(const std::string& filename)
+{
+   PhotoBlockSnapshot snapshot;
+   snapshot.open(filename);
+
+   string* header[PhotoBlockSnapshot::NUM_HEADER_FIELDS] =
+   {
+      &m_name, &m_type, &m_date, &m_description, &m_ownerProducer, &m_classification,
+      &m_derivedFrom, &m_disseminationCtrls
+   };
+   for (unsigned int i=0; i<PhotoBlockSnapshot::NUM_HEADER_FIELDS; ++i)
+      *header[i] = snapshot.getHeaderField(i);
+
+   // Images keep their payloads for deferred model instantiation, so only decompression is
+   // needed here:
+   size_t numImages = snapshot.getNumImages();
+   vector< shared_ptr<MspImage> > images (numImages);
+   vector<string> errors (numImages);
+   ThreadPool::instance()->parallelFor(numImages, [&](size_t i)
+   {
+      try
+      {
+         shared_ptr<MspImage> image (new MspImage(snapshot.getImageId(i),
+                                                  snapshot.getImageFilename(i),
+                                                  snapshot.getImageModelName(i),
+                                                  snapshot.getImageEntryIndex(i)));
+         string payload;
+         snapshot.getImagePayload(i, payload);
+         if (snapshot.getImagePayloadKind(i) == PhotoBlockSnapshot::MODEL_STATE)
+            image->setModelState(payload);
+         else if (snapshot.getImagePayloadKind(i) == PhotoBlockSnapshot::IMAGE_SUPPORT_DATA)
+            image->setImageSupportData(payload);
+         images[i] = image;
+      }
+      catch (exception& e)
+      {
+         errors[i] = e.what();
+      }
+   }, m_numThreads);
+
+   ostringstream xmsg;
+   xmsg<<__FILE__<<": loadSnapshot() -- ";
+   bool failed = false;
+   for (size_t i=0; i<numImages; ++i)
+   {
+      if (errors[i].empty())
+         continue;
+      xmsg<<"\n  image["<<i<<"]: "<<errors[i];
+      failed = true;
+   }
+   if (failed)
+      throw ossimException(xmsg.str());
+
+   // Snapshot image indices are positions in its image table:
+   syncMeasurements();
+   vector<unsigned int> positions (numImages);
+   for (size_t i=0; i<numImages; ++i)
+      positions[i] = addImage(images[i]);
+
+   unsigned int firstPoint = (unsigned int) m_measurements.getNumPoints();
+   vector<unsigned int> points (snapshot.getNumPoints());
+   for (size_t p=0; p<points.size(); ++p)
+      points[p] = m_measurements.addPoint(snapshot.getPointId(p));
+
+   size_t numMeasurements = snapshot.getNumMeasurements();
+   const ossim_uint32* measPoint = snapshot.getMeasurementPoints();
+   const ossim_uint32* measImage = snapshot.getMeasurementImages();
+   const double* measLine = snapshot.getMeasurementLines();
+   const double* measSample = snapshot.getMeasurementSamples();
+   const double* measCovariance = snapshot.getMeasurementCovariances();
+   m_measurements.reserve(m_measurements.size() + numMeasurements);
+   for (size_t m=0; m<numMeasurements; ++m)
+   {
+      const double* packed = measCovariance + 3*m;
+      m_measurements.add(points[measPoint[m]], positions[measImage[m]], measLine[m],
+                         measSample[m], packed[0], packed[1], packed[2]);
+   }
+   createTiePoints(firstPoint);
+
+   string id;
+   double x, y, z, packed[6];
+   NEWMAT::SymmetricMatrix cov (3);
+   for (size_t g=0; g<snapshot.getNumGcps(); ++g)
+   {
+      snapshot.getGcp(g, id, x, y, z, packed);
+      cov(1,1) = packed[0];
+      cov(1,2) = packed[1];
+      cov(1,3) = packed[2];
+      cov(2,2) = packed[3];
+      cov(2,3) = packed[4];
+      cov(3,3) = packed[5];
+      shared_ptr<ossim::GroundControlPoint> gcp (
+            new ossim::GroundControlPoint(id, ossimEcefPoint(x, y, z), cov));
+      m_gcpList.push_back(gcp);
+   }
+
+   string gcpId1, gcpId2;
+   double block[9];
+   for (size_t i=0; i<snapshot.getNumGcpCrossCovariances(); ++i)
+   {
+      snapshot.getGcpCrossCovariance(i, gcpId1, gcpId2, block);
+      m_gcpCrossCov.set(gcpId1, gcpId2, block);
+   }
+}
+
+const MeasurementStore& MspPhotoBlock::getMeasurements()
+{
+   syncMeasurements();
+   m_measurements.buildPointIndex();
+   return m_measurements;
+}
+
+void MspPhotoBlock::syncMeasurements()
+{
+   if (m_measuredCount == m_tiePointList.size())
+      return;
+
+   // Append measurements of tie points added since, or start over if the list has shrunk or the
+   // image positions changed:
+   if (m_measuredCount > m_tiePointList.size())
+   {
+      m_measurements.clear();
+      m_measuredCount = 0;
+   }
+
+   string imageId;
+   ossimDpt xy;
+   NEWMAT::SymmetricMatrix cov;
+   for (size_t t=m_measuredCount; t<m_tiePointList.size(); ++t)
+   {
+      const TiePoint& tp = *m_tiePointList[t];
+      unsigned int point = m_measurements.addPoint(pointIdOf(tp));
+
+      unsigned int imgCount = tp.getImageCount();
+      for (unsigned int i=0; i<imgCount; ++i)
+      {
+         tp.getImagePoint(i, imageId, xy, cov);
+         int position = findImagePosition(imageId);
+         if (position < 0)
+            continue;
+         m_measurements.add(point, (unsigned int) position, xy.y, xy.x,
+                            cov(2,2), cov(1,2), cov(1,1));
       }
    }
+   m_measuredCount = m_tiePointList.size();
 }
 
 void MspPhotoBlock::saveJSON(Json::Value& pbJSON) const
 {
    ossim::PhotoBlock::saveJSON(pbJSON);
+
+   // Images may be shared with copies of the photoblock, so rather than being set on them, this
+   // photoblock's encoding is passed to their serialization, replacing the base class's entries:
+   Json::Value& imagesJson = pbJSON["images"];
+   for (size_t i=0; i<m_imageList.size(); ++i)
+   {
+      shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(m_imageList[i]);
+      if (image && (image->getStateEncoding() != m_stateEncoding))
+         image->saveJSON(imagesJson[(Json::ArrayIndex) i], m_stateEncoding);
+   }
+   if (!m_gcpCrossCov.empty())
+      m_gcpCrossCov.saveJSON(pbJSON["gpCrossCovList"]);
 }
 
-shared_ptr<ossim::Image>  MspPhotoBlock::findImage(const std::string& imageId)
+std::string MspPhotoBlock::normalizeImageId(const std::string& imageId)
 {
-   // Loop over all images represented in this tiepoint:
-   shared_ptr<ossim::Image> image;
-   ossimString tpiid = ossimString(imageId).trim();
-   for (int t=0; t<m_imageList.size(); ++t)
+   static const char* WHITESPACE = " \t\n\r";
+   size_t first = imageId.find_first_not_of(WHITESPACE);
+   if (first == string::npos)
+      return string();
+   size_t last = imageId.find_last_not_of(WHITESPACE);
+   return imageId.substr(first, last - first + 1);
+}
+
+void MspPhotoBlock::rebuildImageIndex()
+{
+   m_imageIndex.clear();
+   m_imageIndex.reserve(m_imageList.size());
+   for (size_t i=0; i<m_imageList.size(); ++i)
    {
-      ossimString pbiid = ossimString(m_imageList[t]->getImageId()).trim();
-      if (pbiid != tpiid)
-         continue;
-      image = m_imageList[t];
-      break;
+      // First occurrence wins, as with a linear search:
+      if (m_imageList[i])
+         m_imageIndex.emplace(normalizeImageId(m_imageList[i]->getImageId()), i);
    }
-   return image;
+   m_indexedCount = m_imageList.size();
+}
+
+int MspPhotoBlock::findImagePosition(const std::string& imageId)
+{
+   string key = normalizeImageId(imageId);
+   if (m_indexedCount != m_imageList.size())
+      rebuildImageIndex();
+
+   // Verify the hit, since images could have been replaced or renamed since indexing. A miss is
+   // confirmed by re-indexing once, and then by resolving the IDs of images whose models are not
+   // yet instantiated, since the ID requested may be the one their models define:
+   for (int attempt=0; attempt<3; ++attempt)
+   {
+      auto entry = m_imageIndex.find(key);
+      if ((entry != m_imageIndex.end()) && (entry->second < m_imageList.size()))
+      {
+         const shared_ptr<ossim::Image>& image = m_imageList[entry->second];
+         if (image && (normalizeImageId(image->getImageId()) == key))
+            return (int) entry->second;
+      }
+      if ((attempt == 0) || ((attempt == 1) && resolveImageIds()))
+         rebuildImageIndex();
+      else
+         break;
+   }
+   return -1;
+}
+
+bool MspPhotoBlock::resolveImageIds()
+{
+   // Images shared with another photoblock are replaced with private copies before instantiating:
+   vector<MspImage*> pending;
+   for (size_t i=0; i<m_imageList.size(); ++i)
+   {
+      MspImage* image = dynamic_cast<MspImage*>(m_imageList[i].get());
+      if (image && !image->hasCsmSensorModel())
+         pending.push_back(getWritableImage(i).get());
+   }
+   if (pending.empty())
+      return false;
+
+   // Instantiation involves model parsing, so do it concurrently. Images whose model cannot be
+   // instantiated keep the ID they were given:
+   vector<char> changed (pending.size(), 0);
+   ThreadPool::instance()->parallelFor(pending.size(), [&](size_t i)
+   {
+      string before = pending[i]->getImageId();
+      try
+      {
+         pending[i]->getCsmSensorModel();
+      }
+      catch (exception&)
+      {
+      }
+      changed[i] = (pending[i]->getImageId() != before);
+   }, m_numThreads);
+
+   for (size_t i=0; i<changed.size(); ++i)
+   {
+      if (changed[i])
+         return true;
+   }
+   return false;
+}
+
+shared_ptr<ossim::Image> MspPhotoBlock::getImage(const std::string& imageId)
+{
+   int position = findImagePosition(imageId);
+   if (position < 0)
+      return shared_ptr<ossim::Image>();
+   return m_imageList[position];
+}
+
+unsigned int MspPhotoBlock::addImage(std::shared_ptr<ossim::Image> image)
+{
+   if (m_indexedCount != m_imageList.size())
+      rebuildImageIndex();
+
+   // Already present if the same instance is indexed under its ID:
+   string key = normalizeImageId(image->getImageId());
+   auto entry = m_imageIndex.find(key);
+   if ((entry != m_imageIndex.end()) && (entry->second < m_imageList.size()) &&
+       (m_imageList[entry->second] == image))
+   {
+      return (unsigned int) entry->second;
+   }
+
+   refreshOwnership();
+   m_imageList.push_back(image);
+   m_ownedImages.insert(image.get());
+   m_imageIndex.emplace(key, m_imageList.size() - 1);
+   m_indexedCount = m_imageList.size();
+   return (unsigned int) (m_imageList.size() - 1);
+}
+
+bool MspPhotoBlock::removeImage(const std::string& imageId)
+{
+   int position = findImagePosition(imageId);
+   if (position < 0)
+      return false;
+
+   // Note the points measured on the image, whose tie points must be rebuilt without it:
+   syncMeasurements();
+   vector<unsigned int> affected;
+   vector<bool> seen (m_measurements.getNumPoints(), false);
+   for (size_t m=0; m<m_measurements.size(); ++m)
+   {
+      unsigned int point = m_measurements.getPoint(m);
+      if ((m_measurements.getImage(m) == (unsigned int) position) && !seen[point])
+      {
+         seen[point] = true;
+         affected.push_back(point);
+      }
+   }
+
+   // Positions after the removed image shift, so re-index both images and measurements:
+   m_ownedImages.erase(m_imageList[position].get());
+   m_imageList.erase(m_imageList.begin() + position);
+   rebuildImageIndex();
+   m_measurements.removeImage((unsigned int) position);
+   refreshTiePoints(affected);
+   return true;
 }
 
-void MspPhotoBlock::getCsmModels(MSP::CsmSensorModelList& csmModelList)
+void MspPhotoBlock::getCsmModels(MSP::CsmSensorModelList& csmModelList,
+                                 std::vector< std::shared_ptr<csm::RasterGM> >& models)
 {
+   ostringstream xmsg;
+   xmsg<<__FILE__<<": getCsmModels() -- Sensor models could not be established for:";
+
    csmModelList.clear();
+   models.clear();
+   vector< shared_ptr<MspImage> > images;
    for (int i=0; i<m_imageList.size(); ++i)
    {
       shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(m_imageList[i]);
       if (image)
+         images.push_back(image);
+   }
+
+   vector<string> errors;
+   unsigned int numErrors = MspImage::createCsmSensorModels(images, errors, m_numThreads);
+   if (numErrors == 0)
+   {
+      models.resize(images.size());
+      ThreadPool::instance()->parallelFor(images.size(), [&](size_t i)
       {
-         const csm::RasterGM* model = image->getCsmSensorModel();
-         csmModelList.push_back(model);
-         //clog<<"imageId: <"<<model->getImageIdentifier()<<">"<<endl;//###TODO
+         try
+         {
+            models[i] = images[i]->cloneCsmSensorModel();
+            if (!models[i])
+               errors[i] = "The sensor model could not be copied.";
+         }
+         catch (exception& e)
+         {
+            errors[i] = e.what();
+         }
+      }, m_numThreads);
+      for (size_t i=0; i<errors.size(); ++i)
+         numErrors += errors[i].empty() ? 0 : 1;
+   }
+   if (numErrors)
+   {
+      for (size_t i=0; i<images.size(); ++i)
+      {
+         if (!errors[i].empty())
+            xmsg<<"\n  <"<<images[i]->getImageId()<<">: "<<errors[i];
       }
+      models.clear();
+      throw ossimException(xmsg.str());
    }
+
+   for (size_t i=0; i<models.size(); ++i)
+      csmModelList.push_back(models[i].get());
 }
 
 void MspPhotoBlock::setCsmModels(MSP::CsmSensorModelList& csmModelList)
@@ -193,15 +1052,43 @@ void MspPhotoBlock::setCsmModels(MSP::CsmSensorModelList& csmModelList)
    if (m_imageList.size() != csmModelList.size())
       throw ossimException(xmsg.str());
 
+   // The models may have been built from the images' states without instantiating the images'
+   // own, whose IDs are only final once they are:
+   if (resolveImageIds())
+      rebuildImageIndex();
+
    for (int i=0; i<m_imageList.size(); ++i)
    {
       if (m_imageList[i]->getImageId() != csmModelList[i]->getImageIdentifier())
          throw ossimException(xmsg.str());
 
-      shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(m_imageList[i]);
+      shared_ptr<MspImage> image = getWritableImage(i);
       if (image)
          image->setCsmSensorModel(csmModelList[i]);
    }
 }
 
+void MspPhotoBlock::refreshOwnership()
+{
+   if (m_ownershipToken.use_count() > 1)
+   {
+      m_ownedImages.clear();
+      m_ownershipToken = make_shared<int>(0);
+   }
+}
+
+std::shared_ptr<MspImage> MspPhotoBlock::getWritableImage(size_t position)
+{
+   refreshOwnership();
+   shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(m_imageList[position]);
+   if (!image || m_ownedImages.count(image.get()))
+      return image;
+
+   // The clone shares the (immutable) model instance until a new one is set:
+   image.reset(new MspImage(*image));
+   m_imageList[position] = image;
+   m_ownedImages.insert(image.get());
+   return image;
+}
+
 } // end namespace ossimMsp
@@ -10,17 +10,25 @@
 #include <Config.h>
 #include <string>
 #include <vector>
+#include <istream>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <ossim/base/ossimConstants.h>
 #include <ossim/reg/TiePoint.h>
 #include <ossim/reg/GroundControlPoint.h>
 #include <ossim/reg/PhotoBlock.h>
 #include <csmutil/JointCovMatrix.h>
 #include <csmutil/CsmSensorModelList.h>
+#include "GcpCrossCovariance.h"
+#include "MeasurementStore.h"
+#include "PayloadCodec.h"
 
 namespace ossimMsp
 {
 
+class MspImage;
+
 /**
  * Class for representing MSP PhotoBlock.
  */
@@ -33,8 +41,18 @@ public:
     */
    MspPhotoBlock();
    MspPhotoBlock(const Json::Value& pb_json_node);
+
+   /**
+    * Copies are cheap branches: the image, tie point and GCP lists share their elements, and the
+    * measurement store shares its chunks, until either photoblock modifies them. Images are
+    * cloned the first time their models are set on either side. The original is only read, so
+    * may be copied concurrently with other readers.
+    */
    MspPhotoBlock(const MspPhotoBlock& copyThis);
 
+   /** Not assignable, since the copy constructor's sharing of images is one-way. */
+   MspPhotoBlock& operator=(const MspPhotoBlock&) = delete;
+
    ~MspPhotoBlock();
 
    /*
@@ -50,22 +68,206 @@ public:
    virtual void saveJSON(Json::Value& json) const;
 
    /**
-    * Convenience method to assemble the list of CSM sensor models corresponding to the images in
-    * the photoblock
+    * Loads an MSP-format photoblock (the same schema as loadJSON()) directly from a token stream,
+    * without holding a DOM of the document. Images are built in batches as their entries and
+    * model states arrive, and image points are grouped by point ID into compact records, so peak
+    * memory is bounded by the models and measurements themselves rather than by the text.
+    * Throws ossimException on syntax errors or if the stream is not an MSP photoblock.
     */
-   void getCsmModels(MSP::CsmSensorModelList& csmModelList);
+   void loadStream(std::istream& in);
 
    /**
-    * Convenience method to assign all CSM models for images in the photoblock:
+    * Loads the named file, either a binary snapshot (see loadSnapshot()) or JSON streamed with
+    * loadStream().
+    */
+   void loadFile(const std::string& filename);
+
+   /**
+    * Writes the photoblock as a binary PhotoBlockSnapshot: header fields, images with their
+    * compressed model states (or ISDs), the measurement store and GCPs. Together with
+    * loadSnapshot() and the JSON methods, this converts between the two formats. Throws
+    * ossimException on failure.
+    */
+   void saveSnapshot(const std::string& filename);
+
+   /**
+    * Adds the contents of a snapshot written by saveSnapshot(). The file is memory-mapped and the
+    * measurement arrays are copied straight from it without parsing. Sensor models are not
+    * instantiated until needed.
+    */
+   void loadSnapshot(const std::string& filename);
+
+   /**
+    * Assembles the list of CSM sensor models corresponding to the images in the photoblock, in
+    * image-list order, for adjustment. The images' own models may be shared with the model caches
+    * and with copies of the photoblock, so must never be modified: the list refers to private
+    * copies, held by models, and adjusted copies are put back with setCsmModels(). Models not yet
+    * instantiated are built and copied concurrently. If any model cannot be established, an
+    * exception listing every failed image is thrown.
+    */
+   void getCsmModels(MSP::CsmSensorModelList& csmModelList,
+                     std::vector< std::shared_ptr<csm::RasterGM> >& models);
+
+   /**
+    * Limits the number of threads used for instantiating sensor models (0 = use all threads in the
+    * shared pool).
+    */
+   void setNumThreads(unsigned int numThreads) { m_numThreads = numThreads; }
+
+   /**
+    * Sets the encoding of the image model states written by saveJSON() (default PLAIN). Applies
+    * to all images in the photoblock at the time of saving.
+    */
+   void setStateEncoding(PayloadCodec::Encoding encoding) { m_stateEncoding = encoding; }
+
+   /**
+    * Convenience method to assign all CSM models for images in the photoblock. Images shared with
+    * copies of the photoblock are first replaced by private clones (see getWritableImage()).
     */
    void setCsmModels(MSP::CsmSensorModelList& csmModelList);
 
+   /**
+    * Returns the image with the ID given (ignoring surrounding whitespace), or null if none. Uses
+    * a hash index of the image list, so is constant-time.
+    */
+   std::shared_ptr<ossim::Image> getImage(const std::string& imageId);
+
+   /**
+    * Adds the image if not already in the photoblock, returning its position in the image list.
+    * Hides the base class version to keep the image index current.
+    */
+   unsigned int addImage(std::shared_ptr<ossim::Image> image);
+
+   /**
+    * Removes the image with the ID given from the image list. Measurements on it are dropped from
+    * the tie points, and tie points left measured on fewer than two images are removed. Returns
+    * false if there is no such image.
+    */
+   bool removeImage(const std::string& imageId);
+
+   /** Removes the tie points with the IDs given, returning the number removed. */
+   size_t removeTiePoints(const std::vector<std::string>& pointIds);
+
+   /**
+    * Removes the ground control points with the IDs given, with their cross-covariances,
+    * returning the number removed.
+    */
+   size_t removeGroundPoints(const std::vector<std::string>& gcpIds);
+
+   /**
+    * Edits the photoblock in place. The delta uses the loadJSON() schema for additions, plus
+    * lists of IDs to remove, which are applied first:
+    *
+    *    { "removeImages": [imageId, ...], "removeTiePoints": [pointId, ...],
+    *      "removeGroundPoints": [gcpId, ...],
+    *      "imageList": [...], "sensorModelStateList": [...], "groundPointList": [...],
+    *      "gpCrossCovList": [...], "imagePointList": [...] }
+    *
+    * Image points with the ID of an existing tie point add measurements to it. Only the edited
+    * items are parsed or built, although removals compact the measurement arrays. Throws
+    * ossimException if an added image cannot be loaded.
+    */
+   void applyDelta(const Json::Value& delta);
+
+   /**
+    * Returns the image measurements of all tie points as a contiguous store, indexed by point.
+    * The TiePoint list remains the editable view: tie points added or removed through it are
+    * picked up by re-deriving the store on the next call.
+    */
+   const MeasurementStore& getMeasurements();
+
+   /** Cross-covariances between GCPs, from the gpCrossCovList. */
+   const GcpCrossCovariance& getGcpCrossCovariance() const { return m_gcpCrossCov; }
+
    MSP::JointCovMatrix& getJointCovariance() {return m_mspJCM;}
 
    void setJointCovariance(const MSP::JointCovMatrix& cov) { m_mspJCM = cov; }
 
 private:
-   std::shared_ptr<ossim::Image> findImage(const std::string& imageId);
+   /** Image point measurements grouped by point ID while loading, without per-point JSON. */
+   struct ImagePointTable
+   {
+      struct Record
+      {
+         unsigned int point;
+         unsigned int image;
+         double column;
+         double row;
+         double sigmaColumn;
+         double sigmaRow;
+         double rho;
+      };
+
+      void add(const std::string& pointId, const std::string& imageId, Record& record);
+
+      std::vector<std::string> pointIds; // in order of first appearance
+      std::unordered_map<std::string, unsigned int> pointIndex;
+      std::vector<std::string> imageIds;
+      std::unordered_map<std::string, unsigned int> imageIndex;
+      std::vector<Record> records;
+   };
+
+   void loadHeader(const Json::Value& pbheaderJson);
+
+   /** Adds the images, GCPs and image points of an MSP-format photoblock or delta. */
+   void addFromJSON(const Json::Value& json);
+
+   /**
+    * Instantiates the images (each node holding its image entry with the model state appended)
+    * concurrently and adds them in order. firstIndex numbers the nodes in error messages.
+    */
+   void addImages(std::vector<Json::Value>& imageNodes, size_t firstIndex);
+
+   void addGroundPoints(const std::vector<Json::Value>& gcpNodes);
+
+   /** Creates the tie points measured on at least two known images. */
+   void addTiePoints(const ImagePointTable& table);
+
+   /** Creates TiePoints for the measurement store's points from firstPoint on. */
+   void createTiePoints(unsigned int firstPoint);
+
+   /** Builds the TiePoint view of a point in the (indexed) measurement store. */
+   std::shared_ptr<ossim::TiePoint> buildTiePoint(unsigned int point) const;
+
+   /**
+    * Replaces the TiePoints of points whose measurements changed, dropping points left measured
+    * on fewer than two images.
+    */
+   void refreshTiePoints(const std::vector<unsigned int>& points);
+
+   /** ID of the point in the measurement store: the GCP ID if any, else the tie point ID. */
+   static std::string pointIdOf(const ossim::TiePoint& tp);
+
+   /** Returns the position of the image in m_imageList, or -1 if not present. */
+   int findImagePosition(const std::string& imageId);
+
+   /** Re-derives the measurement store from the TiePoint list if it no longer corresponds. */
+   void syncMeasurements();
+
+   /** Image IDs are matched with surrounding whitespace removed. */
+   static std::string normalizeImageId(const std::string& imageId);
+
+   /** Re-indexes the whole image list. */
+   void rebuildImageIndex();
+
+   /**
+    * Instantiates the sensor models not yet built, which may update their images' IDs (see
+    * MspImage::getCsmSensorModel()). Returns true if any image ID changed.
+    */
+   bool resolveImageIds();
+
+   /**
+    * Forgets the images owned if the photoblock has been copied since they were, starting a new
+    * ownership token.
+    */
+   void refreshOwnership();
+
+   /**
+    * Returns the image at the list position for modification, first replacing it with a private
+    * clone if it may be shared with a copy of this photoblock. TiePoints identify images by ID,
+    * so they are left referring to the original.
+    */
+   std::shared_ptr<MspImage> getWritableImage(size_t position);
 
    std::string m_name;
    std::string m_type;
@@ -76,7 +278,28 @@ private:
    std::string m_derivedFrom;
    std::string m_disseminationCtrls;
 
+   GcpCrossCovariance m_gcpCrossCov;
    MSP::JointCovMatrix m_mspJCM;
+   unsigned int m_numThreads;
+   PayloadCodec::Encoding m_stateEncoding;
+
+   // Normalized image ID to position in m_imageList. The base class (and callers of
+   // getImageList()) can modify the list directly, so the index is checked against the list on
+   // use and rebuilt when found stale:
+   std::unordered_map<std::string, size_t> m_imageIndex;
+   size_t m_indexedCount;
+
+   // Measurements of the first m_measuredCount tie points, or of none if m_measuredCount is -1
+   // (i.e. invalidated by a change of image positions):
+   MeasurementStore m_measurements;
+   size_t m_measuredCount;
+
+   // Images cloned or added by this photoblock since it was last copied, and so not shared with
+   // any copy. Copies hold a reference to the token of the photoblock they were copied from (and
+   // to those it held), so a token in use elsewhere means the owned images may now be shared:
+   std::unordered_set<const ossim::Image*> m_ownedImages;
+   std::shared_ptr<int> m_ownershipToken;
+   std::vector< std::shared_ptr<int> > m_sharedTokens;
 };
 
 } // End namespace ossimMsp
@@ -0,0 +1,277 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "NitfIsdReader.h"
+#include "FileIdentity.h"
+#include "LruCache.h"
+#include <ossim/base/ossimException.h>
+#include <ossim/base/ossimPreferences.h>
+#include <ossim/base/ossimString.h>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+// Offset of the FL field in both NITF 2.0 and 2.1 file headers (not counting the conditional
+// FSDEVT field of 2.0):
+static const size_t FL_OFFSET = 342;
+
+// Offset of the NITF 2.0 FSDWNG field, whose value "999998" adds the 40-character FSDEVT field:
+static const size_t FSDWNG_OFFSET = 280;
+
+NitfIsdReader::NitfIsdReader()
+:  m_data (0),
+   m_size (0),
+   m_flOffset (0),
+   m_extHeaderOffset (0),
+   m_headerLength (0)
+{
+}
+
+NitfIsdReader::~NitfIsdReader()
+{
+   close();
+}
+
+bool NitfIsdReader::open(const std::string& filename)
+{
+   close();
+
+   if (!m_file.open(filename))
+      return false;
+   m_data = m_file.data();
+   m_size = m_file.size();
+   m_filename = filename;
+
+   try
+   {
+      // Identify the format and version:
+      if ((m_size < FL_OFFSET + 18) ||
+          (strncmp(m_data, "NITF", 4) && strncmp(m_data, "NSIF", 4)))
+      {
+         close();
+         return false;
+      }
+      bool isVersion20 = (strncmp(m_data, "NITF02.00", 9) == 0);
+
+      m_flOffset = FL_OFFSET;
+      if (isVersion20 && (strncmp(m_data + FSDWNG_OFFSET, "999998", 6) == 0))
+         m_flOffset += 40;
+
+      size_t pos = m_flOffset;
+      readNumber(pos, 12); // FL, not trusted since it may be 999999999999 (unknown)
+      m_headerLength = (size_t) readNumber(pos, 6);
+
+      // Segment tables always appear in this order. NUMX of 2.1 is reserved (always 0) and takes
+      // the place of 2.0's label segments:
+      vector<Segment> graphics, labels, texts, res;
+      readSegments(pos, 6, 10, m_images);
+      readSegments(pos, 4, 6, graphics);
+      readSegments(pos, 4, 3, labels);
+      readSegments(pos, 4, 5, texts);
+      readSegments(pos, 4, 9, m_des);
+      readSegments(pos, 4, 7, res);
+      m_extHeaderOffset = pos;
+      if ((m_headerLength < m_extHeaderOffset) || (m_headerLength > m_size))
+         throw ossimException("Header length inconsistent with segment tables.");
+
+      // Segments follow the header in the same order as their tables:
+      ossim_uint64 offset = m_headerLength;
+      vector<Segment>* lists[] = { &m_images, &graphics, &labels, &texts, &m_des, &res };
+      for (size_t l=0; l<6; ++l)
+      {
+         vector<Segment>& segments = *lists[l];
+         for (size_t s=0; s<segments.size(); ++s)
+         {
+            segments[s].offset = offset;
+            offset += segments[s].subheaderLength + segments[s].dataLength;
+         }
+      }
+   }
+   catch (exception&)
+   {
+      close();
+      return false;
+   }
+
+   return true;
+}
+
+void NitfIsdReader::close()
+{
+   m_file.close();
+   m_data = 0;
+   m_size = 0;
+   m_flOffset = 0;
+   m_extHeaderOffset = 0;
+   m_headerLength = 0;
+   m_images.clear();
+   m_des.clear();
+   m_filename.clear();
+}
+
+ossim_uint64 NitfIsdReader::readNumber(size_t& pos, size_t width) const
+{
+   if (pos + width > m_size)
+      throw ossimException("Unexpected end of NITF header.");
+
+   ossim_uint64 value = 0;
+   for (size_t i=0; i<width; ++i)
+   {
+      char c = m_data[pos + i];
+      if ((c < '0') || (c > '9'))
+         throw ossimException("Non-numeric NITF header field.");
+      value = value*10 + (ossim_uint64) (c - '0');
+   }
+   pos += width;
+   return value;
+}
+
+void NitfIsdReader::readSegments(size_t& pos,
+                                 size_t subheaderWidth,
+                                 size_t dataWidth,
+                                 std::vector<Segment>& segments) const
+{
+   size_t count = (size_t) readNumber(pos, 3);
+   segments.resize(count);
+   for (size_t i=0; i<count; ++i)
+   {
+      segments[i].subheaderLength = readNumber(pos, subheaderWidth);
+      segments[i].dataLength = readNumber(pos, dataWidth);
+      segments[i].offset = 0;
+   }
+}
+
+void NitfIsdReader::appendNumber(std::string& s, ossim_uint64 value, size_t width)
+{
+   string digits = ossimString::toString(value).string();
+   if (digits.size() < width)
+      s.append(width - digits.size(), '0');
+   s.append(digits);
+}
+
+void NitfIsdReader::getIsd(unsigned int entryIndex, std::string& isd) const
+{
+   ostringstream xmsg;
+   xmsg<<__FILE__<<": getIsd() -- <"<<m_filename<<"> ";
+
+   if (!m_data)
+   {
+      xmsg<<"File is not open.";
+      throw ossimException(xmsg.str());
+   }
+   if (entryIndex >= m_images.size())
+   {
+      xmsg<<"Image entry "<<entryIndex<<" does not exist.";
+      throw ossimException(xmsg.str());
+   }
+
+   // Only subheaders and DES are copied, and they must be present in the file:
+   const Segment& image = m_images[entryIndex];
+   ossim_uint64 length = 0;
+   if (image.offset + image.subheaderLength > m_size)
+   {
+      xmsg<<"Image subheader extends past end of file.";
+      throw ossimException(xmsg.str());
+   }
+   for (size_t i=0; i<m_des.size(); ++i)
+   {
+      length += m_des[i].subheaderLength + m_des[i].dataLength;
+      if (m_des[i].offset + m_des[i].subheaderLength + m_des[i].dataLength > m_size)
+      {
+         xmsg<<"Data extension segment extends past end of file.";
+         throw ossimException(xmsg.str());
+      }
+   }
+
+   // Rewrite the file header with one image segment having no pixel data, no graphic, text or
+   // reserved extension segments, and the original DES. The user-defined and extended header
+   // data (with their TREs) are kept as is:
+   string header (m_data, m_flOffset);
+   size_t lengthsPos = header.size();
+   header.append(18, '0'); // FL and HL, filled in below
+   appendNumber(header, 1, 3);
+   appendNumber(header, image.subheaderLength, 6);
+   appendNumber(header, 0, 10);
+   header.append("000"); // NUMS
+   header.append("000"); // NUMX (2.1) or NUML (2.0)
+   header.append("000"); // NUMT
+   appendNumber(header, m_des.size(), 3);
+   for (size_t i=0; i<m_des.size(); ++i)
+   {
+      appendNumber(header, m_des[i].subheaderLength, 4);
+      appendNumber(header, m_des[i].dataLength, 9);
+   }
+   header.append("000"); // NUMRES
+   header.append(m_data + m_extHeaderOffset, m_headerLength - m_extHeaderOffset);
+
+   length += header.size() + image.subheaderLength;
+   string lengths;
+   appendNumber(lengths, length, 12);
+   appendNumber(lengths, header.size(), 6);
+   header.replace(lengthsPos, lengths.size(), lengths);
+
+   isd.clear();
+   isd.reserve((size_t) length);
+   isd.append(header);
+   isd.append(m_data + image.offset, (size_t) image.subheaderLength);
+   for (size_t i=0; i<m_des.size(); ++i)
+   {
+      isd.append(m_data + m_des[i].offset,
+                 (size_t) (m_des[i].subheaderLength + m_des[i].dataLength));
+   }
+}
+
+void NitfIsdReader::getIsd(const std::string& filename, unsigned int entryIndex, std::string& isd)
+{
+   typedef LruCache< string, shared_ptr<const string> > IsdCache;
+   static IsdCache* s_cache = 0;
+   static std::once_flag s_once;
+   std::call_once(s_once, []()
+   {
+      size_t maxBytes = 64*1024*1024;
+      const char* value = ossimPreferences::instance()->findPreference("msp.isd_cache.max_bytes");
+      if (value)
+         maxBytes = (size_t) ossimString(value).toInt64();
+      s_cache = new IsdCache(maxBytes);
+   });
+
+   // Keyed by file identity, so a modified file is re-read:
+   FileIdentity fileId;
+   string key;
+   if (fileId.read(filename))
+   {
+      ostringstream s;
+      s<<fileId.path<<'\n'<<fileId.size<<'\n'<<fileId.mtime<<'\n'<<entryIndex;
+      key = s.str();
+      shared_ptr<const string> cached;
+      if (s_cache->find(key, cached))
+      {
+         isd = *cached;
+         return;
+      }
+   }
+
+   NitfIsdReader reader;
+   if (!reader.open(filename))
+   {
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": getIsd() -- Could not open <"<<filename<<"> as a NITF file.";
+      throw ossimException(xmsg.str());
+   }
+   reader.getIsd(entryIndex, isd);
+
+   if (!key.empty())
+      s_cache->insert(key, shared_ptr<const string>(new string(isd)), isd.size());
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,87 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef NitfIsdReader_HEADER
+#define NitfIsdReader_HEADER 1
+
+#include "MappedFile.h"
+#include <ossim/base/ossimConstants.h>
+#include <string>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Extracts the image support data (ISD) for one image entry of a NITF 2.0/2.1 (or NSIF 1.0) file
+ * without reading pixel data. The file is memory-mapped and only the header, the entry's image
+ * subheader (with its TREs) and the data extension segments are touched.
+ *
+ * The ISD is itself a valid, header-only NITF: the file header is rewritten to reference the one
+ * image segment with zero-length image data, followed by that image subheader and all DES. It can
+ * be given to MSP as a csm::BytestreamIsd in place of the full image file.
+ */
+class NitfIsdReader
+{
+public:
+   NitfIsdReader();
+   ~NitfIsdReader();
+
+   /**
+    * Maps the file and parses the segment tables. Returns false if the file cannot be mapped or
+    * is not a NITF.
+    */
+   bool open(const std::string& filename);
+
+   void close();
+
+   unsigned int getNumImages() const { return (unsigned int) m_images.size(); }
+
+   /**
+    * Assembles the header-only NITF for the image entry into isd. Throws ossimException if the
+    * entry does not exist or the file is malformed.
+    */
+   void getIsd(unsigned int entryIndex, std::string& isd) const;
+
+   /**
+    * Convenience returning the ISD for the image entry, from a process-wide cache keyed by file
+    * identity when available. The cache size is set by the "msp.isd_cache.max_bytes" preference
+    * (default 64 MB). Throws ossimException on failure.
+    */
+   static void getIsd(const std::string& filename, unsigned int entryIndex, std::string& isd);
+
+private:
+   struct Segment
+   {
+      ossim_uint64 subheaderLength;
+      ossim_uint64 dataLength;
+      ossim_uint64 offset; // of the subheader from start of file
+   };
+
+   /** Reads a fixed-width decimal field, advancing pos. Throws if out of range or not numeric. */
+   ossim_uint64 readNumber(size_t& pos, size_t width) const;
+
+   /** Reads a segment count and its table of subheader/data lengths, advancing pos. */
+   void readSegments(size_t& pos, size_t subheaderWidth, size_t dataWidth,
+                     std::vector<Segment>& segments) const;
+
+   static void appendNumber(std::string& s, ossim_uint64 value, size_t width);
+
+   const char* m_data;
+   size_t m_size;
+   MappedFile m_file;
+   std::string m_filename;
+
+   size_t m_flOffset;         // offset of the FL field, where the segment tables start
+   size_t m_extHeaderOffset;  // offset of UDHDL, i.e. the user-defined and extended header data
+   size_t m_headerLength;     // HL
+   std::vector<Segment> m_images;
+   std::vector<Segment> m_des;
+};
+
+} // End namespace ossimMsp
+
+#endif
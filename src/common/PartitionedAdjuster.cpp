@@ -0,0 +1,635 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "PartitionedAdjuster.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <queue>
+#include <sstream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+PartitionedAdjuster::Options::Options()
+:  maxImagesPerPartition (0),
+   overlapFraction (0.25),
+   minSharedPoints (3),
+   compareFullSolve (false)
+{
+}
+
+PartitionedAdjuster::Report::Report()
+:  numPartitions (0),
+   numSharedImages (0),
+   numSharedPoints (0),
+   compared (false),
+   numPointsCompared (0),
+   pointRmsDifference (0.0),
+   maxPointDifference (0.0)
+{
+}
+
+PartitionedAdjuster::PartitionedAdjuster(unsigned int numImages, const ModelFactory& factory)
+:  m_factory (factory),
+   m_models (numImages),
+   m_imageObservations (numImages),
+   m_imageRms (numImages, 0.0),
+   m_imageStarts (numImages)
+{
+}
+
+unsigned int PartitionedAdjuster::addPoint(const std::string& pointId)
+{
+   PointData point;
+   point.id = pointId;
+   point.control = false;
+   point.initialized = false;
+   point.estimated = false;
+   fill(point.prior, point.prior + 3, 0.0);
+   fill(point.priorCovariance, point.priorCovariance + 9, 0.0);
+   fill(point.start, point.start + 3, 0.0);
+   fill(point.position, point.position + 3, 0.0);
+   fill(point.covariance, point.covariance + 9, 0.0);
+   m_points.push_back(point);
+   return (unsigned int) (m_points.size() - 1);
+}
+
+unsigned int PartitionedAdjuster::addControlPoint(const std::string& pointId, const double* ecf,
+                                                  const double* covariance)
+{
+   unsigned int index = addPoint(pointId);
+   PointData& point = m_points[index];
+   point.control = true;
+   copy(ecf, ecf + 3, point.prior);
+   copy(covariance, covariance + 9, point.priorCovariance);
+   return index;
+}
+
+void PartitionedAdjuster::addObservation(unsigned int point, unsigned int image, double line,
+                                         double sample, const double* covariance)
+{
+   Observation obs;
+   obs.point = point;
+   obs.image = image;
+   obs.line = line;
+   obs.sample = sample;
+   copy(covariance, covariance + 3, obs.covariance);
+
+   m_points[point].observations.push_back(m_observations.size());
+   m_imageObservations[image].push_back(m_observations.size());
+   m_observations.push_back(obs);
+}
+
+void PartitionedAdjuster::setImageParameters(unsigned int image,
+                                             const std::vector<double>& values)
+{
+   m_imageStarts[image] = values;
+}
+
+void PartitionedAdjuster::setPointPosition(unsigned int point, const double* ecf)
+{
+   copy(ecf, ecf + 3, m_points[point].start);
+   m_points[point].initialized = true;
+}
+
+void PartitionedAdjuster::buildNeighbors()
+{
+   size_t numImages = m_models.size();
+   vector< unordered_map<unsigned int, unsigned int> > counts (numImages);
+   vector<unsigned int> images;
+   for (const PointData& point : m_points)
+   {
+      images.clear();
+      for (size_t a : point.observations)
+         images.push_back(m_observations[a].image);
+      sort(images.begin(), images.end());
+      images.erase(unique(images.begin(), images.end()), images.end());
+      for (size_t j=0; j<images.size(); ++j)
+      {
+         for (size_t k=j+1; k<images.size(); ++k)
+         {
+            ++counts[images[j]][images[k]];
+            ++counts[images[k]][images[j]];
+         }
+      }
+   }
+
+   m_neighbors.assign(numImages, vector< pair<unsigned int, unsigned int> >());
+   for (size_t j=0; j<numImages; ++j)
+      m_neighbors[j].assign(counts[j].begin(), counts[j].end());
+}
+
+void PartitionedAdjuster::partition(size_t target,
+                                    std::vector< std::vector<unsigned int> >& parts) const
+{
+   // Greedy growth from a seed, taking the most strongly connected images first, so that
+   // partitions are compact regions of the block. A disconnected graph is handled by reseeding
+   // from the next unassigned image:
+   size_t numImages = m_models.size();
+   vector<bool> assigned (numImages, false);
+   parts.clear();
+   for (unsigned int seed=0; seed<numImages; ++seed)
+   {
+      if (assigned[seed])
+         continue;
+
+      // Connection strength of each candidate to the partition being grown:
+      vector<unsigned int> part;
+      unordered_map<unsigned int, unsigned int> strength;
+      priority_queue< pair<unsigned int, unsigned int> > candidates;
+      candidates.push(make_pair(0u, seed));
+      while (!candidates.empty() && (part.size() < target))
+      {
+         unsigned int image = candidates.top().second;
+         unsigned int weight = candidates.top().first;
+         candidates.pop();
+         if (assigned[image] || (weight < strength[image]))
+            continue; // stale entry
+         assigned[image] = true;
+         part.push_back(image);
+         for (const pair<unsigned int, unsigned int>& neighbor : m_neighbors[image])
+         {
+            if (assigned[neighbor.first])
+               continue;
+            unsigned int& s = strength[neighbor.first];
+            s += neighbor.second;
+            candidates.push(make_pair(s, neighbor.first));
+         }
+      }
+      parts.push_back(part);
+   }
+
+   // Fold partitions that are much smaller than the target (stragglers left at the edges of the
+   // growth) into the neighbor partition they are most connected to:
+   vector<int> owner (numImages, -1);
+   for (size_t k=0; k<parts.size(); ++k)
+   {
+      for (unsigned int image : parts[k])
+         owner[image] = (int) k;
+   }
+   for (size_t k=0; k<parts.size(); ++k)
+   {
+      if (parts[k].empty() || (4*parts[k].size() >= target))
+         continue;
+      unordered_map<int, unsigned int> links;
+      for (unsigned int image : parts[k])
+      {
+         for (const pair<unsigned int, unsigned int>& neighbor : m_neighbors[image])
+         {
+            if (owner[neighbor.first] != (int) k)
+               links[owner[neighbor.first]] += neighbor.second;
+         }
+      }
+      int best = -1;
+      unsigned int bestLinks = 0;
+      for (const pair<const int, unsigned int>& link : links)
+      {
+         if ((link.second > bestLinks) ||
+             ((link.second == bestLinks) && (best >= 0) && (link.first < best)))
+         {
+            best = link.first;
+            bestLinks = link.second;
+         }
+      }
+      if (best < 0)
+         continue; // an isolated group of images, adjusted on its own
+      for (unsigned int image : parts[k])
+      {
+         owner[image] = best;
+         parts[best].push_back(image);
+      }
+      parts[k].clear();
+   }
+   parts.erase(remove_if(parts.begin(), parts.end(),
+                         [](const vector<unsigned int>& part) { return part.empty(); }),
+               parts.end());
+}
+
+std::vector<unsigned int> PartitionedAdjuster::addOverlap(const std::vector<unsigned int>& part,
+                                                          const Options& options) const
+{
+   vector<unsigned int> images (part);
+   unordered_map<unsigned int, unsigned int> shared;
+   vector<bool> inPart (m_models.size(), false);
+   for (unsigned int image : part)
+      inPart[image] = true;
+   for (unsigned int image : part)
+   {
+      for (const pair<unsigned int, unsigned int>& neighbor : m_neighbors[image])
+      {
+         if (!inPart[neighbor.first])
+            shared[neighbor.first] += neighbor.second;
+      }
+   }
+
+   vector< pair<unsigned int, unsigned int> > ranked;
+   for (const pair<const unsigned int, unsigned int>& entry : shared)
+   {
+      if (entry.second >= options.minSharedPoints)
+         ranked.push_back(make_pair(entry.second, entry.first));
+   }
+   sort(ranked.begin(), ranked.end(), greater< pair<unsigned int, unsigned int> >());
+   size_t maxOverlap = (size_t) ceil(options.overlapFraction*part.size());
+   for (size_t i=0; (i<ranked.size()) && (i<maxOverlap); ++i)
+      images.push_back(ranked[i].second);
+   return images;
+}
+
+void PartitionedAdjuster::createModels(SubBlock& block, unsigned int numThreads) const
+{
+   block.models.resize(block.images.size());
+   ThreadPool::instance()->parallelFor(block.images.size(), [&](size_t j)
+   {
+      block.models[j] = m_factory(block.images[j]);
+   }, numThreads);
+}
+
+void PartitionedAdjuster::buildBlock(SubBlock& block, const std::vector<bool>& fixed,
+                                     bool fresh) const
+{
+   vector<int> localImage (m_models.size(), -1);
+   for (size_t j=0; j<block.images.size(); ++j)
+   {
+      unsigned int image = block.images[j];
+      localImage[image] = (int) j;
+      bool adjustable = fixed.empty() || !fixed[image];
+      unsigned int local = block.adjuster.addImage(block.models[j].get(), adjustable);
+
+      // Starting values given for a different model are ignored:
+      const vector<double>& start = m_imageStarts[image];
+      if (fresh && !start.empty() &&
+          (start.size() == (size_t) block.models[j]->getNumParameters()))
+      {
+         block.adjuster.setImageParameters(local, &start[0]);
+      }
+   }
+
+   for (unsigned int p : block.points)
+   {
+      const PointData& point = m_points[p];
+      unsigned int local = point.control ?
+            block.adjuster.addControlPoint(point.id, point.prior, point.priorCovariance) :
+            block.adjuster.addPoint(point.id);
+      if (fresh && point.initialized)
+         block.adjuster.setPointPosition(local, point.start);
+      else if (!fresh && point.estimated)
+         block.adjuster.setPointPosition(local, point.position);
+      for (size_t a : point.observations)
+      {
+         const Observation& obs = m_observations[a];
+         if ((localImage[obs.image] < 0) ||
+             (!fresh && (obs.status.rejection != BundleAdjuster::NOT_REJECTED)))
+         {
+            continue;
+         }
+         block.adjuster.addObservation(local, (unsigned int) localImage[obs.image], obs.line,
+                                       obs.sample, obs.covariance);
+         block.observations.push_back(a);
+      }
+   }
+}
+
+void PartitionedAdjuster::takePoints(const SubBlock& block)
+{
+   for (size_t i=0; i<block.points.size(); ++i)
+   {
+      PointData& point = m_points[block.points[i]];
+      point.estimated = block.adjuster.isPointEstimated((unsigned int) i);
+      if (!point.estimated)
+         continue;
+      const double* position = block.adjuster.getPointPosition((unsigned int) i);
+      const double* covariance = block.adjuster.getPointCovariance((unsigned int) i);
+      copy(position, position + 3, point.position);
+      copy(covariance, covariance + 9, point.covariance);
+   }
+}
+
+void PartitionedAdjuster::takeObservations(const SubBlock& block, const std::vector<bool>& images)
+{
+   for (size_t i=0; i<block.observations.size(); ++i)
+   {
+      Observation& obs = m_observations[block.observations[i]];
+      if (images.empty() || images[obs.image])
+         obs.status = block.adjuster.getObservationStatus(i);
+   }
+}
+
+PartitionedAdjuster::Report PartitionedAdjuster::solve(const Options& options)
+{
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   Report report;
+   size_t numImages = m_models.size();
+   unsigned int numThreads = options.adjustment.numThreads;
+   vector<bool> noneFixed;
+   const ExecutionControl* control = options.adjustment.control;
+   BundleAdjuster::Options fullOptions (options.adjustment);
+
+   // Whole block in one adjustment:
+   auto solveFull = [&](SubBlock& full)
+   {
+      full.images.resize(numImages);
+      for (size_t j=0; j<numImages; ++j)
+         full.images[j] = (unsigned int) j;
+      full.points.resize(m_points.size());
+      for (size_t i=0; i<m_points.size(); ++i)
+         full.points[i] = (unsigned int) i;
+      createModels(full, numThreads);
+      buildBlock(full, noneFixed, true);
+      full.result = full.adjuster.solve(fullOptions);
+   };
+
+   if ((options.maxImagesPerPartition == 0) || (numImages <= options.maxImagesPerPartition))
+   {
+      SubBlock full;
+      solveFull(full);
+      m_models = full.models;
+      takePoints(full);
+      takeObservations(full, vector<bool>());
+      for (size_t j=0; j<numImages; ++j)
+         m_imageRms[j] = full.adjuster.getImageRms((unsigned int) j);
+      report.overall = full.result;
+      report.numPartitions = 1;
+      report.partitionSizes.push_back(numImages);
+      return report;
+   }
+
+   // Partition, and assign each point to the sub-blocks of the partitions its images are in:
+   buildNeighbors();
+   vector< vector<unsigned int> > parts;
+   partition(options.maxImagesPerPartition, parts);
+   size_t numParts = parts.size();
+   vector<unsigned int> home (numImages);
+   for (size_t k=0; k<numParts; ++k)
+   {
+      for (unsigned int image : parts[k])
+         home[image] = (unsigned int) k;
+   }
+
+   vector<SubBlock> blocks (numParts);
+   vector<bool> sharedPoint (m_points.size(), false);
+   vector<unsigned int> pointHomes;
+   for (size_t i=0; i<m_points.size(); ++i)
+   {
+      pointHomes.clear();
+      for (size_t a : m_points[i].observations)
+         pointHomes.push_back(home[m_observations[a].image]);
+      sort(pointHomes.begin(), pointHomes.end());
+      pointHomes.erase(unique(pointHomes.begin(), pointHomes.end()), pointHomes.end());
+      for (unsigned int k : pointHomes)
+         blocks[k].points.push_back((unsigned int) i);
+      sharedPoint[i] = (pointHomes.size() > 1);
+      report.numSharedPoints += sharedPoint[i] ? 1 : 0;
+   }
+
+   vector<unsigned int> memberships (numImages, 0);
+   for (size_t k=0; k<numParts; ++k)
+   {
+      blocks[k].images = addOverlap(parts[k], options);
+      for (unsigned int image : blocks[k].images)
+         ++memberships[image];
+   }
+
+   // Adjust the sub-blocks concurrently, each single-threaded:
+   BundleAdjuster::Options blockOptions (options.adjustment);
+   blockOptions.numThreads = 1;
+   ThreadPool::instance()->parallelFor(numParts, [&](size_t k)
+   {
+      BundleAdjuster::Options partOptions (blockOptions);
+      ostringstream stage;
+      stage<<"partition "<<k;
+      partOptions.stage = stage.str();
+      createModels(blocks[k], 1);
+      buildBlock(blocks[k], noneFixed, true);
+      blocks[k].result = blocks[k].adjuster.solve(partOptions);
+   }, numThreads);
+
+   // Each image takes its own partition's solution, as does each point unless shared, whose
+   // sub-block estimates are averaged as a start for the merge:
+   report.overall.converged = true;
+   double initialSquares = 0.0;
+   size_t initialCount = 0;
+   for (size_t k=0; k<numParts; ++k)
+   {
+      SubBlock& block = blocks[k];
+      for (size_t j=0; j<parts[k].size(); ++j)
+      {
+         m_models[block.images[j]] = block.models[j];
+         report.overall.numParameters += block.adjuster.getNumImageParameters((unsigned int) j);
+      }
+      vector<bool> own (numImages, false);
+      for (unsigned int image : parts[k])
+         own[image] = true;
+      takeObservations(block, own);
+      report.partitionSizes.push_back(parts[k].size());
+      report.partitionResults.push_back(block.result);
+      report.overall.converged = report.overall.converged && block.result.converged;
+      if (block.result.interruption != ExecutionControl::NOT_INTERRUPTED)
+      {
+         report.overall.interruption = block.result.interruption;
+         report.overall.message = block.result.message;
+      }
+      report.overall.cgIterations += block.result.cgIterations;
+      report.overall.approximateCovariance =
+            report.overall.approximateCovariance || block.result.approximateCovariance;
+      initialSquares += block.result.initialRms*block.result.initialRms*
+                        block.result.numObservations;
+      initialCount += block.result.numObservations;
+   }
+   report.numPartitions = numParts;
+   report.overall.initialRms = initialCount ? sqrt(initialSquares/initialCount) : 0.0;
+
+   vector<unsigned int> numEstimates (m_points.size(), 0);
+   vector<double> sums (3*m_points.size(), 0.0);
+   for (size_t k=0; k<numParts; ++k)
+   {
+      const SubBlock& block = blocks[k];
+      for (size_t i=0; i<block.points.size(); ++i)
+      {
+         unsigned int p = block.points[i];
+         if (!block.adjuster.isPointEstimated((unsigned int) i))
+            continue;
+         const double* position = block.adjuster.getPointPosition((unsigned int) i);
+         for (int c=0; c<3; ++c)
+            sums[3*p + c] += position[c];
+         if (numEstimates[p]++ == 0)
+         {
+            const double* covariance = block.adjuster.getPointCovariance((unsigned int) i);
+            copy(covariance, covariance + 9, m_points[p].covariance);
+         }
+      }
+   }
+   for (size_t i=0; i<m_points.size(); ++i)
+   {
+      PointData& point = m_points[i];
+      point.estimated = (numEstimates[i] > 0);
+      if (!point.estimated && point.control && point.observations.empty())
+      {
+         // Unobserved control keeps its prior, as in a single adjustment:
+         point.estimated = true;
+         copy(point.prior, point.prior + 3, point.position);
+         copy(point.priorCovariance, point.priorCovariance + 9, point.covariance);
+      }
+      for (int c=0; (c<3) && numEstimates[i]; ++c)
+         point.position[c] = sums[3*i + c]/numEstimates[i];
+   }
+
+   // The merge re-adjusts the images in more than one sub-block, with the rest of the images
+   // observing the points involved held fixed. Its points are the shared points and all others
+   // measured on the shared images, whose solutions would otherwise be left inconsistent:
+   vector<bool> fixed (numImages, true);
+   for (size_t j=0; j<numImages; ++j)
+   {
+      fixed[j] = (memberships[j] < 2);
+      report.numSharedImages += fixed[j] ? 0 : 1;
+   }
+   SubBlock merge;
+   vector<bool> inMerge (numImages, false);
+   for (size_t i=0; i<m_points.size(); ++i)
+   {
+      bool include = sharedPoint[i];
+      for (size_t a : m_points[i].observations)
+         include = include || !fixed[m_observations[a].image];
+      if (!include)
+         continue;
+      merge.points.push_back((unsigned int) i);
+      for (size_t a : m_points[i].observations)
+         inMerge[m_observations[a].image] = true;
+   }
+   for (size_t j=0; j<numImages; ++j)
+   {
+      if (!inMerge[j])
+         continue;
+      merge.images.push_back((unsigned int) j);
+      merge.models.push_back(m_models[j]);
+   }
+   // An interrupted adjustment skips the merge, leaving each image and point with its own
+   // partition's estimates (points shared averaged):
+   bool interrupted = (report.overall.interruption != ExecutionControl::NOT_INTERRUPTED);
+   if (!interrupted && control)
+   {
+      report.overall.interruption = control->checkInterruption();
+      interrupted = (report.overall.interruption != ExecutionControl::NOT_INTERRUPTED);
+      if (interrupted)
+      {
+         report.overall.message = (report.overall.interruption == ExecutionControl::CANCELLED) ?
+                                  "Cancelled." : "Time budget exhausted.";
+      }
+   }
+   if (!merge.points.empty() && !interrupted)
+   {
+      // The merge re-adds the shared images' observations, which their sub-block estimates
+      // already include, so they enter with fresh a priori models and only start from their
+      // sub-block parameter values:
+      vector< vector<double> > mergeStarts (merge.images.size());
+      ThreadPool::instance()->parallelFor(merge.images.size(), [&](size_t j)
+      {
+         unsigned int image = merge.images[j];
+         if (fixed[image])
+            return;
+         const csm::RasterGM& adjusted = *merge.models[j];
+         mergeStarts[j].resize(adjusted.getNumParameters());
+         for (size_t k=0; k<mergeStarts[j].size(); ++k)
+            mergeStarts[j][k] = adjusted.getParameterValue((int) k);
+         merge.models[j] = m_factory(image);
+      }, numThreads);
+
+      BundleAdjuster::Options mergeOptions (options.adjustment);
+      mergeOptions.stage = "merge";
+      buildBlock(merge, fixed, false);
+      for (size_t j=0; j<merge.images.size(); ++j)
+      {
+         if (!mergeStarts[j].empty())
+            merge.adjuster.setImageParameters((unsigned int) j, &mergeStarts[j][0]);
+      }
+      merge.result = merge.adjuster.solve(mergeOptions);
+      for (size_t j=0; j<merge.images.size(); ++j)
+      {
+         if (!fixed[merge.images[j]])
+            m_models[merge.images[j]] = merge.models[j];
+      }
+      takePoints(merge);
+      takeObservations(merge, vector<bool>());
+      report.mergeResult = merge.result;
+      report.overall.converged = report.overall.converged && merge.result.converged;
+      report.overall.cgIterations += merge.result.cgIterations;
+      report.overall.approximateCovariance =
+            report.overall.approximateCovariance || merge.result.approximateCovariance;
+   }
+   report.overall.iterations = merge.result.iterations;
+   report.overall.solver = merge.result.solver;
+   if (merge.result.interruption != ExecutionControl::NOT_INTERRUPTED)
+      report.overall.interruption = merge.result.interruption;
+   if (!interrupted)
+   {
+      report.overall.message = merge.points.empty() ?
+                               "No images or points shared by partitions." : merge.result.message;
+   }
+
+   // Residuals over the whole block, everything held fixed:
+   SubBlock all;
+   for (size_t j=0; j<numImages; ++j)
+      all.images.push_back((unsigned int) j);
+   all.models = m_models;
+   for (size_t i=0; i<m_points.size(); ++i)
+   {
+      if (m_points[i].estimated)
+         all.points.push_back((unsigned int) i);
+   }
+   buildBlock(all, vector<bool>(numImages, true), false);
+   BundleAdjuster::Options evaluation (options.adjustment);
+   evaluation.maxIterations = 0;
+   evaluation.computeCovariance = false;
+   evaluation.prepassThreshold = 0.0;
+   evaluation.control = 0;
+   BundleAdjuster::Result residuals = all.adjuster.solve(evaluation);
+   takeObservations(all, vector<bool>());
+   for (const Observation& obs : m_observations)
+      report.overall.numRejected += (obs.status.rejection != BundleAdjuster::NOT_REJECTED) ? 1 : 0;
+   report.overall.numDownweighted = residuals.numDownweighted;
+   for (size_t j=0; j<numImages; ++j)
+      m_imageRms[j] = all.adjuster.getImageRms((unsigned int) j);
+   report.overall.finalRms = residuals.finalRms;
+   report.overall.sigma0 = residuals.sigma0;
+   report.overall.numObservations = residuals.numObservations;
+   report.overall.numPoints = residuals.numPoints;
+
+   interrupted = (report.overall.interruption != ExecutionControl::NOT_INTERRUPTED);
+   if (options.compareFullSolve && !interrupted)
+   {
+      fullOptions.stage = "full solve";
+      SubBlock full;
+      solveFull(full);
+      report.compared = true;
+      report.fullResult = full.result;
+      double sumSquares = 0.0;
+      for (size_t i=0; i<m_points.size(); ++i)
+      {
+         if (!m_points[i].estimated || !full.adjuster.isPointEstimated((unsigned int) i))
+            continue;
+         const double* position = full.adjuster.getPointPosition((unsigned int) i);
+         double d2 = 0.0;
+         for (int c=0; c<3; ++c)
+            d2 += (m_points[i].position[c] - position[c])*(m_points[i].position[c] - position[c]);
+         sumSquares += d2;
+         report.maxPointDifference = max(report.maxPointDifference, sqrt(d2));
+         ++report.numPointsCompared;
+      }
+      if (report.numPointsCompared)
+         report.pointRmsDifference = sqrt(sumSquares/report.numPointsCompared);
+   }
+
+   report.overall.elapsedSeconds =
+         chrono::duration<double>(chrono::steady_clock::now() - start).count();
+   return report;
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,207 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef PartitionedAdjuster_HEADER
+#define PartitionedAdjuster_HEADER 1
+
+#include "BundleAdjuster.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Divide-and-conquer bundle adjustment for photoblocks too large to adjust in one piece. The
+ * images are partitioned by growing regions over the tie point connectivity graph (images joined
+ * by the number of points they share), and each partition is extended with the neighboring
+ * images most strongly connected to it. The overlapping sub-blocks are adjusted concurrently,
+ * each with its own model instances, and each image takes its parameters from the sub-block of
+ * its own partition.
+ *
+ * A final merge adjustment then re-estimates the shared part: the images belonging to more than
+ * one sub-block, and the points measured across partitions, holding the other images fixed.
+ * Shared images enter the merge with their a priori models, starting from their sub-block
+ * estimates, since the merge uses their observations again. Points measured within one partition
+ * keep their sub-block estimates.
+ *
+ * With Options::maxImagesPerPartition of 0 (or no more images than that), this is a single
+ * BundleAdjuster solve. Optionally a full solve is also run to measure the merge quality.
+ *
+ * With an ExecutionControl in the adjustment options, the sub-blocks report progress as
+ * "partition <k>" (concurrently) and the merge as "merge". When interrupted, the sub-blocks stop
+ * at their best estimates so far and the merge (and comparison) are skipped.
+ */
+class PartitionedAdjuster
+{
+public:
+   /** Returns a new private instance of the image's model. Called concurrently. */
+   typedef std::function<std::shared_ptr<csm::RasterGM>(unsigned int image)> ModelFactory;
+
+   struct Options
+   {
+      Options();
+
+      BundleAdjuster::Options adjustment;
+
+      /** Target partition size (0 = no partitioning). */
+      size_t maxImagesPerPartition;
+
+      /** Overlap images added to a partition, as a fraction of its size. */
+      double overlapFraction;
+
+      /** Points an image must share with a partition to be added as overlap. */
+      size_t minSharedPoints;
+
+      /** Also runs a full solve and compares the merged points with it. */
+      bool compareFullSolve;
+   };
+
+   struct Report
+   {
+      Report();
+
+      /**
+       * Summary of the whole adjustment. When partitioned: the merge's iterations, convergence of
+       * all solves, and RMS over all observations (the initial RMS over the sub-blocks).
+       */
+      BundleAdjuster::Result overall;
+
+      size_t numPartitions;
+      size_t numSharedImages;
+      size_t numSharedPoints;
+      std::vector<size_t> partitionSizes;          // own images, excluding overlap
+      std::vector<BundleAdjuster::Result> partitionResults;
+      BundleAdjuster::Result mergeResult;
+
+      bool compared;
+      BundleAdjuster::Result fullResult;
+      size_t numPointsCompared;
+      double pointRmsDifference;                  // meters
+      double maxPointDifference;
+   };
+
+   PartitionedAdjuster(unsigned int numImages, const ModelFactory& factory);
+
+   /** As for BundleAdjuster. */
+   unsigned int addPoint(const std::string& pointId);
+   unsigned int addControlPoint(const std::string& pointId, const double* ecf,
+                                const double* covariance);
+   void addObservation(unsigned int point, unsigned int image, double line, double sample,
+                       const double* covariance);
+
+   /**
+    * Warm start: the image's adjustment starts from the parameter values given (one per model
+    * parameter), with the a priori values and covariance of its factory models as the prior.
+    */
+   void setImageParameters(unsigned int image, const std::vector<double>& values);
+
+   /** Warm start: the point's initial position, which is otherwise found by intersection. */
+   void setPointPosition(unsigned int point, const double* ecf);
+
+   Report solve(const Options& options);
+
+   /** The adjusted model of the image, after solve(). */
+   std::shared_ptr<csm::RasterGM> getModel(unsigned int image) const { return m_models[image]; }
+
+   size_t getNumPoints() const { return m_points.size(); }
+   const std::string& getPointId(unsigned int point) const { return m_points[point].id; }
+   bool isPointEstimated(unsigned int point) const { return m_points[point].estimated; }
+   const double* getPointPosition(unsigned int point) const { return m_points[point].position; }
+   const double* getPointCovariance(unsigned int point) const
+   { return m_points[point].covariance; }
+
+   /**
+    * Rejection and final weighting of the observation (in order added), from the adjustment of its
+    * image's partition and the merge.
+    */
+   const BundleAdjuster::ObservationStatus& getObservationStatus(size_t observation) const
+   { return m_observations[observation].status; }
+
+   double getImageRms(unsigned int image) const { return m_imageRms[image]; }
+   size_t getNumImageObservations(unsigned int image) const
+   { return m_imageObservations[image].size(); }
+
+private:
+   struct PointData
+   {
+      std::string id;
+      bool control;
+      double prior[3];
+      double priorCovariance[9];
+      bool initialized;
+      double start[3];
+      bool estimated;
+      double position[3];
+      double covariance[9];
+      std::vector<size_t> observations;
+   };
+
+   struct Observation
+   {
+      unsigned int point;
+      unsigned int image;
+      double line;
+      double sample;
+      double covariance[3];
+      BundleAdjuster::ObservationStatus status;
+   };
+
+   /** An adjustment over a subset of the images and points. */
+   struct SubBlock
+   {
+      std::vector<unsigned int> images;         // global indices, in local order
+      std::vector< std::shared_ptr<csm::RasterGM> > models;
+      std::vector<unsigned int> points;         // global indices, in local order
+      std::vector<size_t> observations;         // global indices, in local order
+      BundleAdjuster adjuster;
+      BundleAdjuster::Result result;
+   };
+
+   /** Counts the points shared by each pair of images. */
+   void buildNeighbors();
+
+   /** Grows partitions of about the target size over the connectivity graph. */
+   void partition(size_t target, std::vector< std::vector<unsigned int> >& parts) const;
+
+   /** Adds the images most strongly connected to the partition, returning the sub-block images. */
+   std::vector<unsigned int> addOverlap(const std::vector<unsigned int>& part,
+                                        const Options& options) const;
+
+   /** Creates new model instances for the sub-block's images. */
+   void createModels(SubBlock& block, unsigned int numThreads) const;
+
+   /**
+    * Sets up the sub-block's adjuster with its images (adjustable unless marked otherwise by
+    * global index in fixed), points, and their observations on the sub-block's images. Fresh
+    * models and points take any warm start values, otherwise estimated points start from their
+    * current positions and rejected observations are left out.
+    */
+   void buildBlock(SubBlock& block, const std::vector<bool>& fixed, bool fresh) const;
+
+   /** Copies the sub-block's estimates of its points into the results. */
+   void takePoints(const SubBlock& block);
+
+   /** Copies the status of the sub-block's observations on the images given (all if empty). */
+   void takeObservations(const SubBlock& block, const std::vector<bool>& images);
+
+   ModelFactory m_factory;
+   std::vector< std::shared_ptr<csm::RasterGM> > m_models;
+   std::vector<PointData> m_points;
+   std::vector<Observation> m_observations;
+   std::vector< std::vector<size_t> > m_imageObservations;
+   std::vector<double> m_imageRms;
+   std::vector< std::vector<double> > m_imageStarts;
+
+   // Images sharing points with each image, with the number shared:
+   std::vector< std::vector< std::pair<unsigned int, unsigned int> > > m_neighbors;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,218 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "PayloadCodec.h"
+#include <ossim/base/ossimException.h>
+#include <sstream>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+static const char BASE64_CHARS[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Maps characters to their 6-bit values, -1 for non-base64 characters:
+static vector<signed char> makeBase64Lookup()
+{
+   vector<signed char> lookup (256, -1);
+   for (int i=0; i<64; ++i)
+      lookup[(unsigned char) BASE64_CHARS[i]] = (signed char) i;
+   return lookup;
+}
+
+void PayloadCodec::encode(const std::string& payload, Encoding encoding, Json::Value& json)
+{
+   if (encoding == PLAIN)
+   {
+      json = payload;
+      return;
+   }
+
+   string data;
+   json = Json::Value(Json::objectValue);
+   json["encoding"] = encodingToString(encoding);
+   if (encoding == ZLIB_BASE64)
+   {
+      string compressed;
+      compress(payload, compressed);
+      toBase64(compressed, data);
+      json["size"] = (Json::UInt64) payload.size();
+   }
+   else
+   {
+      toBase64(payload, data);
+   }
+   json["data"] = data;
+}
+
+void PayloadCodec::decode(const Json::Value& json, std::string& payload)
+{
+   ostringstream xmsg;
+   xmsg<<__FILE__<<": decode() -- ";
+
+   payload.clear();
+   if (json.isNull())
+      return;
+   if (json.isString())
+   {
+      payload = json.asString();
+      return;
+   }
+
+   string encoding = json["encoding"].asString();
+   if (encoding == "base64")
+   {
+      if (!fromBase64(json["data"].asString(), payload))
+      {
+         xmsg<<"Malformed base64 payload.";
+         throw ossimException(xmsg.str());
+      }
+      return;
+   }
+   if (encoding == "zlib+base64")
+   {
+      string compressed;
+      if (!json["size"].isIntegral() || !fromBase64(json["data"].asString(), compressed) ||
+          !uncompress(compressed, (size_t) json["size"].asUInt64(), payload))
+      {
+         xmsg<<"Malformed zlib+base64 payload.";
+         throw ossimException(xmsg.str());
+      }
+      return;
+   }
+
+   xmsg<<"Unsupported payload encoding <"<<encoding<<">.";
+   throw ossimException(xmsg.str());
+}
+
+PayloadCodec::Encoding PayloadCodec::encodingFromString(const std::string& name)
+{
+   if (name == "base64")
+      return BASE64;
+   if (name == "zlib+base64")
+      return ZLIB_BASE64;
+   return PLAIN;
+}
+
+std::string PayloadCodec::encodingToString(Encoding encoding)
+{
+   switch (encoding)
+   {
+   case BASE64:
+      return "base64";
+   case ZLIB_BASE64:
+      return "zlib+base64";
+   default:
+      break;
+   }
+   return "plain";
+}
+
+void PayloadCodec::toBase64(const std::string& binary, std::string& text)
+{
+   text.clear();
+   text.reserve(((binary.size() + 2) / 3) * 4);
+
+   const unsigned char* p = (const unsigned char*) binary.data();
+   size_t n = binary.size();
+   size_t i = 0;
+   for (; i+2<n; i+=3)
+   {
+      ossim_uint32 v = (p[i] << 16) | (p[i+1] << 8) | p[i+2];
+      text.push_back(BASE64_CHARS[(v >> 18) & 0x3F]);
+      text.push_back(BASE64_CHARS[(v >> 12) & 0x3F]);
+      text.push_back(BASE64_CHARS[(v >> 6) & 0x3F]);
+      text.push_back(BASE64_CHARS[v & 0x3F]);
+   }
+   if (i < n)
+   {
+      ossim_uint32 v = p[i] << 16;
+      if (i+1 < n)
+         v |= p[i+1] << 8;
+      text.push_back(BASE64_CHARS[(v >> 18) & 0x3F]);
+      text.push_back(BASE64_CHARS[(v >> 12) & 0x3F]);
+      text.push_back((i+1 < n) ? BASE64_CHARS[(v >> 6) & 0x3F] : '=');
+      text.push_back('=');
+   }
+}
+
+bool PayloadCodec::fromBase64(const std::string& text, std::string& binary)
+{
+   static const vector<signed char> s_lookup = makeBase64Lookup();
+
+   binary.clear();
+   binary.reserve((text.size() / 4) * 3);
+
+   ossim_uint32 v = 0;
+   int bits = 0;
+   size_t padding = 0;
+   for (size_t i=0; i<text.size(); ++i)
+   {
+      unsigned char c = (unsigned char) text[i];
+      if (c == '=')
+      {
+         ++padding;
+         continue;
+      }
+      if ((c == '\n') || (c == '\r'))
+         continue;
+      if (padding || (s_lookup[c] < 0))
+         return false;
+
+      v = (v << 6) | (ossim_uint32) s_lookup[c];
+      bits += 6;
+      if (bits >= 8)
+      {
+         bits -= 8;
+         binary.push_back((char) ((v >> bits) & 0xFF));
+      }
+   }
+   return padding <= 2;
+}
+
+void PayloadCodec::compress(const std::string& data, std::string& compressed)
+{
+   // Speed matters more than ratio here, and text states compress well at the fastest level:
+   uLongf length = compressBound((uLong) data.size());
+   compressed.resize(length);
+   int status = compress2((Bytef*) &compressed[0], &length, (const Bytef*) data.data(),
+                          (uLong) data.size(), Z_BEST_SPEED);
+   if (status != Z_OK)
+   {
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": compress() -- zlib error "<<status<<".";
+      throw ossimException(xmsg.str());
+   }
+   compressed.resize(length);
+}
+
+bool PayloadCodec::uncompress(const std::string& compressed, size_t size, std::string& data)
+{
+   // Deflate cannot expand more than about 1032:1, so reject sizes that would only allocate:
+   data.clear();
+   if (size > compressed.size() * 1032 + 64)
+      return false;
+   if (size == 0)
+      return true;
+
+   data.resize(size);
+   uLongf length = (uLongf) size;
+   int status = ::uncompress((Bytef*) &data[0], &length, (const Bytef*) compressed.data(),
+                             (uLong) compressed.size());
+   if ((status != Z_OK) || (length != size))
+   {
+      data.clear();
+      return false;
+   }
+   return true;
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,69 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef PayloadCodec_HEADER
+#define PayloadCodec_HEADER 1
+
+#include <ossim/base/JsonInterface.h>
+#include <string>
+
+namespace ossimMsp
+{
+
+/**
+ * Encodes opaque payloads (model states, image support data) for transport in request and
+ * response JSON. A plain payload is written as a JSON string. An encoded payload is written as an
+ * object tagged with its encoding:
+ *
+ *    { "encoding": "base64", "data": "<base64 text>" }
+ *    { "encoding": "zlib+base64", "size": <uncompressed bytes>, "data": "<base64 text>" }
+ *
+ * Model states are verbose text that compresses well, so "zlib+base64" is considerably smaller
+ * than the plain string and much faster for JsonCpp to write and parse.
+ * Decoding accepts either form, so readers need not know which form the writer chose.
+ */
+class PayloadCodec
+{
+public:
+   enum Encoding
+   {
+      PLAIN,
+      BASE64,
+      ZLIB_BASE64
+   };
+
+   /** Writes the payload to json in the requested encoding. */
+   static void encode(const std::string& payload, Encoding encoding, Json::Value& json);
+
+   /**
+    * Reads a payload written by encode() (or a plain string) into payload. A null node gives an
+    * empty payload. Throws ossimException for an unknown encoding or malformed data.
+    */
+   static void decode(const Json::Value& json, std::string& payload);
+
+   /**
+    * Returns the encoding matching the name ("plain", "base64", "zlib+base64"). Unknown names
+    * give PLAIN.
+    */
+   static Encoding encodingFromString(const std::string& name);
+
+   static std::string encodingToString(Encoding encoding);
+
+   static void toBase64(const std::string& binary, std::string& text);
+
+   /** Returns false if text is not valid base64. */
+   static bool fromBase64(const std::string& text, std::string& binary);
+
+   /** Throws ossimException if zlib fails. */
+   static void compress(const std::string& data, std::string& compressed);
+
+   /** Returns false if compressed is corrupt or does not expand to exactly size bytes. */
+   static bool uncompress(const std::string& compressed, size_t size, std::string& data);
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,420 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "PhotoBlockSnapshot.h"
+#include "PayloadCodec.h"
+#include <ossim/base/ossimException.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+static const char MAGIC[8] = { 'O', 'M', 'S', 'P', 'S', 'N', 'A', 'P' };
+static const ossim_uint32 BYTE_ORDER_MARK = 0x01020304;
+
+enum SectionType
+{
+   STRINGS = 1,
+   HEADER = 2,
+   IMAGES = 3,
+   PAYLOADS = 4,
+   POINT_IDS = 5,
+   MEAS_POINT = 6,
+   MEAS_IMAGE = 7,
+   MEAS_LINE = 8,
+   MEAS_SAMPLE = 9,
+   MEAS_COVARIANCE = 10,
+   GCPS = 11,
+   GCP_CROSS_COVARIANCE = 12
+};
+
+struct FileHeader
+{
+   char magic[8];
+   ossim_uint32 version;
+   ossim_uint32 byteOrderMark;
+   ossim_uint64 fileSize;
+   ossim_uint32 numSections;
+   ossim_uint32 reserved;
+};
+
+struct SectionEntry
+{
+   ossim_uint32 type;
+   ossim_uint32 recordSize;
+   ossim_uint64 offset;
+   ossim_uint64 count;
+};
+
+static size_t align8(size_t n)
+{
+   return (n + 7) & ~((size_t) 7);
+}
+
+PhotoBlockSnapshot::Writer::Writer()
+{
+   memset(m_header, 0, sizeof(m_header));
+}
+
+PhotoBlockSnapshot::StringRef PhotoBlockSnapshot::Writer::addString(const std::string& s)
+{
+   StringRef ref = { m_strings.size(), s.size() };
+   m_strings += s;
+   return ref;
+}
+
+void PhotoBlockSnapshot::Writer::setHeaderField(unsigned int index, const std::string& value)
+{
+   if (index < NUM_HEADER_FIELDS)
+      m_header[index] = addString(value);
+}
+
+void PhotoBlockSnapshot::Writer::addImage(const std::string& imageId,
+                                          const std::string& filename,
+                                          const std::string& modelName,
+                                          unsigned int entryIndex,
+                                          PayloadKind kind,
+                                          const std::string& compressedPayload,
+                                          size_t payloadSize)
+{
+   ImageRecord record;
+   memset(&record, 0, sizeof(record));
+   record.imageId = addString(imageId);
+   record.filename = addString(filename);
+   record.modelName = addString(modelName);
+   record.entryIndex = entryIndex;
+   record.payloadKind = kind;
+   record.payloadOffset = m_payloads.size();
+   record.payloadSize = compressedPayload.size();
+   record.payloadRawSize = payloadSize;
+   m_payloads += compressedPayload;
+   m_images.push_back(record);
+}
+
+void PhotoBlockSnapshot::Writer::addPointId(const std::string& pointId)
+{
+   m_pointIds.push_back(addString(pointId));
+}
+
+void PhotoBlockSnapshot::Writer::addMeasurement(unsigned int point, unsigned int image,
+                                                double line, double sample,
+                                                const double* covariance)
+{
+   m_measPoint.push_back(point);
+   m_measImage.push_back(image);
+   m_measLine.push_back(line);
+   m_measSample.push_back(sample);
+   m_measCovariance.insert(m_measCovariance.end(), covariance, covariance + 3);
+}
+
+void PhotoBlockSnapshot::Writer::addGcp(const std::string& id, double x, double y, double z,
+                                        const double* covariance)
+{
+   GcpRecord record;
+   record.id = addString(id);
+   record.ecf[0] = x;
+   record.ecf[1] = y;
+   record.ecf[2] = z;
+   memcpy(record.covariance, covariance, sizeof(record.covariance));
+   m_gcps.push_back(record);
+}
+
+void PhotoBlockSnapshot::Writer::addGcpCrossCovariance(const std::string& gcpId1,
+                                                       const std::string& gcpId2,
+                                                       const double* block)
+{
+   GcpCrossCovRecord record;
+   record.gcpId1 = addString(gcpId1);
+   record.gcpId2 = addString(gcpId2);
+   memcpy(record.block, block, sizeof(record.block));
+   m_gcpCrossCovariances.push_back(record);
+}
+
+void PhotoBlockSnapshot::Writer::write(const std::string& filename) const
+{
+   struct Content
+   {
+      ossim_uint32 type;
+      ossim_uint32 recordSize;
+      const void* data;
+      size_t count;
+   };
+   Content contents[] =
+   {
+      { STRINGS, 1, m_strings.data(), m_strings.size() },
+      { HEADER, sizeof(StringRef), m_header, NUM_HEADER_FIELDS },
+      { IMAGES, sizeof(ImageRecord), m_images.data(), m_images.size() },
+      { PAYLOADS, 1, m_payloads.data(), m_payloads.size() },
+      { POINT_IDS, sizeof(StringRef), m_pointIds.data(), m_pointIds.size() },
+      { MEAS_POINT, sizeof(ossim_uint32), m_measPoint.data(), m_measPoint.size() },
+      { MEAS_IMAGE, sizeof(ossim_uint32), m_measImage.data(), m_measImage.size() },
+      { MEAS_LINE, sizeof(double), m_measLine.data(), m_measLine.size() },
+      { MEAS_SAMPLE, sizeof(double), m_measSample.data(), m_measSample.size() },
+      { MEAS_COVARIANCE, 3*sizeof(double), m_measCovariance.data(), m_measLine.size() },
+      { GCPS, sizeof(GcpRecord), m_gcps.data(), m_gcps.size() },
+      { GCP_CROSS_COVARIANCE, sizeof(GcpCrossCovRecord), m_gcpCrossCovariances.data(),
+        m_gcpCrossCovariances.size() }
+   };
+   const size_t numSections = sizeof(contents)/sizeof(contents[0]);
+
+   // Lay out the sections after the header and section table:
+   vector<SectionEntry> table (numSections);
+   size_t offset = sizeof(FileHeader) + numSections*sizeof(SectionEntry);
+   for (size_t i=0; i<numSections; ++i)
+   {
+      table[i].type = contents[i].type;
+      table[i].recordSize = contents[i].recordSize;
+      table[i].offset = offset;
+      table[i].count = contents[i].count;
+      offset = align8(offset + contents[i].recordSize*contents[i].count);
+   }
+
+   FileHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, MAGIC, sizeof(MAGIC));
+   header.version = VERSION;
+   header.byteOrderMark = BYTE_ORDER_MARK;
+   header.fileSize = offset;
+   header.numSections = (ossim_uint32) numSections;
+
+   ofstream out (filename.c_str(), ios::binary | ios::trunc);
+   out.write((const char*) &header, sizeof(header));
+   out.write((const char*) table.data(), numSections*sizeof(SectionEntry));
+   static const char PADDING[8] = { 0 };
+   size_t written = sizeof(FileHeader) + numSections*sizeof(SectionEntry);
+   for (size_t i=0; i<numSections; ++i)
+   {
+      size_t size = contents[i].recordSize*contents[i].count;
+      out.write((const char*) contents[i].data, size);
+      written += size;
+      out.write(PADDING, align8(written) - written);
+      written = align8(written);
+   }
+   out.close();
+   if (!out)
+   {
+      ostringstream xmsg;
+      xmsg<<__FILE__<<": write() -- Failed writing photoblock snapshot <"<<filename<<">.";
+      throw ossimException(xmsg.str());
+   }
+}
+
+PhotoBlockSnapshot::PhotoBlockSnapshot()
+:  m_strings (0),
+   m_stringsSize (0),
+   m_header (0),
+   m_images (0),
+   m_numImages (0),
+   m_payloads (0),
+   m_payloadsSize (0),
+   m_pointIds (0),
+   m_numPoints (0),
+   m_numMeasurements (0),
+   m_measPoint (0),
+   m_measImage (0),
+   m_measLine (0),
+   m_measSample (0),
+   m_measCovariance (0),
+   m_gcps (0),
+   m_numGcps (0),
+   m_gcpCrossCovariances (0),
+   m_numGcpCrossCovariances (0)
+{
+}
+
+bool PhotoBlockSnapshot::isSnapshot(const std::string& filename)
+{
+   char magic[sizeof(MAGIC)];
+   ifstream in (filename.c_str(), ios::binary);
+   return in.read(magic, sizeof(magic)) && (memcmp(magic, MAGIC, sizeof(MAGIC)) == 0);
+}
+
+void PhotoBlockSnapshot::fail(const std::string& message) const
+{
+   ostringstream xmsg;
+   xmsg<<__FILE__<<": Photoblock snapshot <"<<m_filename<<">: "<<message;
+   throw ossimException(xmsg.str());
+}
+
+void PhotoBlockSnapshot::open(const std::string& filename)
+{
+   m_filename = filename;
+   if (!m_file.open(filename))
+      fail("Could not map file.");
+
+   const char* data = m_file.data();
+   size_t size = m_file.size();
+   if (size < sizeof(FileHeader))
+      fail("File too small.");
+
+   const FileHeader* header = (const FileHeader*) data;
+   if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+      fail("Not a photoblock snapshot.");
+   if (header->byteOrderMark != BYTE_ORDER_MARK)
+      fail("Snapshot was written with a different byte order.");
+   if (header->version > VERSION)
+      fail("Unsupported snapshot version.");
+   if ((header->fileSize != size) ||
+       (sizeof(FileHeader) + header->numSections*sizeof(SectionEntry) > size))
+   {
+      fail("File is truncated.");
+   }
+
+   size_t count = 0;
+   m_strings = findSection(STRINGS, 1, m_stringsSize);
+   m_header = (const StringRef*) findSection(HEADER, sizeof(StringRef), count);
+   if (count < NUM_HEADER_FIELDS)
+      m_header = 0;
+   m_images = (const ImageRecord*) findSection(IMAGES, sizeof(ImageRecord), m_numImages);
+   m_payloads = findSection(PAYLOADS, 1, m_payloadsSize);
+   m_pointIds = (const StringRef*) findSection(POINT_IDS, sizeof(StringRef), m_numPoints);
+
+   m_measPoint = (const ossim_uint32*) findSection(MEAS_POINT, sizeof(ossim_uint32),
+                                                   m_numMeasurements);
+   m_measImage = (const ossim_uint32*) findSection(MEAS_IMAGE, sizeof(ossim_uint32), count);
+   bool consistent = (count == m_numMeasurements);
+   m_measLine = (const double*) findSection(MEAS_LINE, sizeof(double), count);
+   consistent = consistent && (count == m_numMeasurements);
+   m_measSample = (const double*) findSection(MEAS_SAMPLE, sizeof(double), count);
+   consistent = consistent && (count == m_numMeasurements);
+   m_measCovariance = (const double*) findSection(MEAS_COVARIANCE, 3*sizeof(double), count);
+   consistent = consistent && (count == m_numMeasurements);
+   if (!consistent)
+      fail("Measurement arrays differ in length.");
+
+   // Indices are used to address other arrays, so check them once here:
+   for (size_t m=0; m<m_numMeasurements; ++m)
+   {
+      if ((m_measPoint[m] >= m_numPoints) || (m_measImage[m] >= m_numImages))
+         fail("Measurement refers to a nonexistent point or image.");
+   }
+   for (size_t i=0; i<m_numImages; ++i)
+   {
+      if (m_images[i].payloadOffset + m_images[i].payloadSize > m_payloadsSize)
+         fail("Image payload out of range.");
+   }
+
+   m_gcps = (const GcpRecord*) findSection(GCPS, sizeof(GcpRecord), m_numGcps);
+   m_gcpCrossCovariances = (const GcpCrossCovRecord*) findSection(
+         GCP_CROSS_COVARIANCE, sizeof(GcpCrossCovRecord), m_numGcpCrossCovariances);
+}
+
+const char* PhotoBlockSnapshot::findSection(ossim_uint32 type, size_t recordSize,
+                                            size_t& count) const
+{
+   const FileHeader* header = (const FileHeader*) m_file.data();
+   const SectionEntry* table = (const SectionEntry*) (m_file.data() + sizeof(FileHeader));
+   count = 0;
+   for (ossim_uint32 i=0; i<header->numSections; ++i)
+   {
+      if (table[i].type != type)
+         continue;
+      if ((table[i].recordSize != recordSize) || (table[i].offset % 8) ||
+          (table[i].offset > m_file.size()) ||
+          (table[i].count > (m_file.size() - table[i].offset)/recordSize))
+      {
+         fail("Malformed section table.");
+      }
+      count = (size_t) table[i].count;
+      return m_file.data() + table[i].offset;
+   }
+   return 0;
+}
+
+std::string PhotoBlockSnapshot::getString(const StringRef& ref) const
+{
+   if ((ref.offset > m_stringsSize) || (ref.length > m_stringsSize - ref.offset))
+      fail("String reference out of range.");
+   return string(m_strings + ref.offset, (size_t) ref.length);
+}
+
+std::string PhotoBlockSnapshot::getHeaderField(unsigned int index) const
+{
+   if (!m_header || (index >= NUM_HEADER_FIELDS))
+      return string();
+   return getString(m_header[index]);
+}
+
+const PhotoBlockSnapshot::ImageRecord& PhotoBlockSnapshot::getImage(size_t i) const
+{
+   if (i >= m_numImages)
+      fail("Image index out of range.");
+   return m_images[i];
+}
+
+std::string PhotoBlockSnapshot::getImageId(size_t i) const
+{
+   return getString(getImage(i).imageId);
+}
+
+std::string PhotoBlockSnapshot::getImageFilename(size_t i) const
+{
+   return getString(getImage(i).filename);
+}
+
+std::string PhotoBlockSnapshot::getImageModelName(size_t i) const
+{
+   return getString(getImage(i).modelName);
+}
+
+unsigned int PhotoBlockSnapshot::getImageEntryIndex(size_t i) const
+{
+   return getImage(i).entryIndex;
+}
+
+PhotoBlockSnapshot::PayloadKind PhotoBlockSnapshot::getImagePayloadKind(size_t i) const
+{
+   return (PayloadKind) getImage(i).payloadKind;
+}
+
+void PhotoBlockSnapshot::getImagePayload(size_t i, std::string& payload) const
+{
+   const ImageRecord& image = getImage(i);
+   payload.clear();
+   if (image.payloadKind == NO_PAYLOAD)
+      return;
+   string compressed (m_payloads + image.payloadOffset, (size_t) image.payloadSize);
+   if (!PayloadCodec::uncompress(compressed, (size_t) image.payloadRawSize, payload))
+      fail("Corrupt model payload for image <" + getImageId(i) + ">.");
+}
+
+std::string PhotoBlockSnapshot::getPointId(size_t point) const
+{
+   if (point >= m_numPoints)
+      fail("Point index out of range.");
+   return getString(m_pointIds[point]);
+}
+
+void PhotoBlockSnapshot::getGcp(size_t i, std::string& id, double& x, double& y, double& z,
+                                double* covariance) const
+{
+   if (i >= m_numGcps)
+      fail("GCP index out of range.");
+   const GcpRecord& gcp = m_gcps[i];
+   id = getString(gcp.id);
+   x = gcp.ecf[0];
+   y = gcp.ecf[1];
+   z = gcp.ecf[2];
+   memcpy(covariance, gcp.covariance, sizeof(gcp.covariance));
+}
+
+void PhotoBlockSnapshot::getGcpCrossCovariance(size_t i, std::string& gcpId1,
+                                               std::string& gcpId2, double* block) const
+{
+   if (i >= m_numGcpCrossCovariances)
+      fail("GCP cross-covariance index out of range.");
+   const GcpCrossCovRecord& record = m_gcpCrossCovariances[i];
+   gcpId1 = getString(record.gcpId1);
+   gcpId2 = getString(record.gcpId2);
+   memcpy(block, record.block, sizeof(record.block));
+}
+
+} // end namespace ossimMsp
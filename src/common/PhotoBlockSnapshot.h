@@ -0,0 +1,213 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef PhotoBlockSnapshot_HEADER
+#define PhotoBlockSnapshot_HEADER 1
+
+#include "MappedFile.h"
+#include <ossim/base/ossimConstants.h>
+#include <string>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Versioned binary snapshot of a photoblock, laid out to be memory-mapped and used in place. The
+ * file is a fixed header and a table of typed sections, each an 8-byte aligned array of fixed-size
+ * records in native byte order (a byte-order mark rejects foreign files):
+ *
+ *    STRINGS           character data referred to by (offset, length) string references
+ *    HEADER            string references to the photoblock header fields
+ *    IMAGES            image ID, filename, model name, entry index and model payload location
+ *    PAYLOADS          zlib-compressed model states or image support data
+ *    POINT_IDS         string references to the tie point IDs
+ *    MEAS_POINT ...    the MeasurementStore arrays: point and image indices (uint32), line,
+ *    MEAS_COVARIANCE   sample (double) and packed covariance (3 doubles)
+ *    GCPS              ground control point ID, ECF position and packed 3x3 covariance
+ *    GCP_CROSS_COVARIANCE  GCP ID pairs with their 3x3 cross-covariance (row-major)
+ *
+ * Readers skip section types they do not know, so sections can be added without a version change.
+ * Use MspPhotoBlock::saveSnapshot() and loadSnapshot() to convert to and from a photoblock.
+ */
+class PhotoBlockSnapshot
+{
+public:
+   static const ossim_uint32 VERSION = 1;
+
+   /** Number of photoblock header fields stored. */
+   static const unsigned int NUM_HEADER_FIELDS = 8;
+
+private:
+   // Records as stored, all multiples of 8 bytes:
+   struct StringRef
+   {
+      ossim_uint64 offset;
+      ossim_uint64 length;
+   };
+
+   struct ImageRecord
+   {
+      StringRef imageId;
+      StringRef filename;
+      StringRef modelName;
+      ossim_uint32 entryIndex;
+      ossim_uint32 payloadKind;
+      ossim_uint64 payloadOffset;
+      ossim_uint64 payloadSize;     // compressed
+      ossim_uint64 payloadRawSize;
+   };
+
+   struct GcpRecord
+   {
+      StringRef id;
+      double ecf[3];
+      double covariance[6];
+   };
+
+   struct GcpCrossCovRecord
+   {
+      StringRef gcpId1;
+      StringRef gcpId2;
+      double block[9];
+   };
+
+public:
+   enum PayloadKind
+   {
+      NO_PAYLOAD = 0,
+      MODEL_STATE = 1,
+      IMAGE_SUPPORT_DATA = 2
+   };
+
+   /** Collects the contents of a snapshot and writes the file. */
+   class Writer
+   {
+   public:
+      Writer();
+
+      void setHeaderField(unsigned int index, const std::string& value);
+
+      /** Adds an image whose payload has already been compressed with PayloadCodec::compress(). */
+      void addImage(const std::string& imageId, const std::string& filename,
+                    const std::string& modelName, unsigned int entryIndex,
+                    PayloadKind kind, const std::string& compressedPayload, size_t payloadSize);
+
+      void addPointId(const std::string& pointId);
+
+      /** Appends measurements (see MeasurementStore for the covariance packing). */
+      void addMeasurement(unsigned int point, unsigned int image, double line, double sample,
+                          const double* covariance);
+
+      /** Covariance packed as { xx, xy, xz, yy, yz, zz }. */
+      void addGcp(const std::string& id, double x, double y, double z, const double* covariance);
+
+      /** 3x3 block, row-major with rows for gcpId1. */
+      void addGcpCrossCovariance(const std::string& gcpId1, const std::string& gcpId2,
+                                 const double* block);
+
+      /** Writes the file, throwing ossimException on failure. */
+      void write(const std::string& filename) const;
+
+   private:
+      StringRef addString(const std::string& s);
+
+      std::string m_strings;
+      StringRef m_header[NUM_HEADER_FIELDS];
+      std::vector<ImageRecord> m_images;
+      std::string m_payloads;
+      std::vector<StringRef> m_pointIds;
+      std::vector<ossim_uint32> m_measPoint;
+      std::vector<ossim_uint32> m_measImage;
+      std::vector<double> m_measLine;
+      std::vector<double> m_measSample;
+      std::vector<double> m_measCovariance;
+      std::vector<GcpRecord> m_gcps;
+      std::vector<GcpCrossCovRecord> m_gcpCrossCovariances;
+   };
+
+   PhotoBlockSnapshot();
+
+   /** Returns true if the file begins with the snapshot signature. */
+   static bool isSnapshot(const std::string& filename);
+
+   /**
+    * Maps the file and validates the header and section table. Throws ossimException if it is
+    * not a snapshot of a supported version.
+    */
+   void open(const std::string& filename);
+
+   std::string getHeaderField(unsigned int index) const;
+
+   size_t getNumImages() const { return m_numImages; }
+   std::string getImageId(size_t i) const;
+   std::string getImageFilename(size_t i) const;
+   std::string getImageModelName(size_t i) const;
+   unsigned int getImageEntryIndex(size_t i) const;
+   PayloadKind getImagePayloadKind(size_t i) const;
+
+   /** Decompresses the image's payload. Throws ossimException if corrupt. */
+   void getImagePayload(size_t i, std::string& payload) const;
+
+   size_t getNumPoints() const { return m_numPoints; }
+   std::string getPointId(size_t point) const;
+
+   size_t getNumMeasurements() const { return m_numMeasurements; }
+   const ossim_uint32* getMeasurementPoints() const { return m_measPoint; }
+   const ossim_uint32* getMeasurementImages() const { return m_measImage; }
+   const double* getMeasurementLines() const { return m_measLine; }
+   const double* getMeasurementSamples() const { return m_measSample; }
+   const double* getMeasurementCovariances() const { return m_measCovariance; }
+
+   size_t getNumGcps() const { return m_numGcps; }
+
+   /** Covariance packed as { xx, xy, xz, yy, yz, zz }. */
+   void getGcp(size_t i, std::string& id, double& x, double& y, double& z,
+               double* covariance) const;
+
+   size_t getNumGcpCrossCovariances() const { return m_numGcpCrossCovariances; }
+
+   /** 3x3 block, row-major with rows for gcpId1. */
+   void getGcpCrossCovariance(size_t i, std::string& gcpId1, std::string& gcpId2,
+                              double* block) const;
+
+private:
+   /** Returns the section's records, checking record size and bounds, or 0 if absent. */
+   const char* findSection(ossim_uint32 type, size_t recordSize, size_t& count) const;
+
+   std::string getString(const StringRef& ref) const;
+
+   const ImageRecord& getImage(size_t i) const;
+
+   void fail(const std::string& message) const;
+
+   MappedFile m_file;
+   std::string m_filename;
+
+   const char* m_strings;
+   size_t m_stringsSize;
+   const StringRef* m_header;
+   const ImageRecord* m_images;
+   size_t m_numImages;
+   const char* m_payloads;
+   size_t m_payloadsSize;
+   const StringRef* m_pointIds;
+   size_t m_numPoints;
+   size_t m_numMeasurements;
+   const ossim_uint32* m_measPoint;
+   const ossim_uint32* m_measImage;
+   const double* m_measLine;
+   const double* m_measSample;
+   const double* m_measCovariance;
+   const GcpRecord* m_gcps;
+   size_t m_numGcps;
+   const GcpCrossCovRecord* m_gcpCrossCovariances;
+   size_t m_numGcpCrossCovariances;
+};
+
+} // End namespace ossimMsp
+
+#endif
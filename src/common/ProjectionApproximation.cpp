@@ -0,0 +1,424 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "ProjectionApproximation.h"
+#include "LinearAlgebra.h"
+#include "LruCache.h"
+#include "ModelStateCache.h"
+#include <ossim/base/ossimEcefPoint.h>
+#include <ossim/base/ossimGpt.h>
+#include <ossim/base/ossimPreferences.h>
+#include <ossim/base/ossimString.h>
+#include <cmath>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+// Fit grid dimensions in line, sample and height. The check grid is at the cell centers:
+static const int GRID_SIZE = 12;
+static const int GRID_HEIGHTS = 6;
+
+// Rational fits whose denominator gets closer to zero than this are considered unstable:
+static const double MIN_DENOMINATOR = 0.2;
+
+enum { LAT, LON, HGT, LINE, SAMP };
+
+// One rigorous correspondence between ground and image:
+struct Sample
+{
+   double coord[5];
+};
+
+static double normalizeLongitude(double lon, double reference)
+{
+   while (lon - reference > 180.0)
+      lon -= 360.0;
+   while (lon - reference < -180.0)
+      lon += 360.0;
+   return lon;
+}
+
+ProjectionApproximation::ProjectionApproximation()
+:  m_coefficients (4*NUM_TERMS, 0.0),
+   m_minHeight (0.0),
+   m_maxHeight (0.0),
+   m_maxError (0.0)
+{
+   for (int i=0; i<5; ++i)
+   {
+      m_offset[i] = 0.0;
+      m_scale[i] = 1.0;
+   }
+}
+
+void ProjectionApproximation::getDefaultHeightRange(double& minHeight, double& maxHeight)
+{
+   minHeight = -500.0;
+   maxHeight = 3000.0;
+   ossimPreferences* prefs = ossimPreferences::instance();
+   const char* value = prefs->findPreference("msp.approximation.min_height");
+   if (value)
+      minHeight = ossimString(value).toDouble();
+   value = prefs->findPreference("msp.approximation.max_height");
+   if (value)
+      maxHeight = ossimString(value).toDouble();
+}
+
+std::shared_ptr<const ProjectionApproximation> ProjectionApproximation::create(
+      const csm::RasterGM& model, double minHeight, double maxHeight)
+{
+   typedef LruCache< string, shared_ptr<const ProjectionApproximation> > ApproximationCache;
+   static ApproximationCache* s_cache = 0;
+   static std::once_flag s_once;
+   std::call_once(s_once, []()
+   {
+      size_t maxEntries = 256;
+      const char* value = ossimPreferences::instance()->findPreference(
+            "msp.approximation_cache.max_entries");
+      if (value)
+         maxEntries = (size_t) ossimString(value).toInt64();
+      s_cache = new ApproximationCache(maxEntries);
+   });
+
+   // Keyed by model content, since fitting costs thousands of rigorous projections. The whole
+   // state is part of the key, so that a match is exact:
+   ostringstream keyStream;
+   keyStream<<model.getModelName()<<'\n'<<minHeight<<'\n'<<maxHeight<<'\n'
+            <<model.getModelState();
+   string key = keyStream.str();
+
+   shared_ptr<const ProjectionApproximation> approximation;
+   if (s_cache->find(key, approximation))
+      return approximation;
+
+   shared_ptr<ProjectionApproximation> fitted (new ProjectionApproximation);
+   if (fitted->fit(model, minHeight, maxHeight))
+      approximation = fitted;
+
+   // Failures are cached too, so unfittable models are not sampled again:
+   s_cache->insert(key, approximation);
+   return approximation;
+}
+
+void ProjectionApproximation::computeTerms(double p, double l, double h, double* t)
+{
+   t[0]  = 1.0;
+   t[1]  = l;
+   t[2]  = p;
+   t[3]  = h;
+   t[4]  = l*p;
+   t[5]  = l*h;
+   t[6]  = p*h;
+   t[7]  = l*l;
+   t[8]  = p*p;
+   t[9]  = h*h;
+   t[10] = p*l*h;
+   t[11] = l*l*l;
+   t[12] = l*p*p;
+   t[13] = l*h*h;
+   t[14] = l*l*p;
+   t[15] = p*p*p;
+   t[16] = p*h*h;
+   t[17] = l*l*h;
+   t[18] = p*p*h;
+   t[19] = h*h*h;
+}
+
+void ProjectionApproximation::evaluate(const double* terms, double& line, double& samp) const
+{
+   const double* c = &m_coefficients[0];
+   double sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+   for (int k=0; k<4; ++k)
+   {
+      const double* ck = c + k*NUM_TERMS;
+      double s = 0.0;
+      for (int i=0; i<NUM_TERMS; ++i)
+         s += ck[i]*terms[i];
+      sums[k] = s;
+   }
+   line = (sums[0]/sums[1])*m_scale[LINE] + m_offset[LINE];
+   samp = (sums[2]/sums[3])*m_scale[SAMP] + m_offset[SAMP];
+}
+
+bool ProjectionApproximation::isInDomain(double lat, double lon, double hgt) const
+{
+   // The error is only measured over the fitted region, beyond which it grows fastest, so no
+   // margin is allowed:
+   lon = normalizeLongitude(lon, m_offset[LON]);
+   return (fabs((lat - m_offset[LAT])/m_scale[LAT]) <= 1.0) &&
+          (fabs((lon - m_offset[LON])/m_scale[LON]) <= 1.0) &&
+          (fabs((hgt - m_offset[HGT])/m_scale[HGT]) <= 1.0);
+}
+
+void ProjectionApproximation::groundToImage(double lat, double lon, double hgt,
+                                            double& line, double& samp) const
+{
+   double terms[NUM_TERMS];
+   lon = normalizeLongitude(lon, m_offset[LON]);
+   computeTerms((lat - m_offset[LAT])/m_scale[LAT],
+                (lon - m_offset[LON])/m_scale[LON],
+                (hgt - m_offset[HGT])/m_scale[HGT], terms);
+   evaluate(terms, line, samp);
+}
+
+void ProjectionApproximation::groundToImage(size_t count,
+                                            const double* lat,
+                                            const double* lon,
+                                            const double* hgt,
+                                            double* line,
+                                            double* samp) const
+{
+   for (size_t i=0; i<count; ++i)
+      groundToImage(lat[i], lon[i], hgt[i], line[i], samp[i]);
+}
+
+bool ProjectionApproximation::imageToGround(double line, double samp, double hgt,
+                                            double& lat, double& lon) const
+{
+   // Newton iteration in normalized coordinates, starting at the center of the domain:
+   const double h = (hgt - m_offset[HGT])/m_scale[HGT];
+   const double eps = 1.0e-6;
+   const double limit = 2.0;
+   double p = 0.0;
+   double l = 0.0;
+   double terms[NUM_TERMS];
+   for (int iteration=0; iteration<20; ++iteration)
+   {
+      double line0, samp0, lineP, sampP, lineL, sampL;
+      computeTerms(p, l, h, terms);
+      evaluate(terms, line0, samp0);
+      double dLine = line - line0;
+      double dSamp = samp - samp0;
+      if ((fabs(dLine) < 1.0e-3) && (fabs(dSamp) < 1.0e-3))
+      {
+         lat = p*m_scale[LAT] + m_offset[LAT];
+         lon = l*m_scale[LON] + m_offset[LON];
+         if (lon > 180.0)
+            lon -= 360.0;
+         else if (lon < -180.0)
+            lon += 360.0;
+         return true;
+      }
+
+      computeTerms(p + eps, l, h, terms);
+      evaluate(terms, lineP, sampP);
+      computeTerms(p, l + eps, h, terms);
+      evaluate(terms, lineL, sampL);
+      double a = (lineP - line0)/eps;
+      double b = (lineL - line0)/eps;
+      double c = (sampP - samp0)/eps;
+      double d = (sampL - samp0)/eps;
+      double det = a*d - b*c;
+      if (det == 0.0)
+         return false;
+      p += ( d*dLine - b*dSamp)/det;
+      l += (-c*dLine + a*dSamp)/det;
+      if ((fabs(p) > limit) || (fabs(l) > limit))
+         return false;
+   }
+   return false;
+}
+
+bool ProjectionApproximation::fit(const csm::RasterGM& model, double minHeight, double maxHeight)
+{
+   m_minHeight = minHeight;
+   m_maxHeight = maxHeight;
+   if (!(maxHeight > minHeight))
+      return false;
+
+   // Sample the rigorous model on two interleaved grids over the image and height range, the first
+   // for fitting and the second (at the cell centers) for checking:
+   csm::ImageCoord start = model.getImageStart();
+   csm::ImageVector size = model.getImageSize();
+   vector<Sample> fitSamples, checkSamples;
+   double refLon = 0.0;
+   bool haveRefLon = false;
+   for (int pass=0; pass<2; ++pass)
+   {
+      vector<Sample>& samples = (pass == 0) ? fitSamples : checkSamples;
+      int n = GRID_SIZE - pass;
+      int nh = GRID_HEIGHTS - pass;
+      double shift = 0.5*pass;
+      for (int k=0; k<nh; ++k)
+      {
+         double hgt = minHeight + (maxHeight - minHeight)*(k + shift)/(GRID_HEIGHTS - 1);
+         for (int i=0; i<n; ++i)
+         {
+            double line = start.line + size.line*(i + shift)/(GRID_SIZE - 1);
+            for (int j=0; j<n; ++j)
+            {
+               double samp = start.samp + size.samp*(j + shift)/(GRID_SIZE - 1);
+               try
+               {
+                  csm::EcefCoord ecf = model.imageToGround(csm::ImageCoord(line, samp), hgt);
+                  ossimGpt gpt (ossimEcefPoint(ecf.x, ecf.y, ecf.z));
+                  if (!haveRefLon)
+                  {
+                     refLon = gpt.lon;
+                     haveRefLon = true;
+                  }
+                  Sample s;
+                  s.coord[LAT] = gpt.lat;
+                  s.coord[LON] = normalizeLongitude(gpt.lon, refLon);
+                  s.coord[HGT] = hgt;
+                  s.coord[LINE] = line;
+                  s.coord[SAMP] = samp;
+                  samples.push_back(s);
+               }
+               catch (...)
+               {
+                  // Points the model cannot project are left out of the fit
+               }
+            }
+         }
+      }
+   }
+
+   // Need a comfortable surplus over the 39 unknowns of the rational fit:
+   if (fitSamples.size() < 4*NUM_TERMS)
+      return false;
+
+   for (int c=0; c<5; ++c)
+   {
+      double lo = fitSamples[0].coord[c];
+      double hi = lo;
+      for (size_t s=1; s<fitSamples.size(); ++s)
+      {
+         lo = min(lo, fitSamples[s].coord[c]);
+         hi = max(hi, fitSamples[s].coord[c]);
+      }
+      m_offset[c] = 0.5*(lo + hi);
+      m_scale[c] = (hi > lo) ? 0.5*(hi - lo) : 1.0;
+   }
+
+   size_t numFit = fitSamples.size();
+   vector<double> terms (numFit*NUM_TERMS);
+   for (size_t s=0; s<numFit; ++s)
+   {
+      const double* x = fitSamples[s].coord;
+      computeTerms((x[LAT] - m_offset[LAT])/m_scale[LAT], (x[LON] - m_offset[LON])/m_scale[LON],
+                   (x[HGT] - m_offset[HGT])/m_scale[HGT], &terms[s*NUM_TERMS]);
+   }
+
+   // Computes the largest error (pixels) over the samples and whether the denominators stay
+   // clear of zero:
+   auto measure = [this](const vector<Sample>& samples, bool& stable)
+   {
+      double maxError = 0.0;
+      double t[NUM_TERMS];
+      stable = true;
+      for (size_t s=0; s<samples.size(); ++s)
+      {
+         const double* x = samples[s].coord;
+         computeTerms((x[LAT] - m_offset[LAT])/m_scale[LAT],
+                      (x[LON] - m_offset[LON])/m_scale[LON],
+                      (x[HGT] - m_offset[HGT])/m_scale[HGT], t);
+         for (int k=1; k<4; k+=2)
+         {
+            double d = 0.0;
+            for (int i=0; i<NUM_TERMS; ++i)
+               d += m_coefficients[k*NUM_TERMS + i]*t[i];
+            if (fabs(d) < MIN_DENOMINATOR)
+               stable = false;
+         }
+         double line, samp;
+         evaluate(t, line, samp);
+         maxError = max(maxError, hypot(line - x[LINE], samp - x[SAMP]));
+      }
+      return maxError;
+   };
+
+   // Weighted least squares for one output, with the denominator fixed at its previous estimate
+   // (the usual linearization for RPC fitting). The denominator's constant term is fixed at 1:
+   auto solve = [&](int output, bool rational, double* num, double* den)
+   {
+      int numUnknowns = rational ? 2*NUM_TERMS - 1 : NUM_TERMS;
+      vector<double> normal (numUnknowns*numUnknowns, 0.0);
+      vector<double> rhs (numUnknowns, 0.0);
+      vector<double> row (numUnknowns);
+      for (size_t s=0; s<numFit; ++s)
+      {
+         const double* t = &terms[s*NUM_TERMS];
+         double y = (fitSamples[s].coord[output] - m_offset[output])/m_scale[output];
+         double d = 0.0;
+         for (int i=0; i<NUM_TERMS; ++i)
+            d += den[i]*t[i];
+         double w = 1.0/d;
+         for (int i=0; i<NUM_TERMS; ++i)
+            row[i] = w*t[i];
+         for (int i=1; rational && (i<NUM_TERMS); ++i)
+            row[NUM_TERMS + i - 1] = -w*y*t[i];
+         for (int i=0; i<numUnknowns; ++i)
+         {
+            rhs[i] += row[i]*w*y;
+            for (int j=0; j<=i; ++j)
+               normal[i*numUnknowns + j] += row[i]*row[j];
+         }
+      }
+
+      // Slight damping keeps the poorly determined terms (e.g., those in height) bounded:
+      double trace = 0.0;
+      for (int i=0; i<numUnknowns; ++i)
+         trace += normal[i*numUnknowns + i];
+      for (int i=0; i<numUnknowns; ++i)
+         normal[i*numUnknowns + i] += 1.0e-12*trace/numUnknowns;
+
+      if (!LinearAlgebra::solve(normal, numUnknowns, rhs))
+         return false;
+      for (int i=0; i<NUM_TERMS; ++i)
+         num[i] = rhs[i];
+      for (int i=1; rational && (i<NUM_TERMS); ++i)
+         den[i] = rhs[NUM_TERMS + i - 1];
+      return true;
+   };
+
+   // Plain cubic polynomials first:
+   m_coefficients.assign(4*NUM_TERMS, 0.0);
+   double* c = &m_coefficients[0];
+   c[NUM_TERMS] = 1.0;
+   c[3*NUM_TERMS] = 1.0;
+   if (!solve(LINE, false, c, c + NUM_TERMS) || !solve(SAMP, false, c + 2*NUM_TERMS,
+                                                      c + 3*NUM_TERMS))
+   {
+      return false;
+   }
+   bool stable;
+   double polyError = max(measure(fitSamples, stable), measure(checkSamples, stable));
+   vector<double> polyCoefficients = m_coefficients;
+
+   // Then refine to rational functions, keeping them only if they are stable and better:
+   bool solved = true;
+   for (int iteration=0; solved && (iteration<3); ++iteration)
+   {
+      solved = solve(LINE, true, c, c + NUM_TERMS) &&
+               solve(SAMP, true, c + 2*NUM_TERMS, c + 3*NUM_TERMS);
+   }
+   double rationalError = 0.0;
+   if (solved)
+   {
+      bool fitStable, checkStable;
+      rationalError = max(measure(fitSamples, fitStable), measure(checkSamples, checkStable));
+      solved = fitStable && checkStable;
+   }
+
+   if (solved && (rationalError < polyError))
+   {
+      m_maxError = rationalError;
+   }
+   else
+   {
+      m_coefficients = polyCoefficients;
+      m_maxError = polyError;
+   }
+   return true;
+}
+
+} // end namespace ossimMsp
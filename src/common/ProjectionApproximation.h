@@ -0,0 +1,101 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef ProjectionApproximation_HEADER
+#define ProjectionApproximation_HEADER 1
+
+#include <ossim/base/ossimConstants.h>
+#include <csm/RasterGM.h>
+#include <memory>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Rational-polynomial approximation of a rigorous sensor model's ground-to-image function, in the
+ * form of an RPC00B: line and sample are each a ratio of cubic polynomials in normalized
+ * latitude, longitude and height. It is fitted to image-to-ground projections of a grid over the
+ * full image and the given height range, and checked against a second grid offset from the first.
+ * The largest check error (in pixels) is recorded so callers can decide whether the approximation
+ * is good enough. A plain cubic polynomial is used instead when the rational fit is no better.
+ *
+ * Instances are immutable after construction and so safe to share between threads, unlike the
+ * rigorous models. The coefficients of the four polynomials are held contiguously so that
+ * evaluation is a single pass over the 20 monomials.
+ */
+class ProjectionApproximation
+{
+public:
+   static const int NUM_TERMS = 20;
+
+   /**
+    * Returns the approximation of the model over the height range (meters above the ellipsoid),
+    * fitting it if not found in the process-wide cache. The model is only read, but must not be in
+    * use by another thread. Returns null if the model cannot be fitted. The cache size is set by
+    * the "msp.approximation_cache.max_entries" preference (default 256).
+    */
+   static std::shared_ptr<const ProjectionApproximation> create(const csm::RasterGM& model,
+                                                                double minHeight,
+                                                                double maxHeight);
+
+   /**
+    * Default height range for images without better knowledge of the terrain, given by the
+    * "msp.approximation.min_height" and "msp.approximation.max_height" preferences (defaults -500
+    * and 3000 meters).
+    */
+   static void getDefaultHeightRange(double& minHeight, double& maxHeight);
+
+   /** Largest error observed at the check points, in pixels. */
+   double getMaxError() const { return m_maxError; }
+
+   double getMinHeight() const { return m_minHeight; }
+   double getMaxHeight() const { return m_maxHeight; }
+
+   /**
+    * Returns true if the point lies within the ground region the approximation was fitted over.
+    * The error bound only holds inside this region.
+    */
+   bool isInDomain(double lat, double lon, double hgt) const;
+
+   void groundToImage(double lat, double lon, double hgt, double& line, double& samp) const;
+
+   /** Evaluates count points given as separate coordinate arrays. */
+   void groundToImage(size_t count, const double* lat, const double* lon, const double* hgt,
+                      double* line, double* samp) const;
+
+   /**
+    * Inverts the approximation at the given height by Newton iteration. Returns false if it does
+    * not converge to within 1/1000 pixel or leaves the domain.
+    */
+   bool imageToGround(double line, double samp, double hgt, double& lat, double& lon) const;
+
+private:
+   ProjectionApproximation();
+
+   /** Fits the approximation. Returns false if the model could not be sampled adequately. */
+   bool fit(const csm::RasterGM& model, double minHeight, double maxHeight);
+
+   /** Fills the 20 RPC00B monomials of the normalized coordinates. */
+   static void computeTerms(double p, double l, double h, double* terms);
+
+   void evaluate(const double* terms, double& line, double& samp) const;
+
+   // Normalization offsets and scales of lat, lon, hgt, line, samp:
+   double m_offset[5];
+   double m_scale[5];
+
+   // Line numerator, line denominator, sample numerator, sample denominator:
+   std::vector<double> m_coefficients;
+
+   double m_minHeight;
+   double m_maxHeight;
+   double m_maxError;
+};
+
+} // End namespace ossimMsp
+
+#endif
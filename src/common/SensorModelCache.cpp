@@ -0,0 +1,78 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "SensorModelCache.h"
+#include "ModelRegistry.h"
+#include <ossim/base/ossimPreferences.h>
+#include <ossim/base/ossimString.h>
+#include <sstream>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+SensorModelCache* SensorModelCache::instance()
+{
+   // Never destroyed, since it is registered with the model registry:
+   static SensorModelCache* s_instance = new SensorModelCache;
+   return s_instance;
+}
+
+SensorModelCache::SensorModelCache()
+:  m_cache (64)
+{
+   const char* value = ossimPreferences::instance()->findPreference("msp.model_cache.max_models");
+   if (value)
+      m_cache.setMaxCost(ossimString(value).toUInt32());
+
+   // Give up cached models nobody is using when the plugin's model memory ceiling is exceeded:
+   ModelRegistry::instance()->addReleaser([this]()
+   {
+      m_cache.releaseUnreferenced([]() { return !ModelRegistry::instance()->isOverLimit(); });
+   });
+}
+
+bool SensorModelCache::makeKey(const std::string& filename,
+                               unsigned int entryIndex,
+                               const std::string& modelName,
+                               std::string& key) const
+{
+   FileIdentity fileId;
+   if (!fileId.read(filename))
+      return false;
+
+   // The path and model name are free-form, so delimit with a character that won't appear in
+   // either:
+   ostringstream s;
+   s<<fileId.path<<'\n'<<fileId.size<<'\n'<<fileId.mtime<<'\n'<<entryIndex<<'\n'<<modelName;
+   key = s.str();
+   return true;
+}
+
+shared_ptr<const csm::RasterGM> SensorModelCache::findModel(const std::string& filename,
+                                                            unsigned int entryIndex,
+                                                            const std::string& modelName)
+{
+   shared_ptr<const csm::RasterGM> model;
+   string key;
+   if (makeKey(filename, entryIndex, modelName, key))
+      m_cache.find(key, model);
+   return model;
+}
+
+void SensorModelCache::addModel(const std::string& filename,
+                                unsigned int entryIndex,
+                                const std::string& modelName,
+                                shared_ptr<const csm::RasterGM> model)
+{
+   string key;
+   if (model && makeKey(filename, entryIndex, modelName, key))
+      m_cache.insert(key, model);
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,71 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef SensorModelCache_HEADER
+#define SensorModelCache_HEADER 1
+
+#include <common/FileIdentity.h>
+#include <common/LruCache.h>
+#include <csm/RasterGM.h>
+#include <memory>
+#include <string>
+
+namespace ossimMsp
+{
+
+/**
+ * Process-wide cache of CSM sensor models instantiated from image files. Entries are keyed by the
+ * file's identity (path, size and modification time), the entry index and the requested model
+ * name, so a modified file will never be served a stale model. The number of cached models is
+ * bounded by the "msp.model_cache.max_models" preference (default 64).
+ *
+ * Cached models are shared, so are handed out read-only. Callers needing to modify a model make
+ * their own copy (e.g. with ModelStateCache::createModel()).
+ */
+class SensorModelCache
+{
+public:
+   typedef LruCache<std::string, std::shared_ptr<const csm::RasterGM> >::Statistics Statistics;
+
+   static SensorModelCache* instance();
+
+   /**
+    * Returns the cached model for the image entry, or null if not cached (or if the file cannot
+    * be accessed).
+    */
+   std::shared_ptr<const csm::RasterGM> findModel(const std::string& filename,
+                                                  unsigned int entryIndex,
+                                                  const std::string& modelName);
+
+   /**
+    * Caches the model instantiated from the image entry. Ignored if the file cannot be accessed.
+    */
+   void addModel(const std::string& filename,
+                 unsigned int entryIndex,
+                 const std::string& modelName,
+                 std::shared_ptr<const csm::RasterGM> model);
+
+   void setMaxModels(size_t maxModels) { m_cache.setMaxCost(maxModels); }
+
+   void clear() { m_cache.clear(); }
+
+   Statistics getStatistics() const { return m_cache.getStatistics(); }
+
+private:
+   SensorModelCache();
+
+   /** Returns false if the file identity cannot be established. */
+   bool makeKey(const std::string& filename,
+                unsigned int entryIndex,
+                const std::string& modelName,
+                std::string& key) const;
+
+   LruCache<std::string, std::shared_ptr<const csm::RasterGM> > m_cache;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,63 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "SensorModelServicePool.h"
+#include <SensorModel/SensorModelService.h>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+SensorModelServicePool* SensorModelServicePool::instance()
+{
+   // Never destroyed, since instances may still be checked in during static destruction:
+   static SensorModelServicePool* s_instance = new SensorModelServicePool;
+   return s_instance;
+}
+
+SensorModelServicePool::SensorModelServicePool()
+{
+}
+
+SensorModelServicePool::~SensorModelServicePool()
+{
+   for (size_t i=0; i<m_available.size(); ++i)
+      delete m_available[i];
+}
+
+shared_ptr<MSP::SMS::SensorModelService> SensorModelServicePool::checkout()
+{
+   MSP::SMS::SensorModelService* sms = 0;
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      if (!m_available.empty())
+      {
+         sms = m_available.back();
+         m_available.pop_back();
+      }
+   }
+
+   if (!sms)
+   {
+      sms = new MSP::SMS::SensorModelService;
+      sms->setPluginPreferencesRigorousBeforeRpc();
+   }
+
+   return shared_ptr<MSP::SMS::SensorModelService>(sms, [this](MSP::SMS::SensorModelService* p)
+   {
+      checkin(p);
+   });
+}
+
+void SensorModelServicePool::checkin(MSP::SMS::SensorModelService* sms)
+{
+   std::lock_guard<std::mutex> lock (m_mutex);
+   m_available.push_back(sms);
+}
+
+} // end namespace ossimMsp
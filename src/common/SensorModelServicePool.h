@@ -0,0 +1,50 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef SensorModelServicePool_HEADER
+#define SensorModelServicePool_HEADER 1
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace MSP { namespace SMS { class SensorModelService; } }
+
+namespace ossimMsp
+{
+
+/**
+ * Plugin-wide pool of initialized MSP sensor model service instances. Constructing an SMS
+ * instance and setting its plugin preferences is repeated work, so instances are reused instead.
+ * All pooled instances prefer rigorous models over RPC.
+ *
+ * Each checked-out instance is used by one thread at a time. Any number can be checked out
+ * concurrently. The pool grows to the peak number in use.
+ */
+class SensorModelServicePool
+{
+public:
+   static SensorModelServicePool* instance();
+
+   /**
+    * Returns an instance for exclusive use. The instance goes back to the pool when the returned
+    * pointer (and any copies of it) are released.
+    */
+   std::shared_ptr<MSP::SMS::SensorModelService> checkout();
+
+private:
+   SensorModelServicePool();
+   ~SensorModelServicePool();
+
+   void checkin(MSP::SMS::SensorModelService* sms);
+
+   std::mutex m_mutex;
+   std::vector<MSP::SMS::SensorModelService*> m_available;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -28,7 +28,9 @@ Session::Session(const Json::Value& json)
 Session::Session(const Session& copyThis)
 :  m_sessionId (copyThis.m_sessionId),
    m_description (copyThis.m_description),
-   m_photoBlock (copyThis.m_photoBlock)
+   m_photoBlock (new MspPhotoBlock(*copyThis.m_photoBlock)),
+   m_solution (copyThis.m_solution),
+   m_aprioriStates (copyThis.m_aprioriStates)
 {
    m_sessionId += "_COPY";
 }
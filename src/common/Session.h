@@ -11,22 +11,37 @@
 #include <common/MspPhotoBlock.h>
 #include <ossim/base/ossimReferenced.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 namespace ossimMsp
 {
 /**
  * Class representing a 3DISA session. Object manages one instance of a photoblock
- * (either a priori or a posteriori), and any mensuration performed. A new session is needed if
- * either starting from scratch, or adding images, tiepoints or GCPs to the session (anything
- * that affects the results of triangulation). If only new mensuration measurements are made, they
- * can be added to the existing session.
+ * (either a priori or a posteriori), and any mensuration performed. Images, tiepoints and GCPs can
+ * be added to or removed from the session's photoblock in place with MspPhotoBlock::applyDelta(),
+ * so a new session is only needed when starting from scratch. Mensuration measurements can
+ * likewise be added to the existing session.
  */
 class Session : public ossim::JsonInterface,
                 public std::enable_shared_from_this<Session>
 {
 public:
+   /**
+    * Estimates from the session's last adjustment, from which the next can be warm-started. Keyed
+    * by ID, so they remain usable as images and points are added and removed.
+    */
+   struct Solution
+   {
+      std::unordered_map< std::string, std::vector<double> > parameters; // all, by image ID
+      std::unordered_map< std::string, std::vector<double> > points;     // ECF, by point ID
+   };
+
+   /** Model states by image ID. */
+   typedef std::unordered_map<std::string, std::string> ModelStates;
+
    /**
     * Default constructor invents a new sessionId and creates an empty photoblock
     */
@@ -35,7 +50,9 @@ public:
 
    /**
     * Copy constructor usefule when starting from prior existing session but adding new images,
-    * tiepoints, and/or GCPs.
+    * tiepoints, and/or GCPs. The copy branches the photoblock: it shares the original's contents
+    * until either side edits them (see MspPhotoBlock's copy constructor), so is cheap for large
+    * blocks, and edits to one session are not seen by the other.
     */
    Session(const Session& copyThis);
 
@@ -45,8 +62,32 @@ public:
 
    shared_ptr<MspPhotoBlock> getPhotoBlock();
 
+   void setPhotoBlock(std::shared_ptr<MspPhotoBlock> photoBlock) { m_photoBlock = photoBlock; }
+
+   /** The last adjustment's solution, or null if none. Shared with branches of the session. */
+   std::shared_ptr<const Solution> getSolution() const { return m_solution; }
+
+   void setSolution(std::shared_ptr<const Solution> solution) { m_solution = solution; }
+
+   /**
+    * The a priori model states of the images adjusted in the session, or null if none. Adjustments
+    * replace the photoblock's models with adjusted ones, so later adjustments start from these
+    * instead. Shared with branches of the session.
+    */
+   std::shared_ptr<const ModelStates> getAprioriStates() const { return m_aprioriStates; }
+
+   void setAprioriStates(std::shared_ptr<const ModelStates> states) { m_aprioriStates = states; }
+
    const std::string& getSessionId() const { return m_sessionId; }
 
+   void setSessionId(const std::string& sessionId) { m_sessionId = sessionId; }
+
+   /**
+    * Serializes the requests on the session. A request holds it from loading to responding, and
+    * branching holds the original's while copying it.
+    */
+   std::mutex& getMutex() const { return m_mutex; }
+
    /*
    * Refer to <a href="https://docs.google.com/document/d/1DXekmYm7wyo-uveM7mEu80Q7hQv40fYbtwZq-g0uKBs/edit?usp=sharing">3DISA API document</a>
    * for JSON format used.
@@ -63,6 +104,9 @@ private:
    std::string m_sessionId;
    std::string m_description;
    std::shared_ptr<MspPhotoBlock> m_photoBlock;
+   std::shared_ptr<const Solution> m_solution;
+   std::shared_ptr<const ModelStates> m_aprioriStates;
+   mutable std::mutex m_mutex;
 
 };
 
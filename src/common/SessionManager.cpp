@@ -6,11 +6,16 @@
 //**************************************************************************************************
 #include "SessionManager.h"
 #include <ossim/base/ossimCommon.h>
+#include <ossim/base/ossimPreferences.h>
+#include <ossim/base/ossimString.h>
+#include <algorithm>
 
 using namespace std;
 namespace ossimMsp
 {
 std::map< std::string, shared_ptr<Session> > SessionManager::m_activeSessions;
+std::mutex SessionManager::m_mutex;
+std::deque<std::string> SessionManager::m_sessionOrder;
 
 SessionManager::SessionManager()
 {
@@ -20,26 +25,67 @@ SessionManager::~SessionManager()
 {
 
    m_activeSessions.clear();
+   m_sessionOrder.clear();
 }
 
 shared_ptr<Session> SessionManager::newSession()
 {
    shared_ptr<Session> session (new Session);
-   m_activeSessions.emplace(session->getSessionId(), session);
+   std::lock_guard<std::mutex> lock (m_mutex);
+   registerSession(session);
+   return session;
+}
+
+shared_ptr<Session> SessionManager::branchSession(const std::string& sessionId)
+{
+   shared_ptr<Session> original = getSession(sessionId);
+   if (!original)
+      return nullptr;
 
+   // Copying a session branches its photoblock, sharing contents until edited. The original
+   // may be in use by another request, so is copied between its requests:
+   shared_ptr<Session> session;
+   {
+      std::lock_guard<std::mutex> sessionLock (original->getMutex());
+      session.reset(new Session(*original));
+   }
+   std::lock_guard<std::mutex> lock (m_mutex);
+   registerSession(session);
    return session;
 }
 
+void SessionManager::registerSession(std::shared_ptr<Session> session)
+{
+   // Session IDs are timestamps to the second, so disambiguate sessions started together:
+   string sessionId = session->getSessionId();
+   for (int n=2; m_activeSessions.count(sessionId); ++n)
+      sessionId = session->getSessionId() + "_" + ossimString::toString(n).string();
+   session->setSessionId(sessionId);
+   m_activeSessions.emplace(sessionId, session);
+   m_sessionOrder.push_back(sessionId);
+
+   // Each session holds a whole photoblock, so retire the oldest beyond the "msp.max_sessions"
+   // preference (default 16). Sessions in use remain valid to their holders:
+   static size_t s_maxSessions = 0;
+   if (s_maxSessions == 0)
+   {
+      const char* value = ossimPreferences::instance()->findPreference("msp.max_sessions");
+      s_maxSessions = value ? max((size_t) ossimString(value).toUInt32(), (size_t) 1) : 16;
+   }
+   while (m_sessionOrder.size() > s_maxSessions)
+   {
+      m_activeSessions.erase(m_sessionOrder.front());
+      m_sessionOrder.pop_front();
+   }
+}
+
 shared_ptr<Session> SessionManager::getSession(const std::string& sessionId)
 {
+   std::lock_guard<std::mutex> lock (m_mutex);
    map< string, shared_ptr<Session> >::iterator result = m_activeSessions.find(sessionId);
+   // TODO: Search the database for sessions no longer active.
    if (result == m_activeSessions.end())
-   {
-      // Need to search Db and load:
-      // TODO: Implement
-      clog<<__FILE__<<":"<<__LINE__<<" Method not fully implemented!"<<ends;
       return nullptr;
-   }
    return result->second;
 }
 
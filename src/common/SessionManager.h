@@ -9,8 +9,10 @@
 
 #include <common/Session.h>
 #include <string>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <ossim/base/ossimRefPtr.h>
 
 namespace ossimMsp
@@ -29,6 +31,12 @@ public:
 
    static std::shared_ptr<Session> newSession();
 
+   /**
+    * Starts a new session as a copy of the one given, or returns null if there is no such active
+    * session. The branch shares the original's photoblock contents until either is edited.
+    */
+   static std::shared_ptr<Session> branchSession(const std::string& sessionId);
+
    static std::shared_ptr<Session> getSession(const std::string& sessionId);
 
    static void saveSession(std::shared_ptr<Session> session);
@@ -37,7 +45,13 @@ public:
 
 private:
    SessionManager();
+
+   /** Adds the session under a unique ID. Caller holds m_mutex. */
+   static void registerSession(std::shared_ptr<Session> session);
+
    static std::map< std::string, std::shared_ptr<Session> > m_activeSessions;
+   static std::mutex m_mutex;
+   static std::deque<std::string> m_sessionOrder; // oldest first
 };
 
 } // end namespace ossimMsp
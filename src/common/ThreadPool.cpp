@@ -0,0 +1,164 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include "ThreadPool.h"
+#include <ossim/base/ossimPreferences.h>
+#include <ossim/base/ossimString.h>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+namespace
+{
+// State shared between the caller of parallelFor() and the helper jobs it queues. Helpers that are
+// dequeued after the loop is closed exit without touching the task.
+struct LoopState
+{
+   LoopState(size_t n, const std::function<void(size_t)>& t)
+   : count (n), task (t), next (0), active (0), closed (false) {}
+
+   void drain()
+   {
+      size_t i;
+      while ((i = next++) < count)
+      {
+         try
+         {
+            task(i);
+         }
+         catch (...)
+         {
+            std::lock_guard<std::mutex> lock (mutex);
+            if (!error)
+               error = std::current_exception();
+         }
+      }
+   }
+
+   const size_t count;
+   const std::function<void(size_t)>& task;
+   std::atomic<size_t> next;
+   unsigned int active;
+   bool closed;
+   std::exception_ptr error;
+   std::mutex mutex;
+   std::condition_variable done;
+};
+}
+
+ThreadPool* ThreadPool::instance()
+{
+   static ThreadPool* s_instance = 0;
+   static std::once_flag s_once;
+   std::call_once(s_once, []()
+   {
+      unsigned int numThreads = 0;
+      const char* value = ossimPreferences::instance()->findPreference("msp.threads");
+      if (value)
+         numThreads = ossimString(value).toUInt32();
+      s_instance = new ThreadPool(numThreads);
+   });
+   return s_instance;
+}
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+:  m_stopping (false)
+{
+   if (numThreads == 0)
+      numThreads = std::thread::hardware_concurrency();
+   if (numThreads == 0)
+      numThreads = 1;
+
+   for (unsigned int i=0; i<numThreads; ++i)
+      m_workers.push_back(std::thread(&ThreadPool::run, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      m_stopping = true;
+   }
+   m_condition.notify_all();
+   for (size_t i=0; i<m_workers.size(); ++i)
+      m_workers[i].join();
+}
+
+void ThreadPool::run()
+{
+   while (true)
+   {
+      std::function<void()> job;
+      {
+         std::unique_lock<std::mutex> lock (m_mutex);
+         while (!m_stopping && m_queue.empty())
+            m_condition.wait(lock);
+         if (m_queue.empty())
+            return;
+         job = m_queue.front();
+         m_queue.pop_front();
+      }
+      job();
+   }
+}
+
+void ThreadPool::parallelFor(size_t count,
+                             const std::function<void(size_t)>& task,
+                             unsigned int maxThreads)
+{
+   if (count == 0)
+      return;
+
+   unsigned int numThreads = getNumThreads();
+   if ((maxThreads > 0) && (maxThreads < numThreads))
+      numThreads = maxThreads;
+   if (numThreads > count)
+      numThreads = (unsigned int) count;
+
+   shared_ptr<LoopState> state (new LoopState(count, task));
+
+   // The caller counts as one of the threads:
+   if (numThreads > 1)
+   {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      for (unsigned int i=1; i<numThreads; ++i)
+      {
+         m_queue.push_back([state]()
+         {
+            {
+               std::lock_guard<std::mutex> lock (state->mutex);
+               if (state->closed)
+                  return;
+               ++state->active;
+            }
+            state->drain();
+            std::lock_guard<std::mutex> lock (state->mutex);
+            if (--state->active == 0)
+               state->done.notify_all();
+         });
+      }
+   }
+   m_condition.notify_all();
+
+   state->drain();
+
+   // Wait only for helpers that actually started:
+   std::unique_lock<std::mutex> lock (state->mutex);
+   state->closed = true;
+   while (state->active > 0)
+      state->done.wait(lock);
+
+   if (state->error)
+      std::rethrow_exception(state->error);
+}
+
+} // end namespace ossimMsp
@@ -0,0 +1,60 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef ThreadPool_HEADER
+#define ThreadPool_HEADER 1
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ossimMsp
+{
+
+/**
+ * Fixed-size pool of worker threads for running data-parallel loops. The shared instance is sized
+ * by the "msp.threads" preference, defaulting to the hardware concurrency.
+ */
+class ThreadPool
+{
+public:
+   /** Returns the process-wide pool. */
+   static ThreadPool* instance();
+
+   /** Creates a pool with the given number of workers (0 = hardware concurrency). */
+   ThreadPool(unsigned int numThreads=0);
+
+   ~ThreadPool();
+
+   unsigned int getNumThreads() const { return (unsigned int) m_workers.size(); }
+
+   /**
+    * Calls task(i) for every i in [0, count), spreading the calls over at most maxThreads threads
+    * (0 = all workers), and returns when all calls are complete. The calling thread participates,
+    * so nested loops cannot deadlock. Tasks needing per-item error reporting should catch their
+    * own exceptions. Otherwise the first exception thrown is rethrown here after the loop is
+    * finished.
+    */
+   void parallelFor(size_t count,
+                    const std::function<void(size_t)>& task,
+                    unsigned int maxThreads=0);
+
+private:
+   void run();
+
+   std::vector<std::thread> m_workers;
+   std::deque< std::function<void()> > m_queue;
+   std::mutex m_mutex;
+   std::condition_variable m_condition;
+   bool m_stopping;
+};
+
+} // End namespace ossimMsp
+
+#endif
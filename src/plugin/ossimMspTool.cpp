@@ -16,7 +16,9 @@
 #include <services/VersionService.h>
 #include <services/SourceSelectionService.h>
 #include <services/TriangulationService.h>
+#include <services/FootprintService.h>
 #include <services/MensurationService.h>
+#include <services/ProjectionService.h>
 
 #include <iostream>
 #include <memory>
@@ -27,7 +29,8 @@ using namespace std;
 namespace ossimMsp
 {
 const char* ossimMspTool::DESCRIPTION =
-      "Provides access to MSP functionality (source selection, sensor models, triangulation, mensuration).";
+      "Provides access to MSP functionality (source selection, sensor models, triangulation, "
+      "mensuration, projection, footprints).";
 
 ossimMspTool::ossimMspTool()
 : m_outputStream (0),
@@ -156,6 +159,10 @@ void ossimMspTool::loadJSON(const Json::Value& queryRoot)
          m_mspService.reset(new TriangulationService);
       else if (serviceName == "mensuration")
          m_mspService.reset(new MensurationService);
+      else if (serviceName == "projection")
+         m_mspService.reset(new ProjectionService);
+      else if (serviceName == "footprints")
+         m_mspService.reset(new FootprintService);
       else
       {
          xmsg<<"Unsupported service <"<<serviceName<<"> requested."<<endl;
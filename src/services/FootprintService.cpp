@@ -0,0 +1,112 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include <Config.h>
+#include <services/FootprintService.h>
+#include <ossim/base/ossimException.h>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+FootprintService::FootprintService()
+:  m_height (0.0),
+   m_havePoint (false),
+   m_lat (0.0),
+   m_lon (0.0),
+   m_numThreads (0)
+{
+}
+
+FootprintService::~FootprintService()
+{
+}
+
+void FootprintService::loadJSON(const Json::Value& queryRoot)
+{
+   ostringstream xmsg;
+   xmsg<<"FootprintService::loadJSON() EXCEPTION: ";
+
+   m_height = queryRoot["height"].asDouble();
+   m_numThreads = queryRoot["numThreads"].asUInt();
+   m_havePoint = queryRoot.isMember("point");
+   if (m_havePoint)
+   {
+      m_lat = queryRoot["point"]["lat"].asDouble();
+      m_lon = queryRoot["point"]["lon"].asDouble();
+   }
+
+   const Json::Value& imagesJson = queryRoot["images"];
+   if (imagesJson.empty())
+   {
+      xmsg<<"No images provided.";
+      throw ossimException(xmsg.str());
+   }
+
+   m_images.clear();
+   m_errors.clear();
+   m_images.resize(imagesJson.size());
+   m_errors.resize(imagesJson.size());
+   for (unsigned int i=0; i<imagesJson.size(); ++i)
+   {
+      try
+      {
+         m_images[i].reset(new MspImage(imagesJson[i]));
+      }
+      catch (exception& e)
+      {
+         m_errors[i] = e.what();
+      }
+   }
+}
+
+void FootprintService::execute()
+{
+   // Images that failed to load are passed as null and keep their load error:
+   vector<string> errors;
+   MspImage::getFootprints(m_images, m_height, m_footprints, errors, m_numThreads);
+   for (size_t i=0; i<m_images.size(); ++i)
+   {
+      if (m_images[i])
+         m_errors[i] = errors[i];
+   }
+
+   m_selected.assign(m_images.size(), !m_havePoint);
+   if (m_havePoint)
+   {
+      for (size_t i=0; i<m_footprints.size(); ++i)
+         m_selected[i] = m_footprints[i] && m_footprints[i]->contains(m_lat, m_lon);
+   }
+}
+
+void FootprintService::saveJSON(Json::Value& json) const
+{
+   Json::Value footprints (Json::arrayValue);
+   for (size_t i=0; i<m_images.size(); ++i)
+   {
+      // Errors are reported even when filtering by point, since coverage is then unknown:
+      bool failed = !m_errors[i].empty();
+      if (!failed && !m_selected[i])
+         continue;
+
+      Json::Value entry;
+      if (m_images[i])
+      {
+         entry["imageId"] = m_images[i]->getImageId();
+         entry["filename"] = m_images[i]->getFilename().string();
+      }
+      if (failed)
+         entry["error"] = m_errors[i];
+      else
+         m_footprints[i]->saveJSON(entry["footprint"]);
+      footprints.append(entry);
+   }
+   json["footprints"] = footprints;
+}
+
+} // end namespace ossimMsp
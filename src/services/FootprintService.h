@@ -0,0 +1,52 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef FootprintService_HEADER
+#define FootprintService_HEADER 1
+
+#include <services/ServiceBase.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../common/MspImage.h"
+
+namespace ossimMsp
+{
+
+/**
+ * Returns the ground footprints of the images in the request ("images" array), computed from their
+ * sensor models at an optional "height" (meters above the ellipsoid, default 0) and cached per
+ * image. If a "point" ({"lat", "lon"}) is given, only the images whose footprints contain it are
+ * returned. Each result is {"imageId", "filename", "footprint"} or {"imageId", "filename",
+ * "error"}; see Footprint::saveJSON() for the footprint format.
+ */
+class FootprintService : public ServiceBase
+{
+public:
+   FootprintService();
+   ~FootprintService();
+
+   virtual void loadJSON(const Json::Value& json);
+
+   virtual void saveJSON(Json::Value& json) const;
+
+   virtual void execute();
+
+private:
+   std::vector< std::shared_ptr<MspImage> > m_images;
+   std::vector< std::shared_ptr<const Footprint> > m_footprints;
+   std::vector<std::string> m_errors;
+   std::vector<bool> m_selected;
+   double m_height;
+   bool m_havePoint;
+   double m_lat;
+   double m_lon;
+   unsigned int m_numThreads;
+};
+
+} // End namespace ossimMsp
+
+#endif
@@ -0,0 +1,469 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+
+#include <Config.h>
+#include <services/ProjectionService.h>
+#include <common/ModelStateCache.h>
+#include <common/ThreadPool.h>
+#include <ossim/base/ossimException.h>
+#include <ossim/base/ossimEcefPoint.h>
+#include <ossim/base/ossimGpt.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace ossimMsp
+{
+
+// Below this many points per chunk, the cost of copying a sensor model outweighs the parallelism:
+static const size_t MIN_CHUNK_SIZE = 1024;
+
+static const double NaN = numeric_limits<double>::quiet_NaN();
+
+ProjectionService::ProjectionService()
+:  m_inputInEcf (false),
+   m_outputInEcf (false),
+   m_computeCovariance (false),
+   m_desiredPrecision (0.001),
+   m_tolerance (0.0),
+   m_minHeight (0.0),
+   m_maxHeight (0.0),
+   m_numThreads (0)
+{
+}
+
+ProjectionService::~ProjectionService()
+{
+}
+
+void ProjectionService::loadJSON(const Json::Value& queryRoot)
+{
+   ostringstream xmsg;
+   xmsg<<"ProjectionService::loadJSON() EXCEPTION: ";
+
+   m_inputInEcf = (queryRoot["inputCoordinateSystem"].asString() == "ecf");
+   m_outputInEcf = (queryRoot["outputCoordinateSystem"].asString() == "ecf");
+   m_computeCovariance = queryRoot["computeCovariance"].asBool();
+   if (queryRoot.isMember("desiredPrecision"))
+      m_desiredPrecision = queryRoot["desiredPrecision"].asDouble();
+   m_numThreads = queryRoot["numThreads"].asUInt();
+
+   // Optional use of approximations within a tolerance (pixels):
+   m_tolerance = queryRoot["tolerance"].asDouble();
+   ProjectionApproximation::getDefaultHeightRange(m_minHeight, m_maxHeight);
+   const Json::Value& heightRange = queryRoot["heightRange"];
+   if (heightRange.size() == 2)
+   {
+      m_minHeight = heightRange[0].asDouble();
+      m_maxHeight = heightRange[1].asDouble();
+   }
+
+   const Json::Value& imagesJson = queryRoot["images"];
+   if (imagesJson.empty())
+   {
+      xmsg<<"No images provided.";
+      throw ossimException(xmsg.str());
+   }
+
+   m_projections.clear();
+   m_projections.resize(imagesJson.size());
+   for (unsigned int i=0; i<imagesJson.size(); ++i)
+   {
+      const Json::Value& imageJson = imagesJson[i];
+      Projection& projection = m_projections[i];
+
+      // Image errors are reported per image, so one bad image does not fail the request:
+      try
+      {
+         projection.image.reset(new MspImage(imageJson));
+         projection.toGround = imageJson.isMember("imagePoints");
+         if (projection.toGround)
+            readPoints(imageJson["imagePoints"], imageJson["covariances"], projection);
+         else
+            readPoints(imageJson["groundPoints"], imageJson["covariances"], projection);
+      }
+      catch (exception& e)
+      {
+         projection.error = e.what();
+         projection.input.clear();
+      }
+   }
+}
+
+void ProjectionService::readPoints(const Json::Value& points,
+                                   const Json::Value& covariances,
+                                   Projection& projection) const
+{
+   ostringstream xmsg;
+   xmsg<<"ProjectionService::readPoints() EXCEPTION: ";
+
+   if (!points.isArray())
+   {
+      xmsg<<"No imagePoints or groundPoints array provided.";
+      throw ossimException(xmsg.str());
+   }
+
+   size_t numPoints = points.size();
+   projection.flat = (numPoints > 0) && points[0].isNumeric();
+   if (projection.flat)
+   {
+      if (numPoints % 3)
+      {
+         xmsg<<"Flat point array length must be a multiple of 3.";
+         throw ossimException(xmsg.str());
+      }
+      numPoints /= 3;
+      projection.input.resize(3*numPoints);
+      for (unsigned int i=0; i<points.size(); ++i)
+         projection.input[i] = points[i].asDouble();
+   }
+   else
+   {
+      // Order the components as for the flat form:
+      const char* keys[3] = { "x", "y", "hgt" };
+      if (!projection.toGround)
+      {
+         keys[0] = m_inputInEcf ? "x" : "lat";
+         keys[1] = m_inputInEcf ? "y" : "lon";
+         keys[2] = m_inputInEcf ? "z" : "hgt";
+      }
+      projection.input.resize(3*numPoints);
+      for (unsigned int i=0; i<numPoints; ++i)
+      {
+         const Json::Value& point = points[i];
+         for (unsigned int k=0; k<3; ++k)
+            projection.input[3*i+k] = point[keys[k]].asDouble();
+      }
+   }
+
+   if (!m_computeCovariance)
+      return;
+
+   // Covariances are flat or one array per point, in either case zero when absent:
+   size_t stride = projection.toGround ? 4 : 6;
+   projection.inputCov.assign(stride*numPoints, 0.0);
+   if (!covariances.isArray() || covariances.empty())
+      return;
+   bool flatCov = covariances[0].isNumeric();
+   for (unsigned int i=0; i<numPoints; ++i)
+   {
+      for (unsigned int k=0; k<stride; ++k)
+      {
+         const Json::Value& value = flatCov ? covariances[(unsigned int) (stride*i+k)]
+                                            : covariances[i][k];
+         projection.inputCov[stride*i+k] = value.asDouble();
+      }
+   }
+}
+
+void ProjectionService::execute()
+{
+   ThreadPool* pool = ThreadPool::instance();
+   size_t maxChunks = m_numThreads ? m_numThreads : max(pool->getNumThreads(), 1u);
+
+   // Images are processed one at a time, each split into chunks evaluated concurrently:
+   for (size_t p=0; p<m_projections.size(); ++p)
+   {
+      Projection& projection = m_projections[p];
+      if (!projection.error.empty())
+         continue;
+
+      size_t numPoints = projection.input.size() / 3;
+      size_t outStride = projection.toGround ? 3 : 2;
+      projection.output.assign(outStride*numPoints, NaN);
+      if (m_computeCovariance)
+         projection.outputCov.assign((projection.toGround ? 6 : 3)*numPoints, NaN);
+      if (numPoints == 0)
+         continue;
+
+      try
+      {
+         const csm::RasterGM* model = projection.image->getCsmSensorModel();
+         if (!model)
+         {
+            projection.error = "No sensor model could be instantiated.";
+            continue;
+         }
+
+         // The approximation is immutable and so shared by all chunks:
+         shared_ptr<const ProjectionApproximation> approximation;
+         if ((m_tolerance > 0.0) && !m_computeCovariance)
+         {
+            approximation = projection.image->getProjectionApproximation(m_tolerance,
+                                                                          m_minHeight,
+                                                                          m_maxHeight);
+         }
+
+         // The image's model may be shared with the model caches, and so in use by other requests,
+         // and CSM models are not required to be thread-safe. Every chunk therefore evaluates its
+         // own copy, made from the state taken here:
+         size_t numChunks = min(maxChunks, (numPoints + MIN_CHUNK_SIZE - 1) / MIN_CHUNK_SIZE);
+         string state = model->getModelState();
+         vector<size_t> failures (numChunks, 0);
+         pool->parallelFor(numChunks, [&](size_t c)
+         {
+            size_t begin = c*numPoints/numChunks;
+            size_t end = (c+1)*numPoints/numChunks;
+
+            // The copy is made when needed, i.e. not if the approximation serves every point:
+            shared_ptr<csm::RasterGM> clone;
+            auto getModel = [&]() -> const csm::RasterGM*
+            {
+               if (!clone)
+                  clone = ModelStateCache::instance()->createModel(state);
+               if (!clone)
+                  throw ossimException("Sensor model could not be copied.");
+               return clone.get();
+            };
+            failures[c] = project(projection, approximation.get(), getModel, begin, end);
+         }, (unsigned int) numChunks);
+
+         projection.numFailed = 0;
+         for (size_t c=0; c<numChunks; ++c)
+            projection.numFailed += failures[c];
+      }
+      catch (exception& e)
+      {
+         projection.error = e.what();
+      }
+   }
+}
+
+size_t ProjectionService::project(Projection& projection,
+                                  const ProjectionApproximation* approximation,
+                                  const std::function<const csm::RasterGM*()>& getModel,
+                                  size_t begin,
+                                  size_t end) const
+{
+   size_t numFailed = 0;
+   const double* in = &projection.input[0];
+   double* out = &projection.output[0];
+   const double* inCov = m_computeCovariance ? &projection.inputCov[0] : 0;
+   double* outCov = m_computeCovariance ? &projection.outputCov[0] : 0;
+
+   for (size_t i=begin; i<end; ++i)
+   {
+      try
+      {
+         if (projection.toGround)
+         {
+            // Input is x (samp), y (line), hgt:
+            double lat, lon;
+            if (approximation &&
+                approximation->imageToGround(in[3*i+1], in[3*i], in[3*i+2], lat, lon) &&
+                approximation->isInDomain(lat, lon, in[3*i+2]))
+            {
+               ossimGpt gpt (lat, lon, in[3*i+2]);
+               if (m_outputInEcf)
+               {
+                  ossimEcefPoint ecf (gpt);
+                  out[3*i]   = ecf.x();
+                  out[3*i+1] = ecf.y();
+                  out[3*i+2] = ecf.z();
+               }
+               else
+               {
+                  out[3*i]   = gpt.lat;
+                  out[3*i+1] = gpt.lon;
+                  out[3*i+2] = gpt.hgt;
+               }
+               continue;
+            }
+
+            const csm::RasterGM* model = getModel();
+            csm::EcefCoord ecf;
+            if (inCov)
+            {
+               const double* c = inCov + 4*i;
+               csm::ImageCoordCovar ip (in[3*i+1], in[3*i], c[0], c[2], c[1]);
+               csm::EcefCoordCovar gp = model->imageToGround(ip, in[3*i+2], c[3],
+                                                             m_desiredPrecision);
+               ecf = gp;
+               double* oc = outCov + 6*i;
+               oc[0] = gp.covariance[0];
+               oc[1] = gp.covariance[4];
+               oc[2] = gp.covariance[8];
+               oc[3] = gp.covariance[1];
+               oc[4] = gp.covariance[2];
+               oc[5] = gp.covariance[5];
+            }
+            else
+            {
+               csm::ImageCoord ip (in[3*i+1], in[3*i]);
+               ecf = model->imageToGround(ip, in[3*i+2], m_desiredPrecision);
+            }
+
+            if (m_outputInEcf)
+            {
+               out[3*i]   = ecf.x;
+               out[3*i+1] = ecf.y;
+               out[3*i+2] = ecf.z;
+            }
+            else
+            {
+               ossimGpt gpt (ossimEcefPoint(ecf.x, ecf.y, ecf.z));
+               out[3*i]   = gpt.lat;
+               out[3*i+1] = gpt.lon;
+               out[3*i+2] = gpt.hgt;
+            }
+         }
+         else
+         {
+            csm::EcefCoordCovar gp;
+            ossimGpt gpt;
+            if (m_inputInEcf)
+            {
+               gp.x = in[3*i];
+               gp.y = in[3*i+1];
+               gp.z = in[3*i+2];
+               if (approximation)
+                  gpt = ossimGpt(ossimEcefPoint(gp.x, gp.y, gp.z));
+            }
+            else
+            {
+               gpt = ossimGpt(in[3*i], in[3*i+1], in[3*i+2]);
+               ossimEcefPoint ecf (gpt);
+               gp.x = ecf.x();
+               gp.y = ecf.y();
+               gp.z = ecf.z();
+            }
+
+            if (approximation && approximation->isInDomain(gpt.lat, gpt.lon, gpt.hgt))
+            {
+               approximation->groundToImage(gpt.lat, gpt.lon, gpt.hgt, out[2*i+1], out[2*i]);
+               continue;
+            }
+
+            const csm::RasterGM* model = getModel();
+            csm::ImageCoord ip;
+            if (inCov)
+            {
+               const double* c = inCov + 6*i;
+               double cov[9] = { c[0], c[3], c[4],  c[3], c[1], c[5],  c[4], c[5], c[2] };
+               std::copy(cov, cov+9, gp.covariance);
+               csm::ImageCoordCovar ipc = model->groundToImage(gp, m_desiredPrecision);
+               ip = ipc;
+               double* oc = outCov + 3*i;
+               oc[0] = ipc.covariance[0];
+               oc[1] = ipc.covariance[3];
+               oc[2] = ipc.covariance[1];
+            }
+            else
+            {
+               ip = model->groundToImage(csm::EcefCoord(gp.x, gp.y, gp.z), m_desiredPrecision);
+            }
+            out[2*i]   = ip.samp;
+            out[2*i+1] = ip.line;
+         }
+      }
+      catch (ossimException&)
+      {
+         // No model to fall back on; the chunk fails
+         throw;
+      }
+      catch (...)
+      {
+         // Failed points keep NaN outputs. CSM plugins throw csm::Error, which is not derived
+         // from std::exception in all CSM versions:
+         size_t outStride = projection.toGround ? 3 : 2;
+         std::fill(out + outStride*i, out + outStride*(i+1), NaN);
+         ++numFailed;
+      }
+   }
+   return numFailed;
+}
+
+void ProjectionService::writePoints(const Projection& projection, Json::Value& json) const
+{
+   size_t numPoints = projection.input.size() / 3;
+   size_t stride = projection.toGround ? 3 : 2;
+   const char* keys[3] = { "x", "y", "z" };
+   if (projection.toGround && !m_outputInEcf)
+   {
+      keys[0] = "lat";
+      keys[1] = "lon";
+      keys[2] = "hgt";
+   }
+
+   Json::Value points (Json::arrayValue);
+   if (projection.flat)
+   {
+      for (size_t i=0; i<stride*numPoints; ++i)
+      {
+         double value = projection.output[i];
+         points.append(std::isnan(value) ? Json::Value() : Json::Value(value));
+      }
+   }
+   else
+   {
+      for (size_t i=0; i<numPoints; ++i)
+      {
+         Json::Value point;
+         if (!std::isnan(projection.output[stride*i]))
+         {
+            for (size_t k=0; k<stride; ++k)
+               point[keys[k]] = projection.output[stride*i+k];
+         }
+         points.append(point);
+      }
+   }
+   json[projection.toGround ? "groundPoints" : "imagePoints"] = points;
+
+   if (!m_computeCovariance)
+      return;
+
+   size_t covStride = projection.toGround ? 6 : 3;
+   Json::Value covariances (Json::arrayValue);
+   for (size_t i=0; i<numPoints; ++i)
+   {
+      Json::Value cov (Json::arrayValue);
+      bool valid = !std::isnan(projection.output[stride*i]);
+      for (size_t k=0; k<covStride; ++k)
+      {
+         Json::Value value;
+         if (valid)
+            value = projection.outputCov[covStride*i+k];
+         if (projection.flat)
+            covariances.append(value);
+         else
+            cov.append(value);
+      }
+      if (!projection.flat)
+         covariances.append(valid ? cov : Json::Value());
+   }
+   json["covariances"] = covariances;
+}
+
+void ProjectionService::saveJSON(Json::Value& json) const
+{
+   Json::Value projections (Json::arrayValue);
+   for (size_t p=0; p<m_projections.size(); ++p)
+   {
+      const Projection& projection = m_projections[p];
+      Json::Value projectionJson;
+      if (projection.image)
+      {
+         projectionJson["imageId"] = projection.image->getImageId();
+         projectionJson["filename"] = projection.image->getFilename().string();
+      }
+      if (!projection.error.empty())
+      {
+         projectionJson["error"] = projection.error;
+      }
+      else
+      {
+         writePoints(projection, projectionJson);
+         projectionJson["numFailed"] = (Json::UInt64) projection.numFailed;
+      }
+      projections.append(projectionJson);
+   }
+   json["projections"] = projections;
+}
+
+} // end namespace ossimMsp
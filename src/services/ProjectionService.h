@@ -0,0 +1,98 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#ifndef ProjectionService_HEADER
+#define ProjectionService_HEADER 1
+
+#include <services/ServiceBase.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../common/MspImage.h"
+
+namespace ossimMsp
+{
+
+/**
+ * Bulk image-to-ground and ground-to-image projection through the images' CSM sensor models.
+ * Each image in the request carries either "imagePoints" (projected to the ground at the given
+ * heights) or "groundPoints" (projected into the image). Points are given as arrays of objects or,
+ * more compactly, as flat arrays of numbers; results are returned in the same form:
+ *
+ *    image point:  {"x": samp, "y": line, "hgt": h}   or  [x, y, hgt, ...]
+ *    ground point: {"lat", "lon", "hgt"}              or  [lat, lon, hgt, ...]
+ *                  {"x", "y", "z"} (ECF)              or  [x, y, z, ...]
+ *
+ * Ground points are geographic unless "inputCoordinateSystem"/"outputCoordinateSystem" is "ecf".
+ * With "computeCovariance", input covariances are read from a parallel "covariances" array
+ * (image: [lineVar, sampVar, lineSampCov, hgtVar], ground: ECF [xx, yy, zz, xy, xz, yz]; zero if
+ * absent) and the propagated covariances are returned in the same layouts (without hgtVar). Points
+ * that fail to project are returned as null.
+ *
+ * The points of an image are split into contiguous chunks evaluated concurrently, each chunk with
+ * its own copy of the sensor model. If a "tolerance" (pixels) is given and covariances are not
+ * requested, a ProjectionApproximation fitted over the "heightRange" ([min, max] meters, default
+ * from preferences) is used instead wherever its measured error is within the tolerance and the
+ * point lies in its domain. Other points fall back to the rigorous model.
+ */
+class ProjectionService : public ServiceBase
+{
+public:
+   ProjectionService();
+   ~ProjectionService();
+
+   virtual void loadJSON(const Json::Value& json);
+
+   virtual void saveJSON(Json::Value& json) const;
+
+   virtual void execute();
+
+private:
+   struct Projection
+   {
+      Projection() : toGround(false), flat(false), numFailed(0) {}
+
+      std::shared_ptr<MspImage> image;
+      bool toGround;
+      bool flat;
+      std::vector<double> input;     // 3 values per point
+      std::vector<double> inputCov;  // 4 (image) or 6 (ground) values per point, if requested
+      std::vector<double> output;    // 3 (ground) or 2 (image) values per point, NaN on failure
+      std::vector<double> outputCov; // 6 (ground) or 3 (image) values per point, if requested
+      size_t numFailed;
+      std::string error;
+   };
+
+   void readPoints(const Json::Value& points, const Json::Value& covariances,
+                   Projection& projection) const;
+
+   void writePoints(const Projection& projection, Json::Value& json) const;
+
+   /**
+    * Projects the points in [begin, end) using the approximation where possible (if not null),
+    * otherwise the rigorous model, which is only fetched when first needed. Returns the number of
+    * points that failed.
+    */
+   size_t project(Projection& projection,
+                  const ProjectionApproximation* approximation,
+                  const std::function<const csm::RasterGM*()>& getModel,
+                  size_t begin, size_t end) const;
+
+   std::vector<Projection> m_projections;
+   bool m_inputInEcf;
+   bool m_outputInEcf;
+   bool m_computeCovariance;
+   double m_desiredPrecision;
+   double m_tolerance;
+   double m_minHeight;
+   double m_maxHeight;
+   unsigned int m_numThreads;
+};
+
+} // End namespace ossimMsp
+
+#endif
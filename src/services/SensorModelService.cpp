@@ -16,6 +16,9 @@
 #include <services/SensorModelService.h>
 #include <cstdlib>
 #include <SensorModel/SensorModelService.h>
+#include <common/PayloadCodec.h>
+#include <common/SensorModelServicePool.h>
+#include <common/ThreadPool.h>
 
 using namespace std;
 
@@ -23,6 +26,8 @@ namespace ossimMsp
 {
 
 SensorModelService::SensorModelService()
+:  m_numThreads (0),
+   m_stateEncoding (PayloadCodec::PLAIN)
 {
 }
 
@@ -34,6 +39,17 @@ void SensorModelService::loadJSON(const Json::Value& json)
 {
    m_method = json["method"].asString();
    m_application = json["application"].asString();
+   m_stateEncoding = PayloadCodec::encodingFromString(json["stateEncoding"].asString());
+
+   // A batch request lists the images in an array. Images are instantiated in execute() so that
+   // a bad entry only fails its own result:
+   if (json.isMember("images"))
+   {
+      m_image.reset();
+      m_batchImages = json["images"];
+      m_numThreads = json["numThreads"].asUInt();
+      return;
+   }
 
    try
    {
@@ -48,12 +64,17 @@ void SensorModelService::loadJSON(const Json::Value& json)
 
 void SensorModelService::saveJSON(Json::Value& json) const
 {
-   if (!m_image)
+   if (!m_batchResults.isNull())
+   {
+      json["results"] = m_batchResults;
+   }
+   else if (!m_image)
    {
       try
       {
          // Just return list of available plugins:
-         shared_ptr<MSP::SMS::SensorModelService> sms (new MSP::SMS::SensorModelService());
+         shared_ptr<MSP::SMS::SensorModelService> sms =
+               SensorModelServicePool::instance()->checkout();
          MSP::SMS::NameList pluginList;
          sms->getAllRegisteredPlugins(pluginList);
          if ( pluginList.size() == 0 )
@@ -81,50 +102,114 @@ void SensorModelService::saveJSON(Json::Value& json) const
    }
    else
    {
-      // Assemble response JSON header
+      evaluate(*m_image, json);
+   }
+}
 
-      if (m_method.empty() || (m_method == "getAvailableModels"))
-      {
-         // Fetch the models:
-         std::vector< pair<std::string, std::string> > models;
-         m_image->getAvailableModels(models);
+void SensorModelService::evaluate(MspImage& image, Json::Value& json) const
+{
+   // Assemble response JSON header
 
-         // Write the image information:
-         Json::Value modelsArray(Json::arrayValue);
-         for (size_t i=0; i<models.size(); ++i)
-         {
-            Json::Value arrayEntry;
-            arrayEntry["plugin"] = models[i].first;
-            arrayEntry["model"] = models[i].second;
-            modelsArray.append(arrayEntry);
-         }
-         json["sensorModels"] = modelsArray;
+   if (m_method.empty() || (m_method == "getAvailableModels"))
+   {
+      // Fetch the models:
+      std::vector< pair<std::string, std::string> > models;
+      image.getAvailableModels(models);
+
+      // Write the image information:
+      Json::Value modelsArray(Json::arrayValue);
+      for (size_t i=0; i<models.size(); ++i)
+      {
+         Json::Value arrayEntry;
+         arrayEntry["plugin"] = models[i].first;
+         arrayEntry["model"] = models[i].second;
+         modelsArray.append(arrayEntry);
       }
-      else if (m_method == "getModelState")
+      json["sensorModels"] = modelsArray;
+   }
+   else if (m_method == "getModelState")
+   {
+      if (image.getCsmSensorModel())
       {
-         if (m_image->getCsmSensorModel())
-         {
-            Json::Value imageJson;
-            m_image->saveJSON(imageJson);
-            json["image"] =   imageJson;
-         }
-         else
-         {
-            ostringstream msg;
-            msg<<"Model <"<<m_image->getModelName()<<"> not found or not supported.";
-            json["error"] = msg.str();
-         }
+         Json::Value imageJson;
+         image.setStateEncoding(m_stateEncoding);
+         image.saveJSON(imageJson);
+         json["image"] =   imageJson;
+      }
+      else
+      {
+         ostringstream msg;
+         msg<<"Model <"<<image.getModelName()<<"> not found or not supported.";
+         json["error"] = msg.str();
+      }
+   }
+   else if (m_method == "getImageSupportData")
+   {
+      // Compact stand-in for the image file that can be sent in place of it for model creation:
+      try
+      {
+         string isd;
+         MspImage::getISD(isd, image.getFilename().string(), image.getEntryIndex());
+         PayloadCodec::encode(isd, PayloadCodec::BASE64, json["imageSupportData"]);
+      }
+      catch (exception& e)
+      {
+         json["error"] = e.what();
       }
    }
-
 }
 
 void SensorModelService::execute(void)
 {
+   if (m_batchImages.isNull())
+      return;
+
+   // Each worker writes only its own result entry, so all entries must exist beforehand:
+   unsigned int count = m_batchImages.size();
+   m_batchResults = Json::Value(Json::arrayValue);
+   for (unsigned int i=0; i<count; ++i)
+      m_batchResults.append(Json::Value(Json::objectValue));
+
+   const Json::Value& images = m_batchImages;
+   ThreadPool::instance()->parallelFor(count, [this, &images](size_t i)
+   {
+      const Json::Value& imageJson = images[(unsigned int) i];
+      Json::Value& result = m_batchResults[(unsigned int) i];
+      result["filename"] = imageJson["filename"];
+      try
+      {
+         MspImage image (imageJson);
+         evaluate(image, result);
+         result["imageId"] = image.getImageId();
+      }
+      catch (exception& e)
+      {
+         result["error"] = e.what();
+      }
+   }, m_numThreads);
+}
+
+void SensorModelService::execute(const vector<string>& imageFiles)
+{
+   m_image.reset();
+   m_batchImages = Json::Value(Json::arrayValue);
+   for (size_t i=0; i<imageFiles.size(); ++i)
+   {
+      Json::Value imageJson;
+      imageJson["filename"] = imageFiles[i];
+      m_batchImages.append(imageJson);
+   }
+   execute();
+
+   Json::Value json;
+   saveJSON(json);
+   cout << json << endl;
 }
 
 void SensorModelService::execute(const string& imageFile)
 {
+   m_batchImages = Json::Value();
+   m_batchResults = Json::Value();
    m_image.reset(new MspImage("", imageFile, ""));
    Json::Value json;
    saveJSON(json);
@@ -9,6 +9,8 @@
 
 #include <services/ServiceBase.h>
 #include <memory>
+#include <string>
+#include <vector>
 #include "../common/MspImage.h"
 
 namespace ossimMsp
@@ -24,7 +26,8 @@ public:
    virtual ~SensorModelService();
 
    /**
-    * Does nothing. The work is done in saveJSON().
+    * Evaluates the batch of images concurrently when the request provided an "images" array.
+    * Otherwise does nothing, and the work is done in saveJSON().
     */
    virtual void execute();
 
@@ -45,10 +48,25 @@ public:
     */
    void execute(const std::string& imageFile);
 
+   /**
+    * Batch form of the above for many image files, evaluated concurrently. Prints out the JSON
+    * response array to the console.
+    */
+   void execute(const std::vector<std::string>& imageFiles);
+
 private:
+   /** Performs the requested method on one image, writing the response fields to json. */
+   void evaluate(MspImage& image, Json::Value& json) const;
+
    std::string m_method;
    std::string m_application;
    std::shared_ptr<MspImage> m_image;
+
+   // Batch mode:
+   Json::Value m_batchImages;
+   Json::Value m_batchResults;
+   unsigned int m_numThreads;
+   PayloadCodec::Encoding m_stateEncoding;
 };
 
 } // End namespace ossimMsp
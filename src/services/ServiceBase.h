@@ -9,6 +9,7 @@
 
 #include <ossim/base/JsonInterface.h>
 #include <ossim/base/ossimConstants.h>
+#include <common/ExecutionControl.h>
 #include <string>
 #include <memory>
 
@@ -26,8 +27,26 @@ public:
 
    virtual ~ServiceBase() {}
 
+   /**
+    * Runs the service. Services with long-running work report its progress to the callback, and
+    * stop early when cancelled or out of time, with the best result reached; others run to
+    * completion regardless.
+    */
    virtual void execute() = 0;
 
+   /** Called with each iteration's progress during execute(). */
+   void setProgressCallback(const ExecutionControl::ProgressCallback& callback)
+   { m_control.setProgressCallback(callback); }
+
+   /** Token by which execute() can be cancelled from another thread. */
+   void setCancellationToken(const std::shared_ptr<CancellationToken>& token)
+   { m_control.setCancellationToken(token); }
+
+   /** Wall-clock seconds allowed for each execute() (0 = no limit). */
+   void setTimeBudget(double seconds) { m_control.setTimeBudget(seconds); }
+
+protected:
+   ExecutionControl m_control;
 };
 
 } // End namespace ossimMsp
@@ -28,7 +28,9 @@ SourceSelectionService::SourceSelectionService()
    m_desiredLE90 (0),
    m_meetsCriteria (false),
    m_estimatedCE90 (0),
-   m_estimatedLE90 (0)
+   m_estimatedLE90 (0),
+   m_numThreads (0),
+   m_prefilter (true)
 {
 }
 
@@ -44,10 +46,14 @@ void SourceSelectionService::execute()
    m_estimatedCE90 = -1;
    m_estimatedLE90 = -1;
 
-   size_t ncands = m_candidateImages.size();
-   if ((ncands == 0) || (m_mustUse.size() != ncands))
+   if (m_candidateImages.empty() || (m_mustUse.size() != m_candidateImages.size()))
       return;
 
+   // Most candidates in large catalogs don't cover the point. Drop those before any MSP work:
+   if (m_prefilter)
+      prefilterCandidates();
+   size_t ncands = m_candidateImages.size();
+
    // Need the reference ground point in ECEF coordinates:
    double x, y, z;
    csm::EcefCoord csmEcefPt (m_refPt.x(), m_refPt.y(), m_refPt.z());
@@ -60,18 +66,24 @@ void SourceSelectionService::execute()
    // Start a new session NOW:
    m_session = SessionManager::newSession();
 
+   // Instantiate all candidates' sensor models concurrently:
+   vector<string> errors;
+   if (MspImage::createCsmSensorModels(m_candidateImages, errors, m_numThreads))
+   {
+      xmsg<<"Could not instantiate sensor models for candidates:";
+      for (size_t i=0; i<ncands; ++i)
+      {
+         if (!errors[i].empty())
+            xmsg<<"\n  <"<<m_candidateImages[i]->getFilename()<<">: "<<errors[i];
+      }
+      throw ossimException(xmsg.str());
+   }
+
    // Loop to add all images:
    for (size_t i=0; i<ncands; ++i)
    {
       shared_ptr<MspImage> image (m_candidateImages[i]);
-      const char* fname = image->getFilename().c_str();
-      const char* modelName =image->getModelName().c_str();
       const csm::RasterGM* model = image->getCsmSensorModel();
-      if (!model)
-      {
-         xmsg<<"Could not instantiate sensor model from image file: <"<<fname<<">."<<endl;
-         throw ossimException(xmsg.str());
-      }
 
       // Construct MSP candidate image representing this file:
       MSP::SS::CandidateImage::Usage usage_req = MSP::SS::CandidateImage::CAN_USE;
@@ -132,8 +144,20 @@ void SourceSelectionService::loadJSON(const Json::Value& queryRoot)
    refGpt.lat = point["lat"].asDouble();
    refGpt.lon = point["lon"].asDouble();
    refGpt.hgt = 0.0;
+   m_refGpt = refGpt;
    m_refPt = ossimEcefPoint(refGpt);
 
+   // Footprint prefiltering of candidates is on unless disabled:
+   if (queryRoot.isMember("prefilter"))
+      m_prefilter = queryRoot["prefilter"].asBool();
+
+   // Optional limit on threads used for instantiating sensor models:
+   m_numThreads = queryRoot["numThreads"].asUInt();
+
+   // Optional compact encoding of the model states in the response ("plain" by default):
+   PayloadCodec::Encoding stateEncoding =
+         PayloadCodec::encodingFromString(queryRoot["stateEncoding"].asString());
+
    Json::Value desiredAccuracy = queryRoot["desiredAccuracy"];
    m_desiredCE90 = desiredAccuracy["ce90"].asDouble();
    m_desiredLE90 = desiredAccuracy["le90"].asDouble();
@@ -147,6 +171,7 @@ void SourceSelectionService::loadJSON(const Json::Value& queryRoot)
    {
       Json::Value candidate = candidates[index];
       m_candidateImages.push_back(shared_ptr<MspImage>(new MspImage(candidate)));
+      m_candidateImages.back()->setStateEncoding(stateEncoding);
       m_mustUse.push_back(candidate["mustUse"].asBool());
    }
 }
@@ -163,6 +188,57 @@ void SourceSelectionService::saveJSON(Json::Value& responseJson) const
    Json::Value pbJson;
    photoblock->saveJSON(pbJson);
    responseJson["photoblock"] = pbJson;
+
+   if (!m_rejectedImages.empty())
+   {
+      Json::Value rejected (Json::arrayValue);
+      for (size_t i=0; i<m_rejectedImages.size(); ++i)
+      {
+         Json::Value entry;
+         entry["imageId"] = m_rejectedImages[i]->getImageId();
+         entry["filename"] = m_rejectedImages[i]->getFilename().string();
+         rejected.append(entry);
+      }
+      responseJson["rejectedCandidates"] = rejected;
+   }
+}
+
+void SourceSelectionService::prefilterCandidates()
+{
+   vector< shared_ptr<const Footprint> > footprints;
+   vector<string> errors;
+   MspImage::getFootprints(m_candidateImages, m_refGpt.hgt, footprints, errors, m_numThreads);
+
+   // A single point query, so a scan beats building a spatial index. The footprints' bounds
+   // reject most candidates before the polygon test:
+   vector<bool> keep (m_candidateImages.size(), false);
+   for (size_t i=0; i<footprints.size(); ++i)
+      keep[i] = footprints[i] && footprints[i]->contains(m_refGpt.lat, m_refGpt.lon);
+
+   // Candidates without footprints are left for MSP to sort out, and must-use ones always stay:
+   vector< shared_ptr<MspImage> > candidates;
+   vector<bool> mustUse;
+   m_rejectedImages.clear();
+   for (size_t i=0; i<m_candidateImages.size(); ++i)
+   {
+      if (keep[i] || m_mustUse[i] || !footprints[i])
+      {
+         candidates.push_back(m_candidateImages[i]);
+         mustUse.push_back(m_mustUse[i]);
+      }
+      else
+      {
+         m_rejectedImages.push_back(m_candidateImages[i]);
+      }
+   }
+
+   if (traceDebug())
+   {
+      clog<<"SourceSelectionService -- "<<m_rejectedImages.size()<<" of "
+          <<m_candidateImages.size()<<" candidates do not cover the reference point."<<endl;
+   }
+   m_candidateImages.swap(candidates);
+   m_mustUse.swap(mustUse);
 }
 
 void SourceSelectionService::computeAccuracy(MSP::SS::SourceSelectionResult& mspAbsResult)
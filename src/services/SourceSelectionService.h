@@ -50,6 +50,13 @@ public:
 private:
    void computeAccuracy(MSP::SS::SourceSelectionResult& mspResults);
 
+   /**
+    * Removes the candidates whose footprints do not contain the reference point, other than
+    * must-use candidates and those without a footprint, recording them in m_rejectedImages.
+    */
+   void prefilterCandidates();
+
+   ossimGpt m_refGpt;
    ossimEcefPoint m_refPt;
    std::shared_ptr<Session> m_session;
    std::vector< std::shared_ptr<MspImage> > m_candidateImages;
@@ -59,6 +66,9 @@ private:
    bool m_meetsCriteria;
    double m_estimatedCE90;
    double m_estimatedLE90;
+   unsigned int m_numThreads;
+   bool m_prefilter;
+   std::vector< std::shared_ptr<MspImage> > m_rejectedImages;
 };
 
 } // End namespace ossimMsp
@@ -10,8 +10,13 @@
 #include <ossim/base/ossimException.h>
 #include <PointExtraction/PointExtractionService.h>
 #include <csmutil/CsmSensorModelList.h>
+#include <common/MspImage.h>
+#include <common/ModelStateCache.h>
 #include <common/SessionManager.h>
+#include <common/ThreadPool.h>
 #include <common/math/Matrix.h>
+#include <chrono>
+#include <unordered_map>
 
 using namespace std;
 using namespace ossim;
@@ -20,6 +25,13 @@ namespace ossimMsp
 {
 
 TriangulationService::TriangulationService()
+:  m_returnPhotoblock (true),
+   m_backend (MSP_BACKEND),
+   m_warmStart (false),
+   m_mspSeconds (0.0),
+   m_interruption (ExecutionControl::NOT_INTERRUPTED),
+   m_adjusted (false),
+   m_requestTimeBudget (-1.0)
 {
 }
 
@@ -31,19 +43,72 @@ void TriangulationService::loadJSON(const Json::Value& queryRoot)
 {
    ostringstream xmsg;
 
-   if (queryRoot.isMember("sessionId"))
+   // Optional limit on threads used for instantiating sensor models, which must be set before
+   // loading since that instantiates any models needed for image IDs:
+   bool limitThreads = queryRoot.isMember("numThreads");
+   unsigned int numThreads = queryRoot.get("numThreads", 0).asUInt();
+
+   // Release any session of a previous request:
+   m_sessionLock = std::unique_lock<std::mutex>();
+   m_session.reset();
+   m_sessionId.clear();
+
+   bool isSession = queryRoot.isMember("sessionId");
+   if (isSession)
    {
-      // TODO: SessionManager::getSession(sessionId) NOT YET IMPLEMENTED
-      // Parse the JSON request and initialize TiePointFinder object with active session. This will
-      // recall the session from the database along with all image models (from photoblock).
-      string sessionId = queryRoot["sessionID"].asString();
-      shared_ptr<Session> session = SessionManager::getSession(sessionId);
+      // Continue with the photoblock of an active session, edited by the optional delta. With
+      // "branch", the delta is applied to a new session sharing the original's photoblock, and
+      // the original is left as it was:
+      string sessionId = queryRoot["sessionId"].asString();
+      shared_ptr<Session> session;
+      if (queryRoot.get("branch", false).asBool())
+         session = SessionManager::branchSession(sessionId);
+      else
+         session = SessionManager::getSession(sessionId);
       if (!session)
       {
          xmsg << "Fatal: Null session returned trying to access with sessionId <"<<sessionId<<">!";
          throw ossimException(xmsg.str());
       }
-      m_photoBlock.reset(session->getPhotoBlock().get());
+
+      // Other requests on the session wait until this one is destroyed:
+      m_sessionLock = std::unique_lock<std::mutex>(session->getMutex());
+      m_session = session;
+      m_sessionId = session->getSessionId();
+      m_photoBlock = session->getPhotoBlock();
+   }
+   else
+   {
+      m_photoBlock.reset(new MspPhotoBlock);
+   }
+   if (limitThreads)
+      m_photoBlock->setNumThreads(numThreads);
+
+   if (isSession)
+   {
+      if (queryRoot.isMember("delta"))
+      {
+         const Json::Value& delta = queryRoot["delta"];
+         m_photoBlock->applyDelta(delta);
+
+         // An image removed may be added again with a different model, so its a priori state
+         // is recaptured:
+         const Json::Value& removeImages = delta["removeImages"];
+         shared_ptr<const Session::ModelStates> apriori = m_session->getAprioriStates();
+         if (apriori && removeImages.size())
+         {
+            shared_ptr<Session::ModelStates> kept (new Session::ModelStates(*apriori));
+            for (unsigned int i=0; i<removeImages.size(); ++i)
+               kept->erase(removeImages[i].asString());
+            m_session->setAprioriStates(kept);
+         }
+      }
+   }
+   else if (queryRoot.isMember("photoblockFile"))
+   {
+      // Large photoblocks can be given as a file: JSON, streamed rather than parsed into a DOM, or
+      // a binary snapshot:
+      m_photoBlock->loadFile(queryRoot["photoblockFile"].asString());
    }
    else
    {
@@ -54,64 +119,659 @@ void TriangulationService::loadJSON(const Json::Value& queryRoot)
          xmsg <<__FILE__<<":"<<__LINE__<<" Fatal: Null photoblock returned!";
          throw ossimException(xmsg.str());
       }
-      m_photoBlock.reset(new MspPhotoBlock(pbJson));
+      m_photoBlock->loadJSON(pbJson);
+   }
+
+   // With "startSession", a new photoblock starts a session, so that later requests can send
+   // deltas against it. Sessions hold their photoblocks in memory, so are only kept on request:
+   if (!isSession && queryRoot.get("startSession", false).asBool())
+   {
+      shared_ptr<Session> session = SessionManager::newSession();
+      m_sessionLock = std::unique_lock<std::mutex>(session->getMutex());
+      session->setPhotoBlock(m_photoBlock);
+      m_session = session;
+      m_sessionId = session->getSessionId();
+   }
+
+   // The full adjusted photoblock is returned by default only when it was sent in full:
+   m_returnPhotoblock = queryRoot.get("returnPhotoblock", !isSession).asBool();
+
+   // Optional binary snapshot of the adjusted photoblock, for fast reloading via "photoblockFile":
+   m_snapshotFile = queryRoot["snapshotFile"].asString();
+
+   // Optional compact encoding of the model states in the response ("plain" by default):
+   m_photoBlock->setStateEncoding(
+         PayloadCodec::encodingFromString(queryRoot["stateEncoding"].asString()));
+
+   // Triangulation backend: "msp" (default), "native" (the plugin's own bundle adjuster), or
+   // "both" to compare them on the same block, with only MSP's solution kept:
+   string backend = queryRoot.get("backend", "msp").asString();
+   if (backend == "msp")
+      m_backend = MSP_BACKEND;
+   else if (backend == "native")
+      m_backend = NATIVE_BACKEND;
+   else if (backend == "both")
+      m_backend = BOTH_BACKENDS;
+   else
+   {
+      xmsg <<__FILE__<<": loadJSON() -- Unknown triangulation backend <"<<backend<<">.";
+      throw ossimException(xmsg.str());
    }
+
+   // Start the native adjustment from the session's last solution, for quick re-adjustment after
+   // small edits. MSP's triangulation has no input for initial estimates apart from its a priori
+   // models, so always starts from those:
+   m_warmStart = queryRoot.get("warmStart", false).asBool();
+   if (m_warmStart && (m_backend == MSP_BACKEND))
+   {
+      ossimNotify(ossimNotifyLevel_WARN)<<"TriangulationService::loadJSON() -- \"warmStart\" "
+         "applies to the native backend only, and is ignored."<<endl;
+   }
+
+   // Wall-clock seconds allowed for execution, after which the best solution reached is returned.
+   // If given, it applies to this request's execution only, in place of the budget set with
+   // setTimeBudget():
+   m_requestTimeBudget = queryRoot.isMember("timeBudget") ?
+                         queryRoot["timeBudget"].asDouble() : -1.0;
+
+   const Json::Value& nativeJson = queryRoot["nativeOptions"];
+   m_nativeOptions = PartitionedAdjuster::Options();
+   BundleAdjuster::Options& adjustment = m_nativeOptions.adjustment;
+   adjustment.maxIterations = nativeJson.get("maxIterations", adjustment.maxIterations).asUInt();
+   adjustment.convergence = nativeJson.get("convergence", adjustment.convergence).asDouble();
+   adjustment.maxDenseParameters = nativeJson.get(
+         "maxDenseParameters", (Json::UInt64) adjustment.maxDenseParameters).asUInt64();
+   adjustment.maxCgIterations =
+         nativeJson.get("maxCgIterations", adjustment.maxCgIterations).asUInt();
+   adjustment.cgTolerance = nativeJson.get("cgTolerance", adjustment.cgTolerance).asDouble();
+   adjustment.computeCovariance =
+         nativeJson.get("computeCovariance", adjustment.computeCovariance).asBool();
+   adjustment.numThreads = numThreads;
+
+   // Divide-and-conquer adjustment of large blocks, in overlapping sub-blocks of about
+   // maxImages images each:
+   const Json::Value& partitionJson = nativeJson["partition"];
+   m_nativeOptions.maxImagesPerPartition = partitionJson.get(
+         "maxImages", (Json::UInt64) m_nativeOptions.maxImagesPerPartition).asUInt64();
+   m_nativeOptions.overlapFraction =
+         partitionJson.get("overlapFraction", m_nativeOptions.overlapFraction).asDouble();
+   m_nativeOptions.minSharedPoints = partitionJson.get(
+         "minSharedPoints", (Json::UInt64) m_nativeOptions.minSharedPoints).asUInt64();
+   m_nativeOptions.compareFullSolve =
+         partitionJson.get("compareFullSolve", m_nativeOptions.compareFullSolve).asBool();
+
+   // Robust estimation against blunders. The residual pre-pass screens the measurements for
+   // either backend, the robust loss and rejection between iterations are the native backend's:
+   const Json::Value& robustJson = queryRoot["robust"];
+   string loss = robustJson.get("loss", "none").asString();
+   if (loss == "none")
+      adjustment.robustLoss = BundleAdjuster::NO_ROBUST_LOSS;
+   else if (loss == "huber")
+      adjustment.robustLoss = BundleAdjuster::HUBER_LOSS;
+   else if (loss == "cauchy")
+      adjustment.robustLoss = BundleAdjuster::CAUCHY_LOSS;
+   else
+   {
+      xmsg <<__FILE__<<": loadJSON() -- Unknown robust loss <"<<loss<<">.";
+      throw ossimException(xmsg.str());
+   }
+   adjustment.robustScale = robustJson.get("scale", adjustment.robustScale).asDouble();
+   adjustment.prepassThreshold =
+         robustJson.get("prepassThreshold", adjustment.prepassThreshold).asDouble();
+   adjustment.rejectionThreshold =
+         robustJson.get("rejectionThreshold", adjustment.rejectionThreshold).asDouble();
+   adjustment.minResidualScale =
+         robustJson.get("minResidualScale", adjustment.minResidualScale).asDouble();
+   adjustment.maxRejectionRounds =
+         robustJson.get("maxRejectionRounds", adjustment.maxRejectionRounds).asUInt();
 }
 
 void TriangulationService::saveJSON(Json::Value& json) const
 {
-   Json::Value pbJson;
-   m_photoBlock->saveJSON(pbJson);
-   json["photoblock"] = pbJson;
+   if (m_session)
+      json["sessionId"] = m_sessionId;
+   if (m_returnPhotoblock)
+   {
+      Json::Value pbJson;
+      m_photoBlock->saveJSON(pbJson);
+      json["photoblock"] = pbJson;
+   }
 
-   string results = m_triangulationResult->toString(true);
-   json["triangulationResult"] = results;
+   if (m_triangulationResult)
+   {
+      string results = m_triangulationResult->toString(true);
+      json["triangulationResult"] = results;
+      json["timing"]["mspSeconds"] = m_mspSeconds;
+   }
+   if (!m_prepassResult.isNull())
+      json["prepass"] = m_prepassResult;
+   if (m_interruption != ExecutionControl::NOT_INTERRUPTED)
+      json["interrupted"] = ExecutionControl::toString(m_interruption);
+
+   // False if interrupted before any adjustment of the photoblock ran, leaving it as given:
+   json["adjusted"] = m_adjusted;
+   if (!m_nativeResult.isNull())
+   {
+      json["nativeResult"] = m_nativeResult;
+      json["timing"]["nativeSeconds"] = m_nativeResult["elapsedSeconds"];
+   }
 
    //clog << results << endl;
 }
 
 void TriangulationService::execute()
 {
+   // The request's budget, if any, is used once, after which the default applies again:
+   double defaultBudget = m_control.getTimeBudget();
+   if (m_requestTimeBudget >= 0.0)
+      m_control.setTimeBudget(m_requestTimeBudget);
+   m_requestTimeBudget = -1.0;
+   m_control.start();
+   m_interruption = ExecutionControl::NOT_INTERRUPTED;
+   m_adjusted = false;
+   try
+   {
+      m_triangulationResult.reset();
+      m_nativeResult = Json::Value();
+      m_prepassResult = Json::Value();
+      m_rejectedMeasurements.clear();
+
+      // The native adjuster and the pre-pass work on private models made from the a priori
+      // states, captured before MSP's adjusted models replace the photoblock's. Within a session
+      // the photoblock's models may be adjusted already, so MSP's are made from them too:
+      bool screen = (m_backend != NATIVE_BACKEND) &&
+                    (m_nativeOptions.adjustment.prepassThreshold > 0.0);
+      vector<string> modelStates;
+      if ((m_backend != MSP_BACKEND) || screen || m_session)
+         captureModelStates(modelStates);
+
+      if (screen && !checkInterruption())
+         screenMeasurements(modelStates);
+
+      // MSP's triangulation is the adjustment asked for and cannot be stopped part way, so it
+      // runs even if the pre-pass used up the time budget, unless cancelled:
+      bool cancelled = checkInterruption() && (m_interruption == ExecutionControl::CANCELLED);
+      if ((m_backend != NATIVE_BACKEND) && !cancelled)
+      {
+         runMspTriangulation(m_session ? modelStates : vector<string>());
+         m_adjusted = true;
+      }
+      if ((m_backend != MSP_BACKEND) && !checkInterruption())
+      {
+         runNativeAdjustment(modelStates, (m_backend == NATIVE_BACKEND));
+         m_adjusted = m_adjusted || (m_backend == NATIVE_BACKEND);
+      }
+
+      if (!m_snapshotFile.empty())
+         m_photoBlock->saveSnapshot(m_snapshotFile);
+   }
+   catch (exception& e)
+   {
+      ossimNotify(ossimNotifyLevel_FATAL)<<"TriangulationService::execute() -- "<<e.what()<<endl;
+   }
+   m_control.setTimeBudget(defaultBudget);
+}
+
+bool TriangulationService::checkInterruption()
+{
+   if (m_interruption == ExecutionControl::NOT_INTERRUPTED)
+      m_interruption = m_control.checkInterruption();
+   return (m_interruption != ExecutionControl::NOT_INTERRUPTED);
+}
+
+void TriangulationService::runMspTriangulation(const std::vector<std::string>& states)
+{
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+   // Instantiate the sensor models and assemble into an MSP list. MSP adjusts the models in place,
+   // so these are private copies, the images' models being shared with the model caches and with
+   // other sessions:
+   MSP::CsmSensorModelList csmModelList;
+   vector< shared_ptr<csm::RasterGM> > models;
+   if (states.empty())
+      m_photoBlock->getCsmModels(csmModelList, models);
+   else
+   {
+      models.resize(states.size());
+      ThreadPool::instance()->parallelFor(states.size(), [&](size_t i)
+      {
+         models[i] = ModelStateCache::instance()->createModel(states[i]);
+      }, m_nativeOptions.adjustment.numThreads);
+      for (size_t i=0; i<models.size(); ++i)
+      {
+         if (!models[i])
+         {
+            ostringstream xmsg;
+            xmsg<<__FILE__<<": runMspTriangulation() -- Sensor model could not be created for <"
+                <<m_photoBlock->getImageList()[i]->getImageId()<<">.";
+            throw ossimException(xmsg.str());
+         }
+         csmModelList.push_back(models[i].get());
+      }
+   }
+
+   // Assemple all ground control points and image points in the photoblock:
+   MSP::GroundPointList mspGroundPts;
+   fillGcpList(mspGroundPts);
+
+   MSP::ImagePointList mspImagePts;
+   fillTpList(mspImagePts);
+
+   // Establish all auto and cross covariances for sensor models and GCPs:
+   MSP::JointCovMatrix jcm = csmModelList.getJointCovMatrix();
+   jcm.setObjects( csmModelList, mspGroundPts );
+   setGcpCrossCovariances(mspGroundPts, jcm);
+   jcm.validate(csmModelList, mspGroundPts);
+   m_photoBlock->setJointCovariance(jcm);
+
+   // Define a blunder strategy:
+   MSP::PES::BlunderStrategy blunderStrategy;
+   //clog<<"\nBlunderStrategy:\n"<<blunderStrategy.toString()<<endl;
+
+   // Pass to MSP triangualtion service:
+   MSP::PES::PointExtractionService pes;
+   m_triangulationResult =
+         shared_ptr<MSP::PES::TriangulationResult>(new MSP::PES::TriangulationResult);
+   pes.triangulate(csmModelList, mspImagePts, jcm, blunderStrategy, *m_triangulationResult);
+   clog<<"\n"<<m_triangulationResult->toString(true)<<endl;
+
+   // Update photoblock with a posteriori values:
+   m_photoBlock->setCsmModels(csmModelList);
+   //   m_photoBlock->setJointCovariance(m_triangulationResult->getJointCov());
+
+   m_mspSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Adds the photoblock's points to the adjuster in measurement store order, those measured on GCPs
+ * as control points, then their measurements. Returns the store index of each observation, in
+ * the order added.
+ */
+template <class Adjuster>
+static vector<size_t> addMeasurements(MspPhotoBlock& photoBlock, Adjuster& adjuster)
+{
+   // Points measured on GCPs carry the GCP ID, so are control points:
+   const GcpList& gcpList = photoBlock.getGroundPointList();
+   unordered_map<string, size_t> gcpIndex;
+   for (size_t g=0; g<gcpList.size(); ++g)
+      gcpIndex.emplace(gcpList[g]->getId(), g);
+
+   const MeasurementStore& measurements = photoBlock.getMeasurements();
+   vector<size_t> observations;
+   observations.reserve(measurements.size());
+   double ecf[3];
+   double covariance[9];
+   size_t count = 0;
+   for (unsigned int p=0; p<measurements.getNumPoints(); ++p)
+   {
+      const string& pointId = measurements.getPointId(p);
+      auto gcp = gcpIndex.find(pointId);
+      unsigned int point;
+      if (gcp == gcpIndex.end())
+         point = adjuster.addPoint(pointId);
+      else
+      {
+         const ossimEcefPoint& position = gcpList[gcp->second]->getECF();
+         const NEWMAT::SymmetricMatrix& cov = gcpList[gcp->second]->getCovariance();
+         ecf[0] = position.x();
+         ecf[1] = position.y();
+         ecf[2] = position.z();
+         for (int r=0; r<3; ++r)
+         {
+            for (int c=0; c<3; ++c)
+               covariance[3*r + c] = cov(r+1, c+1);
+         }
+         point = adjuster.addControlPoint(pointId, ecf, covariance);
+      }
+
+      const size_t* m = measurements.getPointMeasurements(p, count);
+      for (size_t k=0; k<count; ++k)
+      {
+         adjuster.addObservation(point, measurements.getImage(m[k]), measurements.getLine(m[k]),
+                                 measurements.getSample(m[k]), measurements.getCovariance(m[k]));
+         observations.push_back(m[k]);
+      }
+   }
+   return observations;
+}
+
+/**
+ * Lists the adjuster's rejected observations by point, with the reasons. A point is rejected if
+ * it could no longer be estimated.
+ */
+template <class Adjuster>
+static void saveRejections(MspPhotoBlock& photoBlock, const Adjuster& adjuster,
+                           const vector<size_t>& observations, Json::Value& json)
+{
+   const MeasurementStore& measurements = photoBlock.getMeasurements();
+   const vector< shared_ptr<Image> >& imageList = photoBlock.getImageList();
+   json = Json::Value(Json::arrayValue);
+   Json::Value* pointJson = 0;
+   unsigned int lastPoint = 0;
+   for (size_t a=0; a<observations.size(); ++a)
+   {
+      const BundleAdjuster::ObservationStatus& status = adjuster.getObservationStatus(a);
+      if (status.rejection == BundleAdjuster::NOT_REJECTED)
+         continue;
+
+      // Observations were added point by point, the same order as the adjuster's points:
+      unsigned int point = measurements.getPoint(observations[a]);
+      if (!pointJson || (point != lastPoint))
+      {
+         pointJson = &json.append(Json::Value());
+         (*pointJson)["pointId"] = measurements.getPointId(point);
+         (*pointJson)["pointRejected"] = !adjuster.isPointEstimated(point);
+         lastPoint = point;
+      }
+      Json::Value& obsJson = (*pointJson)["observations"].append(Json::Value());
+      obsJson["imageId"] = imageList[measurements.getImage(observations[a])]->getImageId();
+      if (status.rejection == BundleAdjuster::PREPASS_REJECTED)
+         obsJson["reason"] = "prepass";
+      else
+      {
+         obsJson["reason"] = "residual";
+         obsJson["iteration"] = status.iteration;
+      }
+      obsJson["normalizedResidual"] = status.normalizedResidual;
+   }
+}
+
+void TriangulationService::captureModelStates(std::vector<std::string>& states)
+{
+   const vector< shared_ptr<Image> >& imageList = m_photoBlock->getImageList();
+   shared_ptr<const Session::ModelStates> apriori;
+   if (m_session)
+      apriori = m_session->getAprioriStates();
+   states.assign(imageList.size(), string());
+   vector<string> errors (imageList.size());
+   vector<char> captured (imageList.size(), 0);
+   ThreadPool::instance()->parallelFor(imageList.size(), [&](size_t i)
+   {
+      if (apriori)
+      {
+         auto state = apriori->find(imageList[i]->getImageId());
+         if (state != apriori->end())
+         {
+            states[i] = state->second;
+            return;
+         }
+      }
+      captured[i] = 1;
+      try
+      {
+         shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(imageList[i]);
+         const csm::RasterGM* model = image ? image->getCsmSensorModel() : 0;
+         if (model)
+            states[i] = model->getModelState();
+         else
+            errors[i] = "No sensor model available.";
+      }
+      catch (exception& e)
+      {
+         errors[i] = e.what();
+      }
+   }, m_nativeOptions.adjustment.numThreads);
+
    ostringstream xmsg;
+   xmsg<<__FILE__<<": captureModelStates() -- Sensor models could not be established for:";
+   bool failed = false;
+   for (size_t i=0; i<errors.size(); ++i)
+   {
+      if (errors[i].empty())
+         continue;
+      xmsg<<"\n  <"<<imageList[i]->getImageId()<<">: "<<errors[i];
+      failed = true;
+   }
+   if (failed)
+      throw ossimException(xmsg.str());
 
-   try
+   // Images new to the session keep their states as captured now, before any adjustment:
+   size_t numCaptured = 0;
+   for (size_t i=0; i<captured.size(); ++i)
+      numCaptured += captured[i];
+   if (m_session && numCaptured)
    {
-      // Instantiate the sensor models and assemble into an MSP list:
-      MSP::CsmSensorModelList csmModelList;
-      m_photoBlock->getCsmModels(csmModelList);
+      shared_ptr<Session::ModelStates> updated (apriori ? new Session::ModelStates(*apriori) :
+                                                          new Session::ModelStates);
+      for (size_t i=0; i<imageList.size(); ++i)
+      {
+         if (captured[i])
+            (*updated)[imageList[i]->getImageId()] = states[i];
+      }
+      m_session->setAprioriStates(updated);
+   }
+}
 
-      // Assemple all ground control points and image points in the photoblock:
-      MSP::GroundPointList mspGroundPts;
-      fillGcpList(mspGroundPts);
+void TriangulationService::runNativeAdjustment(const std::vector<std::string>& states,
+                                               bool updatePhotoBlock)
+{
+   // Each sub-block of a partitioned adjustment needs its own instances, so the models are made
+   // on demand (concurrently) from the states:
+   const vector< shared_ptr<Image> >& imageList = m_photoBlock->getImageList();
+   PartitionedAdjuster adjuster ((unsigned int) states.size(), [&](unsigned int i)
+   {
+      shared_ptr<csm::RasterGM> model = ModelStateCache::instance()->createModel(states[i]);
+      if (!model)
+      {
+         ostringstream xmsg;
+         xmsg<<__FILE__<<": runNativeAdjustment() -- Sensor model could not be created for <"
+             <<imageList[i]->getImageId()<<">.";
+         throw ossimException(xmsg.str());
+      }
+      return model;
+   });
 
-      MSP::ImagePointList mspImagePts;
-      fillTpList(mspImagePts);
+   if (!m_photoBlock->getGcpCrossCovariance().empty())
+   {
+      ossimNotify(ossimNotifyLevel_WARN)<<"TriangulationService::runNativeAdjustment() -- "
+         "GCP cross-covariances are not modeled by the native backend and are ignored."<<endl;
+   }
 
-      // Establish all auto and cross covariances for sensor models and GCPs:
-      MSP::JointCovMatrix jcm = csmModelList.getJointCovMatrix();
-      jcm.setObjects( csmModelList, mspGroundPts );
-      jcm.validate(csmModelList, mspGroundPts);
-      m_photoBlock->setJointCovariance(jcm);
+   vector<size_t> observations = addMeasurements(*m_photoBlock, adjuster);
 
-      // Define a blunder strategy:
-      MSP::PES::BlunderStrategy blunderStrategy;
-      //clog<<"\nBlunderStrategy:\n"<<blunderStrategy.toString()<<endl;
+   // Warm start from whatever of the last solution still applies. The a priori models remain the
+   // prior, so the result is that of a cold start, reached in fewer iterations:
+   shared_ptr<const Session::Solution> solution;
+   if (m_warmStart && m_session)
+      solution = m_session->getSolution();
+   size_t numImagesSeeded = 0;
+   size_t numPointsSeeded = 0;
+   if (solution)
+   {
+      for (unsigned int i=0; i<imageList.size(); ++i)
+      {
+         auto parameters = solution->parameters.find(imageList[i]->getImageId());
+         if (parameters == solution->parameters.end())
+            continue;
+         adjuster.setImageParameters(i, parameters->second);
+         ++numImagesSeeded;
+      }
+      for (unsigned int p=0; p<adjuster.getNumPoints(); ++p)
+      {
+         auto position = solution->points.find(adjuster.getPointId(p));
+         if (position == solution->points.end())
+            continue;
+         adjuster.setPointPosition(p, &position->second[0]);
+         ++numPointsSeeded;
+      }
+   }
 
-      // Pass to MSP triangualtion service:
-      MSP::PES::PointExtractionService pes;
-      m_triangulationResult =
-            shared_ptr<MSP::PES::TriangulationResult>(new MSP::PES::TriangulationResult);
-      pes.triangulate(csmModelList, mspImagePts, jcm, blunderStrategy, *m_triangulationResult);
-      clog<<"\n"<<m_triangulationResult->toString(true)<<endl;
+   // Interrupted, the adjustment stops with the best solution reached, which is kept as usual:
+   PartitionedAdjuster::Options options (m_nativeOptions);
+   options.adjustment.control = &m_control;
+   PartitionedAdjuster::Report report = adjuster.solve(options);
+   const BundleAdjuster::Result& result = report.overall;
+   if (result.interruption != ExecutionControl::NOT_INTERRUPTED)
+      m_interruption = result.interruption;
+   clog<<"\nTriangulationService::runNativeAdjustment() -- "<<result.message<<" "
+       <<result.iterations<<" iterations, RMS "<<result.initialRms<<" -> "<<result.finalRms
+       <<" pixels, "<<report.numPartitions<<" partition(s), "<<result.elapsedSeconds<<" s."
+       <<endl;
 
-      // Update photoblock with a posteriori values: SHOULD NOT BE NEEDED AS OBJECTS ARE SHARED
-      //   m_photoBlock->setCsmModels(csmModelList);
-      //   m_photoBlock->setJointCovariance(m_triangulationResult->getJointCov());
+   m_nativeResult = Json::Value();
+   m_nativeResult["converged"] = result.converged;
+   m_nativeResult["message"] = result.message;
+   m_nativeResult["iterations"] = result.iterations;
+   m_nativeResult["initialRms"] = result.initialRms;
+   m_nativeResult["finalRms"] = result.finalRms;
+   m_nativeResult["sigma0"] = result.sigma0;
+   m_nativeResult["numObservations"] = (Json::UInt64) result.numObservations;
+   m_nativeResult["numParameters"] = (Json::UInt64) result.numParameters;
+   m_nativeResult["numPoints"] = (Json::UInt64) result.numPoints;
+   m_nativeResult["solver"] = result.solver;
+   m_nativeResult["cgIterations"] = result.cgIterations;
+   m_nativeResult["approximateCovariance"] = result.approximateCovariance;
+   m_nativeResult["elapsedSeconds"] = result.elapsedSeconds;
+   m_nativeResult["numRejected"] = (Json::UInt64) result.numRejected;
+   m_nativeResult["numDownweighted"] = (Json::UInt64) result.numDownweighted;
+   if (result.interruption != ExecutionControl::NOT_INTERRUPTED)
+      m_nativeResult["interrupted"] = ExecutionControl::toString(result.interruption);
+   saveRejections(*m_photoBlock, adjuster, observations, m_nativeResult["rejections"]);
+   if (m_warmStart)
+   {
+      Json::Value& warmStartJson = m_nativeResult["warmStart"];
+      warmStartJson["numImagesSeeded"] = (Json::UInt64) numImagesSeeded;
+      warmStartJson["numPointsSeeded"] = (Json::UInt64) numPointsSeeded;
    }
-   catch (exception& e)
+
+   if (report.numPartitions > 1)
    {
-      ossimNotify(ossimNotifyLevel_FATAL)<<"TriangulationService::execute() -- "<<e.what()<<endl;
+      Json::Value& partitionJson = m_nativeResult["partition"];
+      partitionJson["numPartitions"] = (Json::UInt64) report.numPartitions;
+      partitionJson["numSharedImages"] = (Json::UInt64) report.numSharedImages;
+      partitionJson["numSharedPoints"] = (Json::UInt64) report.numSharedPoints;
+      for (size_t k=0; k<report.numPartitions; ++k)
+      {
+         const BundleAdjuster::Result& partResult = report.partitionResults[k];
+         Json::Value& partJson = partitionJson["partitions"].append(Json::Value());
+         partJson["numImages"] = (Json::UInt64) report.partitionSizes[k];
+         partJson["converged"] = partResult.converged;
+         partJson["iterations"] = partResult.iterations;
+         partJson["finalRms"] = partResult.finalRms;
+         partJson["elapsedSeconds"] = partResult.elapsedSeconds;
+      }
+      Json::Value& mergeJson = partitionJson["merge"];
+      mergeJson["converged"] = report.mergeResult.converged;
+      mergeJson["iterations"] = report.mergeResult.iterations;
+      mergeJson["numParameters"] = (Json::UInt64) report.mergeResult.numParameters;
+      mergeJson["numPoints"] = (Json::UInt64) report.mergeResult.numPoints;
+      mergeJson["finalRms"] = report.mergeResult.finalRms;
+      mergeJson["elapsedSeconds"] = report.mergeResult.elapsedSeconds;
+
+      // Merge quality against a single adjustment of the whole block:
+      if (report.compared)
+      {
+         Json::Value& compareJson = partitionJson["fullSolve"];
+         compareJson["converged"] = report.fullResult.converged;
+         compareJson["iterations"] = report.fullResult.iterations;
+         compareJson["finalRms"] = report.fullResult.finalRms;
+         compareJson["sigma0"] = report.fullResult.sigma0;
+         compareJson["elapsedSeconds"] = report.fullResult.elapsedSeconds;
+         compareJson["numPointsCompared"] = (Json::UInt64) report.numPointsCompared;
+         compareJson["pointRmsDifference"] = report.pointRmsDifference;
+         compareJson["maxPointDifference"] = report.maxPointDifference;
+      }
    }
+
+   Json::Value& imagesJson = m_nativeResult["images"];
+   for (unsigned int i=0; i<imageList.size(); ++i)
+   {
+      Json::Value& imageJson = imagesJson.append(Json::Value());
+      imageJson["imageId"] = imageList[i]->getImageId();
+      imageJson["rms"] = adjuster.getImageRms(i);
+      imageJson["numObservations"] = (Json::UInt64) adjuster.getNumImageObservations(i);
+   }
+
+   // Adjusted points, with covariance packed as { xx, xy, xz, yy, yz, zz }:
+   Json::Value& pointsJson = m_nativeResult["points"];
+   for (unsigned int p=0; p<adjuster.getNumPoints(); ++p)
+   {
+      if (!adjuster.isPointEstimated(p))
+         continue;
+      Json::Value& pointJson = pointsJson.append(Json::Value());
+      pointJson["pointId"] = adjuster.getPointId(p);
+      const double* position = adjuster.getPointPosition(p);
+      for (int c=0; c<3; ++c)
+         pointJson["ecf"].append(position[c]);
+      const double* cov = adjuster.getPointCovariance(p);
+      for (int r=0; r<3; ++r)
+      {
+         for (int c=r; c<3; ++c)
+            pointJson["covariance"].append(cov[3*r + c]);
+      }
+   }
+
+   // Keep the solution with the session, for warm-starting its next adjustment:
+   if (m_session)
+   {
+      shared_ptr<Session::Solution> newSolution (new Session::Solution);
+      for (unsigned int i=0; i<imageList.size(); ++i)
+      {
+         shared_ptr<csm::RasterGM> model = adjuster.getModel(i);
+         vector<double>& parameters = newSolution->parameters[imageList[i]->getImageId()];
+         parameters.resize(model->getNumParameters());
+         for (int k=0; k<model->getNumParameters(); ++k)
+            parameters[k] = model->getParameterValue(k);
+      }
+      for (unsigned int p=0; p<adjuster.getNumPoints(); ++p)
+      {
+         if (!adjuster.isPointEstimated(p))
+            continue;
+         const double* position = adjuster.getPointPosition(p);
+         newSolution->points[adjuster.getPointId(p)].assign(position, position + 3);
+      }
+      m_session->setSolution(newSolution);
+   }
+
+   if (updatePhotoBlock)
+   {
+      MSP::CsmSensorModelList csmModelList;
+      for (unsigned int i=0; i<imageList.size(); ++i)
+         csmModelList.push_back(adjuster.getModel(i).get());
+      m_photoBlock->setCsmModels(csmModelList);
+   }
+}
+
+void TriangulationService::screenMeasurements(const std::vector<std::string>& states)
+{
+   // Residuals at the intersected points, with the models held fixed:
+   const vector< shared_ptr<Image> >& imageList = m_photoBlock->getImageList();
+   vector< shared_ptr<csm::RasterGM> > models (states.size());
+   ThreadPool::instance()->parallelFor(states.size(), [&](size_t i)
+   {
+      models[i] = ModelStateCache::instance()->createModel(states[i]);
+   }, m_nativeOptions.adjustment.numThreads);
+   BundleAdjuster screen;
+   for (size_t i=0; i<models.size(); ++i)
+   {
+      if (!models[i])
+      {
+         ostringstream xmsg;
+         xmsg<<__FILE__<<": screenMeasurements() -- Sensor model could not be created for <"
+             <<imageList[i]->getImageId()<<">.";
+         throw ossimException(xmsg.str());
+      }
+      screen.addImage(models[i].get(), false);
+   }
+   vector<size_t> observations = addMeasurements(*m_photoBlock, screen);
+
+   BundleAdjuster::Options options (m_nativeOptions.adjustment);
+   options.maxIterations = 0;
+   options.computeCovariance = false;
+   options.rejectionThreshold = 0.0;
+   BundleAdjuster::Result result = screen.solve(options);
+
+   const MeasurementStore& measurements = m_photoBlock->getMeasurements();
+   m_rejectedMeasurements.assign(measurements.size(), false);
+   for (size_t a=0; a<observations.size(); ++a)
+   {
+      if (screen.getObservationStatus(a).rejection != BundleAdjuster::NOT_REJECTED)
+         m_rejectedMeasurements[observations[a]] = true;
+   }
+   m_prepassResult = Json::Value();
+   m_prepassResult["numRejected"] = (Json::UInt64) result.numRejected;
+   m_prepassResult["elapsedSeconds"] = result.elapsedSeconds;
+   saveRejections(*m_photoBlock, screen, observations, m_prepassResult["rejections"]);
 }
 
 void TriangulationService::fillGcpList(MSP::GroundPointList& mspGroundPts)
@@ -140,31 +800,67 @@ void TriangulationService::fillGcpList(MSP::GroundPointList& mspGroundPts)
    }
 }
 
+void TriangulationService::setGcpCrossCovariances(const MSP::GroundPointList& mspGroundPts,
+                                                  MSP::JointCovMatrix& jcm)
+{
+   // Only the non-zero blocks given are set, so this is proportional to their number:
+   const GcpCrossCovariance& crossCov = m_photoBlock->getGcpCrossCovariance();
+   if (crossCov.empty())
+      return;
+
+   const GcpList& gcpList = m_photoBlock->getGroundPointList();
+   unordered_map<string, size_t> gcpIndex;
+   for (size_t g=0; g<gcpList.size(); ++g)
+      gcpIndex.emplace(gcpList[g]->getId(), g);
+
+   MSP::Matrix block(3,3);
+   for (size_t i=0; i<crossCov.size(); ++i)
+   {
+      auto gcp1 = gcpIndex.find(crossCov.getGcpId1(i));
+      auto gcp2 = gcpIndex.find(crossCov.getGcpId2(i));
+      if ((gcp1 == gcpIndex.end()) || (gcp2 == gcpIndex.end()))
+      {
+         ossimNotify(ossimNotifyLevel_WARN)<<"TriangulationService::setGcpCrossCovariances() -- "
+            "Ignoring cross-covariance of unknown GCP pair <"<<crossCov.getGcpId1(i)<<">, <"
+            <<crossCov.getGcpId2(i)<<">."<<endl;
+         continue;
+      }
+      const double* values = crossCov.getBlock(i);
+      for (int r=0; r<3; ++r)
+      {
+         for (int c=0; c<3; ++c)
+            block.setElement(r, c, values[3*r + c]);
+      }
+      jcm.setCrossCovariance(mspGroundPts[gcp1->second], mspGroundPts[gcp2->second], block);
+   }
+}
+
 void TriangulationService::fillTpList(MSP::ImagePointList& mspImagePts)
 {
+   // Scan the photoblock's contiguous measurement store point by point:
+   const MeasurementStore& measurements = m_photoBlock->getMeasurements();
+   const vector< shared_ptr<Image> >& imageList = m_photoBlock->getImageList();
+   vector<string> imageIds (imageList.size());
+   for (size_t i=0; i<imageList.size(); ++i)
+      imageIds[i] = imageList[i]->getImageId();
+
    MSP::Matrix mspCov(2,2);
-   NEWMAT::SymmetricMatrix ossimCov;
    mspCov.zero(); // off-diagonals zeroed
-   string imageId;
-   string pointId;
-   unsigned int imgCount=0;
-   ossimDpt imagePt;
-   const std::vector<std::shared_ptr<TiePoint> >&  tiePoints =
-         m_photoBlock->getTiePointList();
-   for (int t=0; t<tiePoints.size(); ++t)
-   {
-      // Fetch the photoblock's entry for this tiepoint:
-      pointId = tiePoints[t]->getGcpId();
-      if (pointId.empty())
-         pointId = tiePoints[t]->getTiePointId();
-      imgCount = tiePoints[t]->getImageCount();
-      for (int i=0; i<imgCount; ++i)
-      {
-         tiePoints[t]->getImagePoint(i, imageId, imagePt, ossimCov);
-         mspCov.setElement(0, 0, ossimCov(2,2)); // flip for x,y versus line sample
-         mspCov.setElement(1, 1, ossimCov(1,1));
-         MSP::ImagePoint mspImagePoint(imagePt.line, imagePt.samp, imageId, pointId, mspCov);
-         //clog<<"mspImagePoint:\n"<<mspImagePoint.toString()<<endl;//###
+   mspImagePts.reserve(mspImagePts.size() + measurements.size());
+   size_t count = 0;
+   for (unsigned int p=0; p<measurements.getNumPoints(); ++p)
+   {
+      const string& pointId = measurements.getPointId(p);
+      const size_t* m = measurements.getPointMeasurements(p, count);
+      for (size_t k=0; k<count; ++k)
+      {
+         if (!m_rejectedMeasurements.empty() && m_rejectedMeasurements[m[k]])
+            continue;
+         const double* cov = measurements.getCovariance(m[k]);
+         mspCov.setElement(0, 0, cov[0]);
+         mspCov.setElement(1, 1, cov[2]);
+         MSP::ImagePoint mspImagePoint(measurements.getLine(m[k]), measurements.getSample(m[k]),
+                                       imageIds[measurements.getImage(m[k])], pointId, mspCov);
          mspImagePts.push_back( mspImagePoint );
       }
    }
@@ -10,9 +10,12 @@
 #include <geometry/ImagePoint.h>
 #include <geometry/GroundPoint.h>
 #include <services/ServiceBase.h>
+#include <common/PartitionedAdjuster.h>
 #include <common/MspPhotoBlock.h>
+#include <common/Session.h>
 #include <PointExtraction/TriangulationResult.h>
 #include <memory>
+#include <mutex>
 
 namespace ossimMsp
 {
@@ -46,11 +49,70 @@ public:
    virtual void execute();
 
 private:
+   enum Backend
+   {
+      MSP_BACKEND,
+      NATIVE_BACKEND,
+      BOTH_BACKENDS
+   };
+
+   /**
+    * Returns true if execution should stop, cancelled or out of time, recording why. MSP's
+    * triangulation cannot be interrupted, so this is checked between the steps of execute().
+    */
+   bool checkInterruption();
+
+   /**
+    * Triangulates with MSP, with models made from the states (in photoblock image order) if any,
+    * otherwise copies of the photoblock's. The adjusted models replace the photoblock's.
+    */
+   void runMspTriangulation(const std::vector<std::string>& states);
+
+   /**
+    * Records the image models' a priori states, from which the native adjuster's are made. Within
+    * a session, these are the states the images had when first adjusted in it, kept with the
+    * session since adjustments replace the photoblock's models.
+    */
+   void captureModelStates(std::vector<std::string>& states);
+
+   /**
+    * Adjusts models made from the states (in photoblock image order) with the native adjuster,
+    * partitioned if so requested, and records the results for the response. The adjusted models
+    * replace the photoblock's if updatePhotoBlock.
+    */
+   void runNativeAdjustment(const std::vector<std::string>& states, bool updatePhotoBlock);
+
+   /**
+    * Residual pre-pass for MSP: rejects blunders among the measurements, judged at the intersected
+    * points with the models (made from the states) held fixed, so they are left out of the image
+    * points given to MSP.
+    */
+   void screenMeasurements(const std::vector<std::string>& states);
+
    void fillGcpList(MSP::GroundPointList& mspGroundPts);
+
+   /** Sets the photoblock's GCP cross-covariance blocks in the joint covariance. */
+   void setGcpCrossCovariances(const MSP::GroundPointList& mspGroundPts,
+                               MSP::JointCovMatrix& jcm);
    void fillTpList(MSP::ImagePointList& mspImagePts);
 
+   std::shared_ptr<Session> m_session;
+   std::unique_lock<std::mutex> m_sessionLock; // held for the whole request
    std::shared_ptr<MspPhotoBlock> m_photoBlock;
    std::shared_ptr<MSP::PES::TriangulationResult> m_triangulationResult;
+   std::string m_snapshotFile;
+   std::string m_sessionId;
+   bool m_returnPhotoblock;
+   Backend m_backend;
+   bool m_warmStart;
+   PartitionedAdjuster::Options m_nativeOptions;
+   Json::Value m_nativeResult;
+   Json::Value m_prepassResult;
+   std::vector<bool> m_rejectedMeasurements;  // by measurement store index
+   double m_mspSeconds;
+   ExecutionControl::Interruption m_interruption;
+   bool m_adjusted;
+   double m_requestTimeBudget; // seconds, or negative if the request gives none
 
 };
 
@@ -0,0 +1,748 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#include <common/BundleAdjuster.h>
+#include <common/PartitionedAdjuster.h>
+#include <common/MspImage.h>
+#include <common/MspPhotoBlock.h>
+#include <common/SessionManager.h>
+#include <services/TriangulationService.h>
+#include <csm/CorrelationModel.h>
+#include <csm/RasterGM.h>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <ossim/base/ossimException.h>
+
+using namespace std;
+using namespace ossimMsp;
+
+/***************************************************************************************************
+Tests of the native bundle adjuster on a synthetic block of frame cameras with known truth:
+convergence, agreement of the Cholesky and PCG solvers on the same block, no outlier rejections
+from a block without blunders, and agreement of a partitioned adjustment with the full solve.
+
+Given a triangulation request JSON file (with a "photoblock" node), the native adjustment is also
+compared with MSP's on the real block, by running the "both" backend and projecting the native
+points with both sets of adjusted models. The optional second argument is the RMS image difference
+allowed in pixels (default 1).
+***************************************************************************************************/
+
+/**
+ * Minimal frame camera in a local Cartesian frame, looking down the -Z axis: parameters 0-2 are
+ * the perspective center (meters), 3-5 the rotation angles (radians) about X, Y and Z, and 6 the
+ * fixed focal length (pixels). Heights are Z.
+ */
+class FrameCamera : public csm::RasterGM
+{
+public:
+   static const int NUM_PARAMETERS = 7;
+   static const int IMAGE_SIZE = 1000;
+
+   FrameCamera()
+   {
+      for (int i=0; i<NUM_PARAMETERS; ++i)
+      {
+         m_values[i] = 0.0;
+         for (int j=0; j<NUM_PARAMETERS; ++j)
+            m_covariance[i][j] = 0.0;
+      }
+   }
+
+   // Model:
+   virtual csm::Version getVersion() const { return csm::Version(1, 0, 0); }
+   virtual std::string getModelName() const { return "FrameCamera"; }
+   virtual std::string getPedigree() const { return "FrameCamera"; }
+   virtual std::string getImageIdentifier() const { return m_imageId; }
+   virtual void setImageIdentifier(const std::string& imageId, csm::WarningList* =NULL)
+   { m_imageId = imageId; }
+   virtual std::string getSensorIdentifier() const { return "synthetic"; }
+   virtual std::string getPlatformIdentifier() const { return "synthetic"; }
+   virtual std::string getCollectionIdentifier() const { return ""; }
+   virtual std::string getTrajectoryIdentifier() const { return ""; }
+   virtual std::string getSensorType() const { return "EO"; }
+   virtual std::string getSensorMode() const { return "FRAME"; }
+   virtual std::string getReferenceDateAndTime() const { return ""; }
+
+   virtual std::string getModelState() const
+   {
+      ostringstream state;
+      state.precision(17);
+      state<<getModelName()<<" "<<m_imageId;
+      for (int i=0; i<NUM_PARAMETERS; ++i)
+         state<<" "<<m_values[i];
+      return state.str();
+   }
+
+   virtual void replaceModelState(const std::string& argState)
+   {
+      string name;
+      istringstream state (argState);
+      state>>name>>m_imageId;
+      for (int i=0; i<NUM_PARAMETERS; ++i)
+         state>>m_values[i];
+   }
+
+   // GeometricModel:
+   virtual csm::EcefCoord getReferencePoint() const
+   { return csm::EcefCoord(m_values[0], m_values[1], 0.0); }
+   virtual void setReferencePoint(const csm::EcefCoord&) { }
+   virtual int getNumParameters() const { return NUM_PARAMETERS; }
+   virtual std::string getParameterName(int index) const
+   {
+      static const char* NAMES[NUM_PARAMETERS] = { "X", "Y", "Z", "omega", "phi", "kappa", "f" };
+      return NAMES[index];
+   }
+   virtual std::string getParameterUnits(int index) const
+   { return (index < 3) ? "m" : ((index < 6) ? "rad" : "pixel"); }
+   virtual bool hasShareableParameters() const { return false; }
+   virtual bool isParameterShareable(int) const { return false; }
+   virtual csm::SharingCriteria getParameterSharingCriteria(int) const
+   { return csm::SharingCriteria(); }
+   virtual double getParameterValue(int index) const { return m_values[index]; }
+   virtual void setParameterValue(int index, double value) { m_values[index] = value; }
+   virtual csm::param::Type getParameterType(int index) const
+   { return (index < 6) ? csm::param::REAL : csm::param::FIXED; }
+   virtual void setParameterType(int, csm::param::Type) { }
+   virtual double getParameterCovariance(int index1, int index2) const
+   { return m_covariance[index1][index2]; }
+   virtual void setParameterCovariance(int index1, int index2, double covariance)
+   { m_covariance[index1][index2] = covariance; }
+   virtual int getNumGeometricCorrectionSwitches() const { return 0; }
+   virtual std::string getGeometricCorrectionName(int) const { return ""; }
+   virtual void setGeometricCorrectionSwitch(int, bool, csm::param::Type) { }
+   virtual bool getGeometricCorrectionSwitch(int) const { return false; }
+   virtual std::vector<double> getCrossCovarianceMatrix(const csm::GeometricModel&,
+         csm::param::Set pSet=csm::param::VALID,
+         const GeometricModelList& =GeometricModelList()) const
+   {
+      size_t n = (pSet == csm::param::NON_ADJUSTABLE) ? 1 : 6;
+      return vector<double>(n*n, 0.0);
+   }
+
+   // RasterGM:
+   virtual csm::ImageCoord groundToImage(const csm::EcefCoord& groundPt,
+                                         double=0.001, double* achieved=NULL,
+                                         csm::WarningList* =NULL) const
+   {
+      double r[9];
+      rotation(r);
+      double d[3] = { groundPt.x - m_values[0], groundPt.y - m_values[1],
+                      groundPt.z - m_values[2] };
+      double c[3];
+      for (int i=0; i<3; ++i)
+         c[i] = r[3*i]*d[0] + r[3*i+1]*d[1] + r[3*i+2]*d[2];
+      if (achieved)
+         *achieved = 0.0;
+      return csm::ImageCoord(IMAGE_SIZE/2 + m_values[6]*c[1]/(-c[2]),
+                             IMAGE_SIZE/2 + m_values[6]*c[0]/(-c[2]));
+   }
+
+   virtual csm::ImageCoordCovar groundToImage(const csm::EcefCoordCovar& groundPt,
+                                              double desiredPrecision=0.001,
+                                              double* achieved=NULL,
+                                              csm::WarningList* warnings=NULL) const
+   {
+      csm::ImageCoord imagePt = groundToImage((const csm::EcefCoord&) groundPt,
+                                              desiredPrecision, achieved, warnings);
+      return csm::ImageCoordCovar(imagePt.line, imagePt.samp, 0.0, 0.0, 0.0);
+   }
+
+   virtual csm::EcefCoord imageToGround(const csm::ImageCoord& imagePt, double height,
+                                        double=0.001, double* achieved=NULL,
+                                        csm::WarningList* =NULL) const
+   {
+      double d[3];
+      rayDirection(imagePt, d);
+      double t = (height - m_values[2])/d[2];
+      if (achieved)
+         *achieved = 0.0;
+      return csm::EcefCoord(m_values[0] + t*d[0], m_values[1] + t*d[1], height);
+   }
+
+   virtual csm::EcefCoordCovar imageToGround(const csm::ImageCoordCovar& imagePt, double height,
+                                             double, double desiredPrecision=0.001,
+                                             double* achieved=NULL,
+                                             csm::WarningList* warnings=NULL) const
+   {
+      csm::EcefCoord groundPt = imageToGround((const csm::ImageCoord&) imagePt, height,
+                                              desiredPrecision, achieved, warnings);
+      return csm::EcefCoordCovar(groundPt.x, groundPt.y, groundPt.z);
+   }
+
+   virtual csm::EcefLocus imageToProximateImagingLocus(const csm::ImageCoord& imagePt,
+                                                       const csm::EcefCoord&,
+                                                       double desiredPrecision=0.001,
+                                                       double* achieved=NULL,
+                                                       csm::WarningList* warnings=NULL) const
+   {
+      return imageToRemoteImagingLocus(imagePt, desiredPrecision, achieved, warnings);
+   }
+
+   virtual csm::EcefLocus imageToRemoteImagingLocus(const csm::ImageCoord& imagePt,
+                                                    double=0.001, double* achieved=NULL,
+                                                    csm::WarningList* =NULL) const
+   {
+      double d[3];
+      rayDirection(imagePt, d);
+      if (achieved)
+         *achieved = 0.0;
+      return csm::EcefLocus(csm::EcefCoord(m_values[0], m_values[1], m_values[2]),
+                            csm::EcefVector(d[0], d[1], d[2]));
+   }
+
+   virtual csm::ImageCoord getImageStart() const { return csm::ImageCoord(0.0, 0.0); }
+   virtual csm::ImageVector getImageSize() const
+   { return csm::ImageVector(IMAGE_SIZE, IMAGE_SIZE); }
+   virtual std::pair<csm::ImageCoord, csm::ImageCoord> getValidImageRange() const
+   { return make_pair(getImageStart(), csm::ImageCoord(IMAGE_SIZE, IMAGE_SIZE)); }
+   virtual std::pair<double, double> getValidHeightRange() const
+   { return make_pair(-1000.0, 1000.0); }
+   virtual csm::EcefVector getIlluminationDirection(const csm::EcefCoord&) const
+   { return csm::EcefVector(0.0, 0.0, -1.0); }
+   virtual double getImageTime(const csm::ImageCoord&) const { return 0.0; }
+   virtual csm::EcefCoord getSensorPosition(const csm::ImageCoord&) const
+   { return csm::EcefCoord(m_values[0], m_values[1], m_values[2]); }
+   virtual csm::EcefCoord getSensorPosition(double) const
+   { return csm::EcefCoord(m_values[0], m_values[1], m_values[2]); }
+   virtual csm::EcefVector getSensorVelocity(const csm::ImageCoord&) const
+   { return csm::EcefVector(); }
+   virtual csm::EcefVector getSensorVelocity(double) const { return csm::EcefVector(); }
+
+   virtual SensorPartials computeSensorPartials(int index, const csm::EcefCoord& groundPt,
+                                                double=0.001, double* achieved=NULL,
+                                                csm::WarningList* =NULL) const
+   {
+      // Central differences:
+      FrameCamera camera (*this);
+      double h = 1.0e-6*(fabs(m_values[index]) + 1.0);
+      camera.m_values[index] = m_values[index] + h;
+      csm::ImageCoord plus = camera.groundToImage(groundPt);
+      camera.m_values[index] = m_values[index] - h;
+      csm::ImageCoord minus = camera.groundToImage(groundPt);
+      if (achieved)
+         *achieved = 0.0;
+      return SensorPartials((plus.line - minus.line)/(2*h), (plus.samp - minus.samp)/(2*h));
+   }
+
+   virtual SensorPartials computeSensorPartials(int index, const csm::ImageCoord&,
+                                                const csm::EcefCoord& groundPt,
+                                                double desiredPrecision=0.001,
+                                                double* achieved=NULL,
+                                                csm::WarningList* warnings=NULL) const
+   {
+      return computeSensorPartials(index, groundPt, desiredPrecision, achieved, warnings);
+   }
+
+   virtual std::vector<double> computeGroundPartials(const csm::EcefCoord& groundPt) const
+   {
+      // Line partials in X, Y, Z, then sample partials:
+      vector<double> partials (6);
+      const double h = 1.0e-3;
+      for (int k=0; k<3; ++k)
+      {
+         csm::EcefCoord plus (groundPt);
+         csm::EcefCoord minus (groundPt);
+         (&plus.x)[k] += h;
+         (&minus.x)[k] -= h;
+         csm::ImageCoord a = groundToImage(plus);
+         csm::ImageCoord b = groundToImage(minus);
+         partials[k] = (a.line - b.line)/(2*h);
+         partials[3+k] = (a.samp - b.samp)/(2*h);
+      }
+      return partials;
+   }
+
+   virtual const csm::CorrelationModel& getCorrelationModel() const
+   {
+      static const csm::NoCorrelationModel NO_CORRELATION;
+      return NO_CORRELATION;
+   }
+
+   virtual std::vector<double> getUnmodeledCrossCovariance(const csm::ImageCoord&,
+                                                           const csm::ImageCoord&) const
+   {
+      return vector<double>(4, 0.0);
+   }
+
+private:
+   /** Rotation from the local frame to the camera frame, row-major. */
+   void rotation(double* r) const
+   {
+      double ca = cos(m_values[3]), sa = sin(m_values[3]);
+      double cb = cos(m_values[4]), sb = sin(m_values[4]);
+      double cc = cos(m_values[5]), sc = sin(m_values[5]);
+      double rx[9] = { 1, 0, 0,  0, ca, -sa,  0, sa, ca };
+      double ry[9] = { cb, 0, sb,  0, 1, 0,  -sb, 0, cb };
+      double rz[9] = { cc, -sc, 0,  sc, cc, 0,  0, 0, 1 };
+      double t[9];
+      multiply(rz, ry, t);
+      multiply(t, rx, r);
+   }
+
+   static void multiply(const double* a, const double* b, double* c)
+   {
+      for (int i=0; i<3; ++i)
+      {
+         for (int j=0; j<3; ++j)
+            c[3*i+j] = a[3*i]*b[j] + a[3*i+1]*b[3+j] + a[3*i+2]*b[6+j];
+      }
+   }
+
+   /** Direction of the image point's ray in the local frame. */
+   void rayDirection(const csm::ImageCoord& imagePt, double* d) const
+   {
+      double r[9];
+      rotation(r);
+      double c[3] = { (imagePt.samp - IMAGE_SIZE/2)/m_values[6],
+                      (imagePt.line - IMAGE_SIZE/2)/m_values[6], -1.0 };
+      for (int i=0; i<3; ++i)
+         d[i] = r[i]*c[0] + r[3+i]*c[1] + r[6+i]*c[2];
+   }
+
+   std::string m_imageId;
+   double m_values[NUM_PARAMETERS];
+   double m_covariance[NUM_PARAMETERS][NUM_PARAMETERS];
+};
+
+/**
+ * A 4 x 3 grid of cameras at 1000 m with about 1 m pixels, perturbed from the truth by their a
+ * priori sigmas (5 m, 5 mrad), imaging 300 points including 30 ground control points, with 0.5
+ * pixel measurement noise. Seeded, so every test sees the same block.
+ */
+struct SyntheticBlock
+{
+   struct Observation
+   {
+      unsigned int point;
+      unsigned int image;
+      double line;
+      double sample;
+   };
+
+   SyntheticBlock()
+   {
+      const int NUM_CAMERAS = 12;
+      const int NUM_POINTS = 300;
+      const double SIGMAS[6] = { 5.0, 5.0, 5.0, 0.005, 0.005, 0.005 };
+      mt19937 rng (1);
+      normal_distribution<double> noise (0.0, 1.0);
+      uniform_real_distribution<double> uniform (0.0, 1.0);
+
+      truth.resize(NUM_CAMERAS);
+      cameras.resize(NUM_CAMERAS);
+      for (int c=0; c<NUM_CAMERAS; ++c)
+      {
+         truth[c].setParameterValue(0, (c % 4)*300.0);
+         truth[c].setParameterValue(1, (c / 4)*300.0);
+         truth[c].setParameterValue(2, 1000.0);
+         truth[c].setParameterValue(6, 1000.0);
+         cameras[c] = truth[c];
+         for (int i=0; i<6; ++i)
+         {
+            cameras[c].setParameterValue(i, truth[c].getParameterValue(i) + SIGMAS[i]*noise(rng));
+            cameras[c].setParameterCovariance(i, i, SIGMAS[i]*SIGMAS[i]);
+         }
+      }
+
+      points.resize(3*NUM_POINTS);
+      for (int p=0; p<NUM_POINTS; ++p)
+      {
+         points[3*p] = -200.0 + 1300.0*uniform(rng);
+         points[3*p+1] = -200.0 + 1000.0*uniform(rng);
+         points[3*p+2] = 20.0*noise(rng);
+         csm::EcefCoord groundPt (points[3*p], points[3*p+1], points[3*p+2]);
+         for (int c=0; c<NUM_CAMERAS; ++c)
+         {
+            csm::ImageCoord imagePt = truth[c].groundToImage(groundPt);
+            if ((imagePt.line < 0.0) || (imagePt.line > FrameCamera::IMAGE_SIZE) ||
+                (imagePt.samp < 0.0) || (imagePt.samp > FrameCamera::IMAGE_SIZE))
+               continue;
+            Observation obs = { (unsigned int) p, (unsigned int) c,
+                                imagePt.line + 0.5*noise(rng), imagePt.samp + 0.5*noise(rng) };
+            observations.push_back(obs);
+         }
+      }
+   }
+
+   static bool isControl(unsigned int point) { return (point % 10) == 0; }
+
+   /**
+    * Loads the points and observations into the adjuster, whose images must be the cameras. The
+    * measurements are given the a priori sigma in pixels (by default the noise level).
+    */
+   template <class Adjuster>
+   void addTo(Adjuster& adjuster, double measurementSigma=0.5) const
+   {
+      const double GCP_COVARIANCE[9] = { 0.01, 0, 0,  0, 0.01, 0,  0, 0, 0.01 };
+      const double MEASUREMENT_COVARIANCE[3] = { measurementSigma*measurementSigma, 0.0,
+                                                 measurementSigma*measurementSigma };
+      for (unsigned int p=0; p<points.size()/3; ++p)
+      {
+         ostringstream pointId;
+         pointId<<"P"<<p;
+         if (isControl(p))
+            adjuster.addControlPoint(pointId.str(), &points[3*p], GCP_COVARIANCE);
+         else
+            adjuster.addPoint(pointId.str());
+      }
+      for (const Observation& obs : observations)
+      {
+         adjuster.addObservation(obs.point, obs.image, obs.line, obs.sample,
+                                 MEASUREMENT_COVARIANCE);
+      }
+   }
+
+   /** RMS distance (meters) of the estimated points from the truth. */
+   template <class Adjuster>
+   double pointRmsError(const Adjuster& adjuster) const
+   {
+      double sum = 0.0;
+      size_t count = 0;
+      for (unsigned int p=0; p<adjuster.getNumPoints(); ++p)
+      {
+         if (!adjuster.isPointEstimated(p))
+            continue;
+         const double* position = adjuster.getPointPosition(p);
+         for (int c=0; c<3; ++c)
+            sum += pow(position[c] - points[3*p + c], 2);
+         ++count;
+      }
+      return count ? sqrt(sum/count) : 0.0;
+   }
+
+   vector<FrameCamera> truth;
+   vector<FrameCamera> cameras;    // a priori
+   vector<double> points;          // truth, x y z per point
+   vector<Observation> observations;
+};
+
+/** Adjusts a fresh copy of the block's cameras, leaving the adjusted models in cameras. */
+static BundleAdjuster::Result adjust(const SyntheticBlock& block,
+                                     const BundleAdjuster::Options& options,
+                                     BundleAdjuster& adjuster, vector<FrameCamera>& cameras,
+                                     double measurementSigma=0.5)
+{
+   cameras = block.cameras;
+   for (size_t c=0; c<cameras.size(); ++c)
+      adjuster.addImage(&cameras[c]);
+   block.addTo(adjuster, measurementSigma);
+   return adjuster.solve(options);
+}
+
+static bool report(const string& testName, bool passed)
+{
+   clog<<testName<<": "<<(passed ? "PASSED" : "FAILED")<<endl;
+   return passed;
+}
+
+/** The adjustment converges to residuals at the noise level and points near the truth. */
+static bool testConvergence(const SyntheticBlock& block)
+{
+   BundleAdjuster adjuster;
+   vector<FrameCamera> cameras;
+   BundleAdjuster::Options options;
+   BundleAdjuster::Result result = adjust(block, options, adjuster, cameras);
+   double pointError = block.pointRmsError(adjuster);
+   clog<<"Convergence: "<<result.solver<<", "<<result.iterations<<" iterations, RMS "
+       <<result.initialRms<<" -> "<<result.finalRms<<" pixels, sigma0 "<<result.sigma0
+       <<", point RMS error "<<pointError<<" m ("<<result.message<<")"<<endl;
+   return report("Convergence", result.converged && (result.finalRms < 0.75) &&
+                 (result.initialRms > 2.0*result.finalRms) && (pointError < 2.0) &&
+                 (result.numPoints == block.points.size()/3));
+}
+
+/** The Cholesky and PCG solvers reach the same solution. */
+static bool testSolverAgreement(const SyntheticBlock& block)
+{
+   BundleAdjuster dense;
+   vector<FrameCamera> denseCameras;
+   BundleAdjuster::Options options;
+   BundleAdjuster::Result denseResult = adjust(block, options, dense, denseCameras);
+
+   BundleAdjuster sparse;
+   vector<FrameCamera> sparseCameras;
+   options.maxDenseParameters = 0;
+   BundleAdjuster::Result sparseResult = adjust(block, options, sparse, sparseCameras);
+
+   double maxPointDifference = 0.0;
+   for (unsigned int p=0; p<dense.getNumPoints(); ++p)
+   {
+      const double* a = dense.getPointPosition(p);
+      const double* b = sparse.getPointPosition(p);
+      maxPointDifference = max(maxPointDifference,
+            sqrt(pow(a[0] - b[0], 2) + pow(a[1] - b[1], 2) + pow(a[2] - b[2], 2)));
+   }
+   double maxPositionDifference = 0.0;
+   for (size_t c=0; c<denseCameras.size(); ++c)
+   {
+      for (int i=0; i<3; ++i)
+      {
+         maxPositionDifference = max(maxPositionDifference,
+               fabs(denseCameras[c].getParameterValue(i) - sparseCameras[c].getParameterValue(i)));
+      }
+   }
+   clog<<"Solver agreement: "<<denseResult.solver<<" RMS "<<denseResult.finalRms<<", "
+       <<sparseResult.solver<<" RMS "<<sparseResult.finalRms<<" ("<<sparseResult.cgIterations
+       <<" CG iterations), max point difference "<<maxPointDifference
+       <<" m, max camera position difference "<<maxPositionDifference<<" m"<<endl;
+   return report("Solver agreement", (denseResult.solver == "cholesky") &&
+                 (sparseResult.solver == "pcg") && denseResult.converged &&
+                 sparseResult.converged && (maxPointDifference < 0.01) &&
+                 (maxPositionDifference < 0.01));
+}
+
+/**
+ * Outlier rejection leaves a block without blunders intact, including when the a priori sigmas
+ * overstate the measurement noise, which shrinks the normalized residuals and with them their
+ * median-based scale.
+ */
+static bool testCleanBlockRejection(const SyntheticBlock& block)
+{
+   bool passed = true;
+   const double SIGMAS[2] = { 0.5, 2.0 };
+   for (double sigma : SIGMAS)
+   {
+      BundleAdjuster adjuster;
+      vector<FrameCamera> cameras;
+      BundleAdjuster::Options options;
+      options.prepassThreshold = 4.0;
+      options.rejectionThreshold = 4.0;
+      BundleAdjuster::Result result = adjust(block, options, adjuster, cameras, sigma);
+      clog<<"Clean block rejection with "<<sigma<<" pixel a priori sigmas: "
+          <<result.numRejected<<" rejected, "<<result.iterations<<" iterations, RMS "
+          <<result.finalRms<<" pixels ("<<result.message<<")"<<endl;
+      passed = passed && result.converged && (result.numRejected == 0);
+   }
+   return report("Clean block rejection", passed);
+}
+
+/** The merged solution of a partitioned adjustment is within 0.25 m of the full solve. */
+static bool testPartitioned(const SyntheticBlock& block)
+{
+   PartitionedAdjuster adjuster ((unsigned int) block.cameras.size(), [&](unsigned int image)
+   {
+      return shared_ptr<csm::RasterGM>(new FrameCamera(block.cameras[image]));
+   });
+   block.addTo(adjuster);
+   PartitionedAdjuster::Options options;
+   options.maxImagesPerPartition = 4;
+   options.compareFullSolve = true;
+   PartitionedAdjuster::Report summary = adjuster.solve(options);
+   clog<<"Partitioned: "<<summary.numPartitions<<" partitions, "<<summary.numSharedImages
+       <<" shared images, "<<summary.numSharedPoints<<" shared points, merge RMS "
+       <<summary.mergeResult.finalRms<<", full RMS "<<summary.fullResult.finalRms
+       <<", point RMS difference "<<summary.pointRmsDifference<<" m (max "
+       <<summary.maxPointDifference<<" m over "<<summary.numPointsCompared<<")"<<endl;
+   return report("Partitioned versus full", (summary.numPartitions > 1) && summary.compared &&
+                 summary.overall.converged && (summary.numPointsCompared > 0) &&
+                 (summary.pointRmsDifference <= 0.25));
+}
+
+static Json::Value loadRequest(const string& requestFile)
+{
+   Json::Value request;
+   ifstream jsonFile (requestFile);
+   if (jsonFile.fail())
+   {
+      ostringstream xmsg;
+      xmsg<<"Error opening JSON input file <"<<requestFile<<">.";
+      throw ossimException(xmsg.str());
+   }
+   jsonFile>>request;
+   return request;
+}
+
+/**
+ * Runs the request with the "both" backend and compares the native adjustment with MSP's: the
+ * native points are projected with MSP's adjusted models and with the native ones (MSP's with
+ * the native parameter values), and the RMS image difference must be within the tolerance.
+ */
+static bool testNativeVersusMsp(const string& requestFile, double tolerance)
+{
+   Json::Value request = loadRequest(requestFile);
+   request["backend"] = "both";
+   request["returnPhotoblock"] = false;
+   request.removeMember("sessionId");
+   request["startSession"] = true;
+
+   TriangulationService triangulation;
+   triangulation.loadJSON(request);
+   triangulation.execute();
+   Json::Value response;
+   triangulation.saveJSON(response);
+
+   shared_ptr<Session> session = SessionManager::getSession(response["sessionId"].asString());
+   shared_ptr<const Session::Solution> solution = session ? session->getSolution() : 0;
+   const Json::Value& nativePoints = response["nativeResult"]["points"];
+   if (!response.isMember("triangulationResult") || !solution || nativePoints.empty())
+   {
+      clog<<"Native versus MSP: no result from "<<(solution ? "MSP" : "the native adjuster")
+          <<endl;
+      return report("Native versus MSP", false);
+   }
+
+   double sum = 0.0;
+   size_t count = 0;
+   vector< shared_ptr<ossim::Image> >& images = session->getPhotoBlock()->getImageList();
+   for (size_t i=0; i<images.size(); ++i)
+   {
+      shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(images[i]);
+      auto parameters = solution->parameters.find(images[i]->getImageId());
+      if (!image || (parameters == solution->parameters.end()))
+         continue;
+      shared_ptr<csm::RasterGM> msp = image->cloneCsmSensorModel();
+      shared_ptr<csm::RasterGM> native = image->cloneCsmSensorModel();
+      for (size_t k=0; k<parameters->second.size(); ++k)
+         native->setParameterValue((int) k, parameters->second[k]);
+
+      csm::ImageVector size = msp->getImageSize();
+      for (unsigned int p=0; p<nativePoints.size(); ++p)
+      {
+         const Json::Value& ecf = nativePoints[p]["ecf"];
+         csm::EcefCoord groundPt (ecf[0].asDouble(), ecf[1].asDouble(), ecf[2].asDouble());
+         csm::ImageCoord a = msp->groundToImage(groundPt);
+         if ((a.line < 0.0) || (a.line > size.line) || (a.samp < 0.0) || (a.samp > size.samp))
+            continue;
+         csm::ImageCoord b = native->groundToImage(groundPt);
+         sum += pow(a.line - b.line, 2) + pow(a.samp - b.samp, 2);
+         ++count;
+      }
+   }
+   double rms = count ? sqrt(sum/count) : 0.0;
+   clog<<"Native versus MSP: RMS image difference "<<rms<<" pixels over "<<count
+       <<" projections"<<endl;
+   return report("Native versus MSP", (count > 0) && (rms <= tolerance));
+}
+
+/** Copies of the photoblock's image models, in image order. */
+static vector< shared_ptr<csm::RasterGM> > copyModels(MspPhotoBlock& photoBlock)
+{
+   vector< shared_ptr<csm::RasterGM> > models;
+   vector< shared_ptr<ossim::Image> >& images = photoBlock.getImageList();
+   for (size_t i=0; i<images.size(); ++i)
+   {
+      shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(images[i]);
+      models.push_back(image ? image->cloneCsmSensorModel() : shared_ptr<csm::RasterGM>());
+   }
+   return models;
+}
+
+/**
+ * Adjusts the request's photoblock with the native backend in a new session, then again in the
+ * session, warm-started from the first solution. Both adjustments have the a priori models as
+ * their prior, so the adjusted parameters and their covariances must agree to within 1% of the
+ * parameter sigmas.
+ */
+static bool testWarmStart(const string& requestFile)
+{
+   Json::Value request = loadRequest(requestFile);
+   request["backend"] = "native";
+   request["returnPhotoblock"] = false;
+   request["nativeOptions"]["computeCovariance"] = true;
+   request.removeMember("sessionId");
+   request["startSession"] = true;
+
+   // Each service holds the session until destroyed:
+   shared_ptr<Session> session;
+   {
+      TriangulationService cold;
+      cold.loadJSON(request);
+      cold.execute();
+      Json::Value response;
+      cold.saveJSON(response);
+      session = SessionManager::getSession(response["sessionId"].asString());
+   }
+   if (!session)
+   {
+      clog<<"Warm start: the cold run started no session."<<endl;
+      return report("Warm start", false);
+   }
+   vector< shared_ptr<csm::RasterGM> > coldModels = copyModels(*session->getPhotoBlock());
+
+   Json::Value rerun;
+   rerun["sessionId"] = session->getSessionId();
+   rerun["backend"] = "native";
+   rerun["returnPhotoblock"] = false;
+   rerun["warmStart"] = true;
+   rerun["nativeOptions"] = request["nativeOptions"];
+   rerun["robust"] = request["robust"];
+   Json::Value response;
+   {
+      TriangulationService warm;
+      warm.loadJSON(rerun);
+      warm.execute();
+      warm.saveJSON(response);
+   }
+   vector< shared_ptr<csm::RasterGM> > warmModels = copyModels(*session->getPhotoBlock());
+
+   // Differences relative to the cold run's sigmas:
+   double maxParameterDifference = 0.0;
+   double maxCovarianceDifference = 0.0;
+   size_t numCompared = 0;
+   for (size_t i=0; (i<coldModels.size()) && (i<warmModels.size()); ++i)
+   {
+      const shared_ptr<csm::RasterGM>& a = coldModels[i];
+      const shared_ptr<csm::RasterGM>& b = warmModels[i];
+      if (!a || !b || (a->getNumParameters() != b->getNumParameters()))
+         continue;
+      for (int k=0; k<a->getNumParameters(); ++k)
+      {
+         double sigmaK = sqrt(a->getParameterCovariance(k, k));
+         if (sigmaK <= 0.0)
+            continue;
+         maxParameterDifference = max(maxParameterDifference,
+               fabs(b->getParameterValue(k) - a->getParameterValue(k))/sigmaK);
+         for (int l=0; l<a->getNumParameters(); ++l)
+         {
+            double sigmaL = sqrt(a->getParameterCovariance(l, l));
+            if (sigmaL <= 0.0)
+               continue;
+            maxCovarianceDifference = max(maxCovarianceDifference,
+                  fabs(b->getParameterCovariance(k, l) - a->getParameterCovariance(k, l))/
+                  (sigmaK*sigmaL));
+         }
+      }
+      ++numCompared;
+   }
+   unsigned int numSeeded = response["nativeResult"]["warmStart"]["numImagesSeeded"].asUInt();
+   clog<<"Warm start: "<<numSeeded<<" images seeded, "<<numCompared<<" compared, max parameter "
+       <<"difference "<<maxParameterDifference<<" sigma, max covariance difference "
+       <<maxCovarianceDifference<<" (relative)"<<endl;
+   return report("Warm start", (numSeeded > 0) && (numCompared > 0) &&
+                 (maxParameterDifference <= 0.01) && (maxCovarianceDifference <= 0.01));
+}
+
+int main(int argc, char** argv)
+{
+   clog << "Bundle Adjuster Test" << endl;
+
+   bool passed = true;
+   try
+   {
+      SyntheticBlock block;
+      passed = testConvergence(block) && passed;
+      passed = testSolverAgreement(block) && passed;
+      passed = testCleanBlockRejection(block) && passed;
+      passed = testPartitioned(block) && passed;
+
+      if (argc > 1)
+      {
+         double tolerance = (argc > 2) ? atof(argv[2]) : 1.0;
+         passed = testNativeVersusMsp(argv[1], tolerance) && passed;
+         passed = testWarmStart(argv[1]) && passed;
+      }
+   }
+   catch(exception &mspError)
+   {
+      clog<<"Exception: "<<mspError.what()<<endl;
+      passed = false;
+   }
+
+   return passed ? 0 : 1;
+}
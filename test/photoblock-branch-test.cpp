@@ -0,0 +1,123 @@
+//**************************************************************************************************
+//
+//     OSSIM Open Source Geospatial Data Processing Library
+//     See top level LICENSE.txt file for license information
+//
+//**************************************************************************************************
+#include <common/MspImage.h>
+#include <common/MspPhotoBlock.h>
+#include <common/SessionManager.h>
+#include <services/TriangulationService.h>
+#include <fstream>
+#include <iostream>
+#include <ossim/base/ossimException.h>
+
+using namespace std;
+using namespace ossimMsp;
+
+/***************************************************************************************************
+Checks that a branch of a session is independent of the original: the photoblock (the
+"photoblock" node of the JSON file given, e.g. a triangulation request) is loaded into a session
+with its sensor models instantiated, then a branch of the session is triangulated with MSP. The
+original's model states must be unchanged.
+***************************************************************************************************/
+
+/** Returns the model state of each image, instantiating the models first. */
+static vector<string> getModelStates(MspPhotoBlock& pb)
+{
+   vector<string> states;
+   vector< shared_ptr<ossim::Image> >& images = pb.getImageList();
+   for (size_t i=0; i<images.size(); ++i)
+   {
+      shared_ptr<MspImage> image = dynamic_pointer_cast<MspImage>(images[i]);
+      if (!image || !image->getCsmSensorModel())
+      {
+         ostringstream xmsg;
+         xmsg<<"No sensor model for image <"<<images[i]->getImageId()<<">.";
+         throw ossimException(xmsg.str());
+      }
+      states.push_back(image->getModelState());
+   }
+   return states;
+}
+
+int main(int argc, char** argv)
+{
+   clog << "PhotoBlock Branch Test" << endl;
+   if (argc < 2)
+   {
+      clog<<"\nUsage: "<<argv[0]<<" <json-file>\n"<<endl;
+      return 0;
+   }
+
+   ostringstream xmsg;
+   bool passed = false;
+   try
+   {
+      Json::Value queryRoot;
+      string fname_in (argv[1]);
+      ifstream jsonFile (fname_in);
+      if (jsonFile.fail())
+      {
+         xmsg<<"Error opening JSON input file <"<<fname_in<<">.";
+         throw ossimException(xmsg.str());
+      }
+      jsonFile>>queryRoot;
+
+      const Json::Value& pbJson = queryRoot["photoblock"];
+      if (pbJson.isNull())
+      {
+         xmsg<<"Failed to parse JSON photoblock node.";
+         throw ossimException(xmsg.str());
+      }
+
+      // The original session, with its models instantiated so that a branch starts out sharing
+      // them:
+      shared_ptr<Session> original = SessionManager::newSession();
+      original->setPhotoBlock(make_shared<MspPhotoBlock>(pbJson));
+      vector<string> originalStates = getModelStates(*original->getPhotoBlock());
+
+      // Triangulate a branch:
+      Json::Value request;
+      request["sessionId"] = original->getSessionId();
+      request["branch"] = true;
+      request["backend"] = "msp";
+      TriangulationService triangulation;
+      triangulation.loadJSON(request);
+      triangulation.execute();
+      Json::Value response;
+      triangulation.saveJSON(response);
+
+      shared_ptr<Session> branch = SessionManager::getSession(response["sessionId"].asString());
+      if (!branch || (branch == original))
+      {
+         xmsg<<"The triangulation did not run on a branch of the session.";
+         throw ossimException(xmsg.str());
+      }
+
+      // The original must be untouched, whether or not the adjustment changed the branch:
+      vector<string> states = getModelStates(*original->getPhotoBlock());
+      vector<string> branchStates = getModelStates(*branch->getPhotoBlock());
+      size_t numChanged = 0;
+      size_t numAdjusted = 0;
+      for (size_t i=0; i<originalStates.size(); ++i)
+      {
+         if (states[i] != originalStates[i])
+         {
+            clog<<"Original model state of image "<<i<<" was changed by the branch."<<endl;
+            ++numChanged;
+         }
+         if ((i < branchStates.size()) && (branchStates[i] != originalStates[i]))
+            ++numAdjusted;
+      }
+      clog<<"Branch images adjusted: "<<numAdjusted<<" of "<<branchStates.size()<<endl;
+      passed = (numChanged == 0);
+      clog<<"Branch independence: "<<(passed ? "PASSED" : "FAILED")<<endl;
+   }
+   catch(exception &mspError)
+   {
+      clog<<"Exception: "<<mspError.what()<<endl;
+   }
+
+   return passed ? 0 : 1;
+}
@@ -5,12 +5,134 @@
 //
 //**************************************************************************************************
 #include <common/MspPhotoBlock.h>
+#include <cstdio>
 #include <iostream>
+#include <set>
+#include <sstream>
 #include <ossim/base/ossimException.h>
 
 using namespace std;
 using namespace ossimMsp;
 
+/** Reports whether the photoblock serializes to the JSON expected. */
+static bool compare(const string& testName, const MspPhotoBlock& pb, const Json::Value& expected)
+{
+   Json::Value json;
+   pb.saveJSON(json);
+   bool passed = (json == expected);
+   clog<<testName<<": "<<(passed ? "PASSED" : "FAILED")<<endl;
+   return passed;
+}
+
+/** The streaming loader must build the same photoblock as loadJSON(). */
+static bool testStreamLoad(const Json::Value& pbJson, const Json::Value& expected)
+{
+   if (!pbJson.isMember("photoBlockHeader"))
+   {
+      clog<<"Stream load: skipped (not an MSP-format photoblock)"<<endl;
+      return true;
+   }
+   ostringstream text;
+   text<<pbJson;
+   istringstream in (text.str());
+   MspPhotoBlock streamed;
+   streamed.loadStream(in);
+   return compare("Stream load", streamed, expected);
+}
+
+/** A binary snapshot must load back as the photoblock saved. */
+static bool testSnapshot(MspPhotoBlock& pb, const Json::Value& expected)
+{
+   string filename ("photoblock-json-test.snapshot");
+   pb.saveSnapshot(filename);
+   MspPhotoBlock loaded;
+   loaded.loadSnapshot(filename);
+   remove(filename.c_str());
+   return compare("Snapshot round trip", loaded, expected);
+}
+
+/** Copies the image point entries of the point given (matching) or of all other points. */
+static Json::Value selectPoint(const Json::Value& ipList, const string& pointId, bool matching)
+{
+   Json::Value selected (Json::arrayValue);
+   for (unsigned int i=0; i<ipList.size(); ++i)
+   {
+      if ((ipList[i]["pointId"].asString() == pointId) == matching)
+         selected.append(ipList[i]);
+   }
+   return selected;
+}
+
+/**
+ * A delta that removes one tie point and GCP and adds another of each must give the same
+ * photoblock as a full load of the edited JSON. Needs an MSP-format photoblock with at least two
+ * tie points and two GCPs.
+ */
+static bool testDelta(const Json::Value& pbJson, MspPhotoBlock& pb)
+{
+   const Json::Value& ipList = pbJson["imagePointList"];
+   const Json::Value& gcpList = pbJson["groundPointList"];
+   vector<string> pointIds; // in order of first appearance
+   set<string> seen;
+   for (unsigned int i=0; i<ipList.size(); ++i)
+   {
+      string pointId = ipList[i]["pointId"].asString();
+      if (seen.insert(pointId).second)
+         pointIds.push_back(pointId);
+   }
+   ossim::GcpList& gcps = pb.getGroundPointList();
+   if (!pbJson.isMember("photoBlockHeader") || (pointIds.size() < 2) || (gcpList.size() < 2) ||
+       (gcps.size() != gcpList.size()))
+   {
+      clog<<"Delta round trip: skipped (needs an MSP-format photoblock with at least two tie "
+            "points and GCPs)"<<endl;
+      return true;
+   }
+
+   // New points and GCPs are appended, so the delta adds back the last of each to be listed, and
+   // removes the first:
+   const string& removedPoint = pointIds.front();
+   const string& addedPoint = pointIds.back();
+   string removedGcp = gcps.front()->getId();
+   unsigned int lastGcp = gcpList.size() - 1;
+
+   Json::Value baseJson (pbJson);
+   baseJson["imagePointList"] = selectPoint(ipList, addedPoint, false);
+   baseJson["groundPointList"].resize(lastGcp);
+
+   Json::Value delta;
+   delta["removeTiePoints"].append(removedPoint);
+   delta["removeGroundPoints"].append(removedGcp);
+   delta["imagePointList"] = selectPoint(ipList, addedPoint, true);
+   delta["groundPointList"].append(gcpList[lastGcp]);
+
+   Json::Value targetJson (pbJson);
+   targetJson["imagePointList"] = selectPoint(ipList, removedPoint, false);
+   Json::Value& targetGcps = targetJson["groundPointList"];
+   targetGcps = Json::Value(Json::arrayValue);
+   for (unsigned int g=1; g<gcpList.size(); ++g)
+      targetGcps.append(gcpList[g]);
+   if (pbJson.isMember("gpCrossCovList"))
+   {
+      const Json::Value& crossCovList = pbJson["gpCrossCovList"];
+      Json::Value& targetCrossCovs = targetJson["gpCrossCovList"];
+      targetCrossCovs = Json::Value(Json::arrayValue);
+      for (unsigned int i=0; i<crossCovList.size(); ++i)
+      {
+         if ((crossCovList[i]["pointId1"].asString() != removedGcp) &&
+             (crossCovList[i]["pointId2"].asString() != removedGcp))
+            targetCrossCovs.append(crossCovList[i]);
+      }
+   }
+
+   MspPhotoBlock edited (baseJson);
+   edited.applyDelta(delta);
+   MspPhotoBlock target (targetJson);
+   Json::Value expected;
+   target.saveJSON(expected);
+   return compare("Delta round trip", edited, expected);
+}
+
 int main(int argc, char** argv)
 {
 	clog << "JSON Test" << endl;
@@ -21,6 +143,7 @@ int main(int argc, char** argv)
 	}
 
 	ostringstream xmsg;
+   bool passed = true;
    try
    {
       Json::Value queryRoot;
@@ -58,11 +181,17 @@ int main(int argc, char** argv)
 
       outfile.close();
       jsonFile.close();
+
+      // Round trips through the other loaders, against the photoblock as loaded by loadJSON():
+      passed = testStreamLoad(pbJson, regurg) && passed;
+      passed = testSnapshot(pb, regurg) && passed;
+      passed = testDelta(pbJson, pb) && passed;
    }
    catch(exception &mspError)
    {
        clog<<"Exception: "<<mspError.what()<<endl;;
+       passed = false;
    }
 
-	return 0;
+	return passed ? 0 : 1;
 }